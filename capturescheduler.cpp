@@ -0,0 +1,135 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "capturescheduler.h"
+#include "displaymanager.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+
+void CaptureScheduler::setDisplays(const vector<shared_ptr<Display>> &displays, float interval, float now)
+{
+    m_interval = interval;
+    vector<CaptureSlot> slots(displays.size());
+
+    // Spread the displays out over the interval so they don't all land on the same frame
+    for (size_t i = 0; i < displays.size(); i++)
+    {
+        // Displays we already had keep their schedule and scratch buffer
+        auto it = find_if(m_slots.begin(), m_slots.end(), [&displays, i](const CaptureSlot &slot)
+        {
+            return slot.display == displays[i];
+        });
+        if (it != m_slots.end())
+        {
+            slots[i] = *it;
+            it->region = nullptr;
+            continue;
+        }
+        slots[i].display = displays[i];
+        slots[i].nextDue = now + (m_interval * (float)i) / (float)displays.size();
+    }
+
+    for (auto& slot : m_slots)
+    {
+        FrameAllocator::free(slot.region);
+    }
+    m_slots = std::move(slots);
+    log(DEBUG, "setDisplays: %zu displays, interval=%0.3f, budget=%dus", displays.size(), m_interval, m_budget);
+}
+
+float CaptureScheduler::urgency(const CaptureSlot &slot, float now) const
+{
+    // How many intervals overdue, a display that's just become due scores 1
+    float interval = m_interval * (float)slot.display->intervalScale;
+    float overdue = (now - slot.nextDue + interval) / interval;
+    return overdue * (float)(1 + slot.display->subscribers);
+}
+
+int CaptureScheduler::run(float now, const function<void(CaptureSlot &)> &capture)
+{
+    vector<CaptureSlot*> due;
+    for (auto& slot : m_slots)
+    {
+        if (!slot.display->armed || slot.display->paused)
+        {
+            if (slot.region != nullptr)
+            {
+                log(DEBUG, "run: %s: Not capturing, releasing buffer", slot.display->name.c_str());
+                FrameAllocator::free(slot.region);
+                slot.region = nullptr;
+                slot.regionSize = 0;
+            }
+            slot.wasArmed = false;
+            continue;
+        }
+
+        if (!slot.wasArmed)
+        {
+            // Just armed, capture straight away rather than waiting for its turn
+            slot.wasArmed = true;
+            slot.nextDue = now;
+        }
+
+        if (now >= slot.nextDue)
+        {
+            due.push_back(&slot);
+        }
+    }
+
+    if (due.empty())
+    {
+        m_recentCost *= 0.95f;
+        return 0;
+    }
+
+    sort(due.begin(), due.end(), [this, now](const CaptureSlot* a, const CaptureSlot* b)
+    {
+        return urgency(*a, now) > urgency(*b, now);
+    });
+
+    auto start = chrono::steady_clock::now();
+    int captured = 0;
+    for (auto slot : due)
+    {
+        auto captureStart = chrono::steady_clock::now();
+        auto spent = (float)chrono::duration_cast<chrono::microseconds>(captureStart - start).count();
+
+        // Always capture at least one, otherwise a display that costs more than the budget would never be
+        if (m_budget > 0 && captured > 0 && spent + slot->cost > (float)m_budget)
+        {
+#ifdef DEBUG
+            log(DEBUG, "run: %s: Deferring, spent=%0.0fus, cost=%0.0fus", slot->display->name.c_str(), spent, slot->cost);
+#endif
+            break;
+        }
+
+        capture(*slot);
+        captured++;
+
+        auto cost = (float)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - captureStart).count();
+        slot->cost = slot->cost == 0.0f ? cost : slot->cost * 0.8f + cost * 0.2f;
+
+        // Stay on the display's own schedule, but don't let it build up a backlog if it's fallen behind
+        float interval = m_interval * (float)slot->display->intervalScale;
+        slot->nextDue = max(slot->nextDue + interval, now + interval * 0.5f);
+    }
+
+    auto frameCost = (float)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    m_recentCost = m_recentCost * 0.95f + frameCost * 0.05f;
+    return captured;
+}
+
+void CaptureScheduler::release()
+{
+    for (auto& slot : m_slots)
+    {
+        FrameAllocator::free(slot.region);
+        slot.region = nullptr;
+        slot.regionSize = 0;
+        slot.wasArmed = false;
+    }
+}
@@ -0,0 +1,72 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef CAPTURESCHEDULER_H
+#define CAPTURESCHEDULER_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "logger.h"
+
+struct Display;
+
+struct CaptureSlot
+{
+    std::shared_ptr<Display> display;
+
+    // Sim elapsed time the next capture is due
+    float nextDue = 0.0f;
+    bool wasArmed = false;
+
+    // Smoothed time a capture of this display takes, in microseconds
+    float cost = 0.0f;
+
+    // Scratch space the display's region is read back in to, only held while armed
+    uint8_t* region = nullptr;
+    size_t regionSize = 0;
+};
+
+/*
+ * Decides which displays to capture on each sim frame.
+ *
+ * Rather than reading back everything at once every update interval, each
+ * display has its own due time, staggered so they fall on different frames.
+ * Due displays are captured most urgent first (furthest past due, weighted by
+ * how many clients are watching) until the per-frame budget is used up, and
+ * anything left over is picked up on the next frame.
+ */
+class CaptureScheduler : private Logger
+{
+ private:
+    std::vector<CaptureSlot> m_slots;
+    float m_interval = 0.5f;
+
+    // Microseconds per frame, 0 for no limit
+    int m_budget;
+
+    // Smoothed time spent capturing per frame, in microseconds
+    float m_recentCost = 0.0f;
+
+    [[nodiscard]] float urgency(const CaptureSlot &slot, float now) const;
+
+ public:
+    explicit CaptureScheduler(int budget) : Logger("CaptureScheduler"), m_budget(budget) {}
+    ~CaptureScheduler() override = default;
+
+    // Displays that were already being captured carry on where they were
+    void setDisplays(const std::vector<std::shared_ptr<Display>> &displays, float interval, float now);
+
+    // Calls capture for the displays that should be read back this frame, returns how many were
+    int run(float now, const std::function<void(CaptureSlot &)> &capture);
+
+    // Drops the scratch buffers of every display
+    void release();
+
+    [[nodiscard]] float getRecentCost() const { return m_recentCost; }
+};
+
+#endif //CAPTURESCHEDULER_H
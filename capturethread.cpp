@@ -0,0 +1,416 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "capturethread.h"
+#include "displaymanager.h"
+#include "profiler.h"
+#include "sharedglcontext.h"
+#include "texturesource.h"
+
+#include <algorithm>
+#include <future>
+
+#ifdef __APPLE__
+#define GL_DO_NOT_WARN_IF_MULTI_GL_VERSION_HEADERS_INCLUDED 1
+#include <OpenGL/OpenGLAvailability.h>
+#include <OpenGL/gl.h>
+#include <OpenGL/gl3.h>
+#else
+
+#define GL_GLEXT_PROTOTYPES 1
+#define GL3_PROTOTYPES 1
+
+#include <GL/gl.h>
+#endif
+
+using namespace std;
+
+// How long to wait for requests before checking for being stopped
+static const chrono::milliseconds WAIT_TIMEOUT(100);
+
+// How long to wait for the GPU to finish a frame before reading it anyway
+static const GLuint64 FENCE_TIMEOUT_NS = 100 * 1000 * 1000;
+
+// One being read, one waiting to be and one to copy the next frame in to
+static const int COPIES_PER_DISPLAY = 3;
+
+CaptureThread::CaptureThread(const shared_ptr<FrameAllocator> &allocator, float fps, Profiler* profiler) :
+    Logger("CaptureThread"),
+    m_allocator(allocator),
+    m_fps(fps),
+    m_profiler(profiler)
+{
+}
+
+CaptureThread::~CaptureThread()
+{
+    stop();
+}
+
+bool CaptureThread::start()
+{
+    if (m_running)
+    {
+        return true;
+    }
+
+    m_context = make_shared<SharedGLContext>();
+    if (!m_context->create())
+    {
+        m_context = nullptr;
+        return false;
+    }
+
+    // A texture of the sim's context the thread has to be able to see, or it'd only ever read black
+    GLuint probeTexture = 0;
+    GLint previousTexture = 0;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+    glGenTextures(1, &probeTexture);
+    glBindTexture(GL_TEXTURE_2D, probeTexture);
+    glBindTexture(GL_TEXTURE_2D, previousTexture);
+    glFlush();
+
+    // Only worth carrying on if the thread can actually use it
+    promise<bool> started;
+    auto result = started.get_future();
+    m_running = true;
+    m_thread = make_shared<thread>(&CaptureThread::captureMain, this, std::move(started), probeTexture);
+    bool ok = result.get();
+    glDeleteTextures(1, &probeTexture);
+    if (!ok)
+    {
+        stop();
+        return false;
+    }
+    log(INFO, "start: Capturing on a thread of our own");
+    return true;
+}
+
+void CaptureThread::stop()
+{
+    if (m_thread != nullptr)
+    {
+        m_running = false;
+        m_cond.notify_all();
+        m_thread->join();
+        m_thread = nullptr;
+    }
+    m_queued.clear();
+    if (m_context != nullptr)
+    {
+        m_context->destroy();
+        m_context = nullptr;
+    }
+
+    for (const auto& [display, copies] : m_copies)
+    {
+        for (const auto& copy : copies)
+        {
+            glDeleteTextures(1, &copy.texture);
+        }
+    }
+    m_copies.clear();
+    if (m_copyReadFramebuffer != 0)
+    {
+        glDeleteFramebuffers(1, &m_copyReadFramebuffer);
+        glDeleteFramebuffers(1, &m_copyDrawFramebuffer);
+        m_copyReadFramebuffer = 0;
+        m_copyDrawFramebuffer = 0;
+    }
+}
+
+void CaptureThread::queue(const shared_ptr<Display> &display, float now)
+{
+    int copy;
+    CaptureCopy* displayCopy = takeCopy(display, copy);
+    if (displayCopy == nullptr)
+    {
+        log(DEBUG, "queue: %s: No copies free, skipping this frame", display->name.c_str());
+        return;
+    }
+
+    // Nothing else touches a busy copy, so it's safe to write outside the lock
+    if (!copyRegion(*displayCopy, display))
+    {
+        scoped_lock lock(m_mutex);
+        displayCopy->busy = false;
+        return;
+    }
+
+    m_queued.push_back({
+        display,
+        copy,
+        (int)displayCopy->texture,
+        0,
+        0,
+        display->width,
+        display->height,
+        display->resolutionScale,
+        now,
+        chrono::steady_clock::now()});
+}
+
+CaptureCopy* CaptureThread::takeCopy(const shared_ptr<Display> &display, int &index)
+{
+    scoped_lock lock(m_mutex);
+    auto& copies = m_copies[display.get()];
+    for (index = 0; index < (int)copies.size(); index++)
+    {
+        if (!copies[index].busy)
+        {
+            copies[index].busy = true;
+            return &copies[index];
+        }
+    }
+    if (copies.size() >= COPIES_PER_DISPLAY)
+    {
+        return nullptr;
+    }
+
+    // Never grows past this, so the copies don't move
+    copies.reserve(COPIES_PER_DISPLAY);
+    copies.push_back({});
+    copies.back().busy = true;
+    return &copies.back();
+}
+
+bool CaptureThread::copyRegion(CaptureCopy &copy, const shared_ptr<Display> &display)
+{
+    if (m_copyReadFramebuffer == 0)
+    {
+        glGenFramebuffers(1, &m_copyReadFramebuffer);
+        glGenFramebuffers(1, &m_copyDrawFramebuffer);
+    }
+
+    if (copy.texture == 0 || copy.width != display->width || copy.height != display->height)
+    {
+        // Don't disturb whatever the sim has bound
+        GLint previousTexture = 0;
+        GLint previousUnpack = 0;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+        glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &previousUnpack);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        if (copy.texture == 0)
+        {
+            glGenTextures(1, &copy.texture);
+        }
+        glBindTexture(GL_TEXTURE_2D, copy.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, display->width, display->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        copy.width = display->width;
+        copy.height = display->height;
+
+        glBindTexture(GL_TEXTURE_2D, previousTexture);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, previousUnpack);
+    }
+
+    GLint previousRead = 0;
+    GLint previousDraw = 0;
+    GLboolean scissor;
+    {
+        ProfileTimer timer(m_profiler, PROFILE_STATE);
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousDraw);
+        scissor = glIsEnabled(GL_SCISSOR_TEST);
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_copyReadFramebuffer);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, display->texture->textureNum, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_copyDrawFramebuffer);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, copy.texture, 0);
+
+    bool complete =
+        glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE &&
+        glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (complete)
+    {
+        // The sim may have left a scissor set, which a blit would be clipped to
+        glDisable(GL_SCISSOR_TEST);
+        glBlitFramebuffer(
+            display->x,
+            display->y,
+            display->x + display->width,
+            display->y + display->height,
+            0,
+            0,
+            display->width,
+            display->height,
+            GL_COLOR_BUFFER_BIT,
+            GL_NEAREST);
+        if (scissor)
+        {
+            glEnable(GL_SCISSOR_TEST);
+        }
+    }
+
+    ProfileTimer timer(m_profiler, PROFILE_STATE);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_copyReadFramebuffer);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, previousRead);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousDraw);
+    return complete;
+}
+
+void CaptureThread::releaseCopy(const CaptureRequest &request)
+{
+    auto it = m_copies.find(request.display.get());
+    if (it != m_copies.end() && request.copy < (int)it->second.size())
+    {
+        it->second[request.copy].busy = false;
+    }
+}
+
+void CaptureThread::submit()
+{
+    if (m_queued.empty())
+    {
+        return;
+    }
+
+    // Goes in behind everything the sim has drawn so far. Other contexts only see it once it's been flushed
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    {
+        scoped_lock lock(m_mutex);
+        for (auto& request : m_queued)
+        {
+            auto it = find_if(m_pending.begin(), m_pending.end(), [&request](const CaptureRequest &pending)
+            {
+                return pending.display == request.display;
+            });
+            if (it != m_pending.end())
+            {
+                // It was never read, so its copy can be used again
+                releaseCopy(*it);
+                *it = std::move(request);
+            }
+            else
+            {
+                m_pending.push_back(std::move(request));
+            }
+        }
+
+        // Whatever the old one covered, the new one does too
+        if (m_fence != nullptr)
+        {
+            glDeleteSync(static_cast<GLsync>(m_fence));
+        }
+        m_fence = fence;
+    }
+    m_queued.clear();
+    m_cond.notify_one();
+}
+
+void CaptureThread::captureMain(promise<bool> started, unsigned int probeTexture)
+{
+    if (!m_context->makeCurrent())
+    {
+        started.set_value(false);
+        return;
+    }
+
+    // Creating the context can succeed without it sharing anything, e.g. on another X connection with Mesa's DRI3
+    if (!glIsTexture(probeTexture))
+    {
+        log(WARN, "captureMain: The sim's textures aren't shared with our context");
+        m_context->doneCurrent();
+        started.set_value(false);
+        return;
+    }
+    started.set_value(true);
+
+    {
+        // Its framebuffers belong to this context, so it's created and deleted with it current
+        GLTextureSource source(m_fps);
+        while (m_running)
+        {
+            vector<CaptureRequest> requests;
+            GLsync fence;
+            {
+                unique_lock lock(m_mutex);
+                m_cond.wait_for(lock, WAIT_TIMEOUT, [this]()
+                {
+                    return !m_running || !m_pending.empty();
+                });
+                if (!m_running || m_pending.empty())
+                {
+                    continue;
+                }
+                requests.swap(m_pending);
+                fence = static_cast<GLsync>(m_fence);
+                m_fence = nullptr;
+            }
+
+            if (fence != nullptr)
+            {
+                GLenum res = glClientWaitSync(fence, 0, FENCE_TIMEOUT_NS);
+                if (res == GL_TIMEOUT_EXPIRED || res == GL_WAIT_FAILED)
+                {
+                    log(WARN, "captureMain: Frame wasn't finished (0x%x), reading it anyway", res);
+                }
+                glDeleteSync(fence);
+            }
+
+            for (const auto& request : requests)
+            {
+                capture(source, request);
+
+                // Reads are finished by the time they've returned
+                scoped_lock lock(m_mutex);
+                releaseCopy(request);
+            }
+        }
+
+        scoped_lock lock(m_mutex);
+        if (m_fence != nullptr)
+        {
+            glDeleteSync(static_cast<GLsync>(m_fence));
+            m_fence = nullptr;
+        }
+        m_pending.clear();
+    }
+
+    FrameAllocator::free(m_region);
+    m_region = nullptr;
+    m_regionSize = 0;
+    m_context->doneCurrent();
+}
+
+void CaptureThread::capture(TextureSource &source, const CaptureRequest &request)
+{
+    const auto& display = request.display;
+    if (!display->armed)
+    {
+        return;
+    }
+
+    size_t regionSize = (size_t)(request.width / request.scale) * (request.height / request.scale) * 4;
+    if (regionSize > m_regionSize)
+    {
+        // Shared by every display, so it only grows to fit the largest
+        FrameAllocator::free(m_region);
+        m_region = m_allocator->allocate(regionSize);
+        m_regionSize = m_region != nullptr ? regionSize : 0;
+        if (m_region == nullptr)
+        {
+            return;
+        }
+    }
+
+    if (display->bandHeight > 0)
+    {
+        DisplayManager::captureBands(source, display, request.textureNum, request.x, request.y, request.scale, m_region, request.now, request.captureTime);
+        return;
+    }
+
+    if (!source.readRegion(request.textureNum, request.x, request.y, request.width, request.height, request.scale, m_region, request.now))
+    {
+        return;
+    }
+    DisplayManager::copyDisplay(m_region, request.scale, display, request.captureTime);
+}
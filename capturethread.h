@@ -0,0 +1,119 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef CAPTURETHREAD_H
+#define CAPTURETHREAD_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "logger.h"
+
+struct Display;
+class FrameAllocator;
+class Profiler;
+class SharedGLContext;
+class TextureSource;
+
+// A display's region as it was on a sim frame, copied on the GPU in to a texture of our own
+struct CaptureCopy
+{
+    unsigned int texture = 0;
+    int width = 0;
+    int height = 0;
+
+    // From being queued until it's been read or replaced, so the sim's thread doesn't copy over it
+    bool busy = false;
+};
+
+// A display that was due on a sim frame, and which of its copies to read it from
+struct CaptureRequest
+{
+    std::shared_ptr<Display> display;
+    int copy;
+    int textureNum;
+    int x;
+    int y;
+    int width;
+    int height;
+    int scale;
+    float now;
+    std::chrono::steady_clock::time_point captureTime;
+};
+
+/*
+ * Reads back and copies the displays on a thread of its own, with a GL context
+ * shared with the sim's. The draw callback blits each display that's due in to
+ * a texture of our own and inserts a fence behind it, and that's all the sim
+ * waits for. The fence only says the copy is done, it doesn't stop the sim
+ * drawing the next frame in to the panel, so this thread only ever reads the
+ * copies. It takes the readback stall, the flip and any YUV conversion out of
+ * the sim's frame entirely.
+ *
+ * If the thread falls behind, newer requests for a display replace any that
+ * haven't been read yet.
+ */
+class CaptureThread : private Logger
+{
+ private:
+    std::shared_ptr<FrameAllocator> m_allocator;
+    float m_fps;
+    std::shared_ptr<SharedGLContext> m_context;
+
+    // Times the sim's state saved and put back around each copy, never used on the thread
+    Profiler* m_profiler;
+
+    std::shared_ptr<std::thread> m_thread;
+    std::atomic<bool> m_running = false;
+
+    // Queued during a frame on the sim's thread, and handed over when it's submitted
+    std::vector<CaptureRequest> m_queued;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::vector<CaptureRequest> m_pending;
+
+    // A GLsync, signalled once the GPU has finished the frame the pending requests were queued on
+    void* m_fence = nullptr;
+
+    // Up to COPIES_PER_DISPLAY each, the textures are only created and written on the sim's thread
+    std::map<const Display*, std::vector<CaptureCopy>> m_copies;
+
+    // The sim's context's framebuffers the copies are blitted through
+    unsigned int m_copyReadFramebuffer = 0;
+    unsigned int m_copyDrawFramebuffer = 0;
+
+    // Scratch space regions are read back in to, only used on the thread
+    uint8_t* m_region = nullptr;
+    size_t m_regionSize = 0;
+
+    CaptureCopy* takeCopy(const std::shared_ptr<Display> &display, int &index);
+    bool copyRegion(CaptureCopy &copy, const std::shared_ptr<Display> &display);
+    void releaseCopy(const CaptureRequest &request);
+
+    void captureMain(std::promise<bool> started, unsigned int probeTexture);
+    void capture(TextureSource &source, const CaptureRequest &request);
+
+ public:
+    CaptureThread(const std::shared_ptr<FrameAllocator> &allocator, float fps, Profiler* profiler);
+    ~CaptureThread() override;
+
+    // Both must be called on the sim's thread with its context current
+    bool start();
+    void stop();
+
+    // From the draw callback
+    void queue(const std::shared_ptr<Display> &display, float now);
+    void submit();
+};
+
+#endif //CAPTURETHREAD_H
@@ -0,0 +1,601 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "config.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+#include <yaml-cpp/yaml.h>
+
+using namespace std;
+
+// "0-3,6" style lists, as taken by taskset
+static vector<int> parseCpuList(const string &list)
+{
+    vector<int> cpus;
+    size_t pos = 0;
+    while (pos < list.size())
+    {
+        size_t end = list.find(',', pos);
+        if (end == string::npos)
+        {
+            end = list.size();
+        }
+
+        string range = list.substr(pos, end - pos);
+        size_t dash = range.find('-');
+        int first = stoi(range);
+        int last = dash == string::npos ? first : stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; cpu++)
+        {
+            cpus.push_back(cpu);
+        }
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+bool Config::load(const string &path)
+{
+    if (!filesystem::exists(path))
+    {
+        log(INFO, "load: %s not found, using defaults", path.c_str());
+        return true;
+    }
+
+    try
+    {
+        loadRoot(YAML::LoadFile(path));
+    }
+    catch (const YAML::Exception &e)
+    {
+        // A typo anywhere, e.g. "idle_timeout: 30s", leaves the whole config as the defaults rather than half applied
+        log(ERROR, "load: %s: %s, using defaults", path.c_str(), e.what());
+        *this = Config();
+        return false;
+    }
+
+    log(DEBUG, "load: idle_timeout=%d, capture_fps=%0.1f, capture_budget_us=%d, capture_thread=%d, server=%s, preroll=%d, hot_reload=%d", m_idleTimeout, m_captureFps, m_captureBudget, m_captureThread, m_server.c_str(), m_preroll, m_hotReload);
+    return true;
+}
+
+void Config::loadRoot(const YAML::Node &configFile)
+{
+    if (configFile["idle_timeout"])
+    {
+        m_idleTimeout = configFile["idle_timeout"].as<int>();
+    }
+    if (configFile["capture_fps"])
+    {
+        m_captureFps = configFile["capture_fps"].as<float>();
+        if (m_captureFps <= 0.0f)
+        {
+            log(WARN, "loadRoot: Invalid capture_fps %0.1f, using 2", m_captureFps);
+            m_captureFps = 2.0f;
+        }
+    }
+    if (configFile["capture_budget_us"])
+    {
+        m_captureBudget = max(0, configFile["capture_budget_us"].as<int>());
+    }
+    if (configFile["capture_thread"])
+    {
+        m_captureThread = configFile["capture_thread"].as<bool>();
+    }
+    if (configFile["pipelined_capture"])
+    {
+        loadPipelinedCapture(configFile["pipelined_capture"]);
+    }
+    if (configFile["profile"])
+    {
+        m_profile = configFile["profile"].as<bool>();
+    }
+    if (configFile["hot_reload"])
+    {
+        m_hotReload = configFile["hot_reload"].as<bool>();
+    }
+    if (configFile["governor"])
+    {
+        loadGovernor(configFile["governor"]);
+    }
+    if (configFile["server"])
+    {
+        m_server = configFile["server"].as<string>();
+        if (m_server != "rtsp" && m_server != "rfb" && m_server != "both")
+        {
+            log(WARN, "loadRoot: Unknown server %s, using rtsp", m_server.c_str());
+            m_server = "rtsp";
+        }
+    }
+    if (configFile["rtsp"])
+    {
+        loadRtsp(configFile["rtsp"]);
+    }
+    if (configFile["rfb"])
+    {
+        loadRfb(configFile["rfb"]);
+    }
+    if (configFile["http"])
+    {
+        loadHttp(configFile["http"]);
+    }
+    if (configFile["webrtc"])
+    {
+        loadWebRtc(configFile["webrtc"]);
+    }
+    if (configFile["encoder_daemon"])
+    {
+        loadEncoderDaemon(configFile["encoder_daemon"]);
+    }
+    if (configFile["scheduling"])
+    {
+        loadScheduling(configFile["scheduling"]);
+    }
+    if (configFile["memory"])
+    {
+        loadMemory(configFile["memory"]);
+    }
+    if (configFile["preroll"])
+    {
+        m_preroll = configFile["preroll"].as<bool>();
+    }
+    if (configFile["codec"])
+    {
+        m_codec = configFile["codec"].as<string>();
+        if (m_codec != "mjpeg" && m_codec != "h264")
+        {
+            log(WARN, "loadRoot: Unknown codec %s, using mjpeg", m_codec.c_str());
+            m_codec = "mjpeg";
+        }
+    }
+    if (configFile["mjpeg"])
+    {
+        loadMjpeg(configFile["mjpeg"]);
+    }
+    if (configFile["yuv_capture"])
+    {
+        loadYuvCapture(configFile["yuv_capture"]);
+    }
+    if (configFile["low_latency"])
+    {
+        loadLowLatency(configFile["low_latency"]);
+    }
+    if (configFile["recording"])
+    {
+        loadRecording(configFile["recording"]);
+    }
+    if (configFile["replay"])
+    {
+        loadReplay(configFile["replay"]);
+    }
+    if (configFile["dump"])
+    {
+        loadDump(configFile["dump"]);
+    }
+}
+
+void Config::loadGovernor(const YAML::Node &node)
+{
+    if (node["enabled"])
+    {
+        m_governor.enabled = node["enabled"].as<bool>();
+    }
+    if (node["min_fps"])
+    {
+        m_governor.minFps = node["min_fps"].as<float>();
+    }
+    if (node["recover_fps"])
+    {
+        m_governor.recoverFps = node["recover_fps"].as<float>();
+    }
+    if (m_governor.recoverFps < m_governor.minFps)
+    {
+        log(WARN, "loadGovernor: recover_fps is below min_fps, using %0.1f", m_governor.minFps);
+        m_governor.recoverFps = m_governor.minFps;
+    }
+    if (node["degrade_after"])
+    {
+        m_governor.degradeAfter = node["degrade_after"].as<float>();
+    }
+    if (node["recover_after"])
+    {
+        m_governor.recoverAfter = node["recover_after"].as<float>();
+    }
+    if (node["min_cost_us"])
+    {
+        m_governor.minCost = max(0, node["min_cost_us"].as<int>());
+    }
+
+    log(DEBUG, "loadGovernor: enabled=%d, min_fps=%0.1f, recover_fps=%0.1f", m_governor.enabled, m_governor.minFps, m_governor.recoverFps);
+}
+
+void Config::loadRtsp(const YAML::Node &node)
+{
+    if (node["client_threads"])
+    {
+        m_rtsp.clientThreads = max(0, node["client_threads"].as<int>());
+    }
+
+    log(DEBUG, "loadRtsp: clientThreads=%d", m_rtsp.clientThreads);
+}
+
+void Config::loadRfb(const YAML::Node &node)
+{
+    if (node["port"])
+    {
+        m_rfb.port = node["port"].as<int>();
+    }
+    if (node["compression_level"])
+    {
+        m_rfb.compressionLevel = clamp(node["compression_level"].as<int>(), 0, 9);
+    }
+    if (node["threads"])
+    {
+        m_rfb.threads = node["threads"].as<int>();
+    }
+
+    log(DEBUG, "loadRfb: port=%d, compression_level=%d, threads=%d", m_rfb.port, m_rfb.compressionLevel, m_rfb.threads);
+}
+
+void Config::loadHttp(const YAML::Node &node)
+{
+    if (node["enabled"])
+    {
+        m_http.enabled = node["enabled"].as<bool>();
+    }
+    if (node["address"])
+    {
+        m_http.address = node["address"].as<string>();
+    }
+    if (node["port"])
+    {
+        m_http.port = node["port"].as<int>();
+    }
+    if (node["quality"])
+    {
+        m_http.quality = clamp(node["quality"].as<int>(), 1, 100);
+    }
+
+    log(DEBUG, "loadHttp: enabled=%d, address=%s, port=%d, quality=%d", m_http.enabled, m_http.address.c_str(), m_http.port, m_http.quality);
+}
+
+void Config::loadWebRtc(const YAML::Node &node)
+{
+    if (node["enabled"])
+    {
+        m_webRtc.enabled = node["enabled"].as<bool>();
+    }
+    if (node["max_peers"])
+    {
+        m_webRtc.maxPeers = max(0, node["max_peers"].as<int>());
+    }
+
+    log(DEBUG, "loadWebRtc: enabled=%d, maxPeers=%d", m_webRtc.enabled, m_webRtc.maxPeers);
+}
+
+void Config::loadEncoderDaemon(const YAML::Node &node)
+{
+    if (node["enabled"])
+    {
+        m_encoderDaemon.enabled = node["enabled"].as<bool>();
+    }
+    if (node["ring"])
+    {
+        m_encoderDaemon.ring = node["ring"].as<string>();
+    }
+    if (node["slots"])
+    {
+        // The writer needs a slot to itself while readers copy the newest one
+        m_encoderDaemon.slots = max(2, node["slots"].as<int>());
+    }
+
+    log(DEBUG, "loadEncoderDaemon: enabled=%d, ring=%s, slots=%d", m_encoderDaemon.enabled, m_encoderDaemon.ring.c_str(), m_encoderDaemon.slots);
+}
+
+void Config::loadScheduling(const YAML::Node &node)
+{
+    if (node["cpus"])
+    {
+        try
+        {
+            if (node["cpus"].IsSequence())
+            {
+                m_scheduling.cpus = node["cpus"].as<vector<int>>();
+            }
+            else
+            {
+                m_scheduling.cpus = parseCpuList(node["cpus"].as<string>());
+            }
+        }
+        catch (const YAML::Exception &e)
+        {
+            log(WARN, "loadScheduling: Invalid cpus, not restricting threads: %s", e.what());
+            m_scheduling.cpus.clear();
+        }
+        catch (const exception &e)
+        {
+            // stoi's invalid_argument and out_of_range
+            log(WARN, "loadScheduling: Invalid cpus, not restricting threads: %s", e.what());
+            m_scheduling.cpus.clear();
+        }
+    }
+    if (node["policy"])
+    {
+        m_scheduling.policy = node["policy"].as<string>();
+        const auto& policy = m_scheduling.policy;
+        if (policy != "other" && policy != "batch" && policy != "idle" && policy != "fifo" && policy != "rr")
+        {
+            log(WARN, "loadScheduling: Unknown policy %s, using other", policy.c_str());
+            m_scheduling.policy = "other";
+        }
+    }
+    if (node["nice"])
+    {
+        m_scheduling.nice = clamp(node["nice"].as<int>(), -20, 19);
+    }
+    if (node["priority"])
+    {
+        m_scheduling.priority = clamp(node["priority"].as<int>(), 1, 99);
+    }
+    if (node["encoder_threads"])
+    {
+        m_scheduling.encoderThreads = max(0, node["encoder_threads"].as<int>());
+    }
+
+    log(DEBUG, "loadScheduling: cpus=%zu, policy=%s, nice=%d, priority=%d, encoder_threads=%d",
+        m_scheduling.cpus.size(), m_scheduling.policy.c_str(), m_scheduling.nice, m_scheduling.priority, m_scheduling.encoderThreads);
+}
+
+void Config::loadMemory(const YAML::Node &node)
+{
+    if (node["budget_mb"])
+    {
+        m_memory.budget = max(0, node["budget_mb"].as<int>());
+    }
+    if (node["huge_pages"])
+    {
+        m_memory.hugePages = node["huge_pages"].as<bool>();
+    }
+
+    log(DEBUG, "loadMemory: budget=%d, hugePages=%d", m_memory.budget, m_memory.hugePages);
+}
+
+int Config::getEncoderBudget(EncoderConsumer consumer) const
+{
+    int budget = m_scheduling.encoderThreads;
+    if (budget <= 0)
+    {
+        return 0;
+    }
+
+    // Each server encodes in its own pool, all at the same time. HTTP is only served alongside RTSP
+    int consumers = 0;
+    consumers += isRtspEnabled() ? 1 : 0;
+    consumers += isRtspEnabled() && m_http.enabled ? 1 : 0;
+    consumers += isRfbEnabled() ? 1 : 0;
+    consumers = max(1, consumers);
+
+    // RTSP encodes every display all the time, so it gets whatever doesn't divide evenly
+    int share = budget / consumers;
+    if (consumer == ENCODER_RTSP)
+    {
+        share += budget % consumers;
+    }
+    return max(1, share);
+}
+
+int Config::getEncoderThreads(EncoderConsumer consumer, int wanted) const
+{
+    int budget = getEncoderBudget(consumer);
+    if (budget > 0)
+    {
+        wanted = min(wanted, budget);
+    }
+    return max(1, wanted);
+}
+
+void Config::loadMjpeg(const YAML::Node &node)
+{
+    if (node["encoder"])
+    {
+        m_mjpeg.encoder = node["encoder"].as<string>();
+    }
+    if (node["quality"])
+    {
+        m_mjpeg.quality = clamp(node["quality"].as<int>(), 1, 100);
+    }
+    if (node["threads"])
+    {
+        m_mjpeg.threads = node["threads"].as<int>();
+    }
+
+    log(DEBUG, "loadMjpeg: encoder=%s, quality=%d, threads=%d", m_mjpeg.encoder.c_str(), m_mjpeg.quality, m_mjpeg.threads);
+}
+
+void Config::loadYuvCapture(const YAML::Node &node)
+{
+    if (node["enabled"])
+    {
+        m_yuvCapture.enabled = node["enabled"].as<bool>();
+    }
+    if (node["threads"])
+    {
+        m_yuvCapture.threads = node["threads"].as<int>();
+    }
+
+    log(DEBUG, "loadYuvCapture: enabled=%d, threads=%d", m_yuvCapture.enabled, m_yuvCapture.threads);
+}
+
+YuvFormat Config::getYuvFormat() const
+{
+    if (!m_yuvCapture.enabled || !isRtspEnabled())
+    {
+        return YUV_NONE;
+    }
+    if (m_codec == "h264")
+    {
+        // What x264 and VideoToolbox work in natively
+        return YUV_NV12;
+    }
+    if (m_mjpeg.encoder != "turbo")
+    {
+        return YUV_I420;
+    }
+    return YUV_NONE;
+}
+
+YuvMatrix Config::getYuvMatrix() const
+{
+    return m_codec == "h264" ? YUV_BT709 : YUV_JPEG;
+}
+
+void Config::loadLowLatency(const YAML::Node &node)
+{
+    if (node["enabled"])
+    {
+        m_lowLatency.enabled = node["enabled"].as<bool>();
+    }
+    if (node["latency"])
+    {
+        m_lowLatency.latency = max(0, node["latency"].as<int>());
+    }
+    if (node["allow_tcp"])
+    {
+        m_lowLatency.allowTcp = node["allow_tcp"].as<bool>();
+    }
+
+    log(DEBUG, "loadLowLatency: enabled=%d, latency=%d, allowTcp=%d", m_lowLatency.enabled, m_lowLatency.latency, m_lowLatency.allowTcp);
+}
+
+void Config::loadPipelinedCapture(const YAML::Node &node)
+{
+    if (node["enabled"])
+    {
+        m_pipelinedCapture.enabled = node["enabled"].as<bool>();
+    }
+    if (node["bands"])
+    {
+        m_pipelinedCapture.bands = max(1, node["bands"].as<int>());
+    }
+
+    log(DEBUG, "loadPipelinedCapture: enabled=%d, bands=%d", m_pipelinedCapture.enabled, m_pipelinedCapture.bands);
+}
+
+void Config::loadRecording(const YAML::Node &node)
+{
+    if (node["enabled"])
+    {
+        m_recording.enabled = node["enabled"].as<bool>();
+    }
+    if (node["path"])
+    {
+        m_recording.path = node["path"].as<string>();
+    }
+    if (node["format"])
+    {
+        m_recording.format = node["format"].as<string>();
+        if (m_recording.format != "mp4" && m_recording.format != "mkv")
+        {
+            log(WARN, "loadRecording: Unknown format %s, using mp4", m_recording.format.c_str());
+            m_recording.format = "mp4";
+        }
+    }
+    if (node["segment_time"])
+    {
+        m_recording.segmentTime = node["segment_time"].as<int>();
+    }
+    if (node["segment_size"])
+    {
+        m_recording.segmentSize = node["segment_size"].as<int>();
+    }
+    if (node["displays"])
+    {
+        m_recording.displays = node["displays"].as<vector<string>>();
+    }
+
+    log(DEBUG, "loadRecording: enabled=%d, path=%s, format=%s", m_recording.enabled, m_recording.path.c_str(), m_recording.format.c_str());
+}
+
+void Config::loadReplay(const YAML::Node &node)
+{
+    if (node["enabled"])
+    {
+        m_replay.enabled = node["enabled"].as<bool>();
+    }
+    if (node["files"])
+    {
+        auto filesNode = node["files"];
+        if (filesNode.IsScalar())
+        {
+            m_replay.files.push_back(filesNode.as<string>());
+        }
+        else
+        {
+            m_replay.files = filesNode.as<vector<string>>();
+        }
+    }
+    if (node["fps"])
+    {
+        m_replay.fps = node["fps"].as<float>();
+        if (m_replay.fps <= 0.0f)
+        {
+            log(WARN, "loadReplay: Invalid fps %0.1f, using 30", m_replay.fps);
+            m_replay.fps = 30.0f;
+        }
+    }
+    if (node["width"])
+    {
+        m_replay.width = node["width"].as<int>();
+    }
+    if (node["height"])
+    {
+        m_replay.height = node["height"].as<int>();
+    }
+
+    log(DEBUG, "loadReplay: enabled=%d, files=%zu, fps=%0.1f", m_replay.enabled, m_replay.files.size(), m_replay.fps);
+}
+
+void Config::loadDump(const YAML::Node &node)
+{
+    if (node["path"])
+    {
+        m_dump.path = node["path"].as<string>();
+    }
+    if (node["min_size"])
+    {
+        m_dump.minSize = node["min_size"].as<int>();
+    }
+    if (node["max_size"])
+    {
+        m_dump.maxSize = node["max_size"].as<int>();
+    }
+    if (node["png"])
+    {
+        m_dump.png = node["png"].as<bool>();
+    }
+    if (node["raw"])
+    {
+        m_dump.raw = node["raw"].as<bool>();
+    }
+    if (node["compression_level"])
+    {
+        m_dump.compressionLevel = clamp(node["compression_level"].as<int>(), 0, 9);
+    }
+    if (node["filter"])
+    {
+        m_dump.filter = node["filter"].as<string>();
+    }
+    if (node["threads"])
+    {
+        m_dump.threads = node["threads"].as<int>();
+    }
+    if (node["readbacks_per_frame"])
+    {
+        m_dump.readbacksPerFrame = max(1, node["readbacks_per_frame"].as<int>());
+    }
+
+    log(DEBUG, "loadDump: path=%s, png=%d, raw=%d, level=%d, filter=%s", m_dump.path.c_str(), m_dump.png, m_dump.raw, m_dump.compressionLevel, m_dump.filter.c_str());
+}
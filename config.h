@@ -0,0 +1,334 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <string>
+#include <vector>
+
+#include "logger.h"
+
+namespace YAML { class Node; }
+
+// Layouts frames are converted to as they're captured, for encoders that take YUV
+enum YuvFormat
+{
+    YUV_NONE,
+    YUV_I420,
+    YUV_NV12
+};
+
+enum YuvMatrix
+{
+    YUV_BT709,
+    YUV_JPEG
+};
+
+// What the encoder_threads budget is split between
+enum EncoderConsumer
+{
+    ENCODER_RTSP,
+    ENCODER_HTTP,
+    ENCODER_RFB
+};
+
+struct LowLatencyConfig
+{
+    bool enabled = false;
+
+    // Latency reported to the RTSP media, in milliseconds
+    int latency = 100;
+
+    // Also allow RTP over the RTSP TCP connection. UDP is always allowed
+    bool allowTcp = true;
+};
+
+struct PipelinedCaptureConfig
+{
+    // Move each frame through readback, conversion and encoding a band at a time
+    bool enabled = false;
+
+    // Bands each display is split in to, rounded to a whole number of JPEG MCU rows
+    int bands = 4;
+};
+
+struct RecordingConfig
+{
+    bool enabled = false;
+    std::string path = "Output/xstream";
+
+    // "mp4" (fragmented) or "mkv"
+    std::string format = "mp4";
+
+    // Start a new file after this many seconds or megabytes, 0 to disable
+    int segmentTime = 600;
+    int segmentSize = 0;
+
+    // Displays to record, empty to record all of them
+    std::vector<std::string> displays;
+};
+
+struct ReplayConfig
+{
+    // Play back texture dumps instead of reading from the sim
+    bool enabled = false;
+
+    // One entry per texture, glob patterns play back as a sequence
+    std::vector<std::string> files;
+    float fps = 30.0f;
+
+    // Size of the dumps, 0 to assume they're square
+    int width = 0;
+    int height = 0;
+};
+
+struct DumpConfig
+{
+    std::string path = "dump";
+
+    // Only dump textures at least this wide and high, and no bigger than maxSize (0 for no limit)
+    int minSize = 2048;
+    int maxSize = 0;
+
+    bool png = true;
+    bool raw = true;
+
+    // zlib level, 0-9
+    int compressionLevel = 1;
+
+    // none, sub, up, avg, paeth or all
+    std::string filter = "up";
+
+    // Worker threads compressing and writing, 0 to pick automatically
+    int threads = 0;
+
+    // Textures read back per sim frame
+    int readbacksPerFrame = 1;
+};
+
+struct GovernorConfig
+{
+    // Back off capturing when the sim's frame rate drops
+    bool enabled = true;
+
+    // Start degrading below minFps, and recover again above recoverFps
+    float minFps = 25.0f;
+    float recoverFps = 30.0f;
+
+    // Seconds the frame rate has to stay low or high before each step
+    float degradeAfter = 2.0f;
+    float recoverAfter = 5.0f;
+
+    // Don't bother if we're costing less than this per frame, in microseconds
+    int minCost = 200;
+};
+
+struct MjpegConfig
+{
+    // "turbo" to encode in-process with libjpeg-turbo, or "jpegenc"
+    std::string encoder = "turbo";
+    int quality = 85;
+
+    // Threads encoding slices of each frame, 0 to pick automatically
+    int threads = 0;
+};
+
+struct YuvCaptureConfig
+{
+    // Convert frames to YUV while copying them out of the sim, so jpegenc and H.264 take them as they are
+    bool enabled = true;
+
+    // Threads converting each frame, including the sim's own, 0 to pick automatically
+    int threads = 0;
+};
+
+struct MemoryConfig
+{
+    // Megabytes of frame buffers, in use or pooled, 0 for no limit
+    int budget = 0;
+
+    // Back large frame buffers with transparent huge pages, Linux only
+    bool hugePages = false;
+};
+
+struct RtspConfig
+{
+    // Threads handling RTSP clients' requests. Once they're all in use clients share them
+    // round robin, 0 handles every client on the server's own thread
+    int clientThreads = 4;
+};
+
+struct RfbConfig
+{
+    // The first display is served on port, the next on port + 1 and so on
+    int port = 5900;
+
+    // zlib level for ZRLE, 0-9
+    int compressionLevel = 1;
+
+    // Threads encoding tiles, 0 to pick automatically
+    int threads = 0;
+};
+
+struct HttpConfig
+{
+    // Serve snapshots and MJPEG over plain HTTP alongside the RTSP server
+    bool enabled = false;
+
+    // Address to listen on, 127.0.0.1 to only serve this machine
+    std::string address = "0.0.0.0";
+    int port = 8080;
+
+    int quality = 80;
+};
+
+struct WebRtcConfig
+{
+    // Serve each display's H264 stream to browsers over WebRTC, negotiated with WHEP on the HTTP server
+    bool enabled = false;
+
+    // Peers watching each display at once, 0 for no limit
+    int maxPeers = 8;
+};
+
+struct SchedulingConfig
+{
+    // CPUs XStream's streaming and encoding threads may run on, empty for any
+    std::vector<int> cpus;
+
+    // "other", "batch", "idle", "fifo" or "rr"
+    std::string policy = "other";
+
+    // Used by the "other" and "batch" policies
+    int nice = 0;
+
+    // Used by the real time "fifo" and "rr" policies, 1-99
+    int priority = 1;
+
+    // Encoder threads shared between all displays and servers, 0 for no limit
+    int encoderThreads = 0;
+};
+
+struct EncoderDaemonConfig
+{
+    // Only capture in the sim, and leave encoding and streaming to xstream-encoderd
+    bool enabled = false;
+
+    // Name of the shared memory the frames are passed through
+    std::string ring = "/xstream";
+
+    // Frames kept for each display
+    int slots = 3;
+};
+
+class Config : private Logger
+{
+ private:
+    // Seconds a display can go without any clients before its capture buffers are released
+    int m_idleTimeout = 30;
+
+    // How often textures are read back from the sim
+    float m_captureFps = 2.0f;
+
+    // Microseconds of each sim frame that can be spent reading back displays, 0 for no limit
+    int m_captureBudget = 2000;
+
+    // Read back and copy on a thread of our own with a context shared with the sim's
+    bool m_captureThread = false;
+    PipelinedCaptureConfig m_pipelinedCapture;
+
+    // Time the draw callback with CPU timers and GL timer queries
+    bool m_profile = true;
+
+    // Pick up changes to the aircraft definitions while streaming
+    bool m_hotReload = true;
+    GovernorConfig m_governor;
+
+    // "rtsp", "rfb" or "both"
+    std::string m_server = "rtsp";
+    RtspConfig m_rtsp;
+    RfbConfig m_rfb;
+    HttpConfig m_http;
+    WebRtcConfig m_webRtc;
+    EncoderDaemonConfig m_encoderDaemon;
+    SchedulingConfig m_scheduling;
+    MemoryConfig m_memory;
+
+    // Keep displays' pipelines built and encoding until they've been idle for idle_timeout, so clients join straight away
+    bool m_preroll = false;
+
+    // "mjpeg" or "h264"
+    std::string m_codec = "mjpeg";
+    MjpegConfig m_mjpeg;
+    YuvCaptureConfig m_yuvCapture;
+    LowLatencyConfig m_lowLatency;
+
+    RecordingConfig m_recording;
+    ReplayConfig m_replay;
+    DumpConfig m_dump;
+
+    // Throws YAML::Exception if anything's the wrong type
+    void loadRoot(const YAML::Node &configFile);
+    void loadGovernor(const YAML::Node &node);
+    void loadRtsp(const YAML::Node &node);
+    void loadRfb(const YAML::Node &node);
+    void loadHttp(const YAML::Node &node);
+    void loadWebRtc(const YAML::Node &node);
+    void loadEncoderDaemon(const YAML::Node &node);
+    void loadScheduling(const YAML::Node &node);
+    void loadMemory(const YAML::Node &node);
+    void loadMjpeg(const YAML::Node &node);
+    void loadYuvCapture(const YAML::Node &node);
+    void loadLowLatency(const YAML::Node &node);
+    void loadPipelinedCapture(const YAML::Node &node);
+    void loadRecording(const YAML::Node &node);
+    void loadReplay(const YAML::Node &node);
+    void loadDump(const YAML::Node &node);
+
+ public:
+    Config() : Logger("Config") {}
+    ~Config() override = default;
+
+    bool load(const std::string &path);
+
+    [[nodiscard]] int getIdleTimeout() const { return m_idleTimeout; }
+    [[nodiscard]] float getCaptureFps() const { return m_captureFps; }
+    [[nodiscard]] int getCaptureBudget() const { return m_captureBudget; }
+    [[nodiscard]] bool getCaptureThread() const { return m_captureThread; }
+    [[nodiscard]] const PipelinedCaptureConfig& getPipelinedCapture() const { return m_pipelinedCapture; }
+    [[nodiscard]] bool getProfile() const { return m_profile; }
+    [[nodiscard]] bool getHotReload() const { return m_hotReload; }
+    [[nodiscard]] const GovernorConfig& getGovernor() const { return m_governor; }
+    [[nodiscard]] const std::string& getServer() const { return m_server; }
+    [[nodiscard]] bool isRtspEnabled() const { return m_server != "rfb"; }
+    [[nodiscard]] bool isRfbEnabled() const { return m_server != "rtsp"; }
+    [[nodiscard]] const RtspConfig& getRtsp() const { return m_rtsp; }
+    [[nodiscard]] const RfbConfig& getRfb() const { return m_rfb; }
+    [[nodiscard]] const HttpConfig& getHttp() const { return m_http; }
+    [[nodiscard]] const WebRtcConfig& getWebRtc() const { return m_webRtc; }
+    [[nodiscard]] const EncoderDaemonConfig& getEncoderDaemon() const { return m_encoderDaemon; }
+    [[nodiscard]] const SchedulingConfig& getScheduling() const { return m_scheduling; }
+    [[nodiscard]] const MemoryConfig& getMemory() const { return m_memory; }
+
+    // The share of the scheduling budget each encoder that's enabled gets, at least 1, or 0 for no limit
+    [[nodiscard]] int getEncoderBudget(EncoderConsumer consumer) const;
+
+    // Limits a pool wanting this many encoder threads to its share
+    [[nodiscard]] int getEncoderThreads(EncoderConsumer consumer, int wanted) const;
+    [[nodiscard]] bool getPreroll() const { return m_preroll; }
+    [[nodiscard]] const std::string& getCodec() const { return m_codec; }
+    [[nodiscard]] const MjpegConfig& getMjpeg() const { return m_mjpeg; }
+    [[nodiscard]] const YuvCaptureConfig& getYuvCapture() const { return m_yuvCapture; }
+
+    // What the RTSP encoder wants captures converted to, YUV_NONE to keep them as RGBA
+    [[nodiscard]] YuvFormat getYuvFormat() const;
+    [[nodiscard]] YuvMatrix getYuvMatrix() const;
+    [[nodiscard]] const LowLatencyConfig& getLowLatency() const { return m_lowLatency; }
+    [[nodiscard]] const RecordingConfig& getRecording() const { return m_recording; }
+    [[nodiscard]] const ReplayConfig& getReplay() const { return m_replay; }
+    [[nodiscard]] const DumpConfig& getDump() const { return m_dump; }
+};
+
+#endif //CONFIG_H
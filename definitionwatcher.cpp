@@ -0,0 +1,157 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "definitionwatcher.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// How often to check for changes, and for being stopped
+static const chrono::milliseconds CHECK_INTERVAL(250);
+
+// How long the directory has to be quiet before a change is reported
+static const chrono::milliseconds SETTLE_TIME(500);
+
+DefinitionWatcher::~DefinitionWatcher()
+{
+    stop();
+}
+
+bool DefinitionWatcher::start()
+{
+    if (m_running)
+    {
+        return true;
+    }
+
+    error_code ec;
+    if (!filesystem::is_directory(m_path, ec))
+    {
+        log(ERROR, "start: %s is not a directory", m_path.c_str());
+        return false;
+    }
+
+    m_running = true;
+    m_changed = false;
+    m_thread = make_shared<thread>(&DefinitionWatcher::watchMain, this);
+    return true;
+}
+
+void DefinitionWatcher::stop()
+{
+    if (m_thread != nullptr)
+    {
+        m_running = false;
+        m_thread->join();
+        m_thread = nullptr;
+    }
+}
+
+void DefinitionWatcher::watchMain()
+{
+    int fd = -1;
+#ifdef __linux__
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd >= 0 && inotify_add_watch(fd, m_path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) < 0)
+    {
+        log(WARN, "watchMain: Unable to watch %s, checking it instead", m_path.c_str());
+        close(fd);
+        fd = -1;
+    }
+#endif
+    if (fd < 0)
+    {
+        // Note what's there now, so only later changes count
+        pollForChange();
+    }
+    log(DEBUG, "watchMain: Watching %s%s", m_path.c_str(), fd >= 0 ? " with inotify" : "");
+
+    bool pending = false;
+    chrono::steady_clock::time_point lastChange;
+    while (m_running)
+    {
+        bool changed;
+        if (fd >= 0)
+        {
+            changed = waitForChange(fd);
+        }
+        else
+        {
+            this_thread::sleep_for(CHECK_INTERVAL);
+            changed = pollForChange();
+        }
+
+        auto now = chrono::steady_clock::now();
+        if (changed)
+        {
+            pending = true;
+            lastChange = now;
+        }
+        else if (pending && now - lastChange >= SETTLE_TIME)
+        {
+            log(INFO, "watchMain: Aircraft definitions have changed");
+            pending = false;
+            m_changed = true;
+        }
+    }
+
+#ifdef __linux__
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+#endif
+}
+
+bool DefinitionWatcher::waitForChange([[maybe_unused]] int fd)
+{
+#ifdef __linux__
+    pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, (int)CHECK_INTERVAL.count()) <= 0)
+    {
+        return false;
+    }
+
+    bool changed = false;
+    alignas(inotify_event) char buffer[4096];
+    ssize_t len;
+    while ((len = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (char* pos = buffer; pos < buffer + len; )
+        {
+            auto event = reinterpret_cast<inotify_event*>(pos);
+            if (event->len > 0 && filesystem::path(event->name).extension() == ".yaml")
+            {
+                changed = true;
+            }
+            pos += sizeof(inotify_event) + event->len;
+        }
+    }
+    return changed;
+#else
+    return false;
+#endif
+}
+
+bool DefinitionWatcher::pollForChange()
+{
+    map<string, filesystem::file_time_type> modified;
+    error_code ec;
+    for (const auto& entry : filesystem::directory_iterator(m_path, ec))
+    {
+        if (entry.path().extension() == ".yaml")
+        {
+            modified[entry.path().string()] = entry.last_write_time(ec);
+        }
+    }
+
+    bool changed = modified != m_modified;
+    m_modified = std::move(modified);
+    return changed;
+}
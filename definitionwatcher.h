@@ -0,0 +1,54 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef DEFINITIONWATCHER_H
+#define DEFINITIONWATCHER_H
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "logger.h"
+
+/*
+ * Watches the aircraft definitions directory for .yaml files being written,
+ * moved in or deleted. Uses inotify on Linux and checks modification times
+ * everywhere else.
+ *
+ * Editors tend to save in several steps, so a change is only reported once
+ * the directory has been quiet for a moment. The sim's thread picks it up
+ * with takeChanged() at the start of its next frame.
+ */
+class DefinitionWatcher : private Logger
+{
+ private:
+    std::string m_path;
+
+    std::shared_ptr<std::thread> m_thread;
+    std::atomic<bool> m_running = false;
+    std::atomic<bool> m_changed = false;
+
+    // Last modification time of each definition, when polling
+    std::map<std::string, std::filesystem::file_time_type> m_modified;
+
+    void watchMain();
+    bool waitForChange(int fd);
+    bool pollForChange();
+
+ public:
+    explicit DefinitionWatcher(const std::string &path) : Logger("DefinitionWatcher"), m_path(path) {}
+    ~DefinitionWatcher() override;
+
+    bool start();
+    void stop();
+
+    // True once for each settled change
+    bool takeChanged() { return m_changed.exchange(false); }
+};
+
+#endif //DEFINITIONWATCHER_H
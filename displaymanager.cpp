@@ -3,37 +3,47 @@
 //
 
 #include "displaymanager.h"
+#include "capturescheduler.h"
+#include "capturethread.h"
+#include "config.h"
+#include "definitionwatcher.h"
+#include "governor.h"
+#include "replaytexturesource.h"
+#include "texturedumper.h"
+#include "workerpool.h"
 
 #include <XPLMProcessing.h>
 #include <XPLMDisplay.h>
 #include <XPLMDataAccess.h>
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
 
 #include <yaml-cpp/yaml.h>
 
 #include <fnmatch.h>
 
-#include <png.h>
-
-#ifdef __APPLE__
-#define GL_DO_NOT_WARN_IF_MULTI_GL_VERSION_HEADERS_INCLUDED 1
-#include <OpenGL/OpenGLAvailability.h>
-#include <OpenGL/gl.h>
-#include <OpenGL/gl3.h>
-#else
+using namespace std;
 
-#define GL_GLEXT_PROTOTYPES 1
-#define GL3_PROTOTYPES 1
+static const char* const DEFINITIONS_PATH = "Resources/plugins/xstream/data";
 
-#include <GL/gl.h>
-#endif
+// Bands are a whole number of JPEG MCU rows, which is a whole number of YUV row pairs too
+static const int BAND_ALIGN = 16;
 
-using namespace std;
+DisplayManager::DisplayManager(const shared_ptr<Config> &config) :
+    Logger("DisplayManager"),
+    m_config(config),
+    m_profiler(make_shared<Profiler>(config->getProfile())),
+    m_allocator(make_shared<FrameAllocator>(config->getMemory()))
+{
+}
 
 int DisplayManager::updateCallback([[maybe_unused]] XPLMDrawingPhase inPhase, [[maybe_unused]] int inIsBefore, void *inRefcon)
 {
     auto displayManager = static_cast<DisplayManager*>(inRefcon);
+    displayManager->m_profiler->beginFrame();
     displayManager->update();
+    displayManager->m_profiler->endFrame();
     return 0;
 }
 
@@ -50,6 +60,38 @@ bool DisplayManager::start()
         {
             return false;
         }
+
+        // Drop the buffers textures were probed with
+        m_allocator->trim();
+    }
+    else if (m_config->getHotReload())
+    {
+        // Pick up anything that was changed while we were stopped
+        reloadDisplays();
+    }
+
+    setupConversion();
+    setupBands();
+
+    m_scheduler = make_shared<CaptureScheduler>(m_config->getCaptureBudget());
+    m_scheduler->setDisplays(m_displays, m_source->getUpdateInterval(), XPLMGetElapsedTime());
+
+    if (m_config->getGovernor().enabled)
+    {
+        m_governor = make_shared<Governor>(m_config->getGovernor());
+        m_governor->setDisplays(m_displays);
+    }
+
+    // Replays don't come from GL, so there's nothing to share
+    m_captureThreadWanted = m_config->getCaptureThread() && !m_config->getReplay().enabled;
+
+    if (m_config->getHotReload())
+    {
+        if (m_watcher == nullptr)
+        {
+            m_watcher = make_shared<DefinitionWatcher>(DEFINITIONS_PATH);
+        }
+        m_watcher->start();
     }
 
     log(DEBUG, "startStream: Registering callback...");
@@ -68,9 +110,91 @@ bool DisplayManager::stop()
         m_running = false;
         XPLMUnregisterDrawCallback(updateCallback, xplm_Phase_Panel, 0, this);
     }
+    if (m_watcher != nullptr)
+    {
+        m_watcher->stop();
+    }
+    if (m_captureThread != nullptr)
+    {
+        m_captureThread->stop();
+        m_captureThread = nullptr;
+    }
+    m_captureThreadWanted = false;
+
+    for (const auto& display : m_displays)
+    {
+        releaseDisplay(display);
+    }
+    if (m_scheduler != nullptr)
+    {
+        m_scheduler->release();
+    }
+    m_profiler->releaseQueries();
+    if (m_governor != nullptr)
+    {
+        m_governor->reset();
+        m_governor = nullptr;
+    }
+
+    // Nothing's being captured, give the pooled frames back
+    m_allocator->report();
+    m_allocator->trim();
     return true;
 }
 
+void DisplayManager::setupConversion()
+{
+    // xstream-encoderd converts the frames itself, off the sim's thread
+    YuvFormat format = m_config->getEncoderDaemon().enabled ? YUV_NONE : m_config->getYuvFormat();
+    if (format == YUV_NONE)
+    {
+        return;
+    }
+
+    if (m_convertPool == nullptr)
+    {
+        int threads = m_config->getYuvCapture().threads;
+        if (threads <= 0)
+        {
+            threads = clamp((int)thread::hardware_concurrency() / 4, 1, 4);
+        }
+
+        // The sim's thread converts a band too. These hold up the sim, so they don't take the streaming threads' policy
+        m_convertPool = make_shared<WorkerPool>(threads - 1);
+    }
+
+    // Only the RTSP encoder understands YUV
+    bool rgbaWanted = m_config->isRfbEnabled() || m_config->getHttp().enabled;
+    for (const auto& display : m_displays)
+    {
+        if (display->yuvConverter == nullptr)
+        {
+            display->yuvConverter = make_shared<YuvConverter>(format, m_config->getYuvMatrix(), display->width, display->height, m_convertPool);
+        }
+        display->rgbaWanted = rgbaWanted;
+    }
+    log(DEBUG, "setupConversion: format=%d, threads=%d, rgba=%d", format, m_convertPool->getConcurrency(), rgbaWanted);
+}
+
+void DisplayManager::setupBands()
+{
+    const auto& pipelined = m_config->getPipelinedCapture();
+    if (!pipelined.enabled)
+    {
+        return;
+    }
+
+    for (const auto& display : m_displays)
+    {
+        if (display->bandHeight == 0)
+        {
+            int bandHeight = (display->height + pipelined.bands - 1) / pipelined.bands;
+            display->bandHeight = (bandHeight + BAND_ALIGN - 1) / BAND_ALIGN * BAND_ALIGN;
+            log(DEBUG, "setupBands: %s: %d bands of %d rows", display->name.c_str(), display->getBandCount(), display->bandHeight);
+        }
+    }
+}
+
 bool DisplayManager::findDisplays()
 {
     YAML::Node displayDef;
@@ -79,37 +203,34 @@ bool DisplayManager::findDisplays()
         return false;
     }
 
+    if (m_source == nullptr && !createSource())
+    {
+        return false;
+    }
+
     shared_ptr<Texture> texture = nullptr;
     YAML::Node textureNode;
-    for (int i = 1; i < 1000; i++)
+    for (int i : m_source->listTextures())
     {
-        if (glIsTexture(i))
-        {
-            log(DEBUG, "findDisplay: %d: Found texture!");
+        log(DEBUG, "findDisplay: %d: Found texture!", i);
 
-            texture = checkTexture(displayDef, i, textureNode);
-            if (texture != nullptr)
-            {
-                break;
-            }
+        texture = checkTexture(displayDef, i, textureNode);
+        if (texture != nullptr)
+        {
+            break;
         }
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
+    m_source->finish();
 
     if (texture != nullptr)
     {
         log(DEBUG, "findDisplay: Adding display for texture %d", texture->textureNum);
 
         YAML::Node displaysNode = textureNode["displays"];
-        for (auto displayNode : displaysNode)
+        scoped_lock lock(m_displaysMutex);
+        for (const YAML::Node& displayNode : displaysNode)
         {
-             auto display = make_shared<Display>(
-                displayNode["x"].as<int>(),
-                displayNode["y"].as<int>(),
-                displayNode["width"].as<int>(),
-                displayNode["height"].as<int>(),
-                displayNode["name"].as<string>(),
-                texture);
+            auto display = createDisplay(displayNode, texture);
             texture->displays.push_back(display);
             m_displays.push_back(display);
         }
@@ -119,6 +240,184 @@ bool DisplayManager::findDisplays()
     return !m_textures.empty();
 }
 
+vector<shared_ptr<Display>> DisplayManager::getDisplays() const
+{
+    scoped_lock lock(m_displaysMutex);
+    return m_displays;
+}
+
+shared_ptr<Display> DisplayManager::createDisplay(const YAML::Node &displayNode, const shared_ptr<Texture> &texture)
+{
+    auto display = make_shared<Display>(
+        displayNode["x"].as<int>(),
+        displayNode["y"].as<int>(),
+        displayNode["width"].as<int>(),
+        displayNode["height"].as<int>(),
+        displayNode["name"].as<string>(),
+        texture);
+    display->allocator = m_allocator;
+    if (displayNode["priority"])
+    {
+        display->priority = displayNode["priority"].as<int>();
+    }
+    return display;
+}
+
+bool DisplayManager::reloadDisplays()
+{
+    vector<pair<shared_ptr<Texture>, vector<shared_ptr<Display>>>> textureDisplays;
+    vector<pair<shared_ptr<Display>, shared_ptr<Display>>> updated;
+    vector<shared_ptr<Display>> added;
+    vector<shared_ptr<Display>> removed;
+
+    // The definition is probably being edited by hand, so nothing is changed until all of it has been read
+    try
+    {
+        YAML::Node displayDef;
+        if (!findDefinition(displayDef))
+        {
+            log(WARN, "reloadDisplays: No definition for this aircraft, keeping the current displays");
+            return false;
+        }
+
+        for (const auto& texture : m_textures)
+        {
+            // The texture's contents were checked when it was found, it just needs to be the same size
+            YAML::Node textureNode;
+            bool found = false;
+            for (const YAML::Node& node : displayDef["textures"])
+            {
+                if (node["width"].as<int>() == texture->textureWidth && node["height"].as<int>() == texture->textureHeight)
+                {
+                    textureNode = node;
+                    found = true;
+                    break;
+                }
+            }
+            if (!found)
+            {
+                log(WARN, "reloadDisplays: Texture %d: No longer defined, keeping its displays", texture->textureNum);
+                textureDisplays.emplace_back(texture, texture->displays);
+                continue;
+            }
+
+            vector<shared_ptr<Display>> displays;
+            for (const YAML::Node& displayNode : textureNode["displays"])
+            {
+                auto display = createDisplay(displayNode, texture);
+                auto it = find_if(texture->displays.begin(), texture->displays.end(), [&display](const shared_ptr<Display> &existing)
+                {
+                    return existing->name == display->name;
+                });
+                if (it == texture->displays.end())
+                {
+                    added.push_back(display);
+                }
+                else if ((*it)->width != display->width || (*it)->height != display->height)
+                {
+                    // Its pipeline and buffers are all the wrong size, so it starts again from scratch
+                    removed.push_back(*it);
+                    added.push_back(display);
+                }
+                else
+                {
+                    updated.emplace_back(*it, display);
+                    display = *it;
+                }
+                displays.push_back(display);
+            }
+
+            for (const auto& display : texture->displays)
+            {
+                if (find(displays.begin(), displays.end(), display) == displays.end() &&
+                    find(removed.begin(), removed.end(), display) == removed.end())
+                {
+                    removed.push_back(display);
+                }
+            }
+            textureDisplays.emplace_back(texture, displays);
+        }
+    }
+    catch (const YAML::Exception &e)
+    {
+        log(ERROR, "reloadDisplays: Unable to read the definition, keeping the current displays: %s", e.what());
+        return false;
+    }
+
+    // Displays that are the same size carry on streaming, they're just read from their new position from now on
+    bool changed = !added.empty() || !removed.empty();
+    for (const auto& [display, definition] : updated)
+    {
+        if (display->x != definition->x || display->y != definition->y)
+        {
+            log(INFO, "reloadDisplays: %s: Moved to %d, %d", display->name.c_str(), definition->x, definition->y);
+            scoped_lock lock(display->mutex);
+            display->x = definition->x;
+            display->y = definition->y;
+        }
+        if (display->priority != definition->priority)
+        {
+            display->priority = definition->priority;
+            changed = true;
+        }
+    }
+    if (!changed)
+    {
+        return false;
+    }
+
+    {
+        scoped_lock lock(m_displaysMutex);
+        m_displays.clear();
+        for (const auto& [texture, displays] : textureDisplays)
+        {
+            texture->displays = displays;
+            m_displays.insert(m_displays.end(), displays.begin(), displays.end());
+        }
+    }
+
+    for (const auto& display : removed)
+    {
+        log(INFO, "reloadDisplays: %s: Removed", display->name.c_str());
+        releaseDisplay(display);
+    }
+    for (const auto& display : added)
+    {
+        log(INFO, "reloadDisplays: %s: Added at %d, %d, %dx%d", display->name.c_str(), display->x, display->y, display->width, display->height);
+    }
+
+    if (m_running)
+    {
+        setupConversion();
+        setupBands();
+    }
+    if (m_displaysChanged != nullptr && (!added.empty() || !removed.empty()))
+    {
+        m_displaysChanged(added, removed);
+    }
+    return true;
+}
+
+bool DisplayManager::createSource()
+{
+    if (m_config->getReplay().enabled)
+    {
+        auto replaySource = make_shared<ReplayTextureSource>(m_config->getReplay());
+        if (!replaySource->open())
+        {
+            log(ERROR, "createSource: Failed to open replay files");
+            return false;
+        }
+        log(INFO, "createSource: Replaying texture dumps");
+        m_source = replaySource;
+    }
+    else
+    {
+        m_source = make_shared<GLTextureSource>(m_config->getCaptureFps(), m_profiler.get());
+    }
+    return true;
+}
+
 std::string readString(const std::string& dataRefName)
 {
     XPLMDataRef dataRef = XPLMFindDataRef(dataRefName.c_str());
@@ -149,7 +448,7 @@ bool DisplayManager::findDefinition(YAML::Node& result)
 
     log(DEBUG, "findDefinition: Author: %s, ICAO type: %s", aircraftAuthor.c_str(), aircraftICAO.c_str());
 
-    for (const auto & entry : filesystem::directory_iterator("Resources/plugins/xstream/data"))
+    for (const auto & entry : filesystem::directory_iterator(DEFINITIONS_PATH))
     {
         if (entry.path().extension() == ".yaml")
         {
@@ -207,12 +506,12 @@ bool DisplayManager::findDefinition(YAML::Node& result)
 
 shared_ptr<Texture> DisplayManager::checkTexture(YAML::Node& displayDef, int textureNum, YAML::Node& matchingDef)
 {
-    glBindTexture(GL_TEXTURE_2D, textureNum);
-
-    GLint width;
-    GLint height;
-    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
-    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &height);
+    int width;
+    int height;
+    if (!m_source->getTextureSize(textureNum, width, height))
+    {
+        return nullptr;
+    }
     log(DEBUG, "findDisplay: Texture %d:  -> size=%d, %d", textureNum, width, height);
 
     YAML::Node textures = displayDef["textures"];
@@ -223,14 +522,18 @@ shared_ptr<Texture> DisplayManager::checkTexture(YAML::Node& displayDef, int tex
         auto requiredBytes = textureNode["bytes"].as<vector<int>>();
         if (width == requiredWidth && height == requiredHeight)
         {
-            const unique_ptr<uint8_t[]> data(new uint8_t[width * height * 4]);
-            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.get());
-            log(DEBUG, "findDisplay: Texture %d: Correct size. Checking bytes (%02x %02x %02x %02x)", textureNum, data[0], data[1], data[2], data[3]);
+            // Probing each texture would otherwise need a new 16MB+ buffer every time
+            const unique_ptr<uint8_t, void(*)(uint8_t*)> data(m_allocator->allocate((size_t)width * height * 4), FrameAllocator::free);
+            if (data == nullptr || !m_source->readTexture(textureNum, data.get(), XPLMGetElapsedTime()))
+            {
+                continue;
+            }
+            log(DEBUG, "findDisplay: Texture %d: Correct size. Checking bytes (%02x %02x %02x %02x)", textureNum, data.get()[0], data.get()[1], data.get()[2], data.get()[3]);
 
             bool bytesMatch = true;
             for (int i = 0; i < requiredBytes.size(); i++)
             {
-                if (requiredBytes[i] != data[i])
+                if (requiredBytes[i] != data.get()[i])
                 {
                     bytesMatch = false;
                     break;
@@ -244,7 +547,6 @@ shared_ptr<Texture> DisplayManager::checkTexture(YAML::Node& displayDef, int tex
                 texture->textureNum = textureNum;
                 texture->textureWidth = width;
                 texture->textureHeight = height;
-                texture->buffer = new uint8_t[width * height * 4];
                 matchingDef = textureNode;
                 return texture;
             }
@@ -262,120 +564,234 @@ void DisplayManager::update()
         return;
     }
 
+    if (m_captureThreadWanted)
+    {
+        // The sim's context is only sure to be current in here
+        m_captureThreadWanted = false;
+        startCaptureThread();
+    }
+
     float now = XPLMGetElapsedTime();
-    if (now - m_lastUpdate < 0.5f)
+    if (m_watcher != nullptr && m_watcher->takeChanged() && reloadDisplays())
     {
-        return;
+        m_scheduler->setDisplays(m_displays, m_source->getUpdateInterval(), now);
+        if (m_governor != nullptr)
+        {
+            m_governor->setDisplays(m_displays);
+        }
     }
-    m_lastUpdate = now;
 
-    for (const auto& texture : m_textures)
+    int captured = m_scheduler->run(now, [this, now](CaptureSlot &slot)
     {
-#ifdef DEBUG
-        log(DEBUG, "updateDisplay: Texture: %d", texture->textureNum);
-#endif
-        glBindTexture(GL_TEXTURE_2D, texture->textureNum);
-        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, texture->buffer);
+        if (m_captureThread != nullptr)
+        {
+            // The blit in to a copy is the draw callback's share of the readback
+            ProfileTimer timer(m_profiler.get(), PROFILE_READBACK);
+            m_captureThread->queue(slot.display, now);
+        }
+        else
+        {
+            captureDisplay(slot, now);
+        }
+    });
 
-        // Slice the texture up in to the separate displays
-        for (const auto& display : texture->displays)
+    if (captured > 0)
+    {
+        ProfileTimer timer(m_profiler.get(), PROFILE_READBACK);
+        if (m_captureThread != nullptr)
         {
-            copyDisplay(texture, display);
+            m_captureThread->submit();
+        }
+        else
+        {
+            m_source->finish();
         }
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (m_governor != nullptr)
+    {
+        m_governor->update(now, m_scheduler->getRecentCost());
+    }
 }
 
-void DisplayManager::copyDisplay(const shared_ptr<Texture>& texture, const shared_ptr<Display>& display)
+void DisplayManager::startCaptureThread()
 {
-    uintptr_t srcPos = 0;
-    uintptr_t dstStride = display->width * 4;
-    uintptr_t srcStride = texture->textureWidth * 4;
-    uintptr_t dstPos = dstStride * (display->height - 1);
+    auto captureThread = make_shared<CaptureThread>(m_allocator, m_config->getCaptureFps(), m_profiler.get());
+    if (!captureThread->start())
+    {
+        log(WARN, "startCaptureThread: Unable to share the sim's context, capturing in the draw callback instead");
+        return;
+    }
+    m_captureThread = captureThread;
+}
 
-    srcPos += display->x * 4;
-    srcPos += display->y * srcStride;
+void DisplayManager::armDisplay(const shared_ptr<Display>& display)
+{
+    if (!display->armed)
+    {
+        log(DEBUG, "armDisplay: %s", display->name.c_str());
+        display->arm();
+    }
+}
 
-    // Copy backwards!
-    for (int y = 0; y < display->height; y++)
+void DisplayManager::releaseDisplay(const shared_ptr<Display>& display)
+{
+    if (display->armed)
     {
-        memcpy(display->buffer + dstPos, texture->buffer + srcPos, dstStride);
-        srcPos += srcStride;
-        dstPos -= dstStride;
+        log(DEBUG, "releaseDisplay: %s", display->name.c_str());
+        display->release();
     }
 }
 
-void DisplayManager::dumpTextures()
+void DisplayManager::captureDisplay(CaptureSlot &slot, float now)
 {
-    string icao = readString("sim/aircraft/view/acf_ICAO");
-    for (int i = 0; i < 1000; i++)
+    auto& display = slot.display;
+    int scale = display->resolutionScale;
+    size_t regionSize = (size_t)(display->width / scale) * (display->height / scale) * 4;
+    if (slot.region == nullptr || slot.regionSize != regionSize)
+    {
+        FrameAllocator::free(slot.region);
+        slot.region = display->allocator->allocate(regionSize);
+        slot.regionSize = slot.region != nullptr ? regionSize : 0;
+        if (slot.region == nullptr)
+        {
+            return;
+        }
+    }
+
+#ifdef DEBUG
+    log(DEBUG, "captureDisplay: %s: Texture: %d", display->name.c_str(), display->texture->textureNum);
+#endif
+    if (display->bandHeight > 0)
+    {
+        // Each band is copied while the next is still being read, so there's no timing them apart
+        ProfileTimer timer(m_profiler.get(), PROFILE_READBACK);
+        captureBands(*m_source, display, display->texture->textureNum, display->x, display->y, scale, slot.region, now, chrono::steady_clock::now());
+        return;
+    }
+
     {
-        if (glIsTexture(i))
+        ProfileTimer timer(m_profiler.get(), PROFILE_READBACK);
+        if (!m_source->readRegion(display->texture->textureNum, display->x, display->y, display->width, display->height, scale, slot.region, now))
         {
-            glBindTexture(GL_TEXTURE_2D, i);
-            dumpTexture(i, icao);
+            return;
         }
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
+
+    ProfileTimer timer(m_profiler.get(), PROFILE_COPY);
+    copyDisplay(slot.region, scale, display, chrono::steady_clock::now());
 }
 
-void DisplayManager::dumpTexture(int i, std::string icao)
+void DisplayManager::copyDisplay(const uint8_t* region, int scale, const shared_ptr<Display>& display, chrono::steady_clock::time_point captureTime)
 {
-    GLint width;
-    GLint height;
-    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
-    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &height);
+    scoped_lock lock(display->mutex);
+    if (display->buffer == nullptr && display->yuvBuffer == nullptr)
+    {
+        return;
+    }
+
+    copyRows(region, 0, scale, display, 0, display->height);
+
+    display->frameSeq++;
+    display->captureTime = captureTime;
+    display->frameCond.notify_all();
+}
+
+bool DisplayManager::captureBands(TextureSource &source, const shared_ptr<Display> &display, int textureNum, int x, int y, int scale, uint8_t* region, float now, chrono::steady_clock::time_point captureTime)
+{
+    // The region is bottom up, so the top band is read from the end of it
+    int regionHeight = display->height / scale;
+    int bandCount = display->getBandCount();
+    vector<RegionBand> bands(bandCount);
+    for (int band = 0; band < bandCount; band++)
+    {
+        int bottom = min((display->height - display->getBandRow(band + 1)) / scale, regionHeight - 1);
+        int top = min((display->height - 1 - display->getBandRow(band)) / scale, regionHeight - 1);
+        bands[band] = {bottom, top - bottom + 1};
+    }
+
+    bool ok = source.readRegionBands(textureNum, x, y, display->width, display->height, scale, bands, region, [&display, &bands, scale, captureTime](int band, const uint8_t* rows)
+    {
+        copyBand(rows, bands[band].firstRow, scale, display, band, captureTime);
+    }, now);
+    if (!ok)
+    {
+        // Whichever bands made it in will be copied over again by the next frame
+        scoped_lock lock(display->mutex);
+        display->bandsReady = 0;
+        display->bandGeneration++;
+        display->frameCond.notify_all();
+    }
+    return ok;
+}
 
-    if (width >= 2048 && height >= 2048)
+void DisplayManager::copyBand(const uint8_t* rows, int srcFirstRow, int scale, const shared_ptr<Display>& display, int band, chrono::steady_clock::time_point captureTime)
+{
+    scoped_lock lock(display->mutex);
+    if (display->buffer == nullptr && display->yuvBuffer == nullptr)
     {
-        log(DEBUG, "dumpTexture: Texture %d: Size: %d, %d", i, width, height);
+        return;
+    }
 
-        unique_ptr<uint8_t[]> data(new uint8_t[width * height * 4]);
-        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.get());
+    copyRows(rows, srcFirstRow, scale, display, display->getBandRow(band), display->getBandRow(band + 1));
 
-        char filename[1024];
-        snprintf(filename, 1024, "dump/texture_%s_%d.png", icao.c_str(), i);
+    if (band == 0)
+    {
+        // Starts overwriting the frame before
+        display->bandGeneration++;
+    }
+    if (band + 1 < display->getBandCount())
+    {
+        display->bandsReady = band + 1;
+    }
+    else
+    {
+        display->bandsReady = 0;
+        display->frameSeq++;
+        display->captureTime = captureTime;
+    }
+    display->frameCond.notify_all();
+}
+
+void DisplayManager::copyRows(const uint8_t* src, int srcFirstRow, int scale, const shared_ptr<Display>& display, int firstRow, int lastRow)
+{
+    if (display->yuvBuffer != nullptr)
+    {
+        // Flips, converts and fills in the RGBA if anyone wants it, all in one go
+        display->yuvConverter->convert(src, srcFirstRow, scale, true, display->yuvBuffer, display->buffer, firstRow, lastRow);
+        return;
+    }
 
-        FILE* fp = fopen(filename, "wb");
-        if (fp == nullptr)
+    uintptr_t stride = display->width * 4;
+    int regionWidth = display->width / scale;
+    int regionHeight = display->height / scale;
+    for (int y = firstRow; y < lastRow; y++)
+    {
+        // Copy backwards!
+        int srcY = min((display->height - 1 - y) / scale, regionHeight - 1) - srcFirstRow;
+        uint8_t* dstRow = display->buffer + y * stride;
+        if (scale <= 1)
         {
-            log(ERROR, "dumpTexture: Failed to open file %s", filename);
-            return;
+            memcpy(dstRow, src + srcY * stride, stride);
         }
-        png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-        png_infop info_ptr = png_create_info_struct(png_ptr);
-        png_init_io(png_ptr, fp);
-
-        // Output is 8bit depth, RGBA format.
-        png_set_IHDR(
-          png_ptr,
-          info_ptr,
-          width, height,
-          8,
-          PNG_COLOR_TYPE_RGBA,
-          PNG_INTERLACE_NONE,
-          PNG_COMPRESSION_TYPE_DEFAULT,
-          PNG_FILTER_TYPE_DEFAULT
-        );
-        png_write_info(png_ptr, info_ptr);
-
-        png_bytep row = data.get();
-        for (int y = 0; y < height; y++)
+        else
         {
-            png_write_row(png_ptr, row);
-            row += width * 4;
+            // A reduced resolution capture, blow it back up to the size the stream expects
+            auto srcRow = reinterpret_cast<const uint32_t*>(src) + (size_t)srcY * regionWidth;
+            auto dstPixels = reinterpret_cast<uint32_t*>(dstRow);
+            for (int x = 0; x < display->width; x++)
+            {
+                dstPixels[x] = srcRow[min(x / scale, regionWidth - 1)];
+            }
         }
-        png_write_end(png_ptr, nullptr);
-        fclose(fp);
+    }
+}
 
-        snprintf(filename, 1024, "dump/texture_%s_%d.dat", icao.c_str(), i);
-        fp = fopen(filename, "wb");
-        if (fp == nullptr)
-        {
-            log(ERROR, "dumpTexture: Failed to open file %s", filename);
-            return;
-        }
-        fwrite(data.get(), width * height * 4, 1, fp);
-        fclose(fp);
+void DisplayManager::dumpTextures()
+{
+    if (m_dumper == nullptr)
+    {
+        m_dumper = make_shared<TextureDumper>(m_config->getDump());
     }
+    m_dumper->start(readString("sim/aircraft/view/acf_ICAO"));
 }
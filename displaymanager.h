@@ -5,15 +5,35 @@
 #ifndef DISPLAYS_H
 #define DISPLAYS_H
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <gst/gst.h>
 
 #include <XPLMDisplay.h>
 
+#include "frameallocator.h"
 #include "logger.h"
+#include "profiler.h"
+#include "texturesource.h"
+#include "yuvconverter.h"
 #include <yaml-cpp/node/node.h>
 
+class CaptureScheduler;
+class CaptureThread;
+class Config;
+struct CaptureSlot;
+class DefinitionWatcher;
+class Governor;
+class TextureDumper;
+class WorkerPool;
 class XStreamPlugin;
 struct Texture;
 
@@ -27,7 +47,42 @@ struct Display
     int height = 0;
     std::string name;
     std::shared_ptr<Texture> texture;
+
+    // Only allocated while the display is armed, guarded by mutex
+    std::shared_ptr<FrameAllocator> allocator;
     uint8_t* buffer = nullptr;
+    std::mutex mutex;
+    std::atomic<bool> armed = false;
+
+    // Frames are also converted in to yuvBuffer when the encoder takes YUV. Both are set up
+    // before the display is first armed, and RGBA is skipped when nothing else reads it
+    std::shared_ptr<YuvConverter> yuvConverter;
+    uint8_t* yuvBuffer = nullptr;
+    bool rgbaWanted = true;
+
+    // Bumped for every new frame copied in to buffer, frameCond is signalled
+    uint64_t frameSeq = 0;
+    std::chrono::steady_clock::time_point captureTime;
+    std::condition_variable frameCond;
+
+    // With pipelined_capture frames are copied in a band of bandHeight rows at a time, top first.
+    // bandsReady counts the bands of the next frame that are already in, frameSeq is only bumped
+    // once they all are, and it goes back to 0. bandGeneration is bumped when a frame's first band
+    // lands or a frame is abandoned part way, so a copy that's following one knows it's gone
+    int bandHeight = 0;
+    int bandsReady = 0;
+    uint64_t bandGeneration = 0;
+
+    // Clients playing this display, plus one while it's being recorded
+    std::atomic<int> subscribers = 0;
+
+    // Higher priority displays are the last to be degraded by the Governor
+    int priority = 0;
+
+    // Set by the Governor while the sim is struggling, only used on the sim's thread
+    int intervalScale = 1;
+    int resolutionScale = 1;
+    bool paused = false;
 
     Display() = default;
 
@@ -39,12 +94,60 @@ struct Display
         name(name),
         texture(texture)
     {
-        buffer = new uint8_t[width * height * 4];
     }
 
     ~Display()
     {
-        delete[] buffer;
+        FrameAllocator::free(buffer);
+        FrameAllocator::free(yuvBuffer);
+    }
+
+    [[nodiscard]] int getBandCount() const
+    {
+        return bandHeight > 0 ? (height + bandHeight - 1) / bandHeight : 1;
+    }
+
+    // Where a band starts, getBandRow(getBandCount()) being the height
+    [[nodiscard]] int getBandRow(int band) const
+    {
+        return bandHeight > 0 ? std::min(band * bandHeight, height) : band * height;
+    }
+
+    // Buffers that don't fit in the memory budget stay null, and the display isn't captured
+    void arm()
+    {
+        std::scoped_lock lock(mutex);
+        if (buffer == nullptr && rgbaWanted)
+        {
+            size_t size = (size_t)width * height * 4;
+            buffer = allocator->allocate(size);
+            if (buffer != nullptr)
+            {
+                memset(buffer, 0, size);
+            }
+        }
+        if (yuvBuffer == nullptr && yuvConverter != nullptr)
+        {
+            yuvBuffer = allocator->allocate(yuvConverter->getLayout().size);
+            if (yuvBuffer != nullptr)
+            {
+                yuvConverter->clear(yuvBuffer);
+            }
+        }
+        armed = true;
+    }
+
+    void release()
+    {
+        std::scoped_lock lock(mutex);
+        armed = false;
+        bandsReady = 0;
+        bandGeneration++;
+        FrameAllocator::free(buffer);
+        buffer = nullptr;
+        FrameAllocator::free(yuvBuffer);
+        yuvBuffer = nullptr;
+        frameCond.notify_all();
     }
 };
 
@@ -53,46 +156,81 @@ struct Texture
     int textureNum = 0;
     int textureWidth = 0;
     int textureHeight = 0;
-    uint8_t* buffer = nullptr;
 
     std::vector<std::shared_ptr<Display>> displays;
-
-    ~Texture()
-    {
-        delete[] buffer;
-    }
 };
 
+// Displays that were added or removed when the aircraft definition was reloaded. A resized display is both
+typedef std::function<void(const std::vector<std::shared_ptr<Display>> &added, const std::vector<std::shared_ptr<Display>> &removed)> DisplaysChangedCallback;
+
 class DisplayManager : private Logger
 {
+    std::shared_ptr<Config> m_config;
+    std::shared_ptr<TextureSource> m_source;
+    std::shared_ptr<TextureDumper> m_dumper;
+    std::shared_ptr<CaptureScheduler> m_scheduler;
+    std::shared_ptr<Profiler> m_profiler;
+    std::shared_ptr<Governor> m_governor;
+    std::shared_ptr<WorkerPool> m_convertPool;
+    std::shared_ptr<FrameAllocator> m_allocator;
+    std::shared_ptr<DefinitionWatcher> m_watcher;
+    DisplaysChangedCallback m_displaysChanged;
+
+    // Only there with capture_thread, once the draw callback has started it
+    std::shared_ptr<CaptureThread> m_captureThread;
+    bool m_captureThreadWanted = false;
+
     bool m_running = false;
     std::vector<std::shared_ptr<Texture>> m_textures;
+
+    // Only changed on the sim's thread, but read from the streaming threads
+    mutable std::mutex m_displaysMutex;
     std::vector<std::shared_ptr<Display>> m_displays;
-    float m_lastUpdate = 0.0f;
 
-    static void copyDisplay(const std::shared_ptr<Texture> &texture, const std::shared_ptr<Display> &display);
+    void captureDisplay(CaptureSlot &slot, float now);
+    static void copyRows(const uint8_t* src, int srcFirstRow, int scale, const std::shared_ptr<Display>& display, int firstRow, int lastRow);
+    static void copyBand(const uint8_t* rows, int srcFirstRow, int scale, const std::shared_ptr<Display>& display, int band, std::chrono::steady_clock::time_point captureTime);
+    void startCaptureThread();
 
     static int updateCallback(XPLMDrawingPhase inPhase, [[maybe_unused]] int inIsBefore, void *inRefcon);
 
     std::shared_ptr<Texture> checkTexture(YAML::Node &displayDef, int textureNum, YAML::Node &textureDef);
-    void dumpTexture(int i, std::string icao);
+    std::shared_ptr<Display> createDisplay(const YAML::Node &displayNode, const std::shared_ptr<Texture> &texture);
+    bool reloadDisplays();
 
     void update();
 
-
+    bool createSource();
+    void setupConversion();
+    void setupBands();
     bool findDefinition(YAML::Node &result);
 
  public:
-    DisplayManager() : Logger("DisplayManager") {}
+    explicit DisplayManager(const std::shared_ptr<Config> &config);
     ~DisplayManager() override = default;
 
     bool start();
     bool stop();
 
     bool findDisplays();
-    [[nodiscard]] std::vector<std::shared_ptr<Display>> getDisplays() const { return m_displays; }
+    [[nodiscard]] std::vector<std::shared_ptr<Display>> getDisplays() const;
+
+    // Called on the sim's thread, at the start of the frame the new definition takes effect
+    void setDisplaysChangedCallback(const DisplaysChangedCallback &callback) { m_displaysChanged = callback; }
+
+    // Called from the streaming thread as clients come and go
+    void armDisplay(const std::shared_ptr<Display> &display);
+    void releaseDisplay(const std::shared_ptr<Display> &display);
 
     void dumpTextures();
+
+    // Flips a region read back from the texture in to the display's buffers, on whichever thread read it
+    static void copyDisplay(const uint8_t* region, int scale, const std::shared_ptr<Display> &display, std::chrono::steady_clock::time_point captureTime);
+
+    // With pipelined_capture, reads a display a band at a time and copies each in as soon as it's read
+    static bool captureBands(TextureSource &source, const std::shared_ptr<Display> &display, int textureNum, int x, int y, int scale, uint8_t* region, float now, std::chrono::steady_clock::time_point captureTime);
+
+    [[nodiscard]] std::shared_ptr<Profiler> getProfiler() const { return m_profiler; }
 };
 
 #endif //DISPLAYS_H
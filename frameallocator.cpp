@@ -0,0 +1,256 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "frameallocator.h"
+
+#include <cstdlib>
+
+#include <sys/mman.h>
+
+using namespace std;
+
+static const size_t ALIGNMENT = 64;
+static const size_t BLOCK_ROUNDING = 4096;
+#ifdef __linux__
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+#endif
+
+// Pooled sizes nobody has asked for in this long are given back, checked at most every STALE_CHECK_INTERVAL
+static const chrono::seconds STALE_TIMEOUT(10);
+static const chrono::seconds STALE_CHECK_INTERVAL(1);
+
+// Sits in the first 64 bytes of every block, in front of the frame
+struct FrameHeader
+{
+    FrameAllocator* owner;
+    size_t size;
+    bool mapped;
+};
+
+static_assert(sizeof(FrameHeader) <= ALIGNMENT);
+
+static size_t roundUp(size_t value, size_t to)
+{
+    return (value + to - 1) / to * to;
+}
+
+static FrameHeader* header(uint8_t* data)
+{
+    return reinterpret_cast<FrameHeader*>(data - ALIGNMENT);
+}
+
+FrameAllocator::FrameAllocator(const MemoryConfig &config) :
+    Logger("FrameAllocator"),
+    m_config(config),
+    m_budget((size_t)config.budget * 1024 * 1024)
+{
+}
+
+FrameAllocator::~FrameAllocator()
+{
+    trim();
+    if (m_used > 0)
+    {
+        log(WARN, "~FrameAllocator: %zu bytes still in use", m_used);
+    }
+}
+
+uint8_t* FrameAllocator::allocate(size_t size)
+{
+    scoped_lock lock(m_mutex);
+    return take(size);
+}
+
+uint8_t* FrameAllocator::allocate(size_t size, chrono::milliseconds wait)
+{
+    unique_lock lock(m_mutex);
+    uint8_t* data = nullptr;
+    m_freed.wait_for(lock, wait, [this, &data, size]()
+    {
+        data = take(size);
+        return data != nullptr;
+    });
+    return data;
+}
+
+uint8_t* FrameAllocator::take(size_t size)
+{
+    // Huge pages only help blocks that fill at least one. Whatever's left over past the
+    // last whole one is left in normal pages, rather than rounding up to another 2MB
+    size_t total = roundUp(size + ALIGNMENT, BLOCK_ROUNDING);
+    bool huge = false;
+#ifdef __linux__
+    huge = m_config.hugePages && total >= HUGE_PAGE_SIZE;
+#endif
+
+    auto& pool = m_pooled[total];
+    pool.lastTaken = chrono::steady_clock::now();
+    if (!pool.blocks.empty())
+    {
+        uint8_t* data = pool.blocks.back();
+        pool.blocks.pop_back();
+        m_used += total;
+        return data;
+    }
+
+    if (m_budget > 0 && m_total + total > m_budget)
+    {
+        trimLocked(total);
+        if (m_total + total > m_budget)
+        {
+            if (!m_overBudget)
+            {
+                log(WARN, "allocate: %zu bytes would go over the %d MB budget, %zu in use", size, m_config.budget, m_used);
+                m_overBudget = true;
+            }
+            return nullptr;
+        }
+    }
+
+    void* block = nullptr;
+#ifdef __linux__
+    if (huge)
+    {
+        // Map a huge page extra, and trim it back to one that starts on a huge page boundary
+        size_t span = total + HUGE_PAGE_SIZE;
+        auto mapped = static_cast<uint8_t*>(mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (mapped != MAP_FAILED)
+        {
+            auto aligned = reinterpret_cast<uint8_t*>(roundUp(reinterpret_cast<uintptr_t>(mapped), HUGE_PAGE_SIZE));
+            if (aligned > mapped)
+            {
+                munmap(mapped, aligned - mapped);
+            }
+            munmap(aligned + total, (mapped + span) - (aligned + total));
+            madvise(aligned, total, MADV_HUGEPAGE);
+            block = aligned;
+        }
+    }
+    else
+#endif
+    if (posix_memalign(&block, ALIGNMENT, total) != 0)
+    {
+        block = nullptr;
+    }
+    if (block == nullptr)
+    {
+        log(ERROR, "allocate: Unable to allocate %zu bytes", total);
+        return nullptr;
+    }
+
+    auto data = static_cast<uint8_t*>(block) + ALIGNMENT;
+    *header(data) = {this, total, huge};
+    m_total += total;
+    m_used += total;
+    m_overBudget = false;
+    if (m_total > m_peak)
+    {
+        m_peak = m_total;
+    }
+    log(DEBUG, "allocate: New %zu byte block%s, total=%zu, peak=%zu", total, huge ? " (huge pages)" : "", m_total, m_peak);
+    return data;
+}
+
+void FrameAllocator::free(uint8_t* data)
+{
+    if (data != nullptr)
+    {
+        header(data)->owner->put(data);
+    }
+}
+
+void FrameAllocator::put(uint8_t* data)
+{
+    {
+        scoped_lock lock(m_mutex);
+        size_t total = header(data)->size;
+        m_used -= total;
+        m_pooled[total].blocks.push_back(data);
+
+        auto now = chrono::steady_clock::now();
+        if (now - m_lastStaleCheck >= STALE_CHECK_INTERVAL)
+        {
+            m_lastStaleCheck = now;
+            trimStaleLocked(now);
+        }
+    }
+    m_freed.notify_all();
+}
+
+void FrameAllocator::trim()
+{
+    scoped_lock lock(m_mutex);
+    trimLocked(SIZE_MAX);
+}
+
+void FrameAllocator::trimLocked(size_t wanted)
+{
+    // Give back other sizes' blocks until there's room for the one wanted
+    for (auto& [size, pool] : m_pooled)
+    {
+        while (!pool.blocks.empty() && (wanted == SIZE_MAX || m_total + wanted > m_budget))
+        {
+            destroy(pool.blocks.back());
+            pool.blocks.pop_back();
+        }
+    }
+}
+
+void FrameAllocator::trimStaleLocked(chrono::steady_clock::time_point now)
+{
+    for (auto it = m_pooled.begin(); it != m_pooled.end(); )
+    {
+        auto& [size, pool] = *it;
+        if (now - pool.lastTaken < STALE_TIMEOUT)
+        {
+            ++it;
+            continue;
+        }
+
+        if (!pool.blocks.empty())
+        {
+            log(DEBUG, "trimStaleLocked: Giving back %zu unused %zu byte blocks", pool.blocks.size(), size);
+        }
+        for (auto block : pool.blocks)
+        {
+            destroy(block);
+        }
+
+        // Any still in use come back to a new pool, which goes the same way if they're not wanted
+        it = m_pooled.erase(it);
+    }
+}
+
+void FrameAllocator::destroy(uint8_t* data)
+{
+    auto frameHeader = header(data);
+    size_t total = frameHeader->size;
+    m_total -= total;
+#ifdef __linux__
+    if (frameHeader->mapped)
+    {
+        munmap(frameHeader, total);
+        return;
+    }
+#endif
+    ::free(frameHeader);
+}
+
+void FrameAllocator::report()
+{
+    scoped_lock lock(m_mutex);
+    log(INFO, "report: used=%zu KB, pooled=%zu KB, peak=%zu KB, budget=%d MB", m_used / 1024, (m_total - m_used) / 1024, m_peak / 1024, m_config.budget);
+}
+
+size_t FrameAllocator::getUsed()
+{
+    scoped_lock lock(m_mutex);
+    return m_used;
+}
+
+size_t FrameAllocator::getPeak()
+{
+    scoped_lock lock(m_mutex);
+    return m_peak;
+}
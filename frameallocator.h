@@ -0,0 +1,84 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef FRAMEALLOCATOR_H
+#define FRAMEALLOCATOR_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "config.h"
+#include "logger.h"
+
+/*
+ * Hands out 64 byte aligned blocks for frames, and keeps them when they're
+ * freed so the next frame of the same size gets the same memory back. Once
+ * streaming has settled, the blocks it hands out come from the pool rather
+ * than the heap. Callers that fall back to the heap when it returns nullptr
+ * aren't covered by that.
+ *
+ * Every block, in use or pooled, counts towards the budget. When a new block
+ * won't fit, pooled blocks of other sizes are given back to the OS first.
+ * Sizes that haven't been asked for in a while, say after the Governor has
+ * changed a display's resolution, are given back whatever the budget.
+ *
+ * Blocks remember which allocator they came from, so they can be freed from
+ * anywhere, including GStreamer's buffer callbacks. The allocator has to
+ * outlive them.
+ */
+class FrameAllocator : private Logger
+{
+ private:
+    MemoryConfig m_config;
+    size_t m_budget;
+
+    std::mutex m_mutex;
+    std::condition_variable m_freed;
+
+    struct FramePool
+    {
+        std::vector<uint8_t*> blocks;
+        std::chrono::steady_clock::time_point lastTaken;
+    };
+
+    // Pooled blocks by their total size
+    std::map<size_t, FramePool> m_pooled;
+    std::chrono::steady_clock::time_point m_lastStaleCheck;
+
+    size_t m_total = 0;
+    size_t m_used = 0;
+    size_t m_peak = 0;
+    bool m_overBudget = false;
+
+    uint8_t* take(size_t size);
+    void put(uint8_t* data);
+    void trimLocked(size_t wanted);
+    void trimStaleLocked(std::chrono::steady_clock::time_point now);
+    void destroy(uint8_t* data);
+
+ public:
+    explicit FrameAllocator(const MemoryConfig &config);
+    ~FrameAllocator() override;
+
+    // nullptr if it would go over the budget, or after waiting for other blocks to be freed
+    uint8_t* allocate(size_t size);
+    uint8_t* allocate(size_t size, std::chrono::milliseconds wait);
+
+    // Back in to its allocator's pool
+    static void free(uint8_t* data);
+
+    // Gives every pooled block back to the OS
+    void trim();
+    void report();
+
+    [[nodiscard]] size_t getUsed();
+    [[nodiscard]] size_t getPeak();
+};
+
+#endif //FRAMEALLOCATOR_H
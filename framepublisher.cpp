@@ -0,0 +1,105 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "framepublisher.h"
+#include "config.h"
+#include "displaymanager.h"
+#include "streamhost.h"
+#include "threadpolicy.h"
+
+using namespace std;
+
+// How long to wait for a frame before checking on the daemon again
+static const chrono::milliseconds WAIT_TIMEOUT(100);
+
+// Displays are released if the daemon stops asking for them for this long
+static const chrono::milliseconds DAEMON_TIMEOUT(3000);
+
+FramePublisher::~FramePublisher()
+{
+    stop();
+}
+
+bool FramePublisher::start()
+{
+    if (m_running)
+    {
+        log(DEBUG, "start: Already running!");
+        return true;
+    }
+
+    auto config = m_host->getConfig()->getEncoderDaemon();
+    auto displays = m_host->getDisplays();
+    if (!m_ring.create(config.ring, displays, config.slots))
+    {
+        return false;
+    }
+
+    m_running = true;
+    for (int i = 0; i < (int)displays.size(); i++)
+    {
+        m_threads.push_back(make_shared<thread>(&FramePublisher::publishMain, this, i, displays[i]));
+    }
+    return true;
+}
+
+bool FramePublisher::stop()
+{
+    if (!m_running)
+    {
+        return true;
+    }
+
+    log(DEBUG, "stop: Stopping...");
+    m_running = false;
+    for (const auto& display : m_host->getDisplays())
+    {
+        display->frameCond.notify_all();
+    }
+    for (const auto& publishThread : m_threads)
+    {
+        publishThread->join();
+    }
+    m_threads.clear();
+    m_ring.close();
+    log(DEBUG, "stop: Done");
+    return true;
+}
+
+void FramePublisher::publishMain(int index, shared_ptr<Display> display)
+{
+    ThreadPolicy(m_host->getConfig()->getScheduling()).apply("FramePublisher");
+
+    uint64_t lastSeq = 0;
+    while (m_running)
+    {
+        m_ring.writerHeartbeat();
+
+        // The daemon looks after clients and idle timeouts, we just follow along
+        bool wanted = m_ring.isWanted(index, DAEMON_TIMEOUT);
+        if (wanted && !display->armed)
+        {
+            m_host->armDisplay(display);
+        }
+        else if (!wanted && display->armed)
+        {
+            m_host->releaseDisplay(display);
+        }
+        display->subscribers = m_ring.getSubscribers(index);
+
+        unique_lock lock(display->mutex);
+        display->frameCond.wait_for(lock, WAIT_TIMEOUT, [this, &display, lastSeq]()
+        {
+            return !m_running || (display->buffer != nullptr && display->frameSeq != lastSeq);
+        });
+        if (m_running && display->buffer != nullptr && display->frameSeq != lastSeq)
+        {
+            lastSeq = display->frameSeq;
+            m_ring.publish(index, display->buffer, display->captureTime);
+        }
+    }
+
+    m_host->releaseDisplay(display);
+    display->subscribers = 0;
+}
@@ -0,0 +1,45 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef FRAMEPUBLISHER_H
+#define FRAMEPUBLISHER_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "framering.h"
+#include "logger.h"
+
+struct Display;
+class StreamHost;
+
+/*
+ * Plugin side of the encoder daemon. Copies each new frame in to the shared
+ * memory ring from its own thread, so the sim only ever does the readback,
+ * and arms the displays the daemon is asking for.
+ */
+class FramePublisher : private Logger
+{
+ private:
+    StreamHost* m_host;
+    FrameRing m_ring;
+
+    std::vector<std::shared_ptr<std::thread>> m_threads;
+    std::atomic<bool> m_running = false;
+
+    void publishMain(int index, std::shared_ptr<Display> display);
+
+ public:
+    explicit FramePublisher(StreamHost* host) : Logger("FramePublisher"), m_host(host) {}
+    ~FramePublisher() override;
+
+    bool start();
+    bool stop();
+
+    [[nodiscard]] bool isRunning() const { return m_running; }
+};
+
+#endif //FRAMEPUBLISHER_H
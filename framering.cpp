@@ -0,0 +1,327 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "framering.h"
+#include "displaymanager.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace std;
+
+// Slots and their pixels start on cache lines
+static const size_t ALIGNMENT = 64;
+
+// How often readers look for a new frame where there's no futex
+static const chrono::milliseconds POLL_INTERVAL(2);
+
+// Attempts at reading a slot that's being overwritten
+static const int READ_ATTEMPTS = 3;
+
+static_assert(atomic<uint64_t>::is_always_lock_free && atomic<uint32_t>::is_always_lock_free,
+    "The ring's atomics need to be lock free to work across processes");
+
+static size_t align(size_t size)
+{
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+static int64_t steadyNanos(chrono::steady_clock::time_point time)
+{
+    return chrono::duration_cast<chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+static void futexWake(atomic<uint32_t>* word)
+{
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+static void futexWait(atomic<uint32_t>* word, uint32_t value, chrono::milliseconds timeout)
+{
+#ifdef __linux__
+    timespec ts = {};
+    ts.tv_sec = timeout.count() / 1000;
+    ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, value, &ts, nullptr, 0);
+#else
+    this_thread::sleep_for(min(timeout, POLL_INTERVAL));
+#endif
+}
+
+FrameRing::~FrameRing()
+{
+    close();
+}
+
+bool FrameRing::create(const string &name, const vector<shared_ptr<Display>> &displays, int slots)
+{
+    if ((int)displays.size() > FRAME_RING_MAX_DISPLAYS)
+    {
+        log(ERROR, "create: Too many displays: %zu", displays.size());
+        return false;
+    }
+
+    size_t size = align(sizeof(FrameRingHeader));
+    vector<size_t> strides;
+    for (const auto& display : displays)
+    {
+        strides.push_back(align(sizeof(FrameRingSlot)) + align((size_t)display->width * display->height * 4));
+        size += strides.back() * slots;
+    }
+
+    // Anything left behind by a crash would have the wrong layout
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        log(ERROR, "create: %s: Unable to create shared memory: %s", name.c_str(), strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, (off_t)size) < 0)
+    {
+        log(ERROR, "create: %s: Unable to size shared memory: %s", name.c_str(), strerror(errno));
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED)
+    {
+        log(ERROR, "create: %s: Unable to map shared memory: %s", name.c_str(), strerror(errno));
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    m_name = name;
+    m_owner = true;
+    m_base = static_cast<uint8_t*>(base);
+    m_size = size;
+
+    // It's a new segment, so it's all zeros already
+    auto ringHeader = header();
+    ringHeader->version = FRAME_RING_VERSION;
+    ringHeader->size = size;
+    ringHeader->displayCount = (int)displays.size();
+    ringHeader->slotCount = slots;
+    size_t offset = align(sizeof(FrameRingHeader));
+    for (size_t i = 0; i < displays.size(); i++)
+    {
+        auto& ringDisplay = ringHeader->displays[i];
+        strncpy(ringDisplay.name, displays[i]->name.c_str(), sizeof(ringDisplay.name) - 1);
+        ringDisplay.width = displays[i]->width;
+        ringDisplay.height = displays[i]->height;
+        ringDisplay.slotOffset = offset;
+        ringDisplay.slotStride = strides[i];
+        offset += strides[i] * slots;
+    }
+    writerHeartbeat();
+
+    // Readers ignore the ring until the magic is there
+    atomic_thread_fence(memory_order_release);
+    ringHeader->magic = FRAME_RING_MAGIC;
+
+    log(INFO, "create: %s: %zu displays, %d slots, %zu MB", name.c_str(), displays.size(), slots, size / (1024 * 1024));
+    return true;
+}
+
+bool FrameRing::open(const string &name)
+{
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st = {};
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(FrameRingHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED)
+    {
+        log(ERROR, "open: %s: Unable to map shared memory: %s", name.c_str(), strerror(errno));
+        return false;
+    }
+
+    auto ringHeader = static_cast<FrameRingHeader*>(base);
+    if (ringHeader->magic != FRAME_RING_MAGIC || ringHeader->version != FRAME_RING_VERSION || ringHeader->size != size)
+    {
+        munmap(base, size);
+        return false;
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    m_name = name;
+    m_owner = false;
+    m_base = static_cast<uint8_t*>(base);
+    m_size = size;
+    log(INFO, "open: %s: %d displays, %d slots", name.c_str(), ringHeader->displayCount, ringHeader->slotCount);
+    return true;
+}
+
+void FrameRing::close()
+{
+    if (m_base == nullptr)
+    {
+        return;
+    }
+
+    if (m_owner)
+    {
+        // Wake up anybody waiting for frames so they see we've gone
+        auto ringHeader = header();
+        ringHeader->closed = 1;
+        for (int i = 0; i < ringHeader->displayCount; i++)
+        {
+            ringHeader->displays[i].notify++;
+            futexWake(&ringHeader->displays[i].notify);
+        }
+        shm_unlink(m_name.c_str());
+    }
+
+    munmap(m_base, m_size);
+    m_base = nullptr;
+    m_size = 0;
+}
+
+FrameRingSlot* FrameRing::slot(int index, uint64_t frame) const
+{
+    const auto& ringDisplay = header()->displays[index];
+    size_t offset = ringDisplay.slotOffset + (frame % header()->slotCount) * ringDisplay.slotStride;
+    return reinterpret_cast<FrameRingSlot*>(m_base + offset);
+}
+
+void FrameRing::publish(int index, const uint8_t* data, chrono::steady_clock::time_point captureTime)
+{
+    auto& ringDisplay = header()->displays[index];
+    uint64_t frame = ringDisplay.latest.load(memory_order_relaxed) + 1;
+
+    auto frameSlot = slot(index, frame);
+    frameSlot->seq.store(frame * 2 - 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    auto pixels = reinterpret_cast<uint8_t*>(frameSlot) + align(sizeof(FrameRingSlot));
+    memcpy(pixels, data, (size_t)ringDisplay.width * ringDisplay.height * 4);
+    frameSlot->captureTime = steadyNanos(captureTime);
+
+    frameSlot->seq.store(frame * 2, memory_order_release);
+    ringDisplay.latest.store(frame, memory_order_release);
+    ringDisplay.notify.fetch_add(1, memory_order_release);
+    futexWake(&ringDisplay.notify);
+}
+
+void FrameRing::writerHeartbeat()
+{
+    header()->writerHeartbeat = steadyNanos(chrono::steady_clock::now());
+}
+
+bool FrameRing::isWanted(int index, chrono::milliseconds timeout) const
+{
+    auto age = steadyNanos(chrono::steady_clock::now()) - header()->readerHeartbeat;
+    return header()->displays[index].wanted && age < chrono::nanoseconds(timeout).count();
+}
+
+int FrameRing::getSubscribers(int index) const
+{
+    return header()->displays[index].subscribers;
+}
+
+string FrameRing::getName(int index) const
+{
+    const auto& ringDisplay = header()->displays[index];
+    return {ringDisplay.name, strnlen(ringDisplay.name, sizeof(ringDisplay.name))};
+}
+
+uint64_t FrameRing::getLatest(int index) const
+{
+    return header()->displays[index].latest.load(memory_order_acquire);
+}
+
+bool FrameRing::waitForFrame(int index, uint64_t lastFrame, chrono::milliseconds timeout)
+{
+    auto& ringDisplay = header()->displays[index];
+    uint32_t notify = ringDisplay.notify.load(memory_order_acquire);
+    if (ringDisplay.latest.load(memory_order_acquire) != lastFrame)
+    {
+        return true;
+    }
+
+    futexWait(&ringDisplay.notify, notify, timeout);
+    return ringDisplay.latest.load(memory_order_acquire) != lastFrame;
+}
+
+bool FrameRing::read(int index, uint8_t* data, uint64_t &frame, chrono::steady_clock::time_point &captureTime)
+{
+    const auto& ringDisplay = header()->displays[index];
+    for (int attempt = 0; attempt < READ_ATTEMPTS; attempt++)
+    {
+        frame = ringDisplay.latest.load(memory_order_acquire);
+        if (frame == 0)
+        {
+            return false;
+        }
+
+        auto frameSlot = slot(index, frame);
+        uint64_t before = frameSlot->seq.load(memory_order_acquire);
+        if (before != frame * 2)
+        {
+            // Already being overwritten by a newer frame
+            continue;
+        }
+
+        auto pixels = reinterpret_cast<const uint8_t*>(frameSlot) + align(sizeof(FrameRingSlot));
+        memcpy(data, pixels, (size_t)ringDisplay.width * ringDisplay.height * 4);
+        int64_t time = frameSlot->captureTime;
+
+        atomic_thread_fence(memory_order_acquire);
+        if (frameSlot->seq.load(memory_order_relaxed) == before)
+        {
+            captureTime = chrono::steady_clock::time_point(chrono::duration_cast<chrono::steady_clock::duration>(chrono::nanoseconds(time)));
+            return true;
+        }
+    }
+    return false;
+}
+
+void FrameRing::setWanted(int index, bool wanted)
+{
+    header()->displays[index].wanted = wanted ? 1 : 0;
+}
+
+void FrameRing::setSubscribers(int index, int subscribers)
+{
+    header()->displays[index].subscribers = subscribers;
+}
+
+void FrameRing::readerHeartbeat()
+{
+    header()->readerHeartbeat = steadyNanos(chrono::steady_clock::now());
+}
+
+bool FrameRing::isClosed(chrono::milliseconds timeout) const
+{
+    auto age = steadyNanos(chrono::steady_clock::now()) - header()->writerHeartbeat;
+    return header()->closed != 0 || age >= chrono::nanoseconds(timeout).count();
+}
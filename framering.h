@@ -0,0 +1,126 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "logger.h"
+
+struct Display;
+
+static const uint32_t FRAME_RING_MAGIC = 0x58535452;
+static const uint32_t FRAME_RING_VERSION = 1;
+static const int FRAME_RING_MAX_DISPLAYS = 16;
+
+struct FrameRingSlot
+{
+    // Odd while the slot is being written, then twice the frame number
+    std::atomic<uint64_t> seq;
+    int64_t captureTime;
+};
+
+struct FrameRingDisplay
+{
+    char name[64];
+    int32_t width;
+    int32_t height;
+    uint64_t slotOffset;
+    uint64_t slotStride;
+
+    // The newest complete frame, and a counter bumped with it that readers can futex wait on
+    std::atomic<uint64_t> latest;
+    std::atomic<uint32_t> notify;
+
+    // Set by the encoder daemon
+    std::atomic<uint32_t> wanted;
+    std::atomic<int32_t> subscribers;
+};
+
+struct FrameRingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+    int32_t displayCount;
+    int32_t slotCount;
+
+    // Set by the plugin before it goes away, so the daemon knows to wait for a new ring
+    std::atomic<uint32_t> closed;
+
+    // steady_clock times, in nanoseconds, that each side was last seen
+    std::atomic<int64_t> writerHeartbeat;
+    std::atomic<int64_t> readerHeartbeat;
+
+    FrameRingDisplay displays[FRAME_RING_MAX_DISPLAYS];
+};
+
+/*
+ * Frames for every display in a POSIX shared memory segment, so the plugin
+ * can capture while a separate process encodes and streams them.
+ *
+ * Each display has a fixed number of slots that the writer fills in turn.
+ * Slots are seqlocked: a reader copies the newest one and checks its
+ * sequence number didn't change underneath it, so neither side ever blocks
+ * the other. Readers wait for new frames on a futex on Linux, and poll
+ * elsewhere.
+ */
+class FrameRing : private Logger
+{
+ private:
+    std::string m_name;
+    bool m_owner = false;
+    uint8_t* m_base = nullptr;
+    size_t m_size = 0;
+
+    [[nodiscard]] FrameRingHeader* header() const { return reinterpret_cast<FrameRingHeader*>(m_base); }
+    [[nodiscard]] FrameRingSlot* slot(int index, uint64_t frame) const;
+
+ public:
+    FrameRing() : Logger("FrameRing") {}
+    ~FrameRing() override;
+
+    // Plugin side, replaces any ring left over with the same name
+    bool create(const std::string &name, const std::vector<std::shared_ptr<Display>> &displays, int slots);
+
+    // Daemon side
+    bool open(const std::string &name);
+
+    void close();
+    [[nodiscard]] bool isOpen() const { return m_base != nullptr; }
+
+    void publish(int index, const uint8_t* data, std::chrono::steady_clock::time_point captureTime);
+    void writerHeartbeat();
+
+    // The daemon has asked for this display, and is still alive
+    [[nodiscard]] bool isWanted(int index, std::chrono::milliseconds timeout) const;
+    [[nodiscard]] int getSubscribers(int index) const;
+
+    [[nodiscard]] int getDisplayCount() const { return header()->displayCount; }
+    [[nodiscard]] std::string getName(int index) const;
+    [[nodiscard]] int getWidth(int index) const { return header()->displays[index].width; }
+    [[nodiscard]] int getHeight(int index) const { return header()->displays[index].height; }
+    [[nodiscard]] uint64_t getLatest(int index) const;
+
+    // Returns true if there's a newer frame than lastFrame
+    bool waitForFrame(int index, uint64_t lastFrame, std::chrono::milliseconds timeout);
+
+    // Copies the newest frame, returns false if there isn't one or it kept being overwritten
+    bool read(int index, uint8_t* data, uint64_t &frame, std::chrono::steady_clock::time_point &captureTime);
+
+    void setWanted(int index, bool wanted);
+    void setSubscribers(int index, int subscribers);
+    void readerHeartbeat();
+
+    // The plugin has closed the ring or stopped updating it
+    [[nodiscard]] bool isClosed(std::chrono::milliseconds timeout) const;
+};
+
+#endif //FRAMERING_H
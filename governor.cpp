@@ -0,0 +1,156 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "governor.h"
+#include "config.h"
+#include "displaymanager.h"
+
+#include <algorithm>
+
+using namespace std;
+
+static const int STAGE_HALF_RATE = 1;
+static const int STAGE_HALF_RESOLUTION = 2;
+static const int STAGE_QUARTER_RATE = 3;
+static const int STAGE_STOPPED = 4;
+
+Governor::Governor(const GovernorConfig& config) : Logger("Governor"), m_config(config)
+{
+    m_frameRatePeriodRef = XPLMFindDataRef("sim/time/framerate_period");
+}
+
+void Governor::setDisplays(const vector<shared_ptr<Display>> &displays)
+{
+    auto ordered = displays;
+    stable_sort(ordered.begin(), ordered.end(), [](const shared_ptr<Display> &a, const shared_ptr<Display> &b)
+    {
+        return a->priority < b->priority;
+    });
+
+    m_steps.clear();
+    for (int stage = STAGE_HALF_RATE; stage <= STAGE_STOPPED; stage++)
+    {
+        for (size_t i = 0; i < ordered.size(); i++)
+        {
+            // Always keep the most important display going
+            if (stage == STAGE_STOPPED && i == ordered.size() - 1)
+            {
+                continue;
+            }
+            m_steps.push_back({ordered[i], stage});
+        }
+    }
+
+    m_level = 0;
+    apply();
+}
+
+void Governor::update(float now, float ownCost)
+{
+    if (m_frameRatePeriodRef == nullptr)
+    {
+        return;
+    }
+
+    float period = XPLMGetDataf(m_frameRatePeriodRef);
+    if (period <= 0.0f)
+    {
+        return;
+    }
+    float fps = 1.0f / period;
+    m_simFps = m_simFps == 0.0f ? fps : m_simFps * 0.9f + fps * 0.1f;
+
+    if (m_simFps < m_config.minFps)
+    {
+        m_aboveSince = -1.0f;
+        if (m_belowSince < 0.0f)
+        {
+            m_belowSince = now;
+        }
+        if (now - m_belowSince < m_config.degradeAfter || m_level >= (int)m_steps.size())
+        {
+            return;
+        }
+        m_belowSince = now;
+
+        if (ownCost < (float)m_config.minCost)
+        {
+            // Something else is slowing the sim down, backing off won't help
+            log(DEBUG, "update: Sim at %0.1f fps, but only costing %0.0fus per frame", m_simFps, ownCost);
+            return;
+        }
+
+        m_level++;
+        const auto& step = m_steps.at(m_level - 1);
+        log(INFO, "update: Sim at %0.1f fps, costing %0.0fus per frame: Degrading %s to stage %d", m_simFps, ownCost, step.display->name.c_str(), step.stage);
+        apply();
+    }
+    else if (m_simFps >= m_config.recoverFps)
+    {
+        m_belowSince = -1.0f;
+        if (m_aboveSince < 0.0f)
+        {
+            m_aboveSince = now;
+        }
+        if (now - m_aboveSince < m_config.recoverAfter || m_level == 0)
+        {
+            return;
+        }
+        m_aboveSince = now;
+
+        const auto& step = m_steps.at(m_level - 1);
+        log(INFO, "update: Sim at %0.1f fps: Restoring %s to stage %d", m_simFps, step.display->name.c_str(), step.stage - 1);
+        m_level--;
+        apply();
+    }
+    else
+    {
+        // Between the two, hold where we are
+        m_belowSince = -1.0f;
+        m_aboveSince = -1.0f;
+    }
+}
+
+void Governor::reset()
+{
+    m_level = 0;
+    m_simFps = 0.0f;
+    m_belowSince = -1.0f;
+    m_aboveSince = -1.0f;
+    apply();
+}
+
+void Governor::apply()
+{
+    for (const auto& step : m_steps)
+    {
+        step.display->intervalScale = 1;
+        step.display->resolutionScale = 1;
+        step.display->paused = false;
+    }
+
+    // Stages only ever go up as we go through the steps
+    for (int i = 0; i < m_level; i++)
+    {
+        const auto& step = m_steps.at(i);
+        auto& display = step.display;
+        switch (step.stage)
+        {
+            case STAGE_HALF_RATE:
+                display->intervalScale = 2;
+                break;
+            case STAGE_HALF_RESOLUTION:
+                display->resolutionScale = 2;
+                break;
+            case STAGE_QUARTER_RATE:
+                display->intervalScale = 4;
+                break;
+            case STAGE_STOPPED:
+                display->paused = true;
+                break;
+            default:
+                break;
+        }
+    }
+}
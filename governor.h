@@ -0,0 +1,63 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <memory>
+#include <vector>
+
+#include <XPLMDataAccess.h>
+
+#include "logger.h"
+
+struct Display;
+struct GovernorConfig;
+
+struct GovernorStep
+{
+    std::shared_ptr<Display> display;
+    int stage = 0;
+};
+
+/*
+ * Backs off capturing when the sim's frame rate drops below the configured
+ * floor, and only if XStream is costing enough per frame for it to help.
+ *
+ * Each step degrades one display by one stage: half the capture rate, then
+ * half the resolution, then a quarter of the capture rate and finally not
+ * capturing it at all. Every display goes through a stage, lowest priority
+ * first, before any display moves on to the next. The highest priority
+ * display is never stopped. Steps are undone one at a time once the sim has
+ * been back above the recovery frame rate for a while.
+ */
+class Governor : private Logger
+{
+ private:
+    const GovernorConfig& m_config;
+    XPLMDataRef m_frameRatePeriodRef = nullptr;
+
+    std::vector<GovernorStep> m_steps;
+    int m_level = 0;
+
+    float m_simFps = 0.0f;
+    float m_belowSince = -1.0f;
+    float m_aboveSince = -1.0f;
+
+    void apply();
+
+ public:
+    explicit Governor(const GovernorConfig& config);
+    ~Governor() override = default;
+
+    void setDisplays(const std::vector<std::shared_ptr<Display>> &displays);
+
+    // Called every frame, ownCost is XStream's recent cost per frame in microseconds
+    void update(float now, float ownCost);
+
+    // Puts every display back to full quality
+    void reset();
+};
+
+#endif //GOVERNOR_H
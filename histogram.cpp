@@ -0,0 +1,74 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "histogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+using namespace std;
+
+int Histogram::bucketIndex(uint64_t value)
+{
+    value = min(value, ((uint64_t)1 << MAX_BITS) - 1);
+    if (value < SUB_COUNT)
+    {
+        // Small values get a bucket each
+        return (int)value;
+    }
+
+    // Keep the top SUB_BITS bits of the value
+    int shift = bit_width(value) - SUB_BITS;
+    auto sub = (int)(value >> shift);
+    return SUB_COUNT + (shift - 1) * HALF_COUNT + (sub - HALF_COUNT);
+}
+
+uint64_t Histogram::bucketValue(int index)
+{
+    if (index < SUB_COUNT)
+    {
+        return index;
+    }
+
+    int shift = (index - SUB_COUNT) / HALF_COUNT + 1;
+    uint64_t sub = (index - SUB_COUNT) % HALF_COUNT + HALF_COUNT;
+    return ((sub + 1) << shift) - 1;
+}
+
+void Histogram::record(uint64_t value)
+{
+    m_counts[bucketIndex(value)]++;
+    m_count++;
+    m_total += value;
+    m_max = max(m_max, value);
+}
+
+void Histogram::reset()
+{
+    m_counts.fill(0);
+    m_count = 0;
+    m_total = 0;
+    m_max = 0;
+}
+
+uint64_t Histogram::getPercentile(double p) const
+{
+    if (m_count == 0)
+    {
+        return 0;
+    }
+
+    auto target = max<uint64_t>(1, (uint64_t)ceil(clamp(p, 0.0, 100.0) / 100.0 * (double)m_count));
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; i++)
+    {
+        seen += m_counts[i];
+        if (seen >= target)
+        {
+            return min(bucketValue(i), m_max);
+        }
+    }
+    return m_max;
+}
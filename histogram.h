@@ -0,0 +1,47 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <array>
+#include <cstdint>
+
+/*
+ * A fixed size histogram of durations in microseconds, in the style of
+ * HdrHistogram. Every power of two is split in to the same number of linear
+ * buckets, 16 with SUB_BITS of 5, so percentiles are rounded up by at most
+ * 6.25% from 1us up to days, recording is constant time and nothing is
+ * allocated.
+ */
+class Histogram
+{
+ private:
+    static constexpr int SUB_BITS = 5;
+    static constexpr int SUB_COUNT = 1 << SUB_BITS;
+    static constexpr int HALF_COUNT = SUB_COUNT / 2;
+    static constexpr int MAX_BITS = 40;
+    static constexpr int BUCKET_COUNT = SUB_COUNT + (MAX_BITS - SUB_BITS + 1) * HALF_COUNT;
+
+    std::array<uint64_t, BUCKET_COUNT> m_counts {};
+    uint64_t m_count = 0;
+    uint64_t m_total = 0;
+    uint64_t m_max = 0;
+
+    static int bucketIndex(uint64_t value);
+    static uint64_t bucketValue(int index);
+
+ public:
+    void record(uint64_t value);
+    void reset();
+
+    // p is 0-100, returns the highest value in the bucket the percentile falls in
+    [[nodiscard]] uint64_t getPercentile(double p) const;
+
+    [[nodiscard]] uint64_t getCount() const { return m_count; }
+    [[nodiscard]] uint64_t getMax() const { return m_max; }
+    [[nodiscard]] double getMean() const { return m_count > 0 ? (double)m_total / (double)m_count : 0.0; }
+};
+
+#endif //HISTOGRAM_H
@@ -0,0 +1,727 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "httpserver.h"
+#include "displaymanager.h"
+#include "jpegencoder.h"
+#include "lifecyclemanager.h"
+#include "streamhost.h"
+#include "threadpolicy.h"
+#include "webrtcserver.h"
+#include "workerpool.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+// How often to check for connections that have finished
+static const int POLL_TIMEOUT_MS = 250;
+
+// How long a client has to send its request
+static const int REQUEST_TIMEOUT_MS = 5000;
+static const size_t MAX_REQUEST_SIZE = 8192;
+
+// SDP offers are a few KB, anything bigger isn't one
+static const size_t MAX_BODY_SIZE = 65536;
+
+// How long to wait for a frame before checking whether anyone still wants them
+static const chrono::milliseconds WAIT_TIMEOUT(100);
+
+// Keep encoding for a while after a snapshot, so clients polling every few seconds find one ready
+static const chrono::seconds SNAPSHOT_KEEPALIVE(10);
+
+// How long a snapshot waits for the display to be captured, if it wasn't already
+static const chrono::seconds SNAPSHOT_TIMEOUT(3);
+
+// How long an MJPEG client waits for a frame before checking the connection's still needed
+static const chrono::seconds STREAM_WAIT(1);
+
+static const char* BOUNDARY = "xstreamframe";
+
+// WHEP players are often served from somewhere else
+static const char* CORS_HEADERS = "Access-Control-Allow-Origin: *\r\n"
+    "Access-Control-Allow-Methods: POST, DELETE, OPTIONS\r\n"
+    "Access-Control-Allow-Headers: Content-Type\r\n"
+    "Access-Control-Expose-Headers: Location\r\n";
+
+// Plays /whep/<display> for the /webrtc/<display> it was loaded from
+static const char* PLAYER_PAGE = R"(<!DOCTYPE html>
+<html>
+<head>
+<meta charset="utf-8">
+<title>xstream</title>
+<style>
+body { margin: 0; background: #000; color: #fff; font-family: sans-serif; }
+video { width: 100vw; height: 100vh; object-fit: contain; }
+</style>
+</head>
+<body>
+<video id="video" autoplay muted playsinline></video>
+<script>
+const endpoint = location.pathname.replace(/^\/webrtc\//, "/whep/");
+const video = document.getElementById("video");
+let resource = null;
+
+async function play() {
+    const pc = new RTCPeerConnection();
+    pc.addTransceiver("video", {direction: "recvonly"});
+    pc.ontrack = (e) => { video.srcObject = new MediaStream([e.track]); };
+    pc.onconnectionstatechange = () => {
+        if (pc.connectionState === "failed") {
+            location.reload();
+        }
+    };
+    await pc.setLocalDescription(await pc.createOffer());
+
+    // There's no trickle ICE, so the offer has to have the candidates in it
+    await new Promise((resolve) => {
+        if (pc.iceGatheringState === "complete") {
+            resolve();
+            return;
+        }
+        pc.onicegatheringstatechange = () => {
+            if (pc.iceGatheringState === "complete") {
+                resolve();
+            }
+        };
+        setTimeout(resolve, 2000);
+    });
+
+    const response = await fetch(endpoint, {
+        method: "POST",
+        headers: {"Content-Type": "application/sdp"},
+        body: pc.localDescription.sdp
+    });
+    if (!response.ok) {
+        throw new Error(response.status + " " + response.statusText);
+    }
+    resource = response.headers.get("Location");
+    await pc.setRemoteDescription({type: "answer", sdp: await response.text()});
+}
+
+window.addEventListener("pagehide", () => {
+    if (resource !== null) {
+        fetch(resource, {method: "DELETE", keepalive: true});
+    }
+});
+
+play().catch((e) => { document.body.textContent = "Unable to play: " + e.message; });
+</script>
+</body>
+</html>
+)";
+
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+// macOS uses SO_NOSIGPIPE on the socket instead
+static const int SEND_FLAGS = 0;
+#endif
+
+HttpServer::HttpServer(StreamHost* host, const shared_ptr<ThreadPolicy> &threadPolicy, const shared_ptr<WebRtcServer> &webRtc) :
+    Logger("HttpServer"),
+    m_host(host),
+    m_threadPolicy(threadPolicy),
+    m_webRtc(webRtc)
+{
+}
+
+HttpServer::~HttpServer()
+{
+    stop();
+}
+
+bool HttpServer::start()
+{
+    if (m_running)
+    {
+        log(DEBUG, "start: Already running!");
+        return true;
+    }
+
+    auto config = m_host->getConfig();
+    m_config = config->getHttp();
+
+    m_listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listener < 0)
+    {
+        log(ERROR, "start: Unable to create socket: %s", strerror(errno));
+        return false;
+    }
+
+    int one = 1;
+    setsockopt(m_listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(m_config.port);
+    if (inet_pton(AF_INET, m_config.address.c_str(), &addr.sin_addr) != 1)
+    {
+        log(ERROR, "start: Invalid address: %s", m_config.address.c_str());
+        close(m_listener);
+        m_listener = -1;
+        return false;
+    }
+    if (bind(m_listener, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(m_listener, 16) < 0)
+    {
+        log(ERROR, "start: Unable to listen on %s:%d: %s", m_config.address.c_str(), m_config.port, strerror(errno));
+        close(m_listener);
+        m_listener = -1;
+        return false;
+    }
+
+    int threads = config->getMjpeg().threads;
+    if (threads <= 0)
+    {
+        threads = clamp((int)thread::hardware_concurrency() / 2, 1, 4);
+    }
+    threads = config->getEncoderThreads(ENCODER_HTTP, threads);
+
+    // The encoding thread calling in to the pool does a share of the work too
+    m_pool = make_shared<WorkerPool>(threads - 1, m_threadPolicy);
+
+    m_running = true;
+    for (const auto& display : m_host->getDisplays())
+    {
+        auto httpDisplay = make_shared<HttpDisplay>();
+        httpDisplay->display = display;
+        httpDisplay->encoder = make_shared<JpegEncoder>(m_pool, m_config.quality);
+        httpDisplay->thread = make_shared<thread>(&HttpServer::encodeMain, this, httpDisplay);
+        m_displays.push_back(httpDisplay);
+        log(INFO, "start: Serving http://%s:%d/snapshot/%s.jpg and /mjpeg/%s",
+            m_config.address.c_str(), m_config.port, display->name.c_str(), display->name.c_str());
+    }
+
+    m_thread = make_shared<thread>(&HttpServer::serverMain, this);
+    return true;
+}
+
+bool HttpServer::stop()
+{
+    if (m_thread == nullptr)
+    {
+        return true;
+    }
+
+    log(DEBUG, "stop: Stopping...");
+    m_running = false;
+    m_thread->join();
+    m_thread = nullptr;
+
+    for (const auto& httpDisplay : m_displays)
+    {
+        httpDisplay->display->frameCond.notify_all();
+        httpDisplay->cond.notify_all();
+        httpDisplay->thread->join();
+    }
+    m_displays.clear();
+    m_pool = nullptr;
+    log(DEBUG, "stop: Done");
+    return true;
+}
+
+void HttpServer::serverMain()
+{
+    if (m_threadPolicy != nullptr)
+    {
+        // Connection threads are started from here, and pick up the same policy
+        m_threadPolicy->apply("HttpServer");
+    }
+
+    while (m_running)
+    {
+        pollfd pfd = {m_listener, POLLIN, 0};
+        int res = poll(&pfd, 1, POLL_TIMEOUT_MS);
+        if (res < 0 && errno != EINTR)
+        {
+            log(ERROR, "serverMain: poll failed: %s", strerror(errno));
+            break;
+        }
+        if (res > 0 && (pfd.revents & POLLIN))
+        {
+            acceptConnection();
+        }
+        reapConnections();
+        if (m_webRtc != nullptr)
+        {
+            m_webRtc->reapPeers();
+        }
+    }
+
+    // Wake up anything blocked on a socket or waiting for a frame
+    for (const auto& connection : m_connections)
+    {
+        shutdown(connection->socket, SHUT_RDWR);
+    }
+    for (const auto& httpDisplay : m_displays)
+    {
+        httpDisplay->cond.notify_all();
+    }
+    for (const auto& connection : m_connections)
+    {
+        connection->thread->join();
+        close(connection->socket);
+    }
+    m_connections.clear();
+
+    close(m_listener);
+    m_listener = -1;
+}
+
+void HttpServer::acceptConnection()
+{
+    sockaddr_in addr = {};
+    socklen_t addrLen = sizeof(addr);
+    int socket = accept(m_listener, (sockaddr*)&addr, &addrLen);
+    if (socket < 0)
+    {
+        log(WARN, "acceptConnection: accept failed: %s", strerror(errno));
+        return;
+    }
+
+    int one = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+    setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+    char host[INET_ADDRSTRLEN] = {};
+    inet_ntop(AF_INET, &addr.sin_addr, host, sizeof(host));
+
+    auto connection = make_shared<HttpConnection>();
+    connection->socket = socket;
+    connection->address = string(host) + ":" + to_string(ntohs(addr.sin_port));
+    connection->thread = make_shared<thread>(&HttpServer::connectionMain, this, connection);
+    m_connections.push_back(connection);
+}
+
+void HttpServer::reapConnections()
+{
+    for (auto it = m_connections.begin(); it != m_connections.end(); )
+    {
+        auto connection = *it;
+        if (!connection->finished)
+        {
+            ++it;
+            continue;
+        }
+
+        connection->thread->join();
+        close(connection->socket);
+        it = m_connections.erase(it);
+    }
+}
+
+void HttpServer::encodeMain(const shared_ptr<HttpDisplay> &httpDisplay)
+{
+    if (m_threadPolicy != nullptr)
+    {
+        m_threadPolicy->apply("HttpServer");
+    }
+
+    const auto& display = httpDisplay->display;
+    size_t size = (size_t)display->width * display->height * 4;
+    uint64_t lastSeq = 0;
+    while (m_running)
+    {
+        {
+            unique_lock lock(httpDisplay->mutex);
+            auto wanted = [&httpDisplay]()
+            {
+                return httpDisplay->streams > 0 || chrono::steady_clock::now() < httpDisplay->wantedUntil;
+            };
+            if (!wanted())
+            {
+                httpDisplay->cond.wait_for(lock, WAIT_TIMEOUT);
+                continue;
+            }
+        }
+
+        // Take a copy so the sim isn't kept waiting on the lock while we encode
+        {
+            unique_lock lock(display->mutex);
+            display->frameCond.wait_for(lock, WAIT_TIMEOUT, [this, &display, lastSeq]()
+            {
+                return !m_running || (display->buffer != nullptr && display->frameSeq != lastSeq);
+            });
+            if (!m_running || display->buffer == nullptr || display->frameSeq == lastSeq)
+            {
+                continue;
+            }
+            httpDisplay->frame.resize(size);
+            memcpy(httpDisplay->frame.data(), display->buffer, size);
+            lastSeq = display->frameSeq;
+        }
+
+        auto jpeg = make_shared<vector<uint8_t>>();
+        if (!httpDisplay->encoder->encode(httpDisplay->frame.data(), display->width, display->height, *jpeg))
+        {
+            log(ERROR, "encodeMain: %s: Failed to encode frame", display->name.c_str());
+            continue;
+        }
+
+        {
+            scoped_lock lock(httpDisplay->mutex);
+            httpDisplay->jpeg = jpeg;
+            httpDisplay->jpegSeq++;
+        }
+        httpDisplay->cond.notify_all();
+    }
+}
+
+void HttpServer::connectionMain(const shared_ptr<HttpConnection> &connection)
+{
+    int socket = connection->socket;
+    string method;
+    string path;
+    string body;
+    if (readRequest(socket, method, path, body))
+    {
+        log(DEBUG, "connectionMain: %s: %s %s", connection->address.c_str(), method.c_str(), path.c_str());
+
+        // Nobody cares about the query string
+        path = path.substr(0, path.find('?'));
+
+        const string snapshotPrefix = "/snapshot/";
+        const string snapshotSuffix = ".jpg";
+        const string mjpegPrefix = "/mjpeg/";
+        const string whepPrefix = "/whep/";
+        const string webRtcPrefix = "/webrtc/";
+        if (m_webRtc != nullptr && path.starts_with(whepPrefix))
+        {
+            handleWhep(socket, method, path.substr(whepPrefix.size()), body);
+        }
+        else if (method != "GET")
+        {
+            sendError(socket, 405, "Method Not Allowed");
+        }
+        else if (path.starts_with(snapshotPrefix) && path.ends_with(snapshotSuffix))
+        {
+            auto name = path.substr(snapshotPrefix.size(), path.size() - snapshotPrefix.size() - snapshotSuffix.size());
+            auto httpDisplay = findDisplay(name);
+            if (httpDisplay != nullptr)
+            {
+                sendSnapshot(socket, httpDisplay);
+            }
+            else
+            {
+                sendError(socket, 404, "Not Found");
+            }
+        }
+        else if (path.starts_with(mjpegPrefix))
+        {
+            auto httpDisplay = findDisplay(path.substr(mjpegPrefix.size()));
+            if (httpDisplay != nullptr)
+            {
+                log(INFO, "connectionMain: %s: Streaming %s", connection->address.c_str(), httpDisplay->display->name.c_str());
+                sendStream(socket, httpDisplay);
+                log(INFO, "connectionMain: %s: Finished streaming %s", connection->address.c_str(), httpDisplay->display->name.c_str());
+            }
+            else
+            {
+                sendError(socket, 404, "Not Found");
+            }
+        }
+        else if (m_webRtc != nullptr && path.starts_with(webRtcPrefix))
+        {
+            if (m_webRtc->findDisplay(path.substr(webRtcPrefix.size())) != nullptr)
+            {
+                sendPlayer(socket);
+            }
+            else
+            {
+                sendError(socket, 404, "Not Found");
+            }
+        }
+        else
+        {
+            sendError(socket, 404, "Not Found");
+        }
+    }
+    connection->finished = true;
+}
+
+bool HttpServer::readRequest(int socket, string &method, string &path, string &body)
+{
+    string request;
+    char buffer[1024];
+    auto receive = [socket, &request, &buffer]()
+    {
+        while (true)
+        {
+            pollfd pfd = {socket, POLLIN, 0};
+            int res = poll(&pfd, 1, REQUEST_TIMEOUT_MS);
+            if (res < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (res <= 0)
+            {
+                return false;
+            }
+
+            auto length = recv(socket, buffer, sizeof(buffer), 0);
+            if (length <= 0)
+            {
+                return false;
+            }
+            request.append(buffer, length);
+            return true;
+        }
+    };
+
+    size_t headerEnd;
+    while ((headerEnd = request.find("\r\n\r\n")) == string::npos)
+    {
+        if (request.size() > MAX_REQUEST_SIZE)
+        {
+            sendError(socket, 431, "Request Header Fields Too Large");
+            return false;
+        }
+        if (!receive())
+        {
+            return false;
+        }
+    }
+
+    // GET /path HTTP/1.1
+    auto lineEnd = request.find("\r\n");
+    auto methodEnd = request.find(' ');
+    auto pathEnd = methodEnd == string::npos ? string::npos : request.find(' ', methodEnd + 1);
+    if (methodEnd == string::npos || pathEnd == string::npos || pathEnd > lineEnd)
+    {
+        sendError(socket, 400, "Bad Request");
+        return false;
+    }
+    method = request.substr(0, methodEnd);
+    path = request.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+
+    // Only WHEP offers have a body, and they always say how long it is
+    size_t contentLength = 0;
+    string headers = request.substr(lineEnd + 2, headerEnd - lineEnd - 2);
+    transform(headers.begin(), headers.end(), headers.begin(), [](unsigned char c) { return tolower(c); });
+    auto lengthPos = headers.find("content-length:");
+    if (lengthPos != string::npos)
+    {
+        contentLength = strtoul(headers.c_str() + lengthPos + strlen("content-length:"), nullptr, 10);
+    }
+    if (contentLength > MAX_BODY_SIZE)
+    {
+        sendError(socket, 413, "Content Too Large");
+        return false;
+    }
+
+    size_t bodyStart = headerEnd + 4;
+    while (request.size() - bodyStart < contentLength)
+    {
+        if (!receive())
+        {
+            return false;
+        }
+    }
+    body = request.substr(bodyStart, contentLength);
+    return true;
+}
+
+bool HttpServer::sendSnapshot(int socket, const shared_ptr<HttpDisplay> &httpDisplay)
+{
+    // Make sure it's being captured, and will be for a while yet
+    m_host->getLifecycleManager()->displayRequested(httpDisplay->display);
+
+    shared_ptr<const vector<uint8_t>> jpeg;
+    {
+        unique_lock lock(httpDisplay->mutex);
+        auto now = chrono::steady_clock::now();
+        bool encoding = httpDisplay->streams > 0 || now < httpDisplay->wantedUntil;
+        httpDisplay->wantedUntil = now + SNAPSHOT_KEEPALIVE;
+
+        // Anything we have is out of date if nobody has been asking for it
+        uint64_t jpegSeq = httpDisplay->jpegSeq;
+        if (!encoding || httpDisplay->jpeg == nullptr)
+        {
+            httpDisplay->cond.notify_all();
+            httpDisplay->cond.wait_for(lock, SNAPSHOT_TIMEOUT, [this, &httpDisplay, jpegSeq]()
+            {
+                return !m_running || httpDisplay->jpegSeq != jpegSeq;
+            });
+            if (httpDisplay->jpegSeq == jpegSeq)
+            {
+                lock.unlock();
+                return sendError(socket, 503, "Service Unavailable");
+            }
+        }
+        jpeg = httpDisplay->jpeg;
+    }
+
+    string header = "HTTP/1.1 200 OK\r\n"
+        "Content-Type: image/jpeg\r\n"
+        "Content-Length: " + to_string(jpeg->size()) + "\r\n"
+        "Cache-Control: no-cache, no-store\r\n"
+        "Connection: close\r\n"
+        "\r\n";
+    return writeFully(socket, header.data(), header.size()) && writeFully(socket, jpeg->data(), jpeg->size());
+}
+
+bool HttpServer::sendStream(int socket, const shared_ptr<HttpDisplay> &httpDisplay)
+{
+    const auto& display = httpDisplay->display;
+    m_host->getLifecycleManager()->displayRequested(display);
+    display->subscribers++;
+    {
+        scoped_lock lock(httpDisplay->mutex);
+        httpDisplay->streams++;
+    }
+    httpDisplay->cond.notify_all();
+
+    string header = string("HTTP/1.1 200 OK\r\n"
+        "Content-Type: multipart/x-mixed-replace; boundary=") + BOUNDARY + "\r\n"
+        "Cache-Control: no-cache, no-store\r\n"
+        "Connection: close\r\n"
+        "\r\n";
+    bool ok = writeFully(socket, header.data(), header.size());
+
+    // Start with whatever we've got, then send each new frame as it's encoded
+    uint64_t lastJpegSeq = 0;
+    while (ok && m_running)
+    {
+        shared_ptr<const vector<uint8_t>> jpeg;
+        {
+            unique_lock lock(httpDisplay->mutex);
+            httpDisplay->cond.wait_for(lock, STREAM_WAIT, [this, &httpDisplay, lastJpegSeq]()
+            {
+                return !m_running || (httpDisplay->jpeg != nullptr && httpDisplay->jpegSeq != lastJpegSeq);
+            });
+            if (httpDisplay->jpeg == nullptr || httpDisplay->jpegSeq == lastJpegSeq)
+            {
+                continue;
+            }
+            jpeg = httpDisplay->jpeg;
+            lastJpegSeq = httpDisplay->jpegSeq;
+        }
+
+        string partHeader = string("--") + BOUNDARY + "\r\n"
+            "Content-Type: image/jpeg\r\n"
+            "Content-Length: " + to_string(jpeg->size()) + "\r\n"
+            "\r\n";
+        ok = writeFully(socket, partHeader.data(), partHeader.size()) &&
+            writeFully(socket, jpeg->data(), jpeg->size()) &&
+            writeFully(socket, "\r\n", 2);
+    }
+
+    {
+        scoped_lock lock(httpDisplay->mutex);
+        httpDisplay->streams--;
+    }
+    display->subscribers--;
+
+    // Start the idle timeout from when the last client went
+    m_host->getLifecycleManager()->displayRequested(display);
+    return ok;
+}
+
+bool HttpServer::handleWhep(int socket, const string &method, const string &resource, const string &body)
+{
+    // <display> takes offers, <display>/<id> is the session it created
+    auto slash = resource.find('/');
+    auto webRtcDisplay = m_webRtc->findDisplay(resource.substr(0, slash));
+    if (webRtcDisplay == nullptr)
+    {
+        return sendError(socket, 404, "Not Found");
+    }
+
+    if (method == "OPTIONS")
+    {
+        return sendResponse(socket, 204, "No Content", string(CORS_HEADERS) + "Accept-Post: application/sdp\r\n", "");
+    }
+    else if (method == "POST" && slash == string::npos)
+    {
+        if (!m_webRtc->canAddPeer(webRtcDisplay))
+        {
+            return sendError(socket, 503, "Service Unavailable");
+        }
+
+        string answer;
+        auto id = m_webRtc->addPeer(webRtcDisplay, body, answer);
+        if (id.empty())
+        {
+            return sendError(socket, 400, "Bad Request");
+        }
+        return sendResponse(socket, 201, "Created", string(CORS_HEADERS) +
+            "Content-Type: application/sdp\r\n"
+            "Location: /whep/" + resource + "/" + id + "\r\n", answer);
+    }
+    else if (method == "DELETE" && slash != string::npos)
+    {
+        if (!m_webRtc->removePeer(webRtcDisplay, resource.substr(slash + 1)))
+        {
+            return sendError(socket, 404, "Not Found");
+        }
+        return sendResponse(socket, 200, "OK", CORS_HEADERS, "");
+    }
+
+    // No trickle ICE, so PATCH isn't supported either
+    return sendError(socket, 405, "Method Not Allowed");
+}
+
+bool HttpServer::sendPlayer(int socket)
+{
+    return sendResponse(socket, 200, "OK", "Content-Type: text/html; charset=utf-8\r\nCache-Control: no-cache\r\n", PLAYER_PAGE);
+}
+
+bool HttpServer::sendResponse(int socket, int status, const char* reason, const string &headers, const string &body)
+{
+    string response = "HTTP/1.1 " + to_string(status) + " " + reason + "\r\n" +
+        headers +
+        "Content-Length: " + to_string(body.size()) + "\r\n"
+        "Connection: close\r\n"
+        "\r\n" + body;
+    return writeFully(socket, response.data(), response.size());
+}
+
+bool HttpServer::sendError(int socket, int status, const char* reason)
+{
+    string body = to_string(status) + " " + reason + "\n";
+    return sendResponse(socket, status, reason, "Content-Type: text/plain\r\n", body);
+}
+
+bool HttpServer::writeFully(int socket, const void* data, size_t length)
+{
+    auto ptr = static_cast<const uint8_t*>(data);
+    while (length > 0)
+    {
+        auto res = send(socket, ptr, length, SEND_FLAGS);
+        if (res < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (res <= 0)
+        {
+            return false;
+        }
+        ptr += res;
+        length -= res;
+    }
+    return true;
+}
+
+shared_ptr<HttpDisplay> HttpServer::findDisplay(const string &name) const
+{
+    for (const auto& httpDisplay : m_displays)
+    {
+        if (httpDisplay->display->name == name)
+        {
+            return httpDisplay;
+        }
+    }
+    return nullptr;
+}
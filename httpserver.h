@@ -0,0 +1,105 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef HTTPSERVER_H
+#define HTTPSERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "logger.h"
+
+struct Display;
+class JpegEncoder;
+class StreamHost;
+class ThreadPolicy;
+class WebRtcServer;
+class WorkerPool;
+
+struct HttpDisplay
+{
+    std::shared_ptr<Display> display;
+    std::shared_ptr<JpegEncoder> encoder;
+    std::vector<uint8_t> frame;
+    std::shared_ptr<std::thread> thread;
+
+    // The newest JPEG, replaced rather than changed so clients can carry on sending the old one
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::shared_ptr<const std::vector<uint8_t>> jpeg;
+    uint64_t jpegSeq = 0;
+
+    // Frames are only encoded while there are MJPEG clients, or snapshots have been asked for recently
+    int streams = 0;
+    std::chrono::steady_clock::time_point wantedUntil;
+};
+
+struct HttpConnection
+{
+    int socket = -1;
+    std::string address;
+    std::shared_ptr<std::thread> thread;
+    std::atomic<bool> finished = false;
+};
+
+/*
+ * Serves /snapshot/<display>.jpg and /mjpeg/<display> over HTTP, for web
+ * pages and dashboards that don't speak RTSP. Each display has a single
+ * encoder that turns every captured frame in to a JPEG once, however many
+ * clients are polling or streaming, and they all share the result.
+ *
+ * With WebRTC enabled it also takes WHEP offers at /whep/<display>, and
+ * serves a page at /webrtc/<display> that plays it in a browser.
+ */
+class HttpServer : private Logger
+{
+ private:
+    StreamHost* m_host;
+    HttpConfig m_config;
+    std::shared_ptr<ThreadPolicy> m_threadPolicy;
+    std::shared_ptr<WorkerPool> m_pool;
+    std::shared_ptr<WebRtcServer> m_webRtc;
+
+    int m_listener = -1;
+    std::vector<std::shared_ptr<HttpDisplay>> m_displays;
+    std::vector<std::shared_ptr<HttpConnection>> m_connections;
+
+    std::shared_ptr<std::thread> m_thread;
+    std::atomic<bool> m_running = false;
+
+    void serverMain();
+    void acceptConnection();
+    void reapConnections();
+
+    void encodeMain(const std::shared_ptr<HttpDisplay> &httpDisplay);
+
+    void connectionMain(const std::shared_ptr<HttpConnection> &connection);
+    bool readRequest(int socket, std::string &method, std::string &path, std::string &body);
+    bool sendSnapshot(int socket, const std::shared_ptr<HttpDisplay> &httpDisplay);
+    bool sendStream(int socket, const std::shared_ptr<HttpDisplay> &httpDisplay);
+    bool handleWhep(int socket, const std::string &method, const std::string &resource, const std::string &body);
+    bool sendPlayer(int socket);
+    bool sendResponse(int socket, int status, const char* reason, const std::string &headers, const std::string &body);
+    bool sendError(int socket, int status, const char* reason);
+    bool writeFully(int socket, const void* data, size_t length);
+
+    [[nodiscard]] std::shared_ptr<HttpDisplay> findDisplay(const std::string &name) const;
+
+ public:
+    // webRtc may be null, when WebRTC isn't enabled
+    HttpServer(StreamHost* host, const std::shared_ptr<ThreadPolicy> &threadPolicy, const std::shared_ptr<WebRtcServer> &webRtc);
+    ~HttpServer() override;
+
+    bool start();
+    bool stop();
+};
+
+#endif //HTTPSERVER_H
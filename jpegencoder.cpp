@@ -0,0 +1,235 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "jpegencoder.h"
+#include "workerpool.h"
+
+#include <algorithm>
+
+#include <turbojpeg.h>
+
+using namespace std;
+
+// 4:2:0 chroma subsampling, so MCUs are 16x16
+static const int MCU_SIZE = 16;
+
+static const uint8_t MARKER_SOF0 = 0xc0;
+static const uint8_t MARKER_SOF1 = 0xc1;
+static const uint8_t MARKER_RST0 = 0xd0;
+static const uint8_t MARKER_EOI = 0xd9;
+static const uint8_t MARKER_SOS = 0xda;
+static const uint8_t MARKER_DRI = 0xdd;
+
+// One compressor per thread, they're only ever used from the thread that created them
+struct TurboHandle
+{
+    tjhandle handle = tjInitCompress();
+
+    ~TurboHandle()
+    {
+        if (handle != nullptr)
+        {
+            tjDestroy(handle);
+        }
+    }
+};
+
+static thread_local TurboHandle g_turboHandle;
+
+// Find the start of the SOS segment and the first byte of entropy coded data
+static bool findScan(const uint8_t* data, unsigned long size, size_t &sofPos, size_t &sosPos, size_t &scanPos)
+{
+    sofPos = 0;
+    size_t pos = 2;
+    while (pos + 4 <= size)
+    {
+        if (data[pos] != 0xff)
+        {
+            return false;
+        }
+        uint8_t marker = data[pos + 1];
+        size_t length = (data[pos + 2] << 8) | data[pos + 3];
+        if (marker == MARKER_SOF0 || marker == MARKER_SOF1)
+        {
+            sofPos = pos;
+        }
+        else if (marker == MARKER_SOS)
+        {
+            sosPos = pos;
+            scanPos = pos + 2 + length;
+            return sofPos != 0 && scanPos < size;
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
+
+JpegEncoder::JpegEncoder(const shared_ptr<WorkerPool> &pool, int quality) :
+    Logger("JpegEncoder"),
+    m_pool(pool),
+    m_quality(quality)
+{
+}
+
+bool JpegEncoder::encode(const uint8_t* rgba, int width, int height, vector<uint8_t> &out)
+{
+    int mcuRows = (height + MCU_SIZE - 1) / MCU_SIZE;
+    int bandCount = min(m_pool->getConcurrency(), mcuRows);
+    int bandHeight = (mcuRows + bandCount - 1) / bandCount * MCU_SIZE;
+    if (!canEncodeBands(width, bandHeight))
+    {
+        // Too big for DRI, just do it in one go
+        bandHeight = mcuRows * MCU_SIZE;
+    }
+    bandCount = (height + bandHeight - 1) / bandHeight;
+
+    return encodeBands(rgba, width, height, bandHeight, 0, bandCount) && finishBands(width, height, bandHeight, out);
+}
+
+bool JpegEncoder::canEncodeBands(int width, int bandHeight)
+{
+    int mcuCols = (width + MCU_SIZE - 1) / MCU_SIZE;
+    return bandHeight % MCU_SIZE == 0 && mcuCols * (bandHeight / MCU_SIZE) <= 0xffff;
+}
+
+bool JpegEncoder::encodeBands(const uint8_t* rgba, int width, int height, int bandHeight, int firstBand, int lastBand)
+{
+    if ((int)m_bands.size() < lastBand)
+    {
+        m_bands.resize(lastBand);
+    }
+
+    m_pool->parallelFor(lastBand - firstBand, [this, rgba, width, height, bandHeight, firstBand](int i)
+    {
+        int band = firstBand + i;
+        int y = band * bandHeight;
+        int h = min(bandHeight, height - y);
+        m_bands[band].ok = compressBand(m_bands[band], rgba + (size_t)y * width * 4, width, h);
+    });
+
+    for (int i = firstBand; i < lastBand; i++)
+    {
+        if (!m_bands[i].ok)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool JpegEncoder::finishBands(int width, int height, int bandHeight, vector<uint8_t> &out)
+{
+    int bandCount = (height + bandHeight - 1) / bandHeight;
+    if ((int)m_bands.size() < bandCount)
+    {
+        return false;
+    }
+    for (int i = 0; i < bandCount; i++)
+    {
+        if (!m_bands[i].ok)
+        {
+            return false;
+        }
+    }
+
+    if (bandCount == 1)
+    {
+        out.assign(m_bands[0].data.begin(), m_bands[0].data.begin() + (long)m_bands[0].size);
+        return true;
+    }
+
+    int mcuCols = (width + MCU_SIZE - 1) / MCU_SIZE;
+    return assemble(bandCount, height, mcuCols * (bandHeight / MCU_SIZE), out);
+}
+
+bool JpegEncoder::compressBand(JpegBand &band, const uint8_t* rgba, int width, int height)
+{
+    auto handle = g_turboHandle.handle;
+    if (handle == nullptr)
+    {
+        return false;
+    }
+
+    // Big enough for the worst case, so the buffer never needs to grow
+    unsigned long maxSize = tjBufSize(width, height, TJSAMP_420);
+    if (band.data.size() < maxSize)
+    {
+        band.data.resize(maxSize);
+    }
+
+    unsigned char* jpegBuf = band.data.data();
+    band.size = maxSize;
+    int res = tjCompress2(
+        handle,
+        rgba,
+        width,
+        width * 4,
+        height,
+        TJPF_RGBA,
+        &jpegBuf,
+        &band.size,
+        TJSAMP_420,
+        m_quality,
+        TJFLAG_FASTDCT | TJFLAG_NOREALLOC);
+    if (res != 0)
+    {
+        log(ERROR, "compressBand: tjCompress2 failed: %s", tjGetErrorStr2(handle));
+        return false;
+    }
+    return true;
+}
+
+bool JpegEncoder::assemble(int bandCount, int height, int restartInterval, vector<uint8_t> &out)
+{
+    // The first band provides the headers, it only needs the full height and a restart interval
+    const auto& first = m_bands[0];
+    size_t sofPos;
+    size_t sosPos;
+    size_t scanPos;
+    if (!findScan(first.data.data(), first.size, sofPos, sosPos, scanPos))
+    {
+        log(ERROR, "assemble: Unable to parse JPEG headers");
+        return false;
+    }
+
+    out.clear();
+    out.insert(out.end(), first.data.begin(), first.data.begin() + (long)sosPos);
+    out[sofPos + 5] = (height >> 8) & 0xff;
+    out[sofPos + 6] = height & 0xff;
+
+    const uint8_t dri[] = {
+        0xff, MARKER_DRI,
+        0x00, 0x04,
+        (uint8_t)((restartInterval >> 8) & 0xff), (uint8_t)(restartInterval & 0xff)
+    };
+    out.insert(out.end(), dri, dri + sizeof(dri));
+    out.insert(out.end(), first.data.begin() + (long)sosPos, first.data.begin() + (long)scanPos);
+
+    for (int i = 0; i < bandCount; i++)
+    {
+        const auto& band = m_bands[i];
+        size_t bandSofPos;
+        size_t bandSosPos;
+        size_t bandScanPos;
+        if (!findScan(band.data.data(), band.size, bandSofPos, bandSosPos, bandScanPos))
+        {
+            log(ERROR, "assemble: Band %d: Unable to parse JPEG headers", i);
+            return false;
+        }
+
+        // Everything between the SOS header and EOI
+        out.insert(out.end(), band.data.begin() + (long)bandScanPos, band.data.begin() + (long)band.size - 2);
+
+        out.push_back(0xff);
+        if (i < bandCount - 1)
+        {
+            out.push_back(MARKER_RST0 + (i % 8));
+        }
+        else
+        {
+            out.push_back(MARKER_EOI);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,59 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef JPEGENCODER_H
+#define JPEGENCODER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "logger.h"
+
+class WorkerPool;
+
+struct JpegBand
+{
+    std::vector<uint8_t> data;
+    unsigned long size = 0;
+    bool ok = false;
+};
+
+/*
+ * Encodes RGBA frames to baseline JPEG with libjpeg-turbo, in parallel.
+ *
+ * The frame is split in to horizontal bands that are a whole number of MCU
+ * rows high, and each band is compressed on its own. As the DC predictors
+ * are reset at every restart marker, the bands' entropy coded data can be
+ * joined with RSTn markers in between to make a single JPEG with a restart
+ * interval of one band. With pipelined_capture the bands are the display's
+ * own, and each is compressed as soon as it's been captured.
+ *
+ * Not thread safe, use one encoder per stream. The pool can be shared.
+ */
+class JpegEncoder : private Logger
+{
+ private:
+    std::shared_ptr<WorkerPool> m_pool;
+    int m_quality;
+
+    std::vector<JpegBand> m_bands;
+
+    bool compressBand(JpegBand &band, const uint8_t* rgba, int width, int height);
+    bool assemble(int bandCount, int height, int restartInterval, std::vector<uint8_t> &out);
+
+ public:
+    JpegEncoder(const std::shared_ptr<WorkerPool> &pool, int quality);
+    ~JpegEncoder() override = default;
+
+    bool encode(const uint8_t* rgba, int width, int height, std::vector<uint8_t> &out);
+
+    // Or a few bands at a time as they arrive, then finishBands once they're all in. Only
+    // bands that are a whole number of MCU rows high, and short enough for DRI, will do
+    [[nodiscard]] static bool canEncodeBands(int width, int bandHeight);
+    bool encodeBands(const uint8_t* rgba, int width, int height, int bandHeight, int firstBand, int lastBand);
+    bool finishBands(int width, int height, int bandHeight, std::vector<uint8_t> &out);
+};
+
+#endif //JPEGENCODER_H
@@ -0,0 +1,93 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "keyframedropper.h"
+
+using namespace std;
+
+KeyFrameDropper::KeyFrameDropper(GstElement* queue, const string &name, guint64 maxTime, guint maxBytes) :
+    Logger("KeyFrameDropper"),
+    m_name(name),
+    m_queue(queue),
+    m_maxTime(maxTime),
+    m_maxBytes(maxBytes)
+{
+}
+
+void KeyFrameDropper::attach(GstElement* queue, const string &name, guint64 maxTime, guint maxBytes)
+{
+    // Never blocks, it only ever gets as far over the limits as one frame
+    g_object_set(G_OBJECT(queue),
+        "max-size-buffers", 0,
+        "max-size-bytes", 0,
+        "max-size-time", (guint64)0,
+        nullptr);
+    gst_util_set_object_arg(G_OBJECT(queue), "leaky", "no");
+
+    auto pad = gst_element_get_static_pad(queue, "sink");
+    auto dropper = new KeyFrameDropper(queue, name, maxTime, maxBytes);
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, bufferProbe, dropper, freeDropper);
+    gst_object_unref(pad);
+}
+
+bool KeyFrameDropper::isFull() const
+{
+    guint64 time = 0;
+    guint bytes = 0;
+    g_object_get(G_OBJECT(m_queue), "current-level-time", &time, "current-level-bytes", &bytes, nullptr);
+    return time >= m_maxTime || bytes >= m_maxBytes;
+}
+
+void KeyFrameDropper::requestKeyFrame(GstPad* pad)
+{
+    // Pushed from the queue's sink pad, so it goes back up to the encoder
+    auto event = gst_event_new_custom(GST_EVENT_CUSTOM_UPSTREAM, gst_structure_new("GstForceKeyUnit",
+        "running-time", G_TYPE_UINT64, GST_CLOCK_TIME_NONE,
+        "all-headers", G_TYPE_BOOLEAN, TRUE,
+        "count", G_TYPE_UINT, 0,
+        NULL));
+    if (!gst_pad_push_event(pad, event))
+    {
+        log(DEBUG, "requestKeyFrame: %s: Key unit request wasn't handled", m_name.c_str());
+    }
+}
+
+GstPadProbeReturn KeyFrameDropper::bufferProbe(GstPad* pad, GstPadProbeInfo* info, gpointer data)
+{
+    auto dropper = static_cast<KeyFrameDropper*>(data);
+    auto buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    bool keyFrame = !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+    if (!dropper->m_dropping)
+    {
+        if (!dropper->isFull())
+        {
+            return GST_PAD_PROBE_OK;
+        }
+        dropper->m_dropping = true;
+        dropper->m_dropped = 0;
+        dropper->log(DEBUG, "bufferProbe: %s: Queue is full, dropping up to the next key frame", dropper->m_name.c_str());
+        dropper->requestKeyFrame(pad);
+    }
+    else if (keyFrame)
+    {
+        if (!dropper->isFull())
+        {
+            dropper->m_dropping = false;
+            dropper->log(INFO, "bufferProbe: %s: Dropped %lu frames", dropper->m_name.c_str(), dropper->m_dropped);
+            return GST_PAD_PROBE_OK;
+        }
+
+        // Still hasn't drained, so this one's no good either
+        dropper->requestKeyFrame(pad);
+    }
+
+    dropper->m_dropped++;
+    return GST_PAD_PROBE_DROP;
+}
+
+void KeyFrameDropper::freeDropper(gpointer data)
+{
+    delete static_cast<KeyFrameDropper*>(data);
+}
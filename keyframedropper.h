@@ -0,0 +1,50 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef KEYFRAMEDROPPER_H
+#define KEYFRAMEDROPPER_H
+
+#include <string>
+
+#include <gst/gst.h>
+
+#include "logger.h"
+
+/*
+ * Keeps a queue of encoded frames from blocking whatever feeds it, without
+ * leaving holes in a GOP the way a leaky queue would. The queue itself is
+ * unlimited, and once it holds more than the limits every frame is dropped
+ * up to the next key frame that it has room for. A key frame is asked for
+ * upstream as soon as it starts dropping, so it's not waiting a whole GOP.
+ *
+ * MJPEG frames are all key frames, so they're simply dropped one at a time.
+ */
+class KeyFrameDropper : private Logger
+{
+ private:
+    std::string m_name;
+    GstElement* m_queue;
+    guint64 m_maxTime;
+    guint m_maxBytes;
+
+    // Only touched on the queue's upstream streaming thread
+    bool m_dropping = false;
+    unsigned long m_dropped = 0;
+
+    KeyFrameDropper(GstElement* queue, const std::string &name, guint64 maxTime, guint maxBytes);
+
+    [[nodiscard]] bool isFull() const;
+    void requestKeyFrame(GstPad* pad);
+
+    static GstPadProbeReturn bufferProbe(GstPad* pad, GstPadProbeInfo* info, gpointer data);
+    static void freeDropper(gpointer data);
+
+ public:
+    ~KeyFrameDropper() override = default;
+
+    // Lifts the queue's own limits and probes its sink pad, the dropper goes when the pad does
+    static void attach(GstElement* queue, const std::string &name, guint64 maxTime, guint maxBytes);
+};
+
+#endif //KEYFRAMEDROPPER_H
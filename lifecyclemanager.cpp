@@ -0,0 +1,244 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "lifecyclemanager.h"
+#include "config.h"
+#include "displaymanager.h"
+#include "streamhost.h"
+
+#include <algorithm>
+
+using namespace std;
+
+void LifecycleManager::attach(GMainContext* context, const DisplayCallback &mediaWanted, const DisplayCallback &mediaIdle)
+{
+    if (m_checkSource != nullptr)
+    {
+        return;
+    }
+
+    {
+        scoped_lock lock(m_mutex);
+        m_mediaWanted = mediaWanted;
+        m_mediaIdle = mediaIdle;
+        m_attached = true;
+    }
+
+    m_checkSource = g_timeout_source_new_seconds(1);
+    g_source_set_callback(m_checkSource, checkCallback, this, nullptr);
+    g_source_attach(m_checkSource, context);
+}
+
+void LifecycleManager::detach()
+{
+    if (m_checkSource != nullptr)
+    {
+        g_source_destroy(m_checkSource);
+        g_source_unref(m_checkSource);
+        m_checkSource = nullptr;
+    }
+
+    scoped_lock lock(m_mutex);
+    m_mediaWanted = nullptr;
+    m_mediaIdle = nullptr;
+    m_attached = false;
+    m_displays.clear();
+    for (const auto& [client, displays] : m_clients)
+    {
+        for (const auto& display : displays)
+        {
+            display->subscribers--;
+        }
+    }
+    m_clients.clear();
+}
+
+void LifecycleManager::poll()
+{
+    {
+        scoped_lock lock(m_mutex);
+        if (m_attached)
+        {
+            return;
+        }
+    }
+
+    // There's no stream, so there's no media being held
+    check(false);
+}
+
+void LifecycleManager::mediaConfigured(const shared_ptr<Display> &display)
+{
+    scoped_lock lock(m_mutex);
+    auto& lifecycle = m_displays[display.get()];
+    lifecycle.display = display;
+    lifecycle.activeMedia++;
+    log(DEBUG, "mediaConfigured: %s: activeMedia=%d", display->name.c_str(), lifecycle.activeMedia);
+
+    m_host->armDisplay(display);
+    if (m_mediaWanted != nullptr && m_host->getConfig()->getPreroll())
+    {
+        // Held again after being let go, if it isn't already
+        m_mediaWanted(display);
+    }
+}
+
+void LifecycleManager::mediaUnprepared(const shared_ptr<Display> &display)
+{
+    scoped_lock lock(m_mutex);
+    auto it = m_displays.find(display.get());
+    if (it == m_displays.end())
+    {
+        return;
+    }
+
+    auto& lifecycle = it->second;
+    if (lifecycle.activeMedia > 0)
+    {
+        lifecycle.activeMedia--;
+    }
+    if (lifecycle.activeMedia == 0)
+    {
+        lifecycle.idleSince = chrono::steady_clock::now();
+    }
+    log(DEBUG, "mediaUnprepared: %s: activeMedia=%d", display->name.c_str(), lifecycle.activeMedia);
+}
+
+void LifecycleManager::mediaHeld(const shared_ptr<Display> &display)
+{
+    scoped_lock lock(m_mutex);
+    auto& lifecycle = m_displays[display.get()];
+    lifecycle.display = display;
+    lifecycle.heldMedia++;
+    log(DEBUG, "mediaHeld: %s: heldMedia=%d", display->name.c_str(), lifecycle.heldMedia);
+}
+
+void LifecycleManager::mediaReleased(const shared_ptr<Display> &display)
+{
+    scoped_lock lock(m_mutex);
+    auto it = m_displays.find(display.get());
+    if (it == m_displays.end())
+    {
+        return;
+    }
+
+    auto& lifecycle = it->second;
+    if (lifecycle.heldMedia > 0)
+    {
+        lifecycle.heldMedia--;
+    }
+    log(DEBUG, "mediaReleased: %s: heldMedia=%d", display->name.c_str(), lifecycle.heldMedia);
+}
+
+void LifecycleManager::displayRequested(const shared_ptr<Display> &display, bool pipeline)
+{
+    scoped_lock lock(m_mutex);
+    auto& lifecycle = m_displays[display.get()];
+    lifecycle.display = display;
+    lifecycle.idleSince = chrono::steady_clock::now();
+
+    m_host->armDisplay(display);
+    if (m_mediaWanted != nullptr && (pipeline || m_host->getConfig()->getPreroll()))
+    {
+        m_mediaWanted(display);
+    }
+}
+
+void LifecycleManager::clientPlaying(GstRTSPClient* client, const shared_ptr<Display> &display)
+{
+    scoped_lock lock(m_mutex);
+    auto& displays = m_clients[client];
+    if (find(displays.begin(), displays.end(), display) != displays.end())
+    {
+        return;
+    }
+    displays.push_back(display);
+    display->subscribers++;
+    log(DEBUG, "clientPlaying: %s: subscribers=%d", display->name.c_str(), display->subscribers.load());
+}
+
+void LifecycleManager::clientStopped(GstRTSPClient* client, const shared_ptr<Display> &display)
+{
+    scoped_lock lock(m_mutex);
+    auto it = m_clients.find(client);
+    if (it == m_clients.end())
+    {
+        return;
+    }
+
+    auto& displays = it->second;
+    auto displayIt = find(displays.begin(), displays.end(), display);
+    if (displayIt != displays.end())
+    {
+        displays.erase(displayIt);
+        display->subscribers--;
+        log(DEBUG, "clientStopped: %s: subscribers=%d", display->name.c_str(), display->subscribers.load());
+    }
+}
+
+void LifecycleManager::clientClosed(GstRTSPClient* client)
+{
+    scoped_lock lock(m_mutex);
+    auto it = m_clients.find(client);
+    if (it == m_clients.end())
+    {
+        return;
+    }
+
+    for (const auto& display : it->second)
+    {
+        display->subscribers--;
+        log(DEBUG, "clientClosed: %s: subscribers=%d", display->name.c_str(), display->subscribers.load());
+    }
+    m_clients.erase(it);
+}
+
+gboolean LifecycleManager::checkCallback(gpointer data)
+{
+    static_cast<LifecycleManager*>(data)->check(true);
+    return G_SOURCE_CONTINUE;
+}
+
+void LifecycleManager::check(bool releaseMedia)
+{
+    auto idleTimeout = chrono::seconds(m_host->getConfig()->getIdleTimeout());
+    auto now = chrono::steady_clock::now();
+
+    vector<shared_ptr<Display>> idle;
+    {
+        scoped_lock lock(m_mutex);
+        for (auto it = m_displays.begin(); it != m_displays.end(); )
+        {
+            auto& lifecycle = it->second;
+
+            // Media we're only holding ourselves doesn't count, clients playing it and VNC viewers do
+            if (lifecycle.activeMedia > lifecycle.heldMedia || lifecycle.display->subscribers > 0)
+            {
+                lifecycle.idleSince = now;
+                ++it;
+            }
+            else if (now - lifecycle.idleSince >= idleTimeout)
+            {
+                log(INFO, "check: %s: Idle for %d seconds, releasing", lifecycle.display->name.c_str(), (int)idleTimeout.count());
+                idle.push_back(lifecycle.display);
+                it = m_displays.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    // Letting go of held media calls back in to us, so it's done without the lock. This is the
+    // main loop's thread, the same as detach, so the callback can't go away underneath us
+    for (const auto& display : idle)
+    {
+        if (releaseMedia && m_mediaIdle != nullptr)
+        {
+            m_mediaIdle(display);
+        }
+        m_host->releaseDisplay(display);
+    }
+}
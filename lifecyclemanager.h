@@ -0,0 +1,90 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef LIFECYCLEMANAGER_H
+#define LIFECYCLEMANAGER_H
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <glib.h>
+#include <gst/rtsp-server/rtsp-server.h>
+
+#include "logger.h"
+
+struct Display;
+class StreamHost;
+
+struct DisplayLifecycle
+{
+    std::shared_ptr<Display> display;
+
+    // Prepared RTSP media, and how many of those we're holding ourselves
+    int activeMedia = 0;
+    int heldMedia = 0;
+    std::chrono::steady_clock::time_point idleSince;
+};
+
+typedef std::function<void(const std::shared_ptr<Display> &display)> DisplayCallback;
+
+/*
+ * Keeps track of which displays have clients, over RTSP, WebRTC or VNC. Displays
+ * are armed as soon as a client connects and are released once they have been
+ * idle for the configured timeout, so an idle sim does no readback and holds no
+ * frame memory. The servers themselves keep listening the whole time.
+ *
+ * Media the stream holds prepared itself, with preroll or for WebRTC, doesn't
+ * keep a display busy. It's unprepared along with the display being released,
+ * and held again the next time the display is asked for.
+ */
+class LifecycleManager : private Logger
+{
+ private:
+    StreamHost* m_host;
+
+    std::mutex m_mutex;
+    std::map<Display*, DisplayLifecycle> m_displays;
+
+    // Displays each client is playing, for Display::subscribers
+    std::map<GstRTSPClient*, std::vector<std::shared_ptr<Display>>> m_clients;
+    GSource* m_checkSource = nullptr;
+    bool m_attached = false;
+
+    // Set while attached, mediaWanted may be called on any thread and mediaIdle on the main loop's
+    DisplayCallback m_mediaWanted;
+    DisplayCallback m_mediaIdle;
+
+    static gboolean checkCallback(gpointer data);
+    void check(bool releaseMedia);
+
+ public:
+    explicit LifecycleManager(StreamHost* host) : Logger("LifecycleManager"), m_host(host) {}
+    ~LifecycleManager() override = default;
+
+    // mediaWanted asks for a display's media to be held, mediaIdle for it to be let go
+    void attach(GMainContext* context, const DisplayCallback &mediaWanted, const DisplayCallback &mediaIdle);
+    void detach();
+
+    // Without RTSP there's no main loop to check from, so the VNC server calls this instead. Does nothing while attached
+    void poll();
+
+    void mediaConfigured(const std::shared_ptr<Display> &display);
+    void mediaUnprepared(const std::shared_ptr<Display> &display);
+    void mediaHeld(const std::shared_ptr<Display> &display);
+    void mediaReleased(const std::shared_ptr<Display> &display);
+
+    // Arms a display for something other than a client's RTSP pipeline, and restarts its idle timeout.
+    // pipeline is for things fed from the display's RTSP pipeline, which is then held even without preroll
+    void displayRequested(const std::shared_ptr<Display> &display, bool pipeline = false);
+
+    void clientPlaying(GstRTSPClient* client, const std::shared_ptr<Display> &display);
+    void clientStopped(GstRTSPClient* client, const std::shared_ptr<Display> &display);
+    void clientClosed(GstRTSPClient* client);
+};
+
+#endif //LIFECYCLEMANAGER_H
@@ -0,0 +1,227 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "profiler.h"
+
+#include <cstdio>
+#include <filesystem>
+
+#ifdef __APPLE__
+#define GL_DO_NOT_WARN_IF_MULTI_GL_VERSION_HEADERS_INCLUDED 1
+#include <OpenGL/OpenGLAvailability.h>
+#include <OpenGL/gl.h>
+#include <OpenGL/gl3.h>
+#else
+
+#define GL_GLEXT_PROTOTYPES 1
+#define GL3_PROTOTYPES 1
+
+#include <GL/gl.h>
+#endif
+
+using namespace std;
+
+// Never have more than this many timer queries outstanding
+static const int MAX_QUERIES = 8;
+
+static const char* STAGE_NAMES[PROFILE_STAGE_COUNT] = {"readback", "copy", "gl_state"};
+
+static string formatTime(uint64_t us)
+{
+    char buf[32];
+    if (us < 1000)
+    {
+        snprintf(buf, sizeof(buf), "%dus", (int)us);
+    }
+    else
+    {
+        snprintf(buf, sizeof(buf), "%.1fms", (double)us / 1000.0);
+    }
+    return buf;
+}
+
+static string summarise(const char* name, const Histogram &histogram)
+{
+    if (histogram.getCount() == 0)
+    {
+        return string(name) + " -";
+    }
+    return string(name) +
+        " p50 " + formatTime(histogram.getPercentile(50)) +
+        " p99 " + formatTime(histogram.getPercentile(99)) +
+        " max " + formatTime(histogram.getMax());
+}
+
+void Profiler::beginFrame()
+{
+    if (!m_enabled)
+    {
+        return;
+    }
+
+    m_frameStart = chrono::steady_clock::now();
+    m_frameStages.fill(chrono::steady_clock::duration::zero());
+    m_inFrame = true;
+
+    collectQueries();
+
+    if (m_freeQueries.empty() && m_queryCount < MAX_QUERIES)
+    {
+        GLuint query;
+        glGenQueries(1, &query);
+        m_freeQueries.push_back(query);
+        m_queryCount++;
+    }
+
+    // Time elapsed queries don't nest, so if the sim or another plugin has one open
+    // this frame goes untimed rather than failing to begin and ending theirs
+    GLint currentQuery = 0;
+    glGetQueryiv(GL_TIME_ELAPSED, GL_CURRENT_QUERY, &currentQuery);
+
+    // If the GPU is that far behind, skip timing this frame rather than stalling on it
+    if (!m_freeQueries.empty() && currentQuery == 0)
+    {
+        m_activeQuery = m_freeQueries.back();
+        m_freeQueries.pop_back();
+        glBeginQuery(GL_TIME_ELAPSED, m_activeQuery);
+    }
+}
+
+void Profiler::endFrame()
+{
+    if (!m_inFrame)
+    {
+        return;
+    }
+    m_inFrame = false;
+
+    if (m_activeQuery != 0)
+    {
+        // Only wait for a result if ours is still the query that's open
+        GLint currentQuery = 0;
+        glGetQueryiv(GL_TIME_ELAPSED, GL_CURRENT_QUERY, &currentQuery);
+        if ((GLuint)currentQuery == m_activeQuery)
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            m_pendingQueries.push_back(m_activeQuery);
+        }
+        else
+        {
+            m_freeQueries.push_back(m_activeQuery);
+        }
+        m_activeQuery = 0;
+    }
+
+    auto frameTime = chrono::steady_clock::now() - m_frameStart;
+    m_frameCpu.record(chrono::duration_cast<chrono::microseconds>(frameTime).count());
+    for (int stage = 0; stage < PROFILE_STAGE_COUNT; stage++)
+    {
+        m_stages[stage].record(chrono::duration_cast<chrono::microseconds>(m_frameStages[stage]).count());
+    }
+}
+
+void Profiler::addStage(ProfileStage stage, chrono::steady_clock::duration time)
+{
+    if (m_inFrame)
+    {
+        m_frameStages[stage] += time;
+    }
+}
+
+void Profiler::collectQueries()
+{
+    while (!m_pendingQueries.empty())
+    {
+        auto query = m_pendingQueries.front();
+
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            // Results come back in order, so the rest won't be ready either
+            break;
+        }
+
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+        m_frameGpu.record(elapsed / 1000);
+
+        m_pendingQueries.pop_front();
+        m_freeQueries.push_back(query);
+    }
+}
+
+void Profiler::reset()
+{
+    m_frameCpu.reset();
+    m_frameGpu.reset();
+    for (auto& histogram : m_stages)
+    {
+        histogram.reset();
+    }
+    log(INFO, "reset: Profile cleared");
+}
+
+void Profiler::releaseQueries()
+{
+    if (!m_freeQueries.empty())
+    {
+        glDeleteQueries((GLsizei)m_freeQueries.size(), m_freeQueries.data());
+    }
+    for (auto query : m_pendingQueries)
+    {
+        glDeleteQueries(1, &query);
+    }
+    m_freeQueries.clear();
+    m_pendingQueries.clear();
+    m_queryCount = 0;
+}
+
+string Profiler::getCpuSummary() const
+{
+    return summarise("CPU", m_frameCpu);
+}
+
+string Profiler::getGpuSummary() const
+{
+    return summarise("GPU", m_frameGpu);
+}
+
+bool Profiler::writeCsv(const string &path)
+{
+    error_code ec;
+    filesystem::create_directories(filesystem::path(path).parent_path(), ec);
+
+    FILE* fp = fopen(path.c_str(), "w");
+    if (fp == nullptr)
+    {
+        log(ERROR, "writeCsv: Unable to open %s", path.c_str());
+        return false;
+    }
+
+    fprintf(fp, "metric,frames,mean_us,p50_us,p90_us,p99_us,p999_us,max_us\n");
+    auto writeRow = [fp](const string &name, const Histogram &histogram)
+    {
+        fprintf(fp, "%s,%llu,%.1f,%llu,%llu,%llu,%llu,%llu\n",
+            name.c_str(),
+            (unsigned long long)histogram.getCount(),
+            histogram.getMean(),
+            (unsigned long long)histogram.getPercentile(50),
+            (unsigned long long)histogram.getPercentile(90),
+            (unsigned long long)histogram.getPercentile(99),
+            (unsigned long long)histogram.getPercentile(99.9),
+            (unsigned long long)histogram.getMax());
+    };
+
+    writeRow("frame_cpu", m_frameCpu);
+    writeRow("frame_gpu", m_frameGpu);
+    for (int stage = 0; stage < PROFILE_STAGE_COUNT; stage++)
+    {
+        writeRow(string(STAGE_NAMES[stage]) + "_cpu", m_stages[stage]);
+    }
+    fclose(fp);
+
+    log(INFO, "writeCsv: Wrote %s", path.c_str());
+    return true;
+}
@@ -0,0 +1,101 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <array>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "histogram.h"
+#include "logger.h"
+
+enum ProfileStage
+{
+    PROFILE_READBACK,
+    PROFILE_COPY,
+    PROFILE_STATE,
+    PROFILE_STAGE_COUNT
+};
+
+/*
+ * Measures what XStream adds to each sim frame. The CPU time of the whole
+ * draw callback and of each stage under it is recorded, along with the GPU
+ * time from GL_TIME_ELAPSED queries, which are collected a few frames later
+ * so we never wait on them.
+ *
+ * Only used from the sim's main thread.
+ */
+class Profiler : private Logger
+{
+ private:
+    bool m_enabled;
+
+    Histogram m_frameCpu;
+    Histogram m_frameGpu;
+    std::array<Histogram, PROFILE_STAGE_COUNT> m_stages;
+
+    std::chrono::steady_clock::time_point m_frameStart;
+    std::array<std::chrono::steady_clock::duration, PROFILE_STAGE_COUNT> m_frameStages {};
+    bool m_inFrame = false;
+
+    // Timer queries waiting for their results, oldest first
+    std::vector<unsigned int> m_freeQueries;
+    std::deque<unsigned int> m_pendingQueries;
+    unsigned int m_activeQuery = 0;
+    int m_queryCount = 0;
+
+    void collectQueries();
+
+ public:
+    explicit Profiler(bool enabled) : Logger("Profiler"), m_enabled(enabled) {}
+    ~Profiler() override = default;
+
+    void beginFrame();
+    void endFrame();
+    void addStage(ProfileStage stage, std::chrono::steady_clock::duration time);
+
+    void reset();
+
+    // Deletes the timer queries, must be called with the sim's GL context current
+    void releaseQueries();
+
+    // One line summaries for the menu, e.g. "CPU p50 12us p99 840us max 2.1ms"
+    [[nodiscard]] std::string getCpuSummary() const;
+    [[nodiscard]] std::string getGpuSummary() const;
+
+    bool writeCsv(const std::string &path);
+
+    [[nodiscard]] bool isEnabled() const { return m_enabled; }
+};
+
+// Adds the time it was in scope to a stage of the current frame, if there's a profiler
+class ProfileTimer
+{
+ private:
+    Profiler* m_profiler;
+    ProfileStage m_stage;
+    std::chrono::steady_clock::time_point m_start;
+
+ public:
+    ProfileTimer(Profiler* profiler, ProfileStage stage) :
+        m_profiler(profiler),
+        m_stage(stage),
+        m_start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~ProfileTimer()
+    {
+        if (m_profiler != nullptr)
+        {
+            m_profiler->addStage(m_stage, std::chrono::steady_clock::now() - m_start);
+        }
+    }
+};
+
+#endif //PROFILER_H
@@ -0,0 +1,137 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "recorder.h"
+#include "config.h"
+#include "displaymanager.h"
+#include "keyframedropper.h"
+
+#include <algorithm>
+#include <ctime>
+#include <filesystem>
+
+using namespace std;
+
+// Size of the buffered writes to the file
+static const guint WRITE_BUFFER_SIZE = 4 * 1024 * 1024;
+
+// Length of each fragment of a fragmented MP4, in milliseconds
+static const guint FRAGMENT_DURATION = 1000;
+
+// How far behind a slow disk can get before frames are dropped
+static const guint64 QUEUE_MAX_TIME = 5 * GST_SECOND;
+static const guint QUEUE_MAX_BYTES = 64 * 1024 * 1024;
+
+Recorder::Recorder(const RecordingConfig& config) : Logger("Recorder"), m_config(config)
+{
+}
+
+bool Recorder::start()
+{
+    if (!m_config.enabled)
+    {
+        return true;
+    }
+
+    error_code ec;
+    filesystem::create_directories(m_config.path, ec);
+    if (ec)
+    {
+        log(ERROR, "start: Unable to create %s: %s", m_config.path.c_str(), ec.message().c_str());
+        return false;
+    }
+
+    char timeStr[64];
+    time_t t = time(nullptr);
+    tm tm;
+    localtime_r(&t, &tm);
+    strftime(timeStr, sizeof(timeStr), "%Y%m%d_%H%M%S", &tm);
+    m_session = timeStr;
+
+    log(INFO, "start: Recording to %s, session %s", m_config.path.c_str(), m_session.c_str());
+    return true;
+}
+
+bool Recorder::isRecording(const shared_ptr<Display> &display) const
+{
+    if (!m_config.enabled)
+    {
+        return false;
+    }
+    if (m_config.displays.empty())
+    {
+        return true;
+    }
+    return find(m_config.displays.begin(), m_config.displays.end(), display->name) != m_config.displays.end();
+}
+
+string Recorder::getLaunch(Codec codec) const
+{
+    string launch = " enctee. ! ";
+
+    // A slow disk drops whole GOPs instead of blocking the tee, see configure
+    launch += "queue name=recqueue ! ";
+
+    if (codec == CODEC_H264)
+    {
+        launch += "h264parse ! ";
+    }
+
+    launch += "splitmuxsink name=recsink";
+    return launch;
+}
+
+void Recorder::configure(GstElement* element, const shared_ptr<Display> &display, Codec codec)
+{
+    auto recQueue = gst_bin_get_by_name_recurse_up(GST_BIN(element), "recqueue");
+    if (recQueue != nullptr)
+    {
+        KeyFrameDropper::attach(recQueue, display->name + " recording", QUEUE_MAX_TIME, QUEUE_MAX_BYTES);
+        gst_object_unref(recQueue);
+    }
+
+    auto recSink = gst_bin_get_by_name_recurse_up(GST_BIN(element), "recsink");
+    if (recSink == nullptr)
+    {
+        return;
+    }
+
+    // Only H264 can go in to MP4, use Matroska for anything else
+    string format = m_config.format;
+    if (codec != CODEC_H264 && format == "mp4")
+    {
+        log(WARN, "configure: %s: MJPEG can't be recorded to MP4, using Matroska", display->name.c_str());
+        format = "mkv";
+    }
+
+    GstElement* muxer;
+    if (format == "mp4")
+    {
+        // Fragmented, so everything up to the last fragment survives a crash
+        muxer = gst_element_factory_make("mp4mux", nullptr);
+        g_object_set(G_OBJECT(muxer), "fragment-duration", FRAGMENT_DURATION, nullptr);
+    }
+    else
+    {
+        muxer = gst_element_factory_make("matroskamux", nullptr);
+    }
+
+    auto fileSink = gst_element_factory_make("filesink", nullptr);
+    gst_util_set_object_arg(G_OBJECT(fileSink), "buffer-mode", "full");
+    g_object_set(G_OBJECT(fileSink), "buffer-size", WRITE_BUFFER_SIZE, nullptr);
+
+    string location = m_config.path + "/" + display->name + "_" + m_session + "_%05d." + format;
+    g_object_set(G_OBJECT(recSink),
+        "location", location.c_str(),
+        "muxer", muxer,
+        "sink", fileSink,
+        "max-size-time", (guint64)m_config.segmentTime * GST_SECOND,
+        "max-size-bytes", (guint64)m_config.segmentSize * 1024 * 1024,
+        "send-keyframe-requests", m_config.segmentTime > 0,
+        nullptr);
+
+    log(DEBUG, "configure: %s: Recording to %s", display->name.c_str(), location.c_str());
+
+    gst_object_unref(recSink);
+}
@@ -0,0 +1,47 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <memory>
+#include <string>
+
+#include <gst/gst.h>
+
+#include "logger.h"
+#include "videostream.h"
+
+struct Display;
+struct RecordingConfig;
+
+/*
+ * Records the already encoded output of a display pipeline to disk.
+ *
+ * The recording branch hangs off a tee after the encoder and starts with a
+ * queue, so its streaming thread does all the disk I/O. A slow disk only ever
+ * drops recorded frames, a GOP at a time so the file can still be decoded. It
+ * never holds up the sim or the live streams.
+ */
+class Recorder : private Logger
+{
+ private:
+    const RecordingConfig& m_config;
+    std::string m_session;
+
+ public:
+    explicit Recorder(const RecordingConfig& config);
+    ~Recorder() override = default;
+
+    bool start();
+
+    [[nodiscard]] bool isRecording(const std::shared_ptr<Display> &display) const;
+
+    // Launch string for the branch hanging off the tee named "enctee"
+    [[nodiscard]] std::string getLaunch(Codec codec) const;
+
+    void configure(GstElement* element, const std::shared_ptr<Display> &display, Codec codec);
+};
+
+#endif //RECORDER_H
@@ -0,0 +1,235 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "replaytexturesource.h"
+#include "config.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+ReplayTextureSource::~ReplayTextureSource()
+{
+    close();
+}
+
+bool ReplayTextureSource::open()
+{
+    close();
+
+    for (const auto& pattern : m_config.files)
+    {
+        if (!openTexture(pattern))
+        {
+            close();
+            return false;
+        }
+    }
+
+    log(INFO, "open: %zu textures, %.1f fps", m_textures.size(), m_config.fps);
+    return !m_textures.empty();
+}
+
+void ReplayTextureSource::close()
+{
+    for (auto& texture : m_textures)
+    {
+        for (auto& frame : texture.frames)
+        {
+            if (frame.data != nullptr)
+            {
+                munmap(frame.data, frame.size);
+            }
+            if (frame.fd != -1)
+            {
+                ::close(frame.fd);
+            }
+        }
+    }
+    m_textures.clear();
+}
+
+bool ReplayTextureSource::openTexture(const string &pattern)
+{
+    glob_t globResult;
+    int res = glob(pattern.c_str(), 0, nullptr, &globResult);
+    if (res != 0)
+    {
+        log(ERROR, "openTexture: %s: No matching files", pattern.c_str());
+        return false;
+    }
+
+    // glob sorts, so numbered dumps play back in order
+    ReplayTexture texture;
+    for (size_t i = 0; i < globResult.gl_pathc; i++)
+    {
+        ReplayFrame frame;
+        frame.path = globResult.gl_pathv[i];
+        texture.frames.push_back(frame);
+    }
+    globfree(&globResult);
+
+    // Add it straight away so close() cleans up anything we've mapped
+    m_textures.push_back(texture);
+    auto& replayTexture = m_textures.back();
+
+    for (auto& frame : replayTexture.frames)
+    {
+        if (!mapFrame(frame))
+        {
+            return false;
+        }
+
+        int width = m_config.width;
+        int height = m_config.height;
+        if (width == 0 || height == 0)
+        {
+            // Dumps don't have a header, assume they're square
+            width = (int)sqrt((double)frame.size / 4);
+            height = width;
+        }
+
+        if ((size_t)width * height * 4 != frame.size)
+        {
+            log(ERROR, "openTexture: %s: Size %zu doesn't match %dx%d", frame.path.c_str(), frame.size, width, height);
+            return false;
+        }
+
+        if (replayTexture.width == 0)
+        {
+            replayTexture.width = width;
+            replayTexture.height = height;
+        }
+        else if (replayTexture.width != width || replayTexture.height != height)
+        {
+            log(ERROR, "openTexture: %s: All frames in a sequence must be the same size", frame.path.c_str());
+            return false;
+        }
+    }
+
+    log(DEBUG, "openTexture: %d: %s: %zu frames, %dx%d", (int)m_textures.size(), pattern.c_str(), replayTexture.frames.size(), replayTexture.width, replayTexture.height);
+    return true;
+}
+
+bool ReplayTextureSource::mapFrame(ReplayFrame &frame)
+{
+    frame.fd = ::open(frame.path.c_str(), O_RDONLY);
+    if (frame.fd == -1)
+    {
+        log(ERROR, "mapFrame: %s: %s", frame.path.c_str(), strerror(errno));
+        return false;
+    }
+
+    struct stat st = {};
+    if (fstat(frame.fd, &st) != 0 || st.st_size == 0)
+    {
+        log(ERROR, "mapFrame: %s: Unable to get size", frame.path.c_str());
+        return false;
+    }
+    frame.size = st.st_size;
+
+    void* data = mmap(nullptr, frame.size, PROT_READ, MAP_PRIVATE, frame.fd, 0);
+    if (data == MAP_FAILED)
+    {
+        log(ERROR, "mapFrame: %s: mmap failed: %s", frame.path.c_str(), strerror(errno));
+        return false;
+    }
+    frame.data = static_cast<uint8_t*>(data);
+
+    // We'll read every page of it, over and over again
+    madvise(frame.data, frame.size, MADV_WILLNEED);
+
+    return true;
+}
+
+vector<int> ReplayTextureSource::listTextures()
+{
+    vector<int> textures;
+    for (int i = 0; i < (int)m_textures.size(); i++)
+    {
+        textures.push_back(i + 1);
+    }
+    return textures;
+}
+
+bool ReplayTextureSource::getTextureSize(int textureNum, int &width, int &height)
+{
+    if (textureNum < 1 || textureNum > (int)m_textures.size())
+    {
+        return false;
+    }
+    auto& texture = m_textures.at(textureNum - 1);
+    width = texture.width;
+    height = texture.height;
+    return true;
+}
+
+bool ReplayTextureSource::readTexture(int textureNum, uint8_t* buffer, float now)
+{
+    if (textureNum < 1 || textureNum > (int)m_textures.size())
+    {
+        return false;
+    }
+    auto& texture = m_textures.at(textureNum - 1);
+
+    auto frameNum = (size_t)(now * m_config.fps) % texture.frames.size();
+    const auto& frame = texture.frames.at(frameNum);
+    memcpy(buffer, frame.data, frame.size);
+    return true;
+}
+
+bool ReplayTextureSource::readRegion(int textureNum, int x, int y, int width, int height, int scale, uint8_t* buffer, float now)
+{
+    if (textureNum < 1 || textureNum > (int)m_textures.size())
+    {
+        return false;
+    }
+    auto& texture = m_textures.at(textureNum - 1);
+    if (x < 0 || y < 0 || x + width > texture.width || y + height > texture.height)
+    {
+        return false;
+    }
+
+    auto frameNum = (size_t)(now * m_config.fps) % texture.frames.size();
+    const auto& frame = texture.frames.at(frameNum);
+
+    size_t srcStride = texture.width * 4;
+    const uint8_t* src = frame.data + y * srcStride + x * 4;
+    if (scale <= 1)
+    {
+        size_t dstStride = width * 4;
+        for (int row = 0; row < height; row++)
+        {
+            memcpy(buffer + row * dstStride, src + row * srcStride, dstStride);
+        }
+        return true;
+    }
+
+    // Just take every scale'th pixel
+    int scaledWidth = width / scale;
+    int scaledHeight = height / scale;
+    auto dst = reinterpret_cast<uint32_t*>(buffer);
+    for (int row = 0; row < scaledHeight; row++)
+    {
+        auto srcRow = reinterpret_cast<const uint32_t*>(src + row * scale * srcStride);
+        for (int col = 0; col < scaledWidth; col++)
+        {
+            *(dst++) = srcRow[col * scale];
+        }
+    }
+    return true;
+}
+
+float ReplayTextureSource::getUpdateInterval() const
+{
+    return 1.0f / m_config.fps;
+}
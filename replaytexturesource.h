@@ -0,0 +1,60 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef REPLAYTEXTURESOURCE_H
+#define REPLAYTEXTURESOURCE_H
+
+#include <string>
+#include <vector>
+
+#include "logger.h"
+#include "texturesource.h"
+
+struct ReplayConfig;
+
+struct ReplayFrame
+{
+    std::string path;
+    int fd = -1;
+    uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+struct ReplayTexture
+{
+    int width = 0;
+    int height = 0;
+    std::vector<ReplayFrame> frames;
+};
+
+/*
+ * Plays back raw RGBA texture dumps (dump/texture_<icao>_<n>.dat) instead of
+ * reading from GL. Each configured entry is one texture, a glob pattern that
+ * matches several files is played back as a sequence at the configured rate.
+ * Texture numbers are the entries' positions in the list, starting at 1.
+ */
+class ReplayTextureSource : public TextureSource, private Logger
+{
+ private:
+    const ReplayConfig& m_config;
+    std::vector<ReplayTexture> m_textures;
+
+    bool openTexture(const std::string &pattern);
+    bool mapFrame(ReplayFrame &frame);
+
+ public:
+    explicit ReplayTextureSource(const ReplayConfig& config) : Logger("ReplayTextureSource"), m_config(config) {}
+    ~ReplayTextureSource() override;
+
+    bool open();
+    void close();
+
+    std::vector<int> listTextures() override;
+    bool getTextureSize(int textureNum, int &width, int &height) override;
+    bool readTexture(int textureNum, uint8_t* buffer, float now) override;
+    bool readRegion(int textureNum, int x, int y, int width, int height, int scale, uint8_t* buffer, float now) override;
+    [[nodiscard]] float getUpdateInterval() const override;
+};
+
+#endif //REPLAYTEXTURESOURCE_H
@@ -0,0 +1,397 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "rfbclient.h"
+#include "displaymanager.h"
+#include "rfbencoder.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+// How long to wait for the viewer to say something when it hasn't asked for anything
+static const int POLL_TIMEOUT_MS = 100;
+
+// How long to wait for a new frame before checking for messages from the viewer again
+static const chrono::milliseconds FRAME_WAIT(50);
+
+// Client to server message types
+static const uint8_t RFB_SET_PIXEL_FORMAT = 0;
+static const uint8_t RFB_SET_ENCODINGS = 2;
+static const uint8_t RFB_FRAMEBUFFER_UPDATE_REQUEST = 3;
+static const uint8_t RFB_KEY_EVENT = 4;
+static const uint8_t RFB_POINTER_EVENT = 5;
+static const uint8_t RFB_CLIENT_CUT_TEXT = 6;
+
+static const uint8_t RFB_SECURITY_NONE = 1;
+
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+// macOS uses SO_NOSIGPIPE on the socket instead
+static const int SEND_FLAGS = 0;
+#endif
+
+static uint32_t get32(const uint8_t* data)
+{
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+RfbClient::RfbClient(int socket, const string &address, const shared_ptr<Display> &display, const shared_ptr<WorkerPool> &pool, int compressionLevel) :
+    Logger("RfbClient"),
+    m_socket(socket),
+    m_address(address),
+    m_display(display)
+{
+    m_encoder = make_shared<RfbEncoder>(pool, display->width, display->height, compressionLevel);
+}
+
+RfbClient::~RfbClient()
+{
+    stop();
+    close(m_socket);
+}
+
+void RfbClient::start()
+{
+    m_running = true;
+    m_thread = make_shared<thread>(&RfbClient::clientMain, this);
+}
+
+void RfbClient::stop()
+{
+    if (m_thread == nullptr)
+    {
+        return;
+    }
+
+    // Wakes the thread up if it's blocked on the socket
+    m_running = false;
+    shutdown(m_socket, SHUT_RDWR);
+    m_thread->join();
+    m_thread = nullptr;
+}
+
+void RfbClient::clientMain()
+{
+    if (handshake())
+    {
+        log(INFO, "clientMain: %s: Watching %s", m_address.c_str(), m_display->name.c_str());
+        while (m_running)
+        {
+            // Deal with anything the viewer has sent first
+            pollfd pfd = {m_socket, POLLIN, 0};
+            int res = poll(&pfd, 1, m_updateRequested ? 0 : POLL_TIMEOUT_MS);
+            if (res < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                break;
+            }
+            if (res > 0)
+            {
+                if (!readMessage())
+                {
+                    break;
+                }
+                continue;
+            }
+
+            if (m_updateRequested && waitForFrame() && !sendUpdate())
+            {
+                break;
+            }
+        }
+    }
+
+    log(INFO, "clientMain: %s: Disconnected from %s", m_address.c_str(), m_display->name.c_str());
+    m_finished = true;
+}
+
+bool RfbClient::handshake()
+{
+    const char* version = "RFB 003.008\n";
+    if (!writeFully(version, 12))
+    {
+        return false;
+    }
+
+    char clientVersion[13] = {};
+    int major;
+    int minor;
+    if (!readFully(clientVersion, 12))
+    {
+        return false;
+    }
+    if (sscanf(clientVersion, "RFB %03d.%03d", &major, &minor) != 2 || major != 3)
+    {
+        log(WARN, "handshake: %s: Unsupported version: %.11s", m_address.c_str(), clientVersion);
+        return false;
+    }
+
+    // Anything we don't know about is treated as 3.3
+    m_minorVersion = minor >= 8 ? 8 : (minor == 7 ? 7 : 3);
+
+    // No authentication, the same as the RTSP server
+    if (m_minorVersion == 3)
+    {
+        uint8_t security[4] = {0, 0, 0, RFB_SECURITY_NONE};
+        if (!writeFully(security, sizeof(security)))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        uint8_t securityTypes[2] = {1, RFB_SECURITY_NONE};
+        uint8_t chosen;
+        if (!writeFully(securityTypes, sizeof(securityTypes)) || !readFully(&chosen, 1))
+        {
+            return false;
+        }
+        if (chosen != RFB_SECURITY_NONE)
+        {
+            log(WARN, "handshake: %s: Unsupported security type: %d", m_address.c_str(), chosen);
+            return false;
+        }
+        if (m_minorVersion == 8)
+        {
+            uint8_t result[4] = {0, 0, 0, 0};
+            if (!writeFully(result, sizeof(result)))
+            {
+                return false;
+            }
+        }
+    }
+
+    // ClientInit, everybody shares the display anyway
+    uint8_t shared;
+    if (!readFully(&shared, 1))
+    {
+        return false;
+    }
+
+    // ServerInit
+    const string& name = m_display->name;
+    vector<uint8_t> serverInit(24 + name.size());
+    serverInit[0] = m_display->width >> 8;
+    serverInit[1] = m_display->width & 0xff;
+    serverInit[2] = m_display->height >> 8;
+    serverInit[3] = m_display->height & 0xff;
+    RfbPixelFormat::native().write(serverInit.data() + 4);
+    serverInit[20] = 0;
+    serverInit[21] = 0;
+    serverInit[22] = (name.size() >> 8) & 0xff;
+    serverInit[23] = name.size() & 0xff;
+    memcpy(serverInit.data() + 24, name.data(), name.size());
+    if (!writeFully(serverInit.data(), serverInit.size()))
+    {
+        return false;
+    }
+
+    log(DEBUG, "handshake: %s: RFB 3.%d", m_address.c_str(), m_minorVersion);
+    return true;
+}
+
+bool RfbClient::readMessage()
+{
+    uint8_t type;
+    if (!readFully(&type, 1))
+    {
+        return false;
+    }
+
+    switch (type)
+    {
+        case RFB_SET_PIXEL_FORMAT:
+        {
+            uint8_t data[19];
+            if (!readFully(data, sizeof(data)))
+            {
+                return false;
+            }
+
+            RfbPixelFormat format;
+            format.read(data + 3);
+            if (!format.trueColour || (format.bitsPerPixel != 8 && format.bitsPerPixel != 16 && format.bitsPerPixel != 32))
+            {
+                log(WARN, "readMessage: %s: Unsupported pixel format: %d bpp, true colour=%d", m_address.c_str(), format.bitsPerPixel, format.trueColour);
+                return false;
+            }
+            m_encoder->setPixelFormat(format);
+            break;
+        }
+
+        case RFB_SET_ENCODINGS:
+        {
+            uint8_t header[3];
+            if (!readFully(header, sizeof(header)))
+            {
+                return false;
+            }
+
+            int count = (header[1] << 8) | header[2];
+            vector<uint8_t> data(count * 4);
+            if (!readFully(data.data(), data.size()))
+            {
+                return false;
+            }
+
+            vector<int32_t> encodings;
+            for (int i = 0; i < count; i++)
+            {
+                encodings.push_back((int32_t)get32(data.data() + i * 4));
+            }
+            m_encoder->setEncodings(encodings);
+            break;
+        }
+
+        case RFB_FRAMEBUFFER_UPDATE_REQUEST:
+        {
+            // We always send changes for the whole display, whatever area was asked for
+            uint8_t data[9];
+            if (!readFully(data, sizeof(data)))
+            {
+                return false;
+            }
+            m_updateRequested = true;
+            if (data[0] == 0)
+            {
+                m_fullUpdateRequested = true;
+            }
+            break;
+        }
+
+        case RFB_KEY_EVENT:
+            return skip(7);
+
+        case RFB_POINTER_EVENT:
+            return skip(5);
+
+        case RFB_CLIENT_CUT_TEXT:
+        {
+            uint8_t header[7];
+            if (!readFully(header, sizeof(header)))
+            {
+                return false;
+            }
+            return skip(get32(header + 3));
+        }
+
+        default:
+            log(WARN, "readMessage: %s: Unknown message type: %d", m_address.c_str(), type);
+            return false;
+    }
+    return true;
+}
+
+bool RfbClient::waitForFrame()
+{
+    unique_lock lock(m_display->mutex);
+    bool ready = m_display->frameCond.wait_for(lock, FRAME_WAIT, [this]()
+    {
+        return m_fullUpdateRequested || m_display->frameSeq != m_lastFrameSeq || !m_running;
+    });
+    if (!ready || !m_running)
+    {
+        return false;
+    }
+
+    // Take a copy so the sim isn't kept waiting on the lock while we encode
+    size_t size = (size_t)m_display->width * m_display->height * 4;
+    m_frame.resize(size);
+    if (m_display->buffer != nullptr)
+    {
+        memcpy(m_frame.data(), m_display->buffer, size);
+    }
+    else
+    {
+        fill(m_frame.begin(), m_frame.end(), 0);
+    }
+    m_lastFrameSeq = m_display->frameSeq;
+    return true;
+}
+
+bool RfbClient::sendUpdate()
+{
+    if (m_fullUpdateRequested)
+    {
+        m_encoder->refresh();
+    }
+
+    m_update.clear();
+    if (!m_encoder->encode(m_frame.data(), m_update))
+    {
+        // Nothing has changed, wait for the next frame
+        return true;
+    }
+    m_updateRequested = false;
+    m_fullUpdateRequested = false;
+
+    return writeFully(m_update.data(), m_update.size());
+}
+
+bool RfbClient::readFully(void* data, size_t length)
+{
+    auto ptr = static_cast<uint8_t*>(data);
+    while (length > 0)
+    {
+        auto res = recv(m_socket, ptr, length, 0);
+        if (res < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (res <= 0)
+        {
+            return false;
+        }
+        ptr += res;
+        length -= res;
+    }
+    return true;
+}
+
+bool RfbClient::skip(size_t length)
+{
+    uint8_t buffer[256];
+    while (length > 0)
+    {
+        size_t chunk = min(length, sizeof(buffer));
+        if (!readFully(buffer, chunk))
+        {
+            return false;
+        }
+        length -= chunk;
+    }
+    return true;
+}
+
+bool RfbClient::writeFully(const void* data, size_t length)
+{
+    auto ptr = static_cast<const uint8_t*>(data);
+    while (length > 0)
+    {
+        auto res = send(m_socket, ptr, length, SEND_FLAGS);
+        if (res < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (res <= 0)
+        {
+            return false;
+        }
+        ptr += res;
+        length -= res;
+    }
+    return true;
+}
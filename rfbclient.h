@@ -0,0 +1,66 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef RFBCLIENT_H
+#define RFBCLIENT_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logger.h"
+
+struct Display;
+class RfbEncoder;
+class WorkerPool;
+
+/*
+ * One VNC viewer watching one display. Each client has its own thread, which
+ * speaks RFB 3.3 to 3.8 with no authentication, ignores any input and sends
+ * the tiles that have changed whenever the viewer asks for an update and a
+ * new frame has been captured.
+ */
+class RfbClient : private Logger
+{
+ private:
+    int m_socket;
+    std::string m_address;
+    std::shared_ptr<Display> m_display;
+    std::shared_ptr<RfbEncoder> m_encoder;
+
+    std::shared_ptr<std::thread> m_thread;
+    std::atomic<bool> m_running = false;
+    std::atomic<bool> m_finished = false;
+
+    int m_minorVersion = 8;
+    bool m_updateRequested = false;
+    bool m_fullUpdateRequested = false;
+    uint64_t m_lastFrameSeq = 0;
+    std::vector<uint8_t> m_frame;
+    std::vector<uint8_t> m_update;
+
+    void clientMain();
+    bool handshake();
+    bool readMessage();
+    bool waitForFrame();
+    bool sendUpdate();
+
+    bool readFully(void* data, size_t length);
+    bool skip(size_t length);
+    bool writeFully(const void* data, size_t length);
+
+ public:
+    RfbClient(int socket, const std::string &address, const std::shared_ptr<Display> &display, const std::shared_ptr<WorkerPool> &pool, int compressionLevel);
+    ~RfbClient() override;
+
+    void start();
+    void stop();
+
+    [[nodiscard]] bool isFinished() const { return m_finished; }
+    [[nodiscard]] const std::shared_ptr<Display>& getDisplay() const { return m_display; }
+};
+
+#endif //RFBCLIENT_H
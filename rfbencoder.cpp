@@ -0,0 +1,538 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "rfbencoder.h"
+#include "workerpool.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+// ZRLE's tile size, which we use for change detection with raw too
+static const int TILE_SIZE = 64;
+
+// The most colours a ZRLE palette can have
+static const int MAX_PALETTE = 127;
+
+// ZRLE tile subencodings
+static const uint8_t ZRLE_RAW = 0;
+static const uint8_t ZRLE_SOLID = 1;
+static const uint8_t ZRLE_PLAIN_RLE = 128;
+
+static void put16(vector<uint8_t> &out, uint16_t value)
+{
+    out.push_back(value >> 8);
+    out.push_back(value & 0xff);
+}
+
+static void put32(vector<uint8_t> &out, uint32_t value)
+{
+    out.push_back(value >> 24);
+    out.push_back((value >> 16) & 0xff);
+    out.push_back((value >> 8) & 0xff);
+    out.push_back(value & 0xff);
+}
+
+static void putRunLength(vector<uint8_t> &out, int length)
+{
+    int remaining = length - 1;
+    while (remaining >= 255)
+    {
+        out.push_back(255);
+        remaining -= 255;
+    }
+    out.push_back(remaining);
+}
+
+static int findColour(const uint32_t* palette, int paletteSize, uint32_t pixel)
+{
+    for (int i = 0; i < paletteSize; i++)
+    {
+        if (palette[i] == pixel)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void RfbPixelFormat::read(const uint8_t* data)
+{
+    bitsPerPixel = data[0];
+    depth = data[1];
+    bigEndian = data[2] != 0;
+    trueColour = data[3] != 0;
+    redMax = (data[4] << 8) | data[5];
+    greenMax = (data[6] << 8) | data[7];
+    blueMax = (data[8] << 8) | data[9];
+    redShift = data[10];
+    greenShift = data[11];
+    blueShift = data[12];
+}
+
+void RfbPixelFormat::write(uint8_t* data) const
+{
+    data[0] = bitsPerPixel;
+    data[1] = depth;
+    data[2] = bigEndian ? 1 : 0;
+    data[3] = trueColour ? 1 : 0;
+    data[4] = redMax >> 8;
+    data[5] = redMax & 0xff;
+    data[6] = greenMax >> 8;
+    data[7] = greenMax & 0xff;
+    data[8] = blueMax >> 8;
+    data[9] = blueMax & 0xff;
+    data[10] = redShift;
+    data[11] = greenShift;
+    data[12] = blueShift;
+    memset(data + 13, 0, 3);
+}
+
+RfbEncoder::RfbEncoder(const shared_ptr<WorkerPool> &pool, int width, int height, int compressionLevel) :
+    Logger("RfbEncoder"),
+    m_pool(pool),
+    m_width(width),
+    m_height(height),
+    m_compressionLevel(compressionLevel)
+{
+    m_tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    m_tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    m_tiles.resize(m_tilesX * m_tilesY);
+    m_previous.resize((size_t)width * height * 4);
+    setPixelFormat(RfbPixelFormat::native());
+}
+
+RfbEncoder::~RfbEncoder()
+{
+    if (m_zstreamInit)
+    {
+        deflateEnd(&m_zstream);
+    }
+}
+
+void RfbEncoder::setPixelFormat(const RfbPixelFormat &format)
+{
+    m_format = format;
+    m_bytesPerPixel = format.bitsPerPixel / 8;
+
+    // ZRLE drops the unused byte of 32 bit pixels when the colours fit in the other three
+    m_cpixelSize = m_bytesPerPixel;
+    m_cpixelOffset = 0;
+    if (format.bitsPerPixel == 32 && format.depth <= 24 && format.trueColour)
+    {
+        uint32_t mask = ((uint32_t)format.redMax << format.redShift) |
+            ((uint32_t)format.greenMax << format.greenShift) |
+            ((uint32_t)format.blueMax << format.blueShift);
+        if ((mask & 0xff000000) == 0)
+        {
+            m_cpixelSize = 3;
+            m_cpixelOffset = format.bigEndian ? 1 : 0;
+        }
+        else if ((mask & 0x000000ff) == 0)
+        {
+            m_cpixelSize = 3;
+            m_cpixelOffset = format.bigEndian ? 0 : 1;
+        }
+    }
+
+    log(DEBUG, "setPixelFormat: bpp=%d, depth=%d, bigEndian=%d, shifts=%d/%d/%d, cpixel=%d",
+        format.bitsPerPixel, format.depth, format.bigEndian, format.redShift, format.greenShift, format.blueShift, m_cpixelSize);
+
+    // Everything the client has is in the wrong format now
+    m_refresh = true;
+}
+
+void RfbEncoder::setEncodings(const vector<int32_t> &encodings)
+{
+    m_zrle = false;
+    for (auto encoding : encodings)
+    {
+        if (encoding == RFB_ENCODING_ZRLE)
+        {
+            m_zrle = true;
+            break;
+        }
+        if (encoding == RFB_ENCODING_RAW)
+        {
+            break;
+        }
+    }
+
+    if (m_zrle && !m_zstreamInit)
+    {
+        if (deflateInit(&m_zstream, m_compressionLevel) != Z_OK)
+        {
+            log(ERROR, "setEncodings: Failed to initialise zlib, using raw");
+            m_zrle = false;
+            return;
+        }
+        m_zstreamInit = true;
+    }
+    log(DEBUG, "setEncodings: %s", m_zrle ? "ZRLE" : "raw");
+}
+
+uint32_t RfbEncoder::toPixel(const uint8_t* rgba) const
+{
+    uint32_t r = rgba[0];
+    uint32_t g = rgba[1];
+    uint32_t b = rgba[2];
+    if (m_format.redMax != 255)
+    {
+        r = (r * m_format.redMax + 127) / 255;
+    }
+    if (m_format.greenMax != 255)
+    {
+        g = (g * m_format.greenMax + 127) / 255;
+    }
+    if (m_format.blueMax != 255)
+    {
+        b = (b * m_format.blueMax + 127) / 255;
+    }
+    return (r << m_format.redShift) | (g << m_format.greenShift) | (b << m_format.blueShift);
+}
+
+void RfbEncoder::writePixel(vector<uint8_t> &out, uint32_t pixel) const
+{
+    for (int i = 0; i < m_bytesPerPixel; i++)
+    {
+        int byte = m_format.bigEndian ? m_bytesPerPixel - 1 - i : i;
+        out.push_back((pixel >> (byte * 8)) & 0xff);
+    }
+}
+
+void RfbEncoder::writeCPixel(vector<uint8_t> &out, uint32_t pixel) const
+{
+    if (m_cpixelSize != 3)
+    {
+        writePixel(out, pixel);
+        return;
+    }
+
+    // Three of the four bytes the full pixel would have been sent as
+    for (int i = m_cpixelOffset; i < m_cpixelOffset + 3; i++)
+    {
+        int byte = m_format.bigEndian ? 3 - i : i;
+        out.push_back((pixel >> (byte * 8)) & 0xff);
+    }
+}
+
+bool RfbEncoder::encode(const uint8_t* rgba, vector<uint8_t> &out)
+{
+    // Each row of tiles is compared and encoded independently
+    m_pool->parallelFor(m_tilesY, [this, rgba](int tileY)
+    {
+        for (int tileX = 0; tileX < m_tilesX; tileX++)
+        {
+            encodeTile(tileX, tileY, rgba);
+        }
+    });
+    m_refresh = false;
+
+    // Raw sends each tile on its own, ZRLE joins runs of them along a row
+    int rectCount = 0;
+    for (int tileY = 0; tileY < m_tilesY; tileY++)
+    {
+        for (int tileX = 0; tileX < m_tilesX; tileX++)
+        {
+            bool dirty = m_tiles[tileY * m_tilesX + tileX].dirty;
+            bool runStart = tileX == 0 || !m_tiles[tileY * m_tilesX + tileX - 1].dirty;
+            if (dirty && (!m_zrle || runStart))
+            {
+                rectCount++;
+            }
+        }
+    }
+    if (rectCount == 0)
+    {
+        return false;
+    }
+
+    // FramebufferUpdate
+    out.push_back(0);
+    out.push_back(0);
+    put16(out, rectCount);
+
+    for (int tileY = 0; tileY < m_tilesY; tileY++)
+    {
+        int tileX = 0;
+        while (tileX < m_tilesX)
+        {
+            int first = tileY * m_tilesX + tileX;
+            if (!m_tiles[first].dirty)
+            {
+                tileX++;
+                continue;
+            }
+
+            int count = 1;
+            if (m_zrle)
+            {
+                while (tileX + count < m_tilesX && m_tiles[first + count].dirty)
+                {
+                    count++;
+                }
+            }
+
+            int x = tileX * TILE_SIZE;
+            int y = tileY * TILE_SIZE;
+            put16(out, x);
+            put16(out, y);
+            put16(out, min(count * TILE_SIZE, m_width - x));
+            put16(out, min(TILE_SIZE, m_height - y));
+            put32(out, m_zrle ? RFB_ENCODING_ZRLE : RFB_ENCODING_RAW);
+
+            if (m_zrle)
+            {
+                if (!deflateTiles(first, count, out))
+                {
+                    out.clear();
+                    return false;
+                }
+            }
+            else
+            {
+                const auto& data = m_tiles[first].data;
+                out.insert(out.end(), data.begin(), data.end());
+            }
+            tileX += count;
+        }
+    }
+    return true;
+}
+
+void RfbEncoder::encodeTile(int tileX, int tileY, const uint8_t* rgba)
+{
+    auto& tile = m_tiles[tileY * m_tilesX + tileX];
+    int x = tileX * TILE_SIZE;
+    int y = tileY * TILE_SIZE;
+    int width = min(TILE_SIZE, m_width - x);
+    int height = min(TILE_SIZE, m_height - y);
+    size_t rowBytes = (size_t)width * 4;
+
+    bool changed = m_refresh;
+    for (int row = 0; row < height && !changed; row++)
+    {
+        size_t offset = ((size_t)(y + row) * m_width + x) * 4;
+        changed = memcmp(rgba + offset, m_previous.data() + offset, rowBytes) != 0;
+    }
+    tile.dirty = changed;
+    if (!changed)
+    {
+        return;
+    }
+
+    uint32_t pixels[TILE_SIZE * TILE_SIZE];
+    for (int row = 0; row < height; row++)
+    {
+        size_t offset = ((size_t)(y + row) * m_width + x) * 4;
+        memcpy(m_previous.data() + offset, rgba + offset, rowBytes);
+        for (int col = 0; col < width; col++)
+        {
+            pixels[row * width + col] = toPixel(rgba + offset + col * 4);
+        }
+    }
+
+    tile.data.clear();
+    if (m_zrle)
+    {
+        encodeZrleTile(tile, pixels, width, height);
+    }
+    else
+    {
+        for (int i = 0; i < width * height; i++)
+        {
+            writePixel(tile.data, pixels[i]);
+        }
+    }
+}
+
+void RfbEncoder::encodeZrleTile(RfbTile &tile, const uint32_t* pixels, int width, int height) const
+{
+    int count = width * height;
+
+    // Work out what each subencoding would cost, runs can carry on from one row to the next
+    uint32_t palette[MAX_PALETTE];
+    int paletteSize = 0;
+    bool paletteFull = false;
+    size_t plainRleSize = 0;
+    size_t paletteRleSize = 0;
+    for (int i = 0; i < count; )
+    {
+        uint32_t pixel = pixels[i];
+        int length = 1;
+        while (i + length < count && pixels[i + length] == pixel)
+        {
+            length++;
+        }
+        size_t lengthBytes = (length - 1) / 255 + 1;
+        plainRleSize += m_cpixelSize + lengthBytes;
+        paletteRleSize += length == 1 ? 1 : 1 + lengthBytes;
+
+        if (!paletteFull && findColour(palette, paletteSize, pixel) < 0)
+        {
+            if (paletteSize < MAX_PALETTE)
+            {
+                palette[paletteSize++] = pixel;
+            }
+            else
+            {
+                paletteFull = true;
+            }
+        }
+        i += length;
+    }
+
+    auto& out = tile.data;
+    if (!paletteFull && paletteSize == 1)
+    {
+        out.push_back(ZRLE_SOLID);
+        writeCPixel(out, palette[0]);
+        return;
+    }
+
+    uint8_t subencoding = ZRLE_RAW;
+    size_t best = (size_t)count * m_cpixelSize;
+    int bits = 0;
+    if (!paletteFull)
+    {
+        if (paletteSize <= 16)
+        {
+            bits = paletteSize <= 2 ? 1 : (paletteSize <= 4 ? 2 : 4);
+            size_t packedSize = paletteSize * m_cpixelSize + height * ((width * bits + 7) / 8);
+            if (packedSize < best)
+            {
+                best = packedSize;
+                subencoding = paletteSize;
+            }
+        }
+        paletteRleSize += paletteSize * m_cpixelSize;
+        if (paletteRleSize < best)
+        {
+            best = paletteRleSize;
+            subencoding = ZRLE_PLAIN_RLE + paletteSize;
+        }
+    }
+    if (plainRleSize < best)
+    {
+        subencoding = ZRLE_PLAIN_RLE;
+    }
+
+    out.push_back(subencoding);
+    if (subencoding == ZRLE_RAW)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            writeCPixel(out, pixels[i]);
+        }
+    }
+    else if (subencoding < ZRLE_PLAIN_RLE)
+    {
+        // Packed palette, each row starts on a new byte
+        for (int i = 0; i < paletteSize; i++)
+        {
+            writeCPixel(out, palette[i]);
+        }
+        for (int row = 0; row < height; row++)
+        {
+            uint8_t byte = 0;
+            int used = 0;
+            for (int col = 0; col < width; col++)
+            {
+                byte = (byte << bits) | findColour(palette, paletteSize, pixels[row * width + col]);
+                used += bits;
+                if (used == 8)
+                {
+                    out.push_back(byte);
+                    byte = 0;
+                    used = 0;
+                }
+            }
+            if (used > 0)
+            {
+                out.push_back(byte << (8 - used));
+            }
+        }
+    }
+    else
+    {
+        bool usePalette = subencoding > ZRLE_PLAIN_RLE;
+        if (usePalette)
+        {
+            for (int i = 0; i < paletteSize; i++)
+            {
+                writeCPixel(out, palette[i]);
+            }
+        }
+        for (int i = 0; i < count; )
+        {
+            uint32_t pixel = pixels[i];
+            int length = 1;
+            while (i + length < count && pixels[i + length] == pixel)
+            {
+                length++;
+            }
+            if (usePalette)
+            {
+                auto index = (uint8_t)findColour(palette, paletteSize, pixel);
+                if (length == 1)
+                {
+                    out.push_back(index);
+                }
+                else
+                {
+                    out.push_back(index | 0x80);
+                    putRunLength(out, length);
+                }
+            }
+            else
+            {
+                writeCPixel(out, pixel);
+                putRunLength(out, length);
+            }
+            i += length;
+        }
+    }
+}
+
+bool RfbEncoder::deflateTiles(int first, int count, vector<uint8_t> &out)
+{
+    // Length of the zlib data, filled in at the end
+    size_t lengthPos = out.size();
+    out.resize(lengthPos + 4);
+
+    for (int i = 0; i < count; i++)
+    {
+        auto& data = m_tiles[first + i].data;
+        m_zstream.next_in = data.data();
+        m_zstream.avail_in = (uInt)data.size();
+
+        // The rectangle has to end on a byte boundary the client can decode up to
+        int flush = i == count - 1 ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+        do
+        {
+            size_t pos = out.size();
+            size_t space = max<size_t>(4096, deflateBound(&m_zstream, m_zstream.avail_in));
+            out.resize(pos + space);
+            m_zstream.next_out = out.data() + pos;
+            m_zstream.avail_out = (uInt)space;
+
+            int res = deflate(&m_zstream, flush);
+            out.resize(pos + space - m_zstream.avail_out);
+            if (res == Z_STREAM_ERROR)
+            {
+                log(ERROR, "deflateTiles: deflate failed");
+                return false;
+            }
+        }
+        while (m_zstream.avail_out == 0);
+    }
+
+    uint32_t length = out.size() - lengthPos - 4;
+    out[lengthPos] = length >> 24;
+    out[lengthPos + 1] = (length >> 16) & 0xff;
+    out[lengthPos + 2] = (length >> 8) & 0xff;
+    out[lengthPos + 3] = length & 0xff;
+    return true;
+}
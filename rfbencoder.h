@@ -0,0 +1,113 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef RFBENCODER_H
+#define RFBENCODER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <zlib.h>
+
+#include "logger.h"
+
+class WorkerPool;
+
+// RFB encoding numbers
+static const int32_t RFB_ENCODING_RAW = 0;
+static const int32_t RFB_ENCODING_ZRLE = 16;
+
+struct RfbPixelFormat
+{
+    uint8_t bitsPerPixel = 32;
+    uint8_t depth = 24;
+    bool bigEndian = false;
+    bool trueColour = true;
+    uint16_t redMax = 255;
+    uint16_t greenMax = 255;
+    uint16_t blueMax = 255;
+    uint8_t redShift = 0;
+    uint8_t greenShift = 8;
+    uint8_t blueShift = 16;
+
+    // Our RGBA buffers as they are in memory on a little endian machine
+    static RfbPixelFormat native() { return {}; }
+
+    void read(const uint8_t* data);
+    void write(uint8_t* data) const;
+};
+
+struct RfbTile
+{
+    bool dirty = false;
+
+    // The tile's ZRLE data, or raw pixels, before zlib
+    std::vector<uint8_t> data;
+};
+
+/*
+ * Turns RGBA frames in to RFB FramebufferUpdate messages for one client.
+ *
+ * The frame is split in to 64x64 tiles, the same as ZRLE's, and only the tiles
+ * that have changed since the last update sent to this client go out. Tiles
+ * are compared, converted to the client's pixel format and run length or
+ * palette encoded in parallel. Runs of changed tiles along a row are then
+ * sent as a single rectangle, deflated through the connection's one zlib
+ * stream, which ZRLE requires to be continuous and so can't be split up.
+ *
+ * Not thread safe, use one encoder per client. The pool can be shared.
+ */
+class RfbEncoder : private Logger
+{
+ private:
+    std::shared_ptr<WorkerPool> m_pool;
+    int m_width;
+    int m_height;
+
+    RfbPixelFormat m_format;
+    int m_bytesPerPixel = 4;
+    int m_cpixelSize = 3;
+    int m_cpixelOffset = 0;
+
+    bool m_zrle = false;
+    int m_compressionLevel;
+    z_stream m_zstream = {};
+    bool m_zstreamInit = false;
+
+    // The last frame this client was sent, to find the tiles that changed
+    std::vector<uint8_t> m_previous;
+    bool m_refresh = true;
+
+    int m_tilesX;
+    int m_tilesY;
+    std::vector<RfbTile> m_tiles;
+
+    [[nodiscard]] uint32_t toPixel(const uint8_t* rgba) const;
+    void writePixel(std::vector<uint8_t> &out, uint32_t pixel) const;
+    void writeCPixel(std::vector<uint8_t> &out, uint32_t pixel) const;
+
+    void encodeTile(int tileX, int tileY, const uint8_t* rgba);
+    void encodeZrleTile(RfbTile &tile, const uint32_t* pixels, int width, int height) const;
+    bool deflateTiles(int first, int count, std::vector<uint8_t> &out);
+
+ public:
+    RfbEncoder(const std::shared_ptr<WorkerPool> &pool, int width, int height, int compressionLevel);
+    ~RfbEncoder() override;
+
+    void setPixelFormat(const RfbPixelFormat &format);
+
+    // Picks the best encoding we support from the client's list, in the client's order of preference
+    void setEncodings(const std::vector<int32_t> &encodings);
+
+    // Send everything on the next update, not just what's changed
+    void refresh() { m_refresh = true; }
+
+    // Appends a FramebufferUpdate to out, returns false if nothing has changed
+    bool encode(const uint8_t* rgba, std::vector<uint8_t> &out);
+
+    [[nodiscard]] bool isZrle() const { return m_zrle; }
+};
+
+#endif //RFBENCODER_H
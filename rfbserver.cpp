@@ -0,0 +1,213 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "rfbserver.h"
+#include "displaymanager.h"
+#include "lifecyclemanager.h"
+#include "rfbclient.h"
+#include "streamhost.h"
+#include "threadpolicy.h"
+#include "workerpool.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+// How often to check for clients that have gone
+static const int POLL_TIMEOUT_MS = 250;
+
+RfbServer::~RfbServer()
+{
+    stop();
+}
+
+bool RfbServer::start()
+{
+    if (m_running)
+    {
+        log(DEBUG, "start: Already running!");
+        return true;
+    }
+
+    auto config = m_host->getConfig();
+    m_config = config->getRfb();
+
+    int port = m_config.port;
+    for (const auto& display : m_host->getDisplays())
+    {
+        int listener = listenOn(port);
+        if (listener < 0)
+        {
+            closeListeners();
+            return false;
+        }
+        log(INFO, "start: Serving %s on port %d", display->name.c_str(), port);
+        m_listeners.emplace_back(listener, display);
+        port++;
+    }
+
+    int threads = m_config.threads;
+    if (threads <= 0)
+    {
+        threads = clamp((int)thread::hardware_concurrency() / 2, 1, 4);
+    }
+    threads = config->getEncoderThreads(ENCODER_RFB, threads);
+
+    // The client thread calling in to the pool does a share of the work too
+    m_threadPolicy = make_shared<ThreadPolicy>(config->getScheduling());
+    m_pool = make_shared<WorkerPool>(threads - 1, m_threadPolicy);
+
+    m_running = true;
+    m_thread = make_shared<thread>(&RfbServer::serverMain, this);
+    return true;
+}
+
+bool RfbServer::stop()
+{
+    if (m_thread == nullptr)
+    {
+        return true;
+    }
+
+    log(DEBUG, "stop: Stopping...");
+    m_running = false;
+    m_thread->join();
+    m_thread = nullptr;
+    m_pool = nullptr;
+    log(DEBUG, "stop: Done");
+    return true;
+}
+
+int RfbServer::listenOn(int port)
+{
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        log(ERROR, "listenOn: Unable to create socket: %s", strerror(errno));
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(listener, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 4) < 0)
+    {
+        log(ERROR, "listenOn: Unable to listen on port %d: %s", port, strerror(errno));
+        close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+void RfbServer::closeListeners()
+{
+    for (const auto& [listener, display] : m_listeners)
+    {
+        close(listener);
+    }
+    m_listeners.clear();
+}
+
+void RfbServer::serverMain()
+{
+    // Client threads are started from here, and pick up the same policy
+    m_threadPolicy->apply("RfbServer");
+
+    vector<pollfd> pfds;
+    for (const auto& [listener, display] : m_listeners)
+    {
+        pfds.push_back({listener, POLLIN, 0});
+    }
+
+    while (m_running)
+    {
+        int res = poll(pfds.data(), pfds.size(), POLL_TIMEOUT_MS);
+        if (res < 0 && errno != EINTR)
+        {
+            log(ERROR, "serverMain: poll failed: %s", strerror(errno));
+            break;
+        }
+
+        for (size_t i = 0; res > 0 && i < pfds.size(); i++)
+        {
+            if (pfds[i].revents & POLLIN)
+            {
+                acceptClient(m_listeners[i].first, m_listeners[i].second);
+            }
+        }
+
+        reapClients();
+        m_host->getLifecycleManager()->poll();
+    }
+
+    for (const auto& client : m_clients)
+    {
+        client->stop();
+        client->getDisplay()->subscribers--;
+    }
+    m_clients.clear();
+    closeListeners();
+}
+
+void RfbServer::acceptClient(int listener, const shared_ptr<Display> &display)
+{
+    sockaddr_in addr = {};
+    socklen_t addrLen = sizeof(addr);
+    int socket = accept(listener, (sockaddr*)&addr, &addrLen);
+    if (socket < 0)
+    {
+        log(WARN, "acceptClient: accept failed: %s", strerror(errno));
+        return;
+    }
+
+    // Updates are written in one go, don't hold the end of them back
+    int one = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+    setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+    char host[INET_ADDRSTRLEN] = {};
+    inet_ntop(AF_INET, &addr.sin_addr, host, sizeof(host));
+    string address = string(host) + ":" + to_string(ntohs(addr.sin_port));
+    log(INFO, "acceptClient: %s: Connected to %s", address.c_str(), display->name.c_str());
+
+    m_host->getLifecycleManager()->displayRequested(display);
+    display->subscribers++;
+
+    auto client = make_shared<RfbClient>(socket, address, display, m_pool, m_config.compressionLevel);
+    client->start();
+    m_clients.push_back(client);
+}
+
+void RfbServer::reapClients()
+{
+    for (auto it = m_clients.begin(); it != m_clients.end(); )
+    {
+        auto client = *it;
+        if (!client->isFinished())
+        {
+            ++it;
+            continue;
+        }
+
+        // The lifecycle manager times the display out once nobody's watching it
+        client->stop();
+        client->getDisplay()->subscribers--;
+        it = m_clients.erase(it);
+    }
+}
@@ -0,0 +1,60 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef RFBSERVER_H
+#define RFBSERVER_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "logger.h"
+
+struct Display;
+class RfbClient;
+class WorkerPool;
+class StreamHost;
+class ThreadPolicy;
+
+/*
+ * Serves each display as a VNC framebuffer, the first on the configured port
+ * and the rest on the ports after it. Only the tiles that change are sent,
+ * losslessly, so text stays sharp and static parts of the display cost
+ * nothing. Viewers count as the display's subscribers, so the lifecycle
+ * manager arms and releases it the same as with RTSP.
+ */
+class RfbServer : private Logger
+{
+ private:
+    StreamHost* m_host;
+    RfbConfig m_config;
+
+    std::shared_ptr<ThreadPolicy> m_threadPolicy;
+    std::shared_ptr<WorkerPool> m_pool;
+    std::vector<std::pair<int, std::shared_ptr<Display>>> m_listeners;
+    std::vector<std::shared_ptr<RfbClient>> m_clients;
+
+    std::shared_ptr<std::thread> m_thread;
+    std::atomic<bool> m_running = false;
+
+    int listenOn(int port);
+    void closeListeners();
+
+    void serverMain();
+    void acceptClient(int listener, const std::shared_ptr<Display> &display);
+    void reapClients();
+
+ public:
+    explicit RfbServer(StreamHost* host) : Logger("RfbServer"), m_host(host) {}
+    ~RfbServer() override;
+
+    bool start();
+    bool stop();
+
+    [[nodiscard]] bool isRunning() const { return m_running; }
+};
+
+#endif //RFBSERVER_H
@@ -0,0 +1,243 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "sharedglcontext.h"
+
+#if defined(__APPLE__)
+#include <OpenGL/OpenGL.h>
+#elif defined(XSTREAM_EGL)
+#include <EGL/egl.h>
+#else
+#include <GL/glx.h>
+#endif
+
+using namespace std;
+
+SharedGLContext::~SharedGLContext()
+{
+    destroy();
+}
+
+#if defined(__APPLE__)
+
+bool SharedGLContext::create()
+{
+    auto share = CGLGetCurrentContext();
+    if (share == nullptr)
+    {
+        log(ERROR, "create: No current context to share with");
+        return false;
+    }
+
+    CGLContextObj context = nullptr;
+    CGLError error = CGLCreateContext(CGLGetPixelFormat(share), share, &context);
+    if (error != kCGLNoError)
+    {
+        log(ERROR, "create: Unable to create a shared context: %s", CGLErrorString(error));
+        return false;
+    }
+    m_context = context;
+    log(DEBUG, "create: Created a CGL context shared with %p", share);
+    return true;
+}
+
+void SharedGLContext::destroy()
+{
+    if (m_context != nullptr)
+    {
+        CGLDestroyContext(static_cast<CGLContextObj>(m_context));
+        m_context = nullptr;
+    }
+}
+
+bool SharedGLContext::makeCurrent()
+{
+    return CGLSetCurrentContext(static_cast<CGLContextObj>(m_context)) == kCGLNoError;
+}
+
+void SharedGLContext::doneCurrent()
+{
+    CGLSetCurrentContext(nullptr);
+}
+
+#elif defined(XSTREAM_EGL)
+
+bool SharedGLContext::create()
+{
+    EGLDisplay display = eglGetCurrentDisplay();
+    EGLContext share = eglGetCurrentContext();
+    if (display == EGL_NO_DISPLAY || share == EGL_NO_CONTEXT)
+    {
+        log(ERROR, "create: No current context to share with");
+        return false;
+    }
+
+    // Contexts can only share with ones created from the same config
+    EGLint configId = 0;
+    eglQueryContext(display, share, EGL_CONFIG_ID, &configId);
+    const EGLint configAttribs[] = {
+        EGL_CONFIG_ID, configId,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display, configAttribs, &config, 1, &configCount) || configCount == 0)
+    {
+        log(ERROR, "create: Unable to find config %d", configId);
+        return false;
+    }
+
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 2,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+        EGL_NONE
+    };
+    eglBindAPI(EGL_OPENGL_API);
+    EGLContext context = eglCreateContext(display, config, share, contextAttribs);
+    if (context == EGL_NO_CONTEXT)
+    {
+        log(ERROR, "create: Unable to create a shared context: 0x%x", eglGetError());
+        return false;
+    }
+    m_display = display;
+    m_context = context;
+    log(DEBUG, "create: Created an EGL context shared with %p", share);
+    return true;
+}
+
+void SharedGLContext::destroy()
+{
+    if (m_context != nullptr)
+    {
+        eglDestroyContext(m_display, m_context);
+        m_context = nullptr;
+        m_display = nullptr;
+    }
+}
+
+bool SharedGLContext::makeCurrent()
+{
+    // Which API is bound is per thread
+    eglBindAPI(EGL_OPENGL_API);
+    if (!eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context))
+    {
+        log(ERROR, "makeCurrent: eglMakeCurrent failed: 0x%x", eglGetError());
+        return false;
+    }
+    return true;
+}
+
+void SharedGLContext::doneCurrent()
+{
+    eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+#else
+
+bool SharedGLContext::create()
+{
+    ::Display* simDisplay = glXGetCurrentDisplay();
+    GLXContext share = glXGetCurrentContext();
+    if (simDisplay == nullptr || share == nullptr)
+    {
+        log(ERROR, "create: No current context to share with");
+        return false;
+    }
+
+    // Contexts can only share with ones created from a compatible config, so use the sim's
+    int configId = 0;
+    int screen = 0;
+    glXQueryContext(simDisplay, share, GLX_FBCONFIG_ID, &configId);
+    glXQueryContext(simDisplay, share, GLX_SCREEN, &screen);
+
+    // Xlib connections aren't safe to use from two threads, and the sim's is in use on its own.
+    // The context and pbuffer live on a connection of our own to the same server instead
+    ::Display* display = XOpenDisplay(DisplayString(simDisplay));
+    if (display == nullptr)
+    {
+        log(ERROR, "create: Unable to open a connection to %s", DisplayString(simDisplay));
+        return false;
+    }
+
+    const int configAttribs[] = {
+        GLX_FBCONFIG_ID, configId,
+        None
+    };
+    int configCount = 0;
+    GLXFBConfig* configs = glXChooseFBConfig(display, screen, configAttribs, &configCount);
+    if (configs == nullptr || configCount == 0)
+    {
+        log(ERROR, "create: Unable to find FB config 0x%x", configId);
+        XCloseDisplay(display);
+        return false;
+    }
+
+    GLXContext context = glXCreateNewContext(display, configs[0], GLX_RGBA_TYPE, share, True);
+    if (context == nullptr)
+    {
+        log(ERROR, "create: Unable to create a shared context");
+        XFree(configs);
+        XCloseDisplay(display);
+        return false;
+    }
+
+    // The sim's config may be for windows only, in which case it's made current without a drawable
+    int drawableTypes = 0;
+    glXGetFBConfigAttrib(display, configs[0], GLX_DRAWABLE_TYPE, &drawableTypes);
+    if (drawableTypes & GLX_PBUFFER_BIT)
+    {
+        const int pbufferAttribs[] = {
+            GLX_PBUFFER_WIDTH, 1,
+            GLX_PBUFFER_HEIGHT, 1,
+            None
+        };
+        m_pbuffer = glXCreatePbuffer(display, configs[0], pbufferAttribs);
+    }
+    XFree(configs);
+
+    m_display = display;
+    m_context = context;
+    log(DEBUG, "create: Created a GLX context shared with %p, pbuffer=0x%lx", share, m_pbuffer);
+    return true;
+}
+
+void SharedGLContext::destroy()
+{
+    auto display = static_cast<::Display*>(m_display);
+    if (m_pbuffer != 0)
+    {
+        glXDestroyPbuffer(display, m_pbuffer);
+        m_pbuffer = 0;
+    }
+    if (m_context != nullptr)
+    {
+        glXDestroyContext(display, static_cast<GLXContext>(m_context));
+        m_context = nullptr;
+    }
+    if (display != nullptr)
+    {
+        XCloseDisplay(display);
+        m_display = nullptr;
+    }
+}
+
+bool SharedGLContext::makeCurrent()
+{
+    // Our own X connection, so it doesn't matter that this isn't the sim's thread
+    auto display = static_cast<::Display*>(m_display);
+    if (!glXMakeContextCurrent(display, m_pbuffer, m_pbuffer, static_cast<GLXContext>(m_context)))
+    {
+        log(ERROR, "makeCurrent: glXMakeContextCurrent failed");
+        return false;
+    }
+    return true;
+}
+
+void SharedGLContext::doneCurrent()
+{
+    glXMakeContextCurrent(static_cast<::Display*>(m_display), None, None, nullptr);
+}
+
+#endif
@@ -0,0 +1,43 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef SHAREDGLCONTEXT_H
+#define SHAREDGLCONTEXT_H
+
+#include "logger.h"
+
+/*
+ * A GL context in the same share group as whichever one was current when it
+ * was created, so another thread can read the sim's textures. It's created on
+ * the sim's thread and then made current on the thread that uses it.
+ *
+ * Uses CGL on macOS and GLX on Linux, or EGL when built with XSTREAM_EGL for
+ * the headless harness. With GLX it opens an X connection of its own, since
+ * the sim's can't be used from another thread. Platform types are kept out of
+ * here, X11's headers in particular define names that clash with ours.
+ */
+class SharedGLContext : private Logger
+{
+ private:
+    // With GLX, the connection of our own it's created on
+    void* m_display = nullptr;
+    void* m_context = nullptr;
+
+    // GLX only has somewhere to draw with a drawable, even if we never draw
+    unsigned long m_pbuffer = 0;
+
+ public:
+    SharedGLContext() : Logger("SharedGLContext") {}
+    ~SharedGLContext() override;
+
+    // Must be called with the context to share with current
+    bool create();
+    void destroy();
+
+    // On the thread that's going to use it
+    bool makeCurrent();
+    void doneCurrent();
+};
+
+#endif //SHAREDGLCONTEXT_H
@@ -0,0 +1,34 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef STREAMHOST_H
+#define STREAMHOST_H
+
+#include <memory>
+#include <vector>
+
+class Config;
+class LifecycleManager;
+struct Display;
+
+/*
+ * What the streaming servers need from whatever is capturing the displays.
+ * That's the plugin itself, or xstream-encoderd reading the plugin's frames
+ * out of shared memory.
+ */
+class StreamHost
+{
+ public:
+    virtual ~StreamHost() = default;
+
+    virtual std::shared_ptr<Config> getConfig() = 0;
+    virtual std::shared_ptr<LifecycleManager> getLifecycleManager() = 0;
+    virtual std::vector<std::shared_ptr<Display>> getDisplays() = 0;
+
+    // Called from the streaming threads as clients come and go
+    virtual void armDisplay(const std::shared_ptr<Display> &display) = 0;
+    virtual void releaseDisplay(const std::shared_ptr<Display> &display) = 0;
+};
+
+#endif //STREAMHOST_H
@@ -0,0 +1,381 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "texturedumper.h"
+#include "config.h"
+
+#include <algorithm>
+#include <filesystem>
+
+#include <png.h>
+
+#ifdef __APPLE__
+#define GL_DO_NOT_WARN_IF_MULTI_GL_VERSION_HEADERS_INCLUDED 1
+#include <OpenGL/OpenGLAvailability.h>
+#include <OpenGL/gl.h>
+#include <OpenGL/gl3.h>
+#else
+
+#define GL_GLEXT_PROTOTYPES 1
+#define GL3_PROTOTYPES 1
+
+#include <GL/gl.h>
+#endif
+
+using namespace std;
+
+TextureDumper::~TextureDumper()
+{
+    stop();
+    if (m_registered)
+    {
+        XPLMUnregisterDrawCallback(drawCallback, xplm_Phase_Panel, 0, this);
+    }
+
+    // The workers write out whatever's queued before they finish
+    {
+        scoped_lock lock(m_mutex);
+        m_stopping = true;
+        if (!m_jobs.empty())
+        {
+            log(INFO, "~TextureDumper: Writing the last %zu textures", m_jobs.size());
+        }
+    }
+    m_cond.notify_all();
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+bool TextureDumper::start(const string &icao)
+{
+    if (m_active)
+    {
+        log(WARN, "start: Already dumping");
+        return false;
+    }
+
+    error_code ec;
+    filesystem::create_directories(m_config.path, ec);
+    if (ec)
+    {
+        log(ERROR, "start: Unable to create %s: %s", m_config.path.c_str(), ec.message().c_str());
+        return false;
+    }
+
+    // Only look at the sizes now, the actual readback is spread over the following frames
+    for (int i = 1; i < 1000; i++)
+    {
+        if (!glIsTexture(i))
+        {
+            continue;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, i);
+        GLint width;
+        GLint height;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+
+        if (width < m_config.minSize || height < m_config.minSize)
+        {
+            continue;
+        }
+        if (m_config.maxSize > 0 && (width > m_config.maxSize || height > m_config.maxSize))
+        {
+            continue;
+        }
+
+        DumpReadback readback;
+        readback.textureNum = i;
+        readback.width = width;
+        readback.height = height;
+        m_pending.push_back(readback);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (m_pending.empty())
+    {
+        log(INFO, "start: No textures to dump");
+        return false;
+    }
+
+    log(INFO, "start: Dumping %zu textures", m_pending.size());
+    startWorkers();
+
+    m_icao = icao;
+    m_active = true;
+    if (!m_registered)
+    {
+        XPLMRegisterDrawCallback(drawCallback, xplm_Phase_Panel, 0, this);
+        m_registered = true;
+    }
+    return true;
+}
+
+void TextureDumper::stop()
+{
+    if (!m_active)
+    {
+        return;
+    }
+
+    // Anything already read back is still written out, only what hasn't been is lost
+    size_t discarded = m_pending.size() + m_inFlight.size();
+    if (discarded > 0)
+    {
+        log(WARN, "stop: Stopped with %zu textures not read back, they won't be dumped", discarded);
+    }
+
+    for (auto& readback : m_inFlight)
+    {
+        glDeleteSync(static_cast<GLsync>(readback.fence));
+        glDeleteBuffers(1, &readback.pbo);
+    }
+    m_inFlight.clear();
+    m_pending.clear();
+    m_active = false;
+}
+
+int TextureDumper::drawCallback([[maybe_unused]] XPLMDrawingPhase inPhase, [[maybe_unused]] int inIsBefore, void* inRefcon)
+{
+    static_cast<TextureDumper*>(inRefcon)->frame();
+    return 1;
+}
+
+void TextureDumper::frame()
+{
+    if (!m_active)
+    {
+        return;
+    }
+
+    checkReadbacks();
+
+    // Don't read back faster than the workers can write, each job holds a whole texture
+    int queued;
+    {
+        scoped_lock lock(m_mutex);
+        queued = (int)m_jobs.size() + m_busyJobs;
+    }
+
+    int started = 0;
+    while (!m_pending.empty() &&
+        started < m_config.readbacksPerFrame &&
+        queued + (int)m_inFlight.size() < (int)m_workers.size() * 2)
+    {
+        startReadback(m_pending.front());
+        m_pending.pop_front();
+        started++;
+    }
+
+    if (m_pending.empty() && m_inFlight.empty())
+    {
+        log(INFO, "frame: All textures read back");
+        stop();
+    }
+}
+
+void TextureDumper::startReadback(DumpReadback readback)
+{
+    GLsizeiptr size = (GLsizeiptr)readback.width * readback.height * 4;
+
+    glGenBuffers(1, &readback.pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+
+    // With a pack buffer bound this returns straight away, the copy happens on the GPU
+    glBindTexture(GL_TEXTURE_2D, readback.textureNum);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    m_inFlight.push_back(readback);
+}
+
+void TextureDumper::checkReadbacks()
+{
+    for (auto it = m_inFlight.begin(); it != m_inFlight.end(); )
+    {
+        auto fence = static_cast<GLsync>(it->fence);
+        GLenum res = glClientWaitSync(fence, 0, 0);
+        if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED)
+        {
+            // Not done yet, try again next frame
+            ++it;
+            continue;
+        }
+        glDeleteSync(fence);
+
+        auto job = make_shared<DumpJob>();
+        job->icao = m_icao;
+        job->textureNum = it->textureNum;
+        job->width = it->width;
+        job->height = it->height;
+
+        size_t size = (size_t)it->width * it->height * 4;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, it->pbo);
+        auto data = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)size, GL_MAP_READ_BIT));
+        if (data != nullptr)
+        {
+            job->data.assign(data, data + size);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        else
+        {
+            log(ERROR, "checkReadbacks: Texture %d: Failed to map buffer", it->textureNum);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glDeleteBuffers(1, &it->pbo);
+        it = m_inFlight.erase(it);
+
+        if (!job->data.empty())
+        {
+            scoped_lock lock(m_mutex);
+            m_jobs.push_back(job);
+            m_cond.notify_one();
+        }
+    }
+}
+
+void TextureDumper::startWorkers()
+{
+    if (!m_workers.empty())
+    {
+        return;
+    }
+
+    int threads = m_config.threads;
+    if (threads <= 0)
+    {
+        threads = clamp((int)thread::hardware_concurrency() / 2, 1, 4);
+    }
+
+    log(DEBUG, "startWorkers: Starting %d workers", threads);
+    for (int i = 0; i < threads; i++)
+    {
+        m_workers.emplace_back(&TextureDumper::workerMain, this);
+    }
+}
+
+void TextureDumper::workerMain()
+{
+    while (true)
+    {
+        shared_ptr<DumpJob> job;
+        {
+            unique_lock lock(m_mutex);
+            m_cond.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+            if (m_jobs.empty())
+            {
+                // Only once every job that was read back has been written
+                return;
+            }
+            job = m_jobs.front();
+            m_jobs.pop_front();
+            m_busyJobs++;
+        }
+
+        writeJob(*job);
+
+        scoped_lock lock(m_mutex);
+        m_busyJobs--;
+    }
+}
+
+void TextureDumper::writeJob(const DumpJob &job)
+{
+    string base = m_config.path + "/texture_" + job.icao + "_" + to_string(job.textureNum);
+    log(DEBUG, "writeJob: Texture %d: Size: %d, %d", job.textureNum, job.width, job.height);
+
+    if (m_config.png)
+    {
+        writePNG(job, base + ".png");
+    }
+    if (m_config.raw)
+    {
+        writeRaw(job, base + ".dat");
+    }
+}
+
+bool TextureDumper::writePNG(const DumpJob &job, const string &filename)
+{
+    FILE* fp = fopen(filename.c_str(), "wb");
+    if (fp == nullptr)
+    {
+        log(ERROR, "writePNG: Failed to open file %s", filename.c_str());
+        return false;
+    }
+    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+    png_init_io(png_ptr, fp);
+
+    png_set_compression_level(png_ptr, m_config.compressionLevel);
+    png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, getPNGFilter());
+
+    // Output is 8bit depth, RGBA format.
+    png_set_IHDR(
+      png_ptr,
+      info_ptr,
+      job.width, job.height,
+      8,
+      PNG_COLOR_TYPE_RGBA,
+      PNG_INTERLACE_NONE,
+      PNG_COMPRESSION_TYPE_DEFAULT,
+      PNG_FILTER_TYPE_DEFAULT
+    );
+    png_write_info(png_ptr, info_ptr);
+
+    vector<png_bytep> rows(job.height);
+    for (int y = 0; y < job.height; y++)
+    {
+        rows[y] = const_cast<png_bytep>(job.data.data()) + (size_t)y * job.width * 4;
+    }
+    png_write_image(png_ptr, rows.data());
+    png_write_end(png_ptr, nullptr);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    fclose(fp);
+    return true;
+}
+
+bool TextureDumper::writeRaw(const DumpJob &job, const string &filename)
+{
+    FILE* fp = fopen(filename.c_str(), "wb");
+    if (fp == nullptr)
+    {
+        log(ERROR, "writeRaw: Failed to open file %s", filename.c_str());
+        return false;
+    }
+    fwrite(job.data.data(), job.data.size(), 1, fp);
+    fclose(fp);
+    return true;
+}
+
+int TextureDumper::getPNGFilter() const
+{
+    if (m_config.filter == "none")
+    {
+        return PNG_FILTER_NONE;
+    }
+    else if (m_config.filter == "sub")
+    {
+        return PNG_FILTER_SUB;
+    }
+    else if (m_config.filter == "up")
+    {
+        return PNG_FILTER_UP;
+    }
+    else if (m_config.filter == "avg")
+    {
+        return PNG_FILTER_AVG;
+    }
+    else if (m_config.filter == "paeth")
+    {
+        return PNG_FILTER_PAETH;
+    }
+    return PNG_ALL_FILTERS;
+}
@@ -0,0 +1,89 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef TEXTUREDUMPER_H
+#define TEXTUREDUMPER_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <XPLMDisplay.h>
+
+#include "logger.h"
+
+struct DumpConfig;
+
+struct DumpJob
+{
+    // Taken from the dump it's part of, a new dump may have started by the time it's written
+    std::string icao;
+    int textureNum = 0;
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> data;
+};
+
+struct DumpReadback
+{
+    int textureNum = 0;
+    int width = 0;
+    int height = 0;
+    unsigned int pbo = 0;
+    void* fence = nullptr;
+};
+
+/*
+ * Dumps textures to disk without stalling the sim.
+ *
+ * Textures are read back in to pixel buffer objects a few per frame from a
+ * draw callback, and only mapped once their fence has signalled. The PNG
+ * compression and file writing then happen on a pool of worker threads.
+ */
+class TextureDumper : private Logger
+{
+ private:
+    const DumpConfig& m_config;
+
+    // Only touched from the draw callback
+    std::string m_icao;
+    std::deque<DumpReadback> m_pending;
+    std::vector<DumpReadback> m_inFlight;
+    bool m_active = false;
+    bool m_registered = false;
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::shared_ptr<DumpJob>> m_jobs;
+    int m_busyJobs = 0;
+    bool m_stopping = false;
+
+    static int drawCallback(XPLMDrawingPhase inPhase, int inIsBefore, void* inRefcon);
+    void frame();
+    void startReadback(DumpReadback readback);
+    void checkReadbacks();
+
+    void startWorkers();
+    void workerMain();
+    void writeJob(const DumpJob &job);
+    bool writePNG(const DumpJob &job, const std::string &filename);
+    [[nodiscard]] int getPNGFilter() const;
+    bool writeRaw(const DumpJob &job, const std::string &filename);
+
+ public:
+    explicit TextureDumper(const DumpConfig& config) : Logger("TextureDumper"), m_config(config) {}
+    ~TextureDumper() override;
+
+    bool start(const std::string &icao);
+    void stop();
+
+    [[nodiscard]] bool isDumping() const { return m_active; }
+};
+
+#endif //TEXTUREDUMPER_H
@@ -0,0 +1,277 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "texturesource.h"
+#include "profiler.h"
+
+#include <algorithm>
+
+#ifdef __APPLE__
+#define GL_DO_NOT_WARN_IF_MULTI_GL_VERSION_HEADERS_INCLUDED 1
+#include <OpenGL/OpenGLAvailability.h>
+#include <OpenGL/gl.h>
+#include <OpenGL/gl3.h>
+#else
+
+#define GL_GLEXT_PROTOTYPES 1
+#define GL3_PROTOTYPES 1
+
+#include <GL/gl.h>
+#endif
+
+using namespace std;
+
+bool TextureSource::readRegionBands(int textureNum, int x, int y, int width, int height, int scale, const vector<RegionBand> &bands, uint8_t* buffer, const RegionBandCallback &callback, float now)
+{
+    if (!readRegion(textureNum, x, y, width, height, scale, buffer, now))
+    {
+        return false;
+    }
+
+    size_t rowBytes = (size_t)(width / scale) * 4;
+    for (int i = 0; i < (int)bands.size(); i++)
+    {
+        callback(i, buffer + bands[i].firstRow * rowBytes);
+    }
+    return true;
+}
+
+GLTextureSource::~GLTextureSource()
+{
+    if (m_readFramebuffer != 0)
+    {
+        glDeleteFramebuffers(1, &m_readFramebuffer);
+    }
+    if (m_scaleFramebuffer != 0)
+    {
+        glDeleteFramebuffers(1, &m_scaleFramebuffer);
+        glDeleteRenderbuffers(1, &m_scaleRenderbuffer);
+    }
+    if (!m_bandBuffers.empty())
+    {
+        glDeleteBuffers((GLsizei)m_bandBuffers.size(), m_bandBuffers.data());
+    }
+}
+
+vector<int> GLTextureSource::listTextures()
+{
+    vector<int> textures;
+    for (int i = 1; i < 1000; i++)
+    {
+        if (glIsTexture(i))
+        {
+            textures.push_back(i);
+        }
+    }
+    return textures;
+}
+
+bool GLTextureSource::getTextureSize(int textureNum, int &width, int &height)
+{
+    // Put back whatever the sim had bound
+    GLint previous = 0;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+    glBindTexture(GL_TEXTURE_2D, textureNum);
+
+    GLint w;
+    GLint h;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+    width = w;
+    height = h;
+
+    glBindTexture(GL_TEXTURE_2D, previous);
+    return true;
+}
+
+bool GLTextureSource::readTexture(int textureNum, uint8_t* buffer, [[maybe_unused]] float now)
+{
+    GLint previous = 0;
+    GLint previousPack = 0;
+    GLint previousAlignment = 0;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+    glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &previousPack);
+    glGetIntegerv(GL_PACK_ALIGNMENT, &previousAlignment);
+
+    // Straight in to our buffer, even if the sim has a pack buffer bound
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, textureNum);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
+
+    glBindTexture(GL_TEXTURE_2D, previous);
+    glPixelStorei(GL_PACK_ALIGNMENT, previousAlignment);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, previousPack);
+    return true;
+}
+
+void GLTextureSource::prepareScaleBuffer(int width, int height)
+{
+    if (m_scaleFramebuffer == 0)
+    {
+        glGenFramebuffers(1, &m_scaleFramebuffer);
+        glGenRenderbuffers(1, &m_scaleRenderbuffer);
+    }
+    if (width <= m_scaleWidth && height <= m_scaleHeight)
+    {
+        return;
+    }
+
+    // Only ever grows, so a few displays at different sizes can share it
+    m_scaleWidth = max(width, m_scaleWidth);
+    m_scaleHeight = max(height, m_scaleHeight);
+
+    GLint previous = 0;
+    glGetIntegerv(GL_RENDERBUFFER_BINDING, &previous);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_scaleRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_scaleWidth, m_scaleHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, previous);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_scaleFramebuffer);
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_scaleRenderbuffer);
+}
+
+bool GLTextureSource::readRegion(int textureNum, int x, int y, int width, int height, int scale, uint8_t* buffer, [[maybe_unused]] float now)
+{
+    if (m_readFramebuffer == 0)
+    {
+        glGenFramebuffers(1, &m_readFramebuffer);
+    }
+
+    // Don't disturb whatever the sim has bound
+    GLint previousRead = 0;
+    GLint previousDraw = 0;
+    GLint previousPack = 0;
+    GLint previousAlignment = 0;
+    {
+        ProfileTimer timer(m_profiler, PROFILE_STATE);
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousDraw);
+        glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &previousPack);
+        glGetIntegerv(GL_PACK_ALIGNMENT, &previousAlignment);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_readFramebuffer);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureNum, 0);
+
+    bool complete = glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (complete)
+    {
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        if (scale <= 1)
+        {
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+            glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
+        }
+        else
+        {
+            // Let the GPU shrink it, so there's less to copy back
+            int scaledWidth = width / scale;
+            int scaledHeight = height / scale;
+            prepareScaleBuffer(scaledWidth, scaledHeight);
+
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_scaleFramebuffer);
+            glBlitFramebuffer(x, y, x + width, y + height, 0, 0, scaledWidth, scaledHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, m_scaleFramebuffer);
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+            glReadPixels(0, 0, scaledWidth, scaledHeight, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, m_readFramebuffer);
+        }
+    }
+
+    ProfileTimer timer(m_profiler, PROFILE_STATE);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, previousRead);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousDraw);
+    glPixelStorei(GL_PACK_ALIGNMENT, previousAlignment);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, previousPack);
+    return complete;
+}
+
+bool GLTextureSource::readRegionBands(int textureNum, int x, int y, int width, int height, int scale, const vector<RegionBand> &bands, [[maybe_unused]] uint8_t* buffer, const RegionBandCallback &callback, [[maybe_unused]] float now)
+{
+    if (m_readFramebuffer == 0)
+    {
+        glGenFramebuffers(1, &m_readFramebuffer);
+    }
+    if (m_bandBuffers.size() < bands.size())
+    {
+        size_t first = m_bandBuffers.size();
+        m_bandBuffers.resize(bands.size());
+        glGenBuffers((GLsizei)(bands.size() - first), m_bandBuffers.data() + first);
+    }
+
+    GLint previousRead = 0;
+    GLint previousDraw = 0;
+    GLint previousPack = 0;
+    GLint previousAlignment = 0;
+    {
+        ProfileTimer timer(m_profiler, PROFILE_STATE);
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousDraw);
+        glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &previousPack);
+        glGetIntegerv(GL_PACK_ALIGNMENT, &previousAlignment);
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_readFramebuffer);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureNum, 0);
+
+    int readWidth = width / scale;
+    bool complete = glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (complete)
+    {
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        if (scale > 1)
+        {
+            int scaledHeight = height / scale;
+            prepareScaleBuffer(readWidth, scaledHeight);
+
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_scaleFramebuffer);
+            glBlitFramebuffer(x, y, x + width, y + height, 0, 0, readWidth, scaledHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, m_scaleFramebuffer);
+            x = 0;
+            y = 0;
+        }
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+        // Every read is queued before any are mapped, so the GPU carries on with the later bands while we work on the first
+        for (size_t i = 0; i < bands.size(); i++)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, m_bandBuffers[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)readWidth * bands[i].rowCount * 4, nullptr, GL_STREAM_READ);
+            glReadPixels(x, y + bands[i].firstRow, readWidth, bands[i].rowCount, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+    }
+
+    {
+        ProfileTimer timer(m_profiler, PROFILE_STATE);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_readFramebuffer);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, previousRead);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousDraw);
+        glPixelStorei(GL_PACK_ALIGNMENT, previousAlignment);
+    }
+
+    bool ok = complete;
+    for (size_t i = 0; ok && i < bands.size(); i++)
+    {
+        // Only waits for this band's read to finish
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_bandBuffers[i]);
+        GLsizeiptr size = (GLsizeiptr)readWidth * bands[i].rowCount * 4;
+        auto rows = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT));
+        if (rows == nullptr)
+        {
+            ok = false;
+            break;
+        }
+        callback((int)i, rows);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+
+    ProfileTimer timer(m_profiler, PROFILE_STATE);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, previousPack);
+    return ok;
+}
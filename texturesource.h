@@ -0,0 +1,92 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef TEXTURESOURCE_H
+#define TEXTURESOURCE_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class Profiler;
+
+// Rows of a region, counted from the bottom the same as the data
+struct RegionBand
+{
+    int firstRow;
+    int rowCount;
+};
+
+// Given each band's rows as soon as they're in, they're only valid until it returns
+typedef std::function<void(int band, const uint8_t* rows)> RegionBandCallback;
+
+/*
+ * Somewhere DisplayManager can find and read back textures from.
+ * All calls are made from the thread DisplayManager::update runs on, or
+ * with capture_thread, the capture thread's own GLTextureSource.
+ */
+class TextureSource
+{
+ public:
+    virtual ~TextureSource() = default;
+
+    // Texture numbers that are worth checking against the definition
+    virtual std::vector<int> listTextures() = 0;
+
+    virtual bool getTextureSize(int textureNum, int &width, int &height) = 0;
+
+    // Read the whole texture as RGBA in to buffer, now is the sim's elapsed time
+    virtual bool readTexture(int textureNum, uint8_t* buffer, float now) = 0;
+
+    // Read just part of a texture, rows bottom up the same as readTexture. With a scale
+    // of more than 1 the region is shrunk to width / scale by height / scale as it's read
+    virtual bool readRegion(int textureNum, int x, int y, int width, int height, int scale, uint8_t* buffer, float now) = 0;
+
+    // The same, a band at a time and in the order given, so the early bands can be worked on while
+    // the rest are still being read. By default it's all read in to buffer before any are handed over
+    virtual bool readRegionBands(int textureNum, int x, int y, int width, int height, int scale, const std::vector<RegionBand> &bands, uint8_t* buffer, const RegionBandCallback &callback, float now);
+
+    // Called after a batch of reads
+    virtual void finish() {}
+
+    // Minimum time between captures, in seconds
+    [[nodiscard]] virtual float getUpdateInterval() const { return 0.5f; }
+};
+
+// Reads textures with whichever GL context is current, leaving its bindings as they were
+class GLTextureSource : public TextureSource
+{
+ private:
+    float m_updateInterval;
+
+    // Saving and restoring the bindings is timed as the GL state stage, only in the draw callback
+    Profiler* m_profiler;
+
+    // Regions are read through a framebuffer with the texture attached
+    unsigned int m_readFramebuffer = 0;
+
+    // Scaled regions are blitted in to this first
+    unsigned int m_scaleFramebuffer = 0;
+    unsigned int m_scaleRenderbuffer = 0;
+    int m_scaleWidth = 0;
+    int m_scaleHeight = 0;
+
+    // Bands are read in to pixel buffers of their own, so each can be mapped as soon as its own read is done
+    std::vector<unsigned int> m_bandBuffers;
+
+    void prepareScaleBuffer(int width, int height);
+
+ public:
+    explicit GLTextureSource(float fps, Profiler* profiler = nullptr) : m_updateInterval(1.0f / fps), m_profiler(profiler) {}
+    ~GLTextureSource() override;
+
+    std::vector<int> listTextures() override;
+    bool getTextureSize(int textureNum, int &width, int &height) override;
+    bool readTexture(int textureNum, uint8_t* buffer, float now) override;
+    bool readRegion(int textureNum, int x, int y, int width, int height, int scale, uint8_t* buffer, float now) override;
+    bool readRegionBands(int textureNum, int x, int y, int width, int height, int scale, const std::vector<RegionBand> &bands, uint8_t* buffer, const RegionBandCallback &callback, float now) override;
+    [[nodiscard]] float getUpdateInterval() const override { return m_updateInterval; }
+};
+
+#endif //TEXTURESOURCE_H
@@ -0,0 +1,121 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "threadpolicy.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <pthread.h>
+#include <sched.h>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static int schedulingPolicy(const string &policy)
+{
+    if (policy == "fifo")
+    {
+        return SCHED_FIFO;
+    }
+    else if (policy == "rr")
+    {
+        return SCHED_RR;
+    }
+#ifdef __linux__
+    else if (policy == "batch")
+    {
+        return SCHED_BATCH;
+    }
+    else if (policy == "idle")
+    {
+        return SCHED_IDLE;
+    }
+#endif
+    return SCHED_OTHER;
+}
+
+void ThreadPolicy::apply(const char* name)
+{
+    if (isDefault())
+    {
+        return;
+    }
+
+#ifdef __linux__
+    if (!m_config.cpus.empty())
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int cpu : m_config.cpus)
+        {
+            if (cpu >= 0 && cpu < CPU_SETSIZE)
+            {
+                CPU_SET(cpu, &cpus);
+            }
+        }
+        int res = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (res != 0)
+        {
+            log(WARN, "apply: %s: Unable to set affinity: %s", name, strerror(res));
+        }
+    }
+#endif
+
+    int policy = schedulingPolicy(m_config.policy);
+    bool realTime = policy == SCHED_FIFO || policy == SCHED_RR;
+    sched_param param = {};
+    param.sched_priority = realTime ? m_config.priority : 0;
+    int res = pthread_setschedparam(pthread_self(), policy, &param);
+    if (res != 0)
+    {
+        log(WARN, "apply: %s: Unable to set %s scheduling: %s", name, m_config.policy.c_str(), strerror(res));
+    }
+
+#ifdef __linux__
+    // Linux threads each have their own nice value, elsewhere it would change the whole sim
+    if (!realTime && m_config.nice != 0)
+    {
+        if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), m_config.nice) != 0)
+        {
+            log(WARN, "apply: %s: Unable to set nice %d: %s", name, m_config.nice, strerror(errno));
+        }
+    }
+#endif
+
+    log(DEBUG, "apply: %s: policy=%s, nice=%d", name, m_config.policy.c_str(), m_config.nice);
+}
+
+void ThreadPolicy::attach(GstElement* pipeline)
+{
+    if (isDefault())
+    {
+        return;
+    }
+
+    auto bus = gst_element_get_bus(pipeline);
+    gst_bus_set_sync_handler(bus, busSyncCallback, this, nullptr);
+    gst_object_unref(bus);
+}
+
+GstBusSyncReply ThreadPolicy::busSyncCallback([[maybe_unused]] GstBus* bus, GstMessage* message, gpointer data)
+{
+    // Posted from the new streaming thread itself, before it starts running
+    if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_STREAM_STATUS)
+    {
+        GstStreamStatusType type;
+        GstElement* owner = nullptr;
+        gst_message_parse_stream_status(message, &type, &owner);
+        if (type == GST_STREAM_STATUS_TYPE_ENTER)
+        {
+            static_cast<ThreadPolicy*>(data)->apply(GST_ELEMENT_NAME(owner));
+        }
+    }
+    return GST_BUS_PASS;
+}
@@ -0,0 +1,39 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef THREADPOLICY_H
+#define THREADPOLICY_H
+
+#include <gst/gst.h>
+
+#include "config.h"
+#include "logger.h"
+
+/*
+ * Keeps XStream's threads off the cores the sim is using. Applied by each of
+ * our threads as it starts, and to GStreamer's streaming threads as they're
+ * created. Threads started by a thread that has been set up (like the
+ * encoder's own threads) pick up the same settings from it.
+ */
+class ThreadPolicy : private Logger
+{
+ private:
+    SchedulingConfig m_config;
+
+    static GstBusSyncReply busSyncCallback(GstBus* bus, GstMessage* message, gpointer data);
+
+ public:
+    explicit ThreadPolicy(const SchedulingConfig &config) : Logger("ThreadPolicy"), m_config(config) {}
+    ~ThreadPolicy() override = default;
+
+    // Sets the calling thread's affinity, scheduling policy and nice value
+    void apply(const char* name);
+
+    // Applies the policy to every streaming thread the pipeline starts
+    void attach(GstElement* pipeline);
+
+    [[nodiscard]] bool isDefault() const { return m_config.cpus.empty() && m_config.policy == "other" && m_config.nice == 0; }
+};
+
+#endif //THREADPOLICY_H
@@ -0,0 +1,96 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+/*
+ * Encodes and streams the displays captured by the plugin when it's running
+ * with encoder_daemon enabled. Frames are read from the plugin's shared memory
+ * ring, so the daemon can be started and stopped at any time, and pinned to
+ * cores the sim isn't using.
+ *
+ * Usage: xstream-encoderd [-c config.yaml] [-r ring]
+ *
+ *   -c  Config to read, the same one the plugin uses (default Resources/plugins/xstream/config.yaml)
+ *   -r  Shared memory ring to read from, overriding the config
+ */
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "config.h"
+#include "encoderdaemon.h"
+
+using namespace std;
+
+// How often to look for the plugin's ring, and check on it once it's open
+static const chrono::milliseconds POLL_INTERVAL(500);
+
+static atomic<bool> g_running = true;
+
+static void signalHandler([[maybe_unused]] int sig)
+{
+    g_running = false;
+}
+
+int main(int argc, char** argv)
+{
+    string configPath = "Resources/plugins/xstream/config.yaml";
+    string ringName;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:r:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c': configPath = optarg; break;
+            case 'r': ringName = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-c config.yaml] [-r ring]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    auto config = make_shared<Config>();
+    config->load(configPath);
+    if (ringName.empty())
+    {
+        ringName = config->getEncoderDaemon().ring;
+    }
+
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    // Keep going across restarts of the sim, each one creates a new ring
+    bool waiting = false;
+    while (g_running)
+    {
+        EncoderDaemon daemon(config);
+        if (!daemon.start(ringName))
+        {
+            if (!waiting)
+            {
+                printf("Waiting for %s...\n", ringName.c_str());
+                fflush(stdout);
+                waiting = true;
+            }
+            this_thread::sleep_for(POLL_INTERVAL);
+            continue;
+        }
+
+        printf("Streaming from %s\n", ringName.c_str());
+        fflush(stdout);
+        waiting = false;
+        while (g_running && daemon.check())
+        {
+            this_thread::sleep_for(POLL_INTERVAL);
+        }
+        daemon.stop();
+    }
+    return 0;
+}
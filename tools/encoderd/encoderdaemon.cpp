@@ -0,0 +1,189 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "encoderdaemon.h"
+#include "config.h"
+#include "displaymanager.h"
+#include "lifecyclemanager.h"
+#include "rfbserver.h"
+#include "threadpolicy.h"
+#include "videostream.h"
+
+using namespace std;
+
+// How long to wait for a frame before checking for subscribers and shutdown again
+static const chrono::milliseconds WAIT_TIMEOUT(100);
+
+// The plugin is treated as gone if it stops updating the ring for this long
+static const chrono::milliseconds PLUGIN_TIMEOUT(3000);
+
+EncoderDaemon::EncoderDaemon(const shared_ptr<Config> &config) : Logger("EncoderDaemon"), m_config(config)
+{
+    m_allocator = make_shared<FrameAllocator>(config->getMemory());
+    m_lifecycleManager = make_shared<LifecycleManager>(this);
+    m_videoStream = make_shared<VideoStream>(this);
+    m_rfbServer = make_shared<RfbServer>(this);
+}
+
+EncoderDaemon::~EncoderDaemon()
+{
+    stop();
+}
+
+bool EncoderDaemon::start(const string &ringName)
+{
+    if (!m_ring.open(ringName))
+    {
+        return false;
+    }
+    if (m_ring.isClosed(PLUGIN_TIMEOUT))
+    {
+        // Left behind by a sim that's gone away
+        m_ring.close();
+        return false;
+    }
+
+    for (int i = 0; i < m_ring.getDisplayCount(); i++)
+    {
+        auto display = make_shared<Display>(0, 0, m_ring.getWidth(i), m_ring.getHeight(i), m_ring.getName(i), nullptr);
+        display->allocator = m_allocator;
+        if (m_config->getYuvFormat() != YUV_NONE)
+        {
+            // Each display's feeder converts its own frames, so there's no need for a pool
+            display->yuvConverter = make_shared<YuvConverter>(m_config->getYuvFormat(), m_config->getYuvMatrix(), display->width, display->height, nullptr);
+        }
+        log(INFO, "start: %s: %dx%d", display->name.c_str(), display->width, display->height);
+        m_displays.push_back(display);
+    }
+
+    m_running = true;
+    for (int i = 0; i < (int)m_displays.size(); i++)
+    {
+        m_feeders.push_back(make_shared<thread>(&EncoderDaemon::feedMain, this, i, m_displays[i]));
+    }
+    check();
+
+    bool res = true;
+    if (m_config->isRtspEnabled())
+    {
+        res = m_videoStream->start();
+    }
+    if (res && m_config->isRfbEnabled())
+    {
+        res = m_rfbServer->start();
+    }
+    if (!res)
+    {
+        stop();
+    }
+    return res;
+}
+
+void EncoderDaemon::stop()
+{
+    if (!m_ring.isOpen())
+    {
+        return;
+    }
+
+    log(DEBUG, "stop: Stopping...");
+    m_videoStream->stop();
+    m_rfbServer->stop();
+
+    m_running = false;
+    for (const auto& feeder : m_feeders)
+    {
+        feeder->join();
+    }
+    m_feeders.clear();
+
+    for (const auto& display : m_displays)
+    {
+        releaseDisplay(display);
+    }
+    m_displays.clear();
+    m_ring.close();
+    m_allocator->report();
+    m_allocator->trim();
+    log(DEBUG, "stop: Done");
+}
+
+bool EncoderDaemon::check()
+{
+    m_ring.readerHeartbeat();
+    return !m_ring.isClosed(PLUGIN_TIMEOUT);
+}
+
+int EncoderDaemon::findDisplay(const shared_ptr<Display> &display) const
+{
+    for (int i = 0; i < (int)m_displays.size(); i++)
+    {
+        if (m_displays[i] == display)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void EncoderDaemon::armDisplay(const shared_ptr<Display> &display)
+{
+    int index = findDisplay(display);
+    if (index >= 0 && !display->armed)
+    {
+        log(DEBUG, "armDisplay: %s", display->name.c_str());
+        display->arm();
+        m_ring.setWanted(index, true);
+    }
+}
+
+void EncoderDaemon::releaseDisplay(const shared_ptr<Display> &display)
+{
+    int index = findDisplay(display);
+    if (index >= 0 && display->armed)
+    {
+        log(DEBUG, "releaseDisplay: %s", display->name.c_str());
+        m_ring.setWanted(index, false);
+        display->release();
+    }
+}
+
+void EncoderDaemon::feedMain(int index, shared_ptr<Display> display)
+{
+    ThreadPolicy(m_config->getScheduling()).apply("EncoderDaemon");
+
+    uint64_t lastFrame = m_ring.getLatest(index);
+    while (m_running)
+    {
+        // The plugin's capture scheduler favours displays with more viewers
+        m_ring.setSubscribers(index, display->subscribers);
+
+        if (!m_ring.waitForFrame(index, lastFrame, WAIT_TIMEOUT))
+        {
+            continue;
+        }
+
+        scoped_lock lock(display->mutex);
+        if (display->buffer == nullptr)
+        {
+            // Nobody's watching, skip it
+            lastFrame = m_ring.getLatest(index);
+            continue;
+        }
+
+        uint64_t frame;
+        chrono::steady_clock::time_point captureTime;
+        if (m_ring.read(index, display->buffer, frame, captureTime))
+        {
+            if (display->yuvBuffer != nullptr)
+            {
+                display->yuvConverter->convert(display->buffer, 1, false, display->yuvBuffer, nullptr);
+            }
+            lastFrame = frame;
+            display->frameSeq++;
+            display->captureTime = captureTime;
+            display->frameCond.notify_all();
+        }
+    }
+}
@@ -0,0 +1,63 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef ENCODERDAEMON_H
+#define ENCODERDAEMON_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "framering.h"
+#include "logger.h"
+#include "streamhost.h"
+
+class Config;
+class FrameAllocator;
+class VideoStream;
+class RfbServer;
+
+/*
+ * Streams the displays the plugin publishes in to a frame ring. The displays
+ * here have no textures, their buffers are filled from the ring by a feeder
+ * thread each, and arming one just asks the plugin to start capturing it.
+ */
+class EncoderDaemon : private Logger, public StreamHost
+{
+ private:
+    std::shared_ptr<Config> m_config;
+    std::shared_ptr<FrameAllocator> m_allocator;
+    std::shared_ptr<LifecycleManager> m_lifecycleManager;
+    std::shared_ptr<VideoStream> m_videoStream;
+    std::shared_ptr<RfbServer> m_rfbServer;
+
+    FrameRing m_ring;
+    std::vector<std::shared_ptr<Display>> m_displays;
+    std::vector<std::shared_ptr<std::thread>> m_feeders;
+    std::atomic<bool> m_running = false;
+
+    void feedMain(int index, std::shared_ptr<Display> display);
+    [[nodiscard]] int findDisplay(const std::shared_ptr<Display> &display) const;
+
+ public:
+    explicit EncoderDaemon(const std::shared_ptr<Config> &config);
+    ~EncoderDaemon() override;
+
+    // Returns false if the plugin hasn't created the ring yet
+    bool start(const std::string &ringName);
+    void stop();
+
+    // Lets the plugin know we're still here, returns false once the plugin has gone
+    bool check();
+
+    std::shared_ptr<Config> getConfig() override { return m_config; }
+    std::shared_ptr<LifecycleManager> getLifecycleManager() override { return m_lifecycleManager; }
+    std::vector<std::shared_ptr<Display>> getDisplays() override { return m_displays; }
+    void armDisplay(const std::shared_ptr<Display> &display) override;
+    void releaseDisplay(const std::shared_ptr<Display> &display) override;
+};
+
+#endif //ENCODERDAEMON_H
@@ -0,0 +1,192 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+/*
+ * Runs the plugin outside X-Plane. The XPLM API is stubbed out, the draw loop
+ * is faked and the textures live in an offscreen software GL context, so
+ * discovery, capture and streaming can be run and timed on a headless Linux
+ * machine.
+ *
+ * Usage: xstream_harness [-r root] [-d datarefs.yaml] [-f fps] [-n frames] [-T timestep]
+ *                        [-W width -H height] [-a] [-S] [-c] texture.png|texture.dat...
+ *
+ *   -r  Directory to run in, it should have Resources/plugins/xstream/data in it
+ *   -d  Datarefs to define, as a YAML map of names to values
+ *   -f  Frame rate to pace the draw loop at, 0 to run flat out (default 60)
+ *   -n  Number of frames to run, 0 to run until interrupted (default 0)
+ *   -T  Advance the sim clock by a fixed amount each frame instead of following the real clock
+ *   -W, -H  Size of the .dat dumps, if they're not square
+ *   -a  Arm every display, as if somebody was watching each one
+ *   -S  Start streaming
+ *   -c  Write the profile CSV before exiting
+ */
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "displaymanager.h"
+#include "histogram.h"
+#include "offscreengl.h"
+#include "profiler.h"
+#include "xplmstub.h"
+#include "xstreamplugin.h"
+
+using namespace std;
+
+extern XStreamPlugin g_ufcPlugin;
+
+static atomic<bool> g_running = true;
+
+static void signalHandler([[maybe_unused]] int sig)
+{
+    g_running = false;
+}
+
+static void printStats(int frames, const Histogram &drawTimes)
+{
+    auto profiler = g_ufcPlugin.getDisplayManager()->getProfiler();
+    printf("%d frames: Draw p50 %lluus p99 %lluus max %lluus | %s | %s\n",
+        frames,
+        (unsigned long long)drawTimes.getPercentile(50),
+        (unsigned long long)drawTimes.getPercentile(99),
+        (unsigned long long)drawTimes.getMax(),
+        profiler->getCpuSummary().c_str(),
+        profiler->getGpuSummary().c_str());
+    fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+    string root;
+    string dataRefs;
+    float fps = 60.0f;
+    int frameCount = 0;
+    float timestep = 0.0f;
+    int datWidth = 0;
+    int datHeight = 0;
+    bool arm = false;
+    bool stream = false;
+    bool writeCsv = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:d:f:n:T:W:H:aSc")) != -1)
+    {
+        switch (opt)
+        {
+            case 'r': root = optarg; break;
+            case 'd': dataRefs = optarg; break;
+            case 'f': fps = strtof(optarg, nullptr); break;
+            case 'n': frameCount = atoi(optarg); break;
+            case 'T': timestep = strtof(optarg, nullptr); break;
+            case 'W': datWidth = atoi(optarg); break;
+            case 'H': datHeight = atoi(optarg); break;
+            case 'a': arm = true; break;
+            case 'S': stream = true; break;
+            case 'c': writeCsv = true; break;
+            default:
+                fprintf(stderr, "Usage: %s [-r root] [-d datarefs.yaml] [-f fps] [-n frames] [-T timestep] [-W width -H height] [-a] [-S] [-c] texture...\n", argv[0]);
+                return 1;
+        }
+    }
+
+    OffscreenGL gl;
+    if (!gl.create())
+    {
+        return 1;
+    }
+
+    // Load everything relative to where we were started, before moving to the root
+    for (int i = optind; i < argc; i++)
+    {
+        if (gl.loadTexture(argv[i], datWidth, datHeight) == 0)
+        {
+            return 1;
+        }
+    }
+    if (!dataRefs.empty() && !XPLMStub::loadDataRefs(dataRefs))
+    {
+        return 1;
+    }
+    if (!root.empty())
+    {
+        filesystem::current_path(root);
+    }
+
+    XPLMStub::setFixedTimestep(timestep);
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    char name[256];
+    char sig[256];
+    char desc[256];
+    g_ufcPlugin.start(name, sig, desc);
+    g_ufcPlugin.enable();
+
+    // Let the sim clock get going before anything looks at it
+    XPLMStub::runFrame();
+
+    if (stream)
+    {
+        XPLMStub::clickMenuItem("Start Streaming");
+    }
+    else if (!g_ufcPlugin.getDisplayManager()->start())
+    {
+        fprintf(stderr, "No displays found\n");
+        return 1;
+    }
+
+    if (arm)
+    {
+        for (const auto& display : g_ufcPlugin.getDisplayManager()->getDisplays())
+        {
+            g_ufcPlugin.getDisplayManager()->armDisplay(display);
+        }
+    }
+
+    Histogram drawTimes;
+    auto frameInterval = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<float>(fps > 0.0f ? 1.0f / fps : 0.0f));
+    auto nextFrame = chrono::steady_clock::now();
+    auto nextStats = nextFrame + chrono::seconds(1);
+    int frame = 0;
+    while (g_running && (frameCount == 0 || frame < frameCount))
+    {
+        auto start = chrono::steady_clock::now();
+        XPLMStub::runFrame();
+        auto end = chrono::steady_clock::now();
+        drawTimes.record(chrono::duration_cast<chrono::microseconds>(end - start).count());
+        frame++;
+
+        if (end >= nextStats)
+        {
+            printStats(frame, drawTimes);
+            nextStats += chrono::seconds(1);
+        }
+
+        if (fps > 0.0f)
+        {
+            nextFrame += frameInterval;
+            this_thread::sleep_until(nextFrame);
+        }
+    }
+    printStats(frame, drawTimes);
+
+    if (writeCsv)
+    {
+        XPLMStub::clickMenuItem("Write Profile CSV");
+    }
+
+    g_ufcPlugin.disable();
+    g_ufcPlugin.stop();
+    gl.destroy();
+    return 0;
+}
@@ -0,0 +1,200 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "offscreengl.h"
+
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <EGL/eglext.h>
+
+#define GL_GLEXT_PROTOTYPES 1
+#include <GL/gl.h>
+
+#include <png.h>
+
+using namespace std;
+
+OffscreenGL::~OffscreenGL()
+{
+    destroy();
+}
+
+bool OffscreenGL::create()
+{
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay == nullptr)
+    {
+        log(ERROR, "create: eglGetPlatformDisplayEXT isn't available");
+        return false;
+    }
+
+    m_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    EGLint major;
+    EGLint minor;
+    if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, &major, &minor))
+    {
+        log(ERROR, "create: Unable to initialise the surfaceless EGL display");
+        return false;
+    }
+    log(DEBUG, "create: EGL %d.%d", major, minor);
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        log(ERROR, "create: Desktop OpenGL isn't supported");
+        return false;
+    }
+
+    // Surfaceless only has pbuffer configs, and the default is to look for window ones
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(m_display, configAttribs, &config, 1, &configCount) || configCount == 0)
+    {
+        log(ERROR, "create: No suitable EGL config");
+        return false;
+    }
+
+    // A compatibility profile, like the sim's
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 2,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+        EGL_NONE
+    };
+    m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (m_context == EGL_NO_CONTEXT)
+    {
+        log(ERROR, "create: Unable to create a GL context: 0x%x", eglGetError());
+        return false;
+    }
+
+    if (!eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context))
+    {
+        log(ERROR, "create: Unable to make the context current: 0x%x", eglGetError());
+        return false;
+    }
+
+    log(INFO, "create: Using %s", getRenderer().c_str());
+    return true;
+}
+
+void OffscreenGL::destroy()
+{
+    if (m_display == EGL_NO_DISPLAY)
+    {
+        return;
+    }
+
+    if (m_context != EGL_NO_CONTEXT)
+    {
+        if (!m_textures.empty())
+        {
+            glDeleteTextures((GLsizei)m_textures.size(), m_textures.data());
+            m_textures.clear();
+        }
+        eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(m_display, m_context);
+        m_context = EGL_NO_CONTEXT;
+    }
+    eglTerminate(m_display);
+    m_display = EGL_NO_DISPLAY;
+}
+
+unsigned int OffscreenGL::loadTexture(const string &path, int width, int height)
+{
+    vector<uint8_t> data;
+    bool loaded;
+    if (filesystem::path(path).extension() == ".png")
+    {
+        loaded = loadPng(path, data, width, height);
+    }
+    else
+    {
+        loaded = loadDat(path, data, width, height);
+    }
+    if (!loaded)
+    {
+        log(ERROR, "loadTexture: %s: Unable to load", path.c_str());
+        return 0;
+    }
+
+    // The rows are already bottom up, as they were when they were dumped
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_textures.push_back(texture);
+    log(INFO, "loadTexture: %s: Texture %d, %dx%d", path.c_str(), texture, width, height);
+    return texture;
+}
+
+bool OffscreenGL::loadPng(const string &path, vector<uint8_t> &data, int &width, int &height)
+{
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_file(&image, path.c_str()))
+    {
+        return false;
+    }
+
+    image.format = PNG_FORMAT_RGBA;
+    data.resize(PNG_IMAGE_SIZE(image));
+    if (!png_image_finish_read(&image, nullptr, data.data(), 0, nullptr))
+    {
+        png_image_free(&image);
+        return false;
+    }
+
+    width = (int)image.width;
+    height = (int)image.height;
+    return true;
+}
+
+bool OffscreenGL::loadDat(const string &path, vector<uint8_t> &data, int &width, int &height)
+{
+    ifstream file(path, ios::binary | ios::ate);
+    if (!file)
+    {
+        return false;
+    }
+    auto size = (size_t)file.tellg();
+
+    if (width <= 0 || height <= 0)
+    {
+        width = (int)sqrt((double)size / 4);
+        height = width;
+    }
+    if ((size_t)width * height * 4 != size)
+    {
+        return false;
+    }
+
+    data.resize(size);
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(data.data()), (streamsize)size);
+    return (bool)file;
+}
+
+string OffscreenGL::getRenderer() const
+{
+    auto renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    auto version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    return string(renderer != nullptr ? renderer : "unknown") + ", " + (version != nullptr ? version : "unknown");
+}
@@ -0,0 +1,44 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef OFFSCREENGL_H
+#define OFFSCREENGL_H
+
+#include <string>
+#include <vector>
+
+#include <EGL/egl.h>
+
+#include "logger.h"
+
+/*
+ * A desktop GL context with no window, using Mesa's surfaceless EGL platform
+ * so it works on a headless machine with just llvmpipe. Textures are loaded
+ * from PNGs or raw .dat dumps so they look like the sim's to the plugin.
+ */
+class OffscreenGL : private Logger
+{
+ private:
+    EGLDisplay m_display = EGL_NO_DISPLAY;
+    EGLContext m_context = EGL_NO_CONTEXT;
+    std::vector<unsigned int> m_textures;
+
+    static bool loadPng(const std::string &path, std::vector<uint8_t> &data, int &width, int &height);
+    static bool loadDat(const std::string &path, std::vector<uint8_t> &data, int &width, int &height);
+
+ public:
+    OffscreenGL() : Logger("OffscreenGL") {}
+    ~OffscreenGL() override;
+
+    bool create();
+    void destroy();
+
+    // Creates a texture from a PNG or a raw RGBA dump, returns its texture number or 0.
+    // Dumps are assumed to be square unless a width and height are given
+    unsigned int loadTexture(const std::string &path, int width = 0, int height = 0);
+
+    [[nodiscard]] std::string getRenderer() const;
+};
+
+#endif //OFFSCREENGL_H
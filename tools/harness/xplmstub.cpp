@@ -0,0 +1,500 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#define XPLM200 1
+#define XPLM210 1
+#define XPLM300 1
+#define XPLM400 1
+
+#include "xplmstub.h"
+
+#include <XPLMDataAccess.h>
+#include <XPLMDisplay.h>
+#include <XPLMMenus.h>
+#include <XPLMProcessing.h>
+#include <XPLMUtilities.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+
+#include <yaml-cpp/yaml.h>
+
+using namespace std;
+
+struct StubDataRef
+{
+    string value;
+
+    // Set by the user, so don't overwrite it with what the draw loop measures
+    bool pinned = false;
+};
+
+struct StubDrawCallback
+{
+    XPLMDrawCallback_f callback;
+    XPLMDrawingPhase phase;
+    int before;
+    void* refcon;
+};
+
+struct StubFlightLoop
+{
+    XPLMFlightLoop_f callback;
+    void* refcon;
+
+    // Positive for seconds, negative for frames, 0 when not scheduled
+    float interval;
+    float nextCall = 0.0f;
+    int nextCycle = 0;
+    float lastCall = 0.0f;
+};
+
+struct StubMenuItem
+{
+    string name;
+    void* itemRef;
+    bool enabled = true;
+    XPLMMenuCheck check = xplm_Menu_NoCheck;
+};
+
+struct StubMenu
+{
+    string name;
+    XPLMMenuHandler_f handler = nullptr;
+    void* menuRef = nullptr;
+    vector<StubMenuItem> items;
+};
+
+struct StubCommandHandler
+{
+    XPLMCommandCallback_f callback;
+    int before;
+    void* refcon;
+};
+
+struct StubCommand
+{
+    string name;
+    string description;
+    vector<StubCommandHandler> handlers;
+};
+
+// The ones the sim always has, kept up to date by runFrame
+static map<string, StubDataRef> g_dataRefs = {
+    {"sim/time/framerate_period", {"0"}},
+    {"sim/time/total_running_time_sec", {"0"}},
+};
+static vector<StubDrawCallback> g_drawCallbacks;
+static vector<StubFlightLoop> g_flightLoops;
+static list<StubMenu> g_menus;
+static map<string, StubCommand> g_commands;
+
+static const chrono::steady_clock::time_point g_startTime = chrono::steady_clock::now();
+static float g_fixedTimestep = 0.0f;
+static float g_elapsed = 0.0f;
+static float g_lastFrame = -1.0f;
+static int g_cycle = 0;
+
+static StubDataRef* findStubDataRef(const string &name, bool create)
+{
+    auto it = g_dataRefs.find(name);
+    if (it != g_dataRefs.end())
+    {
+        return &it->second;
+    }
+    if (!create)
+    {
+        return nullptr;
+    }
+    return &g_dataRefs[name];
+}
+
+static StubMenu* getPluginsMenu()
+{
+    if (g_menus.empty())
+    {
+        g_menus.push_back({"Plugins"});
+    }
+    return &g_menus.front();
+}
+
+/*
+ * The harness's API
+ */
+
+bool XPLMStub::loadDataRefs(const string &path)
+{
+    YAML::Node node;
+    try
+    {
+        node = YAML::LoadFile(path);
+    }
+    catch (const YAML::Exception &e)
+    {
+        fprintf(stderr, "XPLMStub: %s: %s\n", path.c_str(), e.what());
+        return false;
+    }
+
+    for (const auto& it : node)
+    {
+        setDataRef(it.first.as<string>(), it.second.as<string>());
+    }
+    return true;
+}
+
+void XPLMStub::setDataRef(const string &name, const string &value)
+{
+    auto dataRef = findStubDataRef(name, true);
+    dataRef->value = value;
+    dataRef->pinned = true;
+}
+
+void XPLMStub::setFixedTimestep(float seconds)
+{
+    g_fixedTimestep = seconds;
+}
+
+void XPLMStub::runFrame()
+{
+    if (g_fixedTimestep > 0.0f)
+    {
+        g_elapsed += g_fixedTimestep;
+    }
+    else
+    {
+        g_elapsed = chrono::duration<float>(chrono::steady_clock::now() - g_startTime).count();
+    }
+    g_cycle++;
+
+    if (g_lastFrame >= 0.0f)
+    {
+        auto frameRatePeriod = findStubDataRef("sim/time/framerate_period", false);
+        if (!frameRatePeriod->pinned)
+        {
+            frameRatePeriod->value = to_string(g_elapsed - g_lastFrame);
+        }
+    }
+    g_lastFrame = g_elapsed;
+    auto runningTime = findStubDataRef("sim/time/total_running_time_sec", false);
+    runningTime->value = to_string(g_elapsed);
+
+    // Callbacks may register or unregister others, so work through copies
+    auto flightLoops = g_flightLoops;
+    for (const auto& flightLoop : flightLoops)
+    {
+        bool due =
+            (flightLoop.interval > 0.0f && g_elapsed >= flightLoop.nextCall) ||
+            (flightLoop.interval < 0.0f && g_cycle >= flightLoop.nextCycle);
+        if (!due)
+        {
+            continue;
+        }
+
+        float next = flightLoop.callback(g_elapsed - flightLoop.lastCall, g_elapsed - flightLoop.lastCall, g_cycle, flightLoop.refcon);
+        XPLMSetFlightLoopCallbackInterval(flightLoop.callback, next, 1, flightLoop.refcon);
+    }
+
+    auto drawCallbacks = g_drawCallbacks;
+    for (const auto& drawCallback : drawCallbacks)
+    {
+        drawCallback.callback(drawCallback.phase, drawCallback.before, drawCallback.refcon);
+    }
+}
+
+bool XPLMStub::clickMenuItem(const string &name)
+{
+    for (auto& menu : g_menus)
+    {
+        for (const auto& item : menu.items)
+        {
+            if (item.name == name && item.enabled && menu.handler != nullptr)
+            {
+                menu.handler(menu.menuRef, item.itemRef);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+vector<string> XPLMStub::getMenuItems(const string &name)
+{
+    vector<string> items;
+    for (const auto& menu : g_menus)
+    {
+        if (menu.name == name)
+        {
+            for (const auto& item : menu.items)
+            {
+                items.push_back(item.name);
+            }
+        }
+    }
+    return items;
+}
+
+bool XPLMStub::runCommand(const string &name)
+{
+    auto command = XPLMFindCommand(name.c_str());
+    if (command == nullptr)
+    {
+        return false;
+    }
+    XPLMCommandOnce(command);
+    return true;
+}
+
+/*
+ * XPLMDisplay
+ */
+
+int XPLMRegisterDrawCallback(XPLMDrawCallback_f inCallback, XPLMDrawingPhase inPhase, int inWantsBefore, void* inRefcon)
+{
+    g_drawCallbacks.push_back({inCallback, inPhase, inWantsBefore, inRefcon});
+    return 1;
+}
+
+int XPLMUnregisterDrawCallback(XPLMDrawCallback_f inCallback, XPLMDrawingPhase inPhase, int inWantsBefore, void* inRefcon)
+{
+    auto it = find_if(g_drawCallbacks.begin(), g_drawCallbacks.end(), [&](const StubDrawCallback &drawCallback)
+    {
+        return drawCallback.callback == inCallback &&
+            drawCallback.phase == inPhase &&
+            drawCallback.before == inWantsBefore &&
+            drawCallback.refcon == inRefcon;
+    });
+    if (it == g_drawCallbacks.end())
+    {
+        return 0;
+    }
+    g_drawCallbacks.erase(it);
+    return 1;
+}
+
+/*
+ * XPLMProcessing
+ */
+
+float XPLMGetElapsedTime()
+{
+    return g_elapsed;
+}
+
+int XPLMGetCycleNumber()
+{
+    return g_cycle;
+}
+
+void XPLMRegisterFlightLoopCallback(XPLMFlightLoop_f inFlightLoop, float inInterval, void* inRefcon)
+{
+    g_flightLoops.push_back({inFlightLoop, inRefcon, 0.0f, 0.0f, 0, g_elapsed});
+    XPLMSetFlightLoopCallbackInterval(inFlightLoop, inInterval, 1, inRefcon);
+}
+
+void XPLMUnregisterFlightLoopCallback(XPLMFlightLoop_f inFlightLoop, void* inRefcon)
+{
+    g_flightLoops.erase(remove_if(g_flightLoops.begin(), g_flightLoops.end(), [&](const StubFlightLoop &flightLoop)
+    {
+        return flightLoop.callback == inFlightLoop && flightLoop.refcon == inRefcon;
+    }), g_flightLoops.end());
+}
+
+void XPLMSetFlightLoopCallbackInterval(XPLMFlightLoop_f inFlightLoop, float inInterval, [[maybe_unused]] int inRelativeToNow, void* inRefcon)
+{
+    for (auto& flightLoop : g_flightLoops)
+    {
+        if (flightLoop.callback == inFlightLoop && flightLoop.refcon == inRefcon)
+        {
+            flightLoop.interval = inInterval;
+            flightLoop.nextCall = g_elapsed + inInterval;
+            flightLoop.nextCycle = g_cycle + (int)-inInterval;
+            flightLoop.lastCall = g_elapsed;
+        }
+    }
+}
+
+/*
+ * XPLMDataAccess
+ */
+
+XPLMDataRef XPLMFindDataRef(const char* inDataRefName)
+{
+    // Like the sim, datarefs nobody has defined don't exist
+    return findStubDataRef(inDataRefName, false);
+}
+
+int XPLMGetDatai(XPLMDataRef inDataRef)
+{
+    return inDataRef != nullptr ? atoi(static_cast<StubDataRef*>(inDataRef)->value.c_str()) : 0;
+}
+
+float XPLMGetDataf(XPLMDataRef inDataRef)
+{
+    return inDataRef != nullptr ? strtof(static_cast<StubDataRef*>(inDataRef)->value.c_str(), nullptr) : 0.0f;
+}
+
+double XPLMGetDatad(XPLMDataRef inDataRef)
+{
+    return inDataRef != nullptr ? strtod(static_cast<StubDataRef*>(inDataRef)->value.c_str(), nullptr) : 0.0;
+}
+
+void XPLMSetDatai(XPLMDataRef inDataRef, int inValue)
+{
+    if (inDataRef != nullptr)
+    {
+        static_cast<StubDataRef*>(inDataRef)->value = to_string(inValue);
+    }
+}
+
+void XPLMSetDataf(XPLMDataRef inDataRef, float inValue)
+{
+    if (inDataRef != nullptr)
+    {
+        static_cast<StubDataRef*>(inDataRef)->value = to_string(inValue);
+    }
+}
+
+void XPLMSetDatad(XPLMDataRef inDataRef, double inValue)
+{
+    if (inDataRef != nullptr)
+    {
+        static_cast<StubDataRef*>(inDataRef)->value = to_string(inValue);
+    }
+}
+
+int XPLMGetDatab(XPLMDataRef inDataRef, void* outValue, int inOffset, int inMaxBytes)
+{
+    if (inDataRef == nullptr)
+    {
+        return 0;
+    }
+
+    const auto& value = static_cast<StubDataRef*>(inDataRef)->value;
+    if (outValue == nullptr)
+    {
+        return (int)value.size();
+    }
+    if (inOffset >= (int)value.size())
+    {
+        return 0;
+    }
+
+    int bytes = min(inMaxBytes, (int)value.size() - inOffset);
+    memcpy(outValue, value.data() + inOffset, bytes);
+    return bytes;
+}
+
+/*
+ * XPLMMenus
+ */
+
+XPLMMenuID XPLMFindPluginsMenu()
+{
+    return getPluginsMenu();
+}
+
+XPLMMenuID XPLMCreateMenu(const char* inName, [[maybe_unused]] XPLMMenuID inParentMenu, [[maybe_unused]] int inParentItem, XPLMMenuHandler_f inHandler, void* inMenuRef)
+{
+    getPluginsMenu();
+    g_menus.push_back({inName, inHandler, inMenuRef});
+    return &g_menus.back();
+}
+
+int XPLMAppendMenuItem(XPLMMenuID inMenu, const char* inItemName, void* inItemRef, [[maybe_unused]] int inDeprecatedAndIgnored)
+{
+    auto menu = static_cast<StubMenu*>(inMenu);
+    menu->items.push_back({inItemName, inItemRef});
+    return (int)menu->items.size() - 1;
+}
+
+void XPLMAppendMenuSeparator(XPLMMenuID inMenu)
+{
+    XPLMAppendMenuItem(inMenu, "-", nullptr, 0);
+    static_cast<StubMenu*>(inMenu)->items.back().enabled = false;
+}
+
+void XPLMSetMenuItemName(XPLMMenuID inMenu, int inIndex, const char* inItemName, [[maybe_unused]] int inDeprecatedAndIgnored)
+{
+    auto menu = static_cast<StubMenu*>(inMenu);
+    if (inIndex >= 0 && inIndex < (int)menu->items.size())
+    {
+        menu->items[inIndex].name = inItemName;
+    }
+}
+
+void XPLMCheckMenuItem(XPLMMenuID inMenu, int index, XPLMMenuCheck inCheck)
+{
+    auto menu = static_cast<StubMenu*>(inMenu);
+    if (index >= 0 && index < (int)menu->items.size())
+    {
+        menu->items[index].check = inCheck;
+    }
+}
+
+void XPLMEnableMenuItem(XPLMMenuID inMenu, int index, int enabled)
+{
+    auto menu = static_cast<StubMenu*>(inMenu);
+    if (index >= 0 && index < (int)menu->items.size())
+    {
+        menu->items[index].enabled = enabled != 0;
+    }
+}
+
+/*
+ * XPLMUtilities
+ */
+
+void XPLMDebugString(const char* inString)
+{
+    fputs(inString, stderr);
+}
+
+XPLMCommandRef XPLMCreateCommand(const char* inName, const char* inDescription)
+{
+    auto& command = g_commands[inName];
+    command.name = inName;
+    command.description = inDescription;
+    return &command;
+}
+
+XPLMCommandRef XPLMFindCommand(const char* inName)
+{
+    auto it = g_commands.find(inName);
+    return it != g_commands.end() ? &it->second : nullptr;
+}
+
+void XPLMRegisterCommandHandler(XPLMCommandRef inComand, XPLMCommandCallback_f inHandler, int inBefore, void* inRefcon)
+{
+    static_cast<StubCommand*>(inComand)->handlers.push_back({inHandler, inBefore, inRefcon});
+}
+
+void XPLMUnregisterCommandHandler(XPLMCommandRef inComand, XPLMCommandCallback_f inHandler, int inBefore, void* inRefcon)
+{
+    auto& handlers = static_cast<StubCommand*>(inComand)->handlers;
+    handlers.erase(remove_if(handlers.begin(), handlers.end(), [&](const StubCommandHandler &handler)
+    {
+        return handler.callback == inHandler && handler.before == inBefore && handler.refcon == inRefcon;
+    }), handlers.end());
+}
+
+void XPLMCommandOnce(XPLMCommandRef inCommand)
+{
+    auto handlers = static_cast<StubCommand*>(inCommand)->handlers;
+    for (auto phase : {xplm_CommandBegin, xplm_CommandEnd})
+    {
+        for (const auto& handler : handlers)
+        {
+            if (!handler.callback(inCommand, phase, handler.refcon))
+            {
+                break;
+            }
+        }
+    }
+}
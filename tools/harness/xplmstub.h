@@ -0,0 +1,42 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef XPLMSTUB_H
+#define XPLMSTUB_H
+
+#include <string>
+#include <vector>
+
+/*
+ * Just enough of the X-Plane plugin API to run the plugin outside the sim.
+ *
+ * Datarefs are plain strings, set from a YAML file or by the harness, and
+ * converted to whatever type the plugin asks for. sim/time/framerate_period
+ * follows the fake draw loop unless it has been set explicitly. Menus and
+ * commands are recorded so the harness can "click" on them.
+ */
+class XPLMStub
+{
+ public:
+    // A flat map of dataref names to values, e.g. "sim/aircraft/view/acf_ICAO: A321"
+    static bool loadDataRefs(const std::string &path);
+    static void setDataRef(const std::string &name, const std::string &value);
+
+    // Advance the elapsed time by a fixed step every frame, rather than following the real clock.
+    // 0 to go back to the real clock
+    static void setFixedTimestep(float seconds);
+
+    // One sim frame: runs any flight loops that are due and then every draw callback
+    static void runFrame();
+
+    // Calls the handler of the first menu item with this name, in any menu
+    static bool clickMenuItem(const std::string &name);
+
+    // Current names of the items in the named menu
+    static std::vector<std::string> getMenuItems(const std::string &menu);
+
+    static bool runCommand(const std::string &name);
+};
+
+#endif //XPLMSTUB_H
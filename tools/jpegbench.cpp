@@ -0,0 +1,246 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+/*
+ * Compares the stock GStreamer MJPEG path (videoconvert ! jpegenc) with the
+ * in-process libjpeg-turbo slice encoder, encoding the same frames with each.
+ *
+ * Usage: xstream_jpegbench [-w width] [-h height] [-n frames] [-t threads] [-q quality]
+ *                          [-f texture.dat -s texturesize -x x -y y]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
+
+#include "jpegencoder.h"
+#include "workerpool.h"
+
+using namespace std;
+
+struct BenchResult
+{
+    double totalMs = 0;
+    double maxMs = 0;
+    size_t bytes = 0;
+};
+
+static void syntheticFrame(vector<uint8_t> &frame, int width, int height, int n)
+{
+    // Mostly black with some text-like detail and a moving bar, like an avionics display
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            uint8_t* p = &frame[((size_t)y * width + x) * 4];
+            bool glyph = ((x / 3) % 7 < 4) && ((y / 5) % 9 < 6) && (y % 60 < 30) && (x % 200 < 120);
+            bool bar = ((y + n * 4) % height) < 40;
+            p[0] = glyph ? 0x20 : 0;
+            p[1] = glyph ? 0xff : (bar ? 0x60 : 0);
+            p[2] = glyph ? 0x20 : (bar ? 0xc0 : 0);
+            p[3] = 0xff;
+        }
+    }
+}
+
+static bool loadFrame(vector<uint8_t> &frame, const string &path, int textureSize, int x, int y, int width, int height)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        perror(path.c_str());
+        return false;
+    }
+    struct stat st = {};
+    fstat(fd, &st);
+    if ((size_t)st.st_size < (size_t)textureSize * textureSize * 4)
+    {
+        fprintf(stderr, "%s: Too small for a %dx%d texture\n", path.c_str(), textureSize, textureSize);
+        close(fd);
+        return false;
+    }
+    auto data = static_cast<uint8_t*>(mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        perror("mmap");
+        return false;
+    }
+
+    for (int row = 0; row < height; row++)
+    {
+        memcpy(&frame[(size_t)row * width * 4], data + ((size_t)(y + row) * textureSize + x) * 4, (size_t)width * 4);
+    }
+    munmap(data, st.st_size);
+    return true;
+}
+
+static BenchResult benchGStreamer(const vector<vector<uint8_t>> &frames, int width, int height, int quality, int count)
+{
+    BenchResult result;
+
+    string launch = "appsrc name=src is-live=true format=time ! videoconvert ! video/x-raw,format=I420 ! ";
+    launch += "jpegenc quality=" + to_string(quality) + " ! appsink name=sink sync=false";
+
+    GError* error = nullptr;
+    auto pipeline = gst_parse_launch(launch.c_str(), &error);
+    if (pipeline == nullptr)
+    {
+        fprintf(stderr, "gst_parse_launch failed: %s\n", error != nullptr ? error->message : "Unknown");
+        return result;
+    }
+    auto src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+    auto sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+
+    auto caps = gst_caps_new_simple("video/x-raw",
+        "format", G_TYPE_STRING, "RGBA",
+        "width", G_TYPE_INT, width,
+        "height", G_TYPE_INT, height,
+        "framerate", GST_TYPE_FRACTION, 30, 1, NULL);
+    g_object_set(G_OBJECT(src), "caps", caps, NULL);
+    gst_caps_unref(caps);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    size_t frameSize = (size_t)width * height * 4;
+    for (int i = 0; i < count; i++)
+    {
+        auto start = chrono::steady_clock::now();
+
+        auto buffer = gst_buffer_new_allocate(nullptr, frameSize, nullptr);
+        gst_buffer_fill(buffer, 0, frames[i % frames.size()].data(), frameSize);
+        GST_BUFFER_PTS(buffer) = gst_util_uint64_scale(i, GST_SECOND, 30);
+        gst_app_src_push_buffer(GST_APP_SRC(src), buffer);
+
+        auto sample = gst_app_sink_pull_sample(GST_APP_SINK(sink));
+        if (sample == nullptr)
+        {
+            fprintf(stderr, "No sample from jpegenc\n");
+            break;
+        }
+        result.bytes += gst_buffer_get_size(gst_sample_get_buffer(sample));
+        gst_sample_unref(sample);
+
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        result.totalMs += ms;
+        result.maxMs = max(result.maxMs, ms);
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(src);
+    gst_object_unref(sink);
+    gst_object_unref(pipeline);
+    return result;
+}
+
+static BenchResult benchTurbo(const vector<vector<uint8_t>> &frames, int width, int height, int quality, int threads, int count)
+{
+    BenchResult result;
+    auto pool = make_shared<WorkerPool>(threads - 1);
+    JpegEncoder encoder(pool, quality);
+    vector<uint8_t> out;
+
+    for (int i = 0; i < count; i++)
+    {
+        auto start = chrono::steady_clock::now();
+        if (!encoder.encode(frames[i % frames.size()].data(), width, height, out))
+        {
+            fprintf(stderr, "JpegEncoder failed\n");
+            break;
+        }
+        result.bytes += out.size();
+
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        result.totalMs += ms;
+        result.maxMs = max(result.maxMs, ms);
+    }
+    return result;
+}
+
+static void printResult(const char* name, const BenchResult &result, int count)
+{
+    printf("%-24s %8.2f ms/frame avg %8.2f ms max %8.1f fps %8.1f KB/frame\n",
+        name,
+        result.totalMs / count,
+        result.maxMs,
+        count * 1000.0 / result.totalMs,
+        result.bytes / 1024.0 / count);
+}
+
+int main(int argc, char** argv)
+{
+    gst_init(&argc, &argv);
+
+    int width = 812;
+    int height = 812;
+    int count = 300;
+    int threads = 4;
+    int quality = 85;
+    string file;
+    int textureSize = 2436;
+    int x = 0;
+    int y = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "w:h:n:t:q:f:s:x:y:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'w': width = atoi(optarg); break;
+            case 'h': height = atoi(optarg); break;
+            case 'n': count = atoi(optarg); break;
+            case 't': threads = max(1, atoi(optarg)); break;
+            case 'q': quality = atoi(optarg); break;
+            case 'f': file = optarg; break;
+            case 's': textureSize = atoi(optarg); break;
+            case 'x': x = atoi(optarg); break;
+            case 'y': y = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-w width] [-h height] [-n frames] [-t threads] [-q quality] [-f texture.dat -s texturesize -x x -y y]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    vector<vector<uint8_t>> frames;
+    if (!file.empty())
+    {
+        frames.emplace_back((size_t)width * height * 4);
+        if (!loadFrame(frames.back(), file, textureSize, x, y, width, height))
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            frames.emplace_back((size_t)width * height * 4);
+            syntheticFrame(frames.back(), width, height, i);
+        }
+    }
+
+    printf("%dx%d, %d frames, quality %d\n", width, height, count, quality);
+    printResult("videoconvert ! jpegenc", benchGStreamer(frames, width, height, quality, count), count);
+    printResult("turbo, 1 thread", benchTurbo(frames, width, height, quality, 1, count), count);
+    if (threads > 1)
+    {
+        string name = "turbo, " + to_string(threads) + " threads";
+        printResult(name.c_str(), benchTurbo(frames, width, height, quality, threads, count), count);
+    }
+    return 0;
+}
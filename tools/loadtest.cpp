@@ -0,0 +1,428 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+/*
+ * Finds out how many RTSP clients a server can keep up with. Clients are added
+ * a few at a time, spread across the given mounts, and each step reports
+ * the clients' frame rate, inter-frame jitter, startup time and bitrate along
+ * with the server's CPU usage. Run it against xstream_harness -S to test
+ * without X-Plane.
+ *
+ * Usage: xstream_loadtest [-H host] [-P port] [-c mjpeg|h264] [-T] [-d] [-n clients] [-s step]
+ *                         [-t seconds] [-w warmup] [-p pid] [-v] mount...
+ *
+ *   -H, -P  Server to connect to (default 127.0.0.1:8554)
+ *   -c  Codec the server is sending (default mjpeg)
+ *   -T  Use RTP over the RTSP TCP connection rather than UDP
+ *   -d  Decode the frames too, rather than just depayloading them
+ *   -n  Clients to finish with (default 32)
+ *   -s  Clients to add at each step (default 4)
+ *   -t  Seconds to measure each step over (default 10)
+ *   -w  Seconds to let new clients settle before measuring (default 2)
+ *   -p  PID of the server, to report its CPU usage (Linux only)
+ *   -v  Print every client's results, not just the summary
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+
+#include "histogram.h"
+
+using namespace std;
+
+static atomic<bool> g_running = true;
+
+struct ClientStats
+{
+    double fps = 0;
+    double jitterMs = 0;
+    double p99GapMs = 0;
+    double startupMs = -1;
+    double kbps = 0;
+};
+
+struct LoadClient
+{
+    int id = 0;
+    string mount;
+    GstElement* pipeline = nullptr;
+    string error;
+
+    mutex statsMutex;
+    chrono::steady_clock::time_point started;
+    chrono::steady_clock::time_point firstFrame;
+    chrono::steady_clock::time_point lastFrame;
+    bool gotFrame = false;
+
+    // For the current measurement window
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    double gapSum = 0;
+    double gapSquares = 0;
+    Histogram gaps;
+
+    void frame(size_t size)
+    {
+        auto now = chrono::steady_clock::now();
+        scoped_lock lock(statsMutex);
+        if (!gotFrame)
+        {
+            firstFrame = now;
+            gotFrame = true;
+        }
+        else
+        {
+            auto gap = chrono::duration_cast<chrono::microseconds>(now - lastFrame).count();
+            gaps.record(gap);
+            gapSum += (double)gap;
+            gapSquares += (double)gap * (double)gap;
+        }
+        lastFrame = now;
+        frames++;
+        bytes += size;
+    }
+
+    void resetWindow()
+    {
+        scoped_lock lock(statsMutex);
+        frames = 0;
+        bytes = 0;
+        gapSum = 0;
+        gapSquares = 0;
+        gaps.reset();
+    }
+
+    ClientStats getStats(double seconds)
+    {
+        scoped_lock lock(statsMutex);
+        ClientStats stats;
+        stats.fps = (double)frames / seconds;
+        stats.kbps = (double)bytes * 8.0 / 1000.0 / seconds;
+        auto count = (double)gaps.getCount();
+        if (count > 0)
+        {
+            double mean = gapSum / count;
+            stats.jitterMs = sqrt(max(0.0, gapSquares / count - mean * mean)) / 1000.0;
+            stats.p99GapMs = (double)gaps.getPercentile(99) / 1000.0;
+        }
+        if (gotFrame)
+        {
+            stats.startupMs = (double)chrono::duration_cast<chrono::microseconds>(firstFrame - started).count() / 1000.0;
+        }
+        return stats;
+    }
+};
+
+static void signalHandler([[maybe_unused]] int sig)
+{
+    g_running = false;
+}
+
+static GstFlowReturn newSampleCallback(GstElement* sink, LoadClient* client)
+{
+    auto sample = gst_app_sink_pull_sample(GST_APP_SINK(sink));
+    if (sample == nullptr)
+    {
+        return GST_FLOW_EOS;
+    }
+    client->frame(gst_buffer_get_size(gst_sample_get_buffer(sample)));
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
+
+static shared_ptr<LoadClient> startClient(int id, const string &url, const string &mount, const string &codec, bool tcp, bool decode)
+{
+    string launch = "rtspsrc location=" + url + mount + " latency=0";
+    if (tcp)
+    {
+        launch += " protocols=tcp";
+    }
+    launch += codec == "h264" ? " ! rtph264depay" : " ! rtpjpegdepay";
+    if (decode)
+    {
+        launch += " ! decodebin";
+    }
+    launch += " ! appsink name=sink sync=false emit-signals=true";
+
+    auto client = make_shared<LoadClient>();
+    client->id = id;
+    client->mount = mount;
+
+    GError* error = nullptr;
+    client->pipeline = gst_parse_launch(launch.c_str(), &error);
+    if (client->pipeline == nullptr)
+    {
+        client->error = error != nullptr ? error->message : "Unable to create pipeline";
+        g_clear_error(&error);
+        return client;
+    }
+
+    auto sink = gst_bin_get_by_name(GST_BIN(client->pipeline), "sink");
+    g_signal_connect(sink, "new-sample", (GCallback)newSampleCallback, client.get());
+    gst_object_unref(sink);
+
+    client->started = chrono::steady_clock::now();
+    gst_element_set_state(client->pipeline, GST_STATE_PLAYING);
+    return client;
+}
+
+static void stopClient(const shared_ptr<LoadClient> &client)
+{
+    if (client->pipeline != nullptr)
+    {
+        gst_element_set_state(client->pipeline, GST_STATE_NULL);
+        gst_object_unref(client->pipeline);
+        client->pipeline = nullptr;
+    }
+}
+
+static void checkErrors(const vector<shared_ptr<LoadClient>> &clients)
+{
+    for (const auto& client : clients)
+    {
+        if (client->pipeline == nullptr || !client->error.empty())
+        {
+            continue;
+        }
+
+        auto bus = gst_element_get_bus(client->pipeline);
+        auto message = gst_bus_pop_filtered(bus, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+        if (message != nullptr)
+        {
+            if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR)
+            {
+                GError* error = nullptr;
+                gst_message_parse_error(message, &error, nullptr);
+                client->error = error != nullptr ? error->message : "Unknown error";
+                g_clear_error(&error);
+            }
+            else
+            {
+                client->error = "End of stream";
+            }
+            fprintf(stderr, "Client %d (%s): %s\n", client->id, client->mount.c_str(), client->error.c_str());
+            gst_message_unref(message);
+        }
+        gst_object_unref(bus);
+    }
+}
+
+static void waitFor(double seconds, const vector<shared_ptr<LoadClient>> &clients)
+{
+    auto end = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds));
+    while (g_running && chrono::steady_clock::now() < end)
+    {
+        this_thread::sleep_for(chrono::milliseconds(250));
+        checkErrors(clients);
+    }
+}
+
+// CPU time used by a process in seconds, or -1 if it can't be read
+static double processCpu(int pid)
+{
+#ifdef __linux__
+    ifstream stat("/proc/" + to_string(pid) + "/stat");
+    string line;
+    if (!getline(stat, line))
+    {
+        return -1;
+    }
+
+    // The command name can have spaces in it, the fields we want come after it
+    istringstream fields(line.substr(line.rfind(')') + 2));
+    string field;
+    unsigned long long utime = 0;
+    unsigned long long stime = 0;
+    for (int i = 3; i <= 15 && fields >> field; i++)
+    {
+        if (i == 14)
+        {
+            utime = stoull(field);
+        }
+        else if (i == 15)
+        {
+            stime = stoull(field);
+        }
+    }
+    return (double)(utime + stime) / (double)sysconf(_SC_CLK_TCK);
+#else
+    return -1;
+#endif
+}
+
+static double ownCpu()
+{
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return (double)usage.ru_utime.tv_sec + (double)usage.ru_utime.tv_usec / 1e6 +
+        (double)usage.ru_stime.tv_sec + (double)usage.ru_stime.tv_usec / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+    string host = "127.0.0.1";
+    int port = 8554;
+    string codec = "mjpeg";
+    bool tcp = false;
+    bool decode = false;
+    int maxClients = 32;
+    int step = 4;
+    double seconds = 10;
+    double warmup = 2;
+    int serverPid = 0;
+    bool verbose = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "H:P:c:Tdn:s:t:w:p:v")) != -1)
+    {
+        switch (opt)
+        {
+            case 'H': host = optarg; break;
+            case 'P': port = atoi(optarg); break;
+            case 'c': codec = optarg; break;
+            case 'T': tcp = true; break;
+            case 'd': decode = true; break;
+            case 'n': maxClients = atoi(optarg); break;
+            case 's': step = max(1, atoi(optarg)); break;
+            case 't': seconds = max(1.0, atof(optarg)); break;
+            case 'w': warmup = max(0.0, atof(optarg)); break;
+            case 'p': serverPid = atoi(optarg); break;
+            case 'v': verbose = true; break;
+            default:
+                fprintf(stderr, "Usage: %s [-H host] [-P port] [-c mjpeg|h264] [-T] [-d] [-n clients] [-s step] [-t seconds] [-w warmup] [-p pid] [-v] mount...\n", argv[0]);
+                return 1;
+        }
+    }
+
+    vector<string> mounts;
+    for (int i = optind; i < argc; i++)
+    {
+        string mount = argv[i];
+        mounts.push_back(mount.starts_with("/") ? mount : "/" + mount);
+    }
+    if (mounts.empty())
+    {
+        fprintf(stderr, "%s: No mounts given\n", argv[0]);
+        return 1;
+    }
+
+    gst_init(&argc, &argv);
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    string url = "rtsp://" + host + ":" + to_string(port);
+    printf("%s, %s over %s, %s, %zu mounts\n", url.c_str(), codec.c_str(), tcp ? "TCP" : "UDP", decode ? "decoding" : "depayloading", mounts.size());
+    printf("%7s %6s | %6s %6s %6s | %7s %7s %7s | %8s %8s | %8s | %6s %6s\n",
+        "clients", "failed", "fps", "minfps", "maxfps", "jitter", "maxjit", "p99gap", "startup", "maxstart", "Mbps", "server", "self");
+
+    vector<shared_ptr<LoadClient>> clients;
+    for (int target = min(step, maxClients); g_running && target <= maxClients; target += step)
+    {
+        while ((int)clients.size() < target)
+        {
+            int id = (int)clients.size();
+            clients.push_back(startClient(id, url, mounts[id % mounts.size()], codec, tcp, decode));
+        }
+        waitFor(warmup, clients);
+
+        for (const auto& client : clients)
+        {
+            client->resetWindow();
+        }
+        auto start = chrono::steady_clock::now();
+        double serverStart = serverPid > 0 ? processCpu(serverPid) : -1;
+        double selfStart = ownCpu();
+
+        waitFor(seconds, clients);
+        if (!g_running)
+        {
+            break;
+        }
+
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        double serverEnd = serverPid > 0 ? processCpu(serverPid) : -1;
+        double serverPercent = serverStart >= 0 && serverEnd >= 0 ? (serverEnd - serverStart) / elapsed * 100.0 : -1;
+        double selfPercent = (ownCpu() - selfStart) / elapsed * 100.0;
+
+        int failed = 0;
+        double fpsTotal = 0;
+        double fpsMin = 1e9;
+        double fpsMax = 0;
+        double jitterTotal = 0;
+        double jitterMax = 0;
+        double gapMax = 0;
+        double startupTotal = 0;
+        double startupMax = 0;
+        int started = 0;
+        double kbpsTotal = 0;
+        for (const auto& client : clients)
+        {
+            auto stats = client->getStats(elapsed);
+            if (verbose)
+            {
+                printf("  client %3d %-12s %6.1f fps, jitter %6.1f ms, p99 gap %6.1f ms, startup %7.1f ms, %8.0f kbps%s%s\n",
+                    client->id, client->mount.c_str(), stats.fps, stats.jitterMs, stats.p99GapMs, stats.startupMs, stats.kbps,
+                    client->error.empty() ? "" : ", ", client->error.c_str());
+            }
+            if (!client->error.empty())
+            {
+                failed++;
+                continue;
+            }
+
+            fpsTotal += stats.fps;
+            fpsMin = min(fpsMin, stats.fps);
+            fpsMax = max(fpsMax, stats.fps);
+            jitterTotal += stats.jitterMs;
+            jitterMax = max(jitterMax, stats.jitterMs);
+            gapMax = max(gapMax, stats.p99GapMs);
+            kbpsTotal += stats.kbps;
+            if (stats.startupMs >= 0)
+            {
+                startupTotal += stats.startupMs;
+                startupMax = max(startupMax, stats.startupMs);
+                started++;
+            }
+        }
+
+        int working = (int)clients.size() - failed;
+        char serverCpu[16] = "-";
+        if (serverPercent >= 0)
+        {
+            snprintf(serverCpu, sizeof(serverCpu), "%5.0f%%", serverPercent);
+        }
+        printf("%7zu %6d | %6.1f %6.1f %6.1f | %7.1f %7.1f %7.1f | %8.0f %8.0f | %8.2f | %6s %5.0f%%\n",
+            clients.size(), failed,
+            working > 0 ? fpsTotal / working : 0.0, working > 0 ? fpsMin : 0.0, fpsMax,
+            working > 0 ? jitterTotal / working : 0.0, jitterMax, gapMax,
+            started > 0 ? startupTotal / started : 0.0, startupMax,
+            kbpsTotal / 1000.0,
+            serverCpu, selfPercent);
+        fflush(stdout);
+    }
+
+    for (const auto& client : clients)
+    {
+        stopClient(client);
+    }
+    return 0;
+}
@@ -4,10 +4,40 @@
 
 #include "videostream.h"
 #include "displaymanager.h"
-#include "xstreamplugin.h"
+#include "config.h"
+#include "httpserver.h"
+#include "jpegencoder.h"
+#include "lifecyclemanager.h"
+#include "recorder.h"
+#include "workerpool.h"
+#include "streamhost.h"
+#include "threadpolicy.h"
+#include "webrtcserver.h"
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
 
 using namespace std;
 
+// How long to wait for a new frame in low latency mode before sending the last one again, or for
+// the rest of a frame that's part way through being captured
+static const chrono::milliseconds FRAME_TIMEOUT(1000);
+
+// How long to wait for GStreamer to give back a frame at the memory budget before going over it
+static const chrono::milliseconds ALLOCATE_TIMEOUT(2);
+
+// How many times a copy that's following a frame's bands in is started again, because the frame was
+// abandoned or the next one overtook it, before it waits for a whole frame instead
+static const int MAX_BAND_RESTARTS = 2;
+
+// A mount that's being removed, and whether the client being checked is watching it
+struct WatchingClient
+{
+    string path;
+    bool watching;
+};
+
 bool VideoStream::start()
 {
     if (m_streaming)
@@ -31,6 +61,11 @@ bool VideoStream::stop()
         m_streaming = false;
         g_main_loop_quit(m_loop);
     }
+    if (m_streamMainThread != nullptr)
+    {
+        m_streamMainThread->join();
+        m_streamMainThread = nullptr;
+    }
     return true;
 }
 
@@ -44,20 +79,78 @@ void VideoStream::enoughData(const shared_ptr<Display> &display)
     log(DEBUG, "enoughData: display=%s", display->name.c_str());
 }
 
-void VideoStream::needDataCallback([[maybe_unused]] GstElement* appsrc, [[maybe_unused]] guint unused, const DisplayContext* displayData)
+void VideoStream::needDataCallback([[maybe_unused]] GstElement* appsrc, [[maybe_unused]] guint unused, DisplayContext* displayData)
 {
-    displayData->videoStream->needData(displayData->display);
+    displayData->videoStream->needData(displayData);
 }
 
-void VideoStream::needData(const shared_ptr<Display> &display)
+void VideoStream::needData(DisplayContext* displayContext)
 {
+    const auto& display = displayContext->display;
 #ifdef DEBUG
-    log(DEBUG, "needData: display=%p", appsrc);
+    log(DEBUG, "needData: display=%s", display->name.c_str());
 #endif
-    guint size = display->width * display->height * 4;
+    if (m_lowLatency.enabled)
+    {
+        // Every buffer should be a new capture, not the same one again
+        waitForFrame(displayContext);
+    }
+
+    GstBuffer* buffer;
+    if (displayContext->jpegEncoder != nullptr)
+    {
+        buffer = encodeJpeg(displayContext);
+        if (buffer == nullptr)
+        {
+            return;
+        }
+    }
+    else if (display->yuvConverter != nullptr)
+    {
+        // Already converted when it was captured
+        guint size = display->yuvConverter->getLayout().size;
+
+        buffer = allocateFrame(display, size);
+        GstMapInfo map;
+        gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+        copyFrame(displayContext, [&display, &map](int firstRow, int lastRow)
+        {
+            if (display->yuvBuffer != nullptr)
+            {
+                display->yuvConverter->copyRows(display->yuvBuffer, map.data, firstRow, lastRow);
+            }
+            else
+            {
+                display->yuvConverter->clear(map.data);
+            }
+        }, nullptr);
+        gst_buffer_unmap(buffer, &map);
+    }
+    else
+    {
+        guint size = display->width * display->height * 4;
+
+        buffer = allocateFrame(display, size);
+        size_t stride = (size_t)display->width * 4;
+        copyFrame(displayContext, [&display, buffer, stride](int firstRow, int lastRow)
+        {
+            size_t offset = firstRow * stride;
+            size_t length = (lastRow - firstRow) * stride;
+            if (display->buffer != nullptr)
+            {
+                gst_buffer_fill(buffer, offset, display->buffer + offset, length);
+            }
+            else
+            {
+                gst_buffer_memset(buffer, offset, 0, length);
+            }
+        }, nullptr);
+    }
 
-    auto buffer = gst_buffer_new_allocate (nullptr, size, nullptr);
-    gst_buffer_fill(buffer, 0, display->buffer, size);
+    if (m_lowLatency.enabled)
+    {
+        GST_BUFFER_PTS(buffer) = captureTimestamp(displayContext);
+    }
 
     GstFlowReturn ret;
     g_signal_emit_by_name (display->appSrc, "push-buffer", buffer, &ret);
@@ -72,6 +165,195 @@ void VideoStream::needData(const shared_ptr<Display> &display)
     gst_buffer_unref (buffer);
 }
 
+GstBuffer* VideoStream::allocateFrame(const shared_ptr<Display> &display, size_t size)
+{
+    // Waits briefly for GStreamer to finish with an earlier frame if we're at the memory budget
+    auto data = display->allocator->allocate(size, ALLOCATE_TIMEOUT);
+    if (data == nullptr)
+    {
+        // Better to go over than to stall the stream
+        return gst_buffer_new_allocate (nullptr, size, nullptr);
+    }
+    return gst_buffer_new_wrapped_full((GstMemoryFlags)0, data, size, 0, size, data, freeFrame);
+}
+
+void VideoStream::freeFrame(gpointer data)
+{
+    FrameAllocator::free(static_cast<uint8_t*>(data));
+}
+
+GstBuffer* VideoStream::encodeJpeg(DisplayContext* displayContext)
+{
+    const auto& display = displayContext->display;
+    size_t size = (size_t)display->width * display->height * 4;
+
+    // Take a copy so the sim isn't kept waiting on the lock while we encode
+    displayContext->frame.resize(size);
+    uint8_t* frame = displayContext->frame.data();
+    size_t stride = (size_t)display->width * 4;
+
+    // With pipelined_capture each of the display's bands is compressed as soon as it's in
+    const auto& encoder = displayContext->jpegEncoder;
+    bool banded = display->bandHeight > 0 && JpegEncoder::canEncodeBands(display->width, display->bandHeight);
+    copyFrame(displayContext, [&display, frame, stride](int firstRow, int lastRow)
+    {
+        size_t offset = firstRow * stride;
+        size_t length = (lastRow - firstRow) * stride;
+        if (display->buffer != nullptr)
+        {
+            memcpy(frame + offset, display->buffer + offset, length);
+        }
+        else
+        {
+            memset(frame + offset, 0, length);
+        }
+    }, [&display, &encoder, frame, banded](int firstBand, int lastBand)
+    {
+        if (banded)
+        {
+            encoder->encodeBands(frame, display->width, display->height, display->bandHeight, firstBand, lastBand);
+        }
+    });
+
+    bool encoded = banded ?
+        encoder->finishBands(display->width, display->height, display->bandHeight, displayContext->encoded) :
+        encoder->encode(frame, display->width, display->height, displayContext->encoded);
+    if (!encoded)
+    {
+        log(ERROR, "encodeJpeg: %s: Failed to encode frame", display->name.c_str());
+        return nullptr;
+    }
+
+    auto buffer = gst_buffer_new_allocate (nullptr, displayContext->encoded.size(), nullptr);
+    gst_buffer_fill(buffer, 0, displayContext->encoded.data(), displayContext->encoded.size());
+    return buffer;
+}
+
+void VideoStream::waitForFrame(DisplayContext* displayContext)
+{
+    const auto& display = displayContext->display;
+    unique_lock lock(display->mutex);
+    display->frameCond.wait_for(lock, FRAME_TIMEOUT, [displayContext, &display]()
+    {
+        return display->frameSeq != displayContext->lastFrameSeq || display->bandsReady > 0 || !display->armed;
+    });
+}
+
+void VideoStream::copyFrame(DisplayContext* displayContext, const function<void(int, int)> &copyRows, const function<void(int, int)> &bandsCopied)
+{
+    const auto& display = displayContext->display;
+    int bandCount = display->getBandCount();
+    unique_lock lock(display->mutex);
+    for (int restarts = 0; display->bandsReady > 0 && display->armed; restarts++)
+    {
+        if (restarts == MAX_BAND_RESTARTS)
+        {
+            // Keeps being overtaken, so wait for the capture to be between frames
+            display->frameCond.wait_for(lock, FRAME_TIMEOUT, [&display]()
+            {
+                return display->bandsReady == 0 || !display->armed;
+            });
+            break;
+        }
+        if (copyBands(displayContext, lock, copyRows, bandsCopied))
+        {
+            return;
+        }
+        if (display->bandsReady == 0 && display->armed)
+        {
+            // Abandoned, and whatever it got to is mixed in with the frame before, so wait for the next
+            uint64_t frameSeq = display->frameSeq;
+            display->frameCond.wait_for(lock, FRAME_TIMEOUT, [&display, frameSeq]()
+            {
+                return display->bandsReady > 0 || display->frameSeq != frameSeq || !display->armed;
+            });
+        }
+    }
+
+    // Nothing part way through, so the last whole frame
+    copyRows(0, display->height);
+    displayContext->frameSeq = display->frameSeq;
+    displayContext->frameTime = display->captureTime;
+    lock.unlock();
+    if (bandsCopied != nullptr)
+    {
+        bandsCopied(0, bandCount);
+    }
+}
+
+bool VideoStream::copyBands(DisplayContext* displayContext, unique_lock<mutex> &lock, const function<void(int, int)> &copyRows, const function<void(int, int)> &bandsCopied)
+{
+    // Take the bands as they come in rather than waiting for the lot, and let go of the lock while
+    // they're worked on so the capture can carry on with the next
+    const auto& display = displayContext->display;
+    int bandCount = display->getBandCount();
+    uint64_t frameSeq = display->frameSeq + 1;
+    uint64_t generation = display->bandGeneration;
+    int band = 0;
+    while (band < bandCount)
+    {
+        display->frameCond.wait_for(lock, FRAME_TIMEOUT, [&display, frameSeq, generation, band]()
+        {
+            return display->frameSeq >= frameSeq || display->bandsReady > band || display->bandGeneration != generation || !display->armed;
+        });
+
+        // The frame was abandoned, or it finished and the next one has started on top of it
+        // while the lock was let go. Either way the bands still to come aren't this frame's
+        if (display->bandGeneration != generation)
+        {
+            displayContext->videoStream->log(DEBUG, "copyBands: %s: Frame %llu was overtaken at band %d", display->name.c_str(), (unsigned long long)frameSeq, band);
+            return false;
+        }
+
+        // If the rest of the frame isn't coming, make do with what's there
+        int ready = bandCount;
+        if (display->frameSeq < frameSeq && display->bandsReady > band && display->armed)
+        {
+            ready = display->bandsReady;
+        }
+        copyRows(display->getBandRow(band), display->getBandRow(ready));
+        lock.unlock();
+        if (bandsCopied != nullptr)
+        {
+            bandsCopied(band, ready);
+        }
+        band = ready;
+        lock.lock();
+    }
+    displayContext->frameSeq = display->frameSeq;
+    displayContext->frameTime = display->captureTime;
+    return true;
+}
+
+GstClockTime VideoStream::captureTimestamp(DisplayContext* displayContext)
+{
+    auto appSrc = displayContext->display->appSrc;
+    auto clock = gst_element_get_clock(appSrc);
+    if (clock == nullptr)
+    {
+        return GST_CLOCK_TIME_NONE;
+    }
+
+    // Running time now, less how long ago the frame was captured
+    GstClockTime now = gst_clock_get_time(clock) - gst_element_get_base_time(appSrc);
+    gst_object_unref(clock);
+
+    GstClockTime age = 0;
+    if (displayContext->frameSeq != displayContext->lastFrameSeq)
+    {
+        age = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - displayContext->frameTime).count();
+    }
+    displayContext->lastFrameSeq = displayContext->frameSeq;
+
+    GstClockTime pts = now > age ? now - age : 0;
+    if (displayContext->lastPts != GST_CLOCK_TIME_NONE && pts <= displayContext->lastPts)
+    {
+        pts = displayContext->lastPts + 1;
+    }
+    displayContext->lastPts = pts;
+    return pts;
+}
+
 void VideoStream::mediaConfigure(GstRTSPMedia* media, const shared_ptr<Display> &display)
 {
     log(DEBUG, "mediaConfigure: media=%p, display=%s", media, display->name.c_str());
@@ -79,6 +361,14 @@ void VideoStream::mediaConfigure(GstRTSPMedia* media, const shared_ptr<Display>
     /* get the element used for providing the streams of the media */
     auto element = gst_rtsp_media_get_element (media);
 
+    /* run the pipeline's streaming threads with our scheduling policy */
+    auto pipeline = GST_ELEMENT(gst_object_get_parent(GST_OBJECT(element)));
+    if (pipeline != nullptr)
+    {
+        m_threadPolicy->attach(pipeline);
+        gst_object_unref(pipeline);
+    }
+
     /* get our appsrc, we named it 'mysrc' with the name property */
     display->appSrc = gst_bin_get_by_name_recurse_up (GST_BIN (element), "mysrc");
 
@@ -86,24 +376,76 @@ void VideoStream::mediaConfigure(GstRTSPMedia* media, const shared_ptr<Display>
     gst_util_set_object_arg (G_OBJECT (display->appSrc), "format", "time");
 
     /* configure the caps of the video */
-    g_object_set (G_OBJECT (display->appSrc), "caps",
-        gst_caps_new_simple ("video/x-raw",
-            "format", G_TYPE_STRING, "RGBA",
-            "width", G_TYPE_INT, display->width,
-            "height", G_TYPE_INT, display->height,
-            "framerate", GST_TYPE_FRACTION, 0, 1, NULL), NULL);
+    if (m_turboJpeg)
+    {
+        g_object_set (G_OBJECT (display->appSrc), "caps",
+            gst_caps_new_simple ("image/jpeg",
+                "width", G_TYPE_INT, display->width,
+                "height", G_TYPE_INT, display->height,
+                "framerate", GST_TYPE_FRACTION, 0, 1, NULL), NULL);
+    }
+    else if (display->yuvConverter != nullptr)
+    {
+        g_object_set (G_OBJECT (display->appSrc), "caps",
+            gst_caps_new_simple ("video/x-raw",
+                "format", G_TYPE_STRING, display->yuvConverter->getFormatName(),
+                "colorimetry", G_TYPE_STRING, display->yuvConverter->getColorimetry(),
+                "width", G_TYPE_INT, display->width,
+                "height", G_TYPE_INT, display->height,
+                "framerate", GST_TYPE_FRACTION, 0, 1, NULL), NULL);
+    }
+    else
+    {
+        g_object_set (G_OBJECT (display->appSrc), "caps",
+            gst_caps_new_simple ("video/x-raw",
+                "format", G_TYPE_STRING, "RGBA",
+                "width", G_TYPE_INT, display->width,
+                "height", G_TYPE_INT, display->height,
+                "framerate", GST_TYPE_FRACTION, 0, 1, NULL), NULL);
+    }
 
     /* install the callback that will be called when a buffer is needed */
 
-    auto displayContext = g_new0(DisplayContext, 1);
-    displayContext->display = display;
-    displayContext->videoStream = this;
+    auto displayContext = new DisplayContext{display, this};
+    if (m_turboJpeg)
+    {
+        scoped_lock lock(m_mutex);
+        if (m_jpegPool == nullptr)
+        {
+            int threads = m_host->getConfig()->getMjpeg().threads;
+            if (threads <= 0)
+            {
+                threads = clamp((int)thread::hardware_concurrency() / 2, 1, 4);
+            }
+
+            // One pool for every display, so it's all within RTSP's share of the encoder budget
+            threads = m_host->getConfig()->getEncoderThreads(ENCODER_RTSP, threads);
 
-    g_object_set_data_full (G_OBJECT (media), "display-context", displayContext, (GDestroyNotify) g_free);
+            // The thread calling in to the pool does a share of the work too
+            m_jpegPool = make_shared<WorkerPool>(threads - 1, m_threadPolicy);
+        }
+        displayContext->jpegEncoder = make_shared<JpegEncoder>(m_jpegPool, m_host->getConfig()->getMjpeg().quality);
+    }
+
+    g_object_set_data_full (G_OBJECT (media), "display-context", displayContext, freeDisplayContext);
 
     g_signal_connect (display->appSrc, "need-data", (GCallback)needDataCallback, displayContext);
     g_signal_connect (display->appSrc, "enough-data", (GCallback)enoughDataCallback, displayContext);
 
+    /* let the lifecycle manager know when this pipeline goes away again */
+    g_signal_connect (media, "unprepared", (GCallback)mediaUnpreparedCallback, displayContext);
+    m_host->getLifecycleManager()->mediaConfigured(display);
+
+    if (m_recorder != nullptr)
+    {
+        m_recorder->configure(element, display, m_codec);
+    }
+
+    if (m_webRtcServer != nullptr)
+    {
+        m_webRtcServer->configure(element, display);
+    }
+
     //gst_object_unref (display->appSrc);
     gst_object_unref (element);
 
@@ -115,8 +457,503 @@ void VideoStream::mediaConfigureCallback(GstRTSPMediaFactory* factory, GstRTSPMe
     displayData->videoStream->mediaConfigure(media, displayData->display);
 }
 
+void VideoStream::mediaUnpreparedCallback(GstRTSPMedia* media, DisplayContext* displayData)
+{
+    auto videoStream = displayData->videoStream;
+    videoStream->m_host->getLifecycleManager()->mediaUnprepared(displayData->display);
+
+    // The server unprepares shared media when the last client tears down, even ones we're holding.
+    // This may be on a media or client thread, so build a new one from the main loop
+    if (videoStream->m_streaming)
+    {
+        g_object_ref(media);
+        auto source = g_idle_source_new();
+        g_source_set_callback(source, reholdMediaCallback, new pair<VideoStream*, GstRTSPMedia*>(videoStream, media), freeReholdArgs);
+        g_source_attach(source, videoStream->m_context);
+        g_source_unref(source);
+    }
+}
+
+gboolean VideoStream::reholdMediaCallback(gpointer data)
+{
+    auto args = static_cast<pair<VideoStream*, GstRTSPMedia*>*>(data);
+    args->first->reholdMedia(args->second);
+    return G_SOURCE_REMOVE;
+}
+
+void VideoStream::freeReholdArgs(gpointer data)
+{
+    // Also called if the loop stops before it gets to run
+    auto args = static_cast<pair<VideoStream*, GstRTSPMedia*>*>(data);
+    g_object_unref(args->second);
+    delete args;
+}
+
+void VideoStream::reholdMedia(GstRTSPMedia* media)
+{
+    auto it = find_if(m_heldMedia.begin(), m_heldMedia.end(), [media](const HeldMedia &held)
+    {
+        return held.media == media;
+    });
+    if (it == m_heldMedia.end() || !m_streaming)
+    {
+        return;
+    }
+
+    auto held = *it;
+    m_heldMedia.erase(it);
+    log(DEBUG, "reholdMedia: %s: Media %p was unprepared, preparing a new one", held.display->name.c_str(), media);
+
+    if (held.subscribed)
+    {
+        held.display->subscribers--;
+    }
+    m_host->getLifecycleManager()->mediaReleased(held.display);
+    holdMedia(held.factory, held.display, held.subscribed);
+    g_object_unref(held.media);
+    g_object_unref(held.factory);
+}
+
+void VideoStream::wantMedia(const shared_ptr<Display> &display)
+{
+    // Asked for from any thread, it's held from the main loop
+    auto source = g_idle_source_new();
+    g_source_set_callback(source, holdWantedCallback, new pair<VideoStream*, shared_ptr<Display>>(this, display), freeHoldWantedArgs);
+    g_source_attach(source, m_context);
+    g_source_unref(source);
+}
+
+gboolean VideoStream::holdWantedCallback(gpointer data)
+{
+    auto args = static_cast<pair<VideoStream*, shared_ptr<Display>>*>(data);
+    args->first->holdWanted(args->second);
+    return G_SOURCE_REMOVE;
+}
+
+void VideoStream::freeHoldWantedArgs(gpointer data)
+{
+    delete static_cast<pair<VideoStream*, shared_ptr<Display>>*>(data);
+}
+
+void VideoStream::holdWanted(const shared_ptr<Display> &display)
+{
+    bool held = any_of(m_heldMedia.begin(), m_heldMedia.end(), [&display](const HeldMedia &held)
+    {
+        return held.display == display;
+    });
+    if (held || !m_streaming)
+    {
+        return;
+    }
+
+    // Gone if the display was removed since it was asked for
+    auto mounts = gst_rtsp_server_get_mount_points(m_server);
+    auto factory = gst_rtsp_mount_points_match(mounts, ("/" + display->name).c_str(), nullptr);
+    g_object_unref(mounts);
+    if (factory == nullptr)
+    {
+        return;
+    }
+
+    log(DEBUG, "holdWanted: %s: Holding media", display->name.c_str());
+    holdMedia(factory, display, false);
+    g_object_unref(factory);
+}
+
+void VideoStream::freeDisplayContext(gpointer data)
+{
+    delete static_cast<DisplayContext*>(data);
+}
+
+void VideoStream::clientConnectedCallback([[maybe_unused]] GstRTSPServer* server, GstRTSPClient* client, VideoStream* videoStream)
+{
+    // Keep track of who is playing what, so busy displays get captured first
+    g_signal_connect(client, "play-request", (GCallback)playRequestCallback, videoStream);
+    g_signal_connect(client, "pause-request", (GCallback)stopRequestCallback, videoStream);
+    g_signal_connect(client, "teardown-request", (GCallback)stopRequestCallback, videoStream);
+    g_signal_connect(client, "closed", (GCallback)clientClosedCallback, videoStream);
+}
+
+void VideoStream::playRequestCallback(GstRTSPClient* client, GstRTSPContext* ctx, VideoStream* videoStream)
+{
+    auto display = videoStream->findDisplay(ctx);
+    if (display != nullptr)
+    {
+        videoStream->m_host->getLifecycleManager()->clientPlaying(client, display);
+        if (ctx->media != nullptr)
+        {
+            videoStream->forceKeyUnit(ctx->media, display);
+        }
+    }
+}
+
+void VideoStream::stopRequestCallback(GstRTSPClient* client, GstRTSPContext* ctx, VideoStream* videoStream)
+{
+    auto display = videoStream->findDisplay(ctx);
+    if (display != nullptr)
+    {
+        videoStream->m_host->getLifecycleManager()->clientStopped(client, display);
+    }
+}
+
+void VideoStream::clientClosedCallback(GstRTSPClient* client, VideoStream* videoStream)
+{
+    videoStream->m_host->getLifecycleManager()->clientClosed(client);
+}
+
+shared_ptr<Display> VideoStream::findDisplay(const GstRTSPContext* ctx) const
+{
+    if (ctx->uri == nullptr || ctx->uri->abspath == nullptr)
+    {
+        return nullptr;
+    }
+
+    // The path is /<display>, possibly followed by a stream, e.g. /pfd/stream=0
+    string path = ctx->uri->abspath;
+    auto start = path.find_first_not_of('/');
+    if (start == string::npos)
+    {
+        return nullptr;
+    }
+    auto name = path.substr(start, path.find('/', start) - start);
+
+    for (const auto& display : m_host->getDisplays())
+    {
+        if (display->name == name)
+        {
+            return display;
+        }
+    }
+    return nullptr;
+}
+
+void VideoStream::forceKeyUnit(GstRTSPMedia* media, const shared_ptr<Display> &display)
+{
+    // Every MJPEG frame is a key frame already
+    if (m_codec != CODEC_H264)
+    {
+        return;
+    }
+
+    // A shared pipeline is already mid-GOP when somebody joins, so ask the encoder for
+    // a key frame now rather than having them wait for the next one. The payloader
+    // sends SPS/PPS along with it, and passes the event on upstream to the encoder
+    auto element = gst_rtsp_media_get_element(media);
+    auto payloader = gst_bin_get_by_name_recurse_up(GST_BIN(element), "pay0");
+    gst_object_unref(element);
+    if (payloader == nullptr)
+    {
+        return;
+    }
+
+    auto pad = gst_element_get_static_pad(payloader, "src");
+    if (pad != nullptr)
+    {
+        auto event = gst_event_new_custom(GST_EVENT_CUSTOM_UPSTREAM, gst_structure_new("GstForceKeyUnit",
+            "running-time", G_TYPE_UINT64, GST_CLOCK_TIME_NONE,
+            "all-headers", G_TYPE_BOOLEAN, TRUE,
+            "count", G_TYPE_UINT, 0,
+            NULL));
+        if (!gst_pad_send_event(pad, event))
+        {
+            log(WARN, "forceKeyUnit: %s: Key unit request wasn't handled", display->name.c_str());
+        }
+        else
+        {
+            log(DEBUG, "forceKeyUnit: %s: Requested a key frame", display->name.c_str());
+        }
+        gst_object_unref(pad);
+    }
+    gst_object_unref(payloader);
+}
+
+void VideoStream::holdMedia(GstRTSPMediaFactory* factory, const shared_ptr<Display> &display, bool subscribed)
+{
+    // Construct the media the same way a client would, the factory is shared so
+    // clients will pick up this instance rather than building their own
+    gchar* service = gst_rtsp_server_get_service(m_server);
+    string uri = string("rtsp://127.0.0.1:") + service + "/" + display->name;
+    g_free(service);
+
+    GstRTSPUrl* url = nullptr;
+    if (gst_rtsp_url_parse(uri.c_str(), &url) != GST_RTSP_OK)
+    {
+        log(ERROR, "holdMedia: %s: Failed to parse %s", display->name.c_str(), uri.c_str());
+        return;
+    }
+
+    auto media = gst_rtsp_media_factory_construct(factory, url);
+    gst_rtsp_url_free(url);
+    if (media == nullptr)
+    {
+        log(ERROR, "holdMedia: %s: Failed to construct media", display->name.c_str());
+        return;
+    }
+
+    auto pool = gst_rtsp_server_get_thread_pool(m_server);
+    GstRTSPContext ctx = {};
+    auto thread = gst_rtsp_thread_pool_get_thread(pool, GST_RTSP_THREAD_TYPE_MEDIA, &ctx);
+    g_object_unref(pool);
+
+    if (!gst_rtsp_media_prepare(media, thread))
+    {
+        log(ERROR, "holdMedia: %s: Failed to prepare media", display->name.c_str());
+        g_object_unref(media);
+        return;
+    }
+
+    // Prepared media sits in PAUSED until a client plays it, keep it running so the
+    // encoder is warmed up and the recording, if any, gets written
+    gst_rtsp_media_set_pipeline_state(media, GST_STATE_PLAYING);
+
+    log(DEBUG, "holdMedia: %s: Holding media %p", display->name.c_str(), media);
+    g_object_ref(factory);
+    m_heldMedia.push_back({media, factory, display, subscribed});
+    m_host->getLifecycleManager()->mediaHeld(display);
+
+    if (subscribed)
+    {
+        display->subscribers++;
+    }
+}
+
+void VideoStream::releaseHeldMedia(const shared_ptr<Display> &display)
+{
+    // Take them out first, so unpreparing them doesn't build them again
+    auto it = stable_partition(m_heldMedia.begin(), m_heldMedia.end(), [&display](const HeldMedia &held)
+    {
+        return display != nullptr && held.display != display;
+    });
+    vector<HeldMedia> heldMedia(it, m_heldMedia.end());
+    m_heldMedia.erase(it, m_heldMedia.end());
+    for (const auto& held : heldMedia)
+    {
+        m_host->getLifecycleManager()->mediaReleased(held.display);
+        gst_rtsp_media_unprepare(held.media);
+        g_object_unref(held.media);
+        g_object_unref(held.factory);
+        if (held.subscribed)
+        {
+            held.display->subscribers--;
+        }
+    }
+}
+
+GstRTSPMediaFactory* VideoStream::createFactory(const shared_ptr<Display> &display, bool recording)
+{
+    log(DEBUG, "createFactory: Creating factory for: /%s", display->name.c_str());
+    auto factory = gst_rtsp_media_factory_new();
+
+    string launch = buildLaunch(display, recording);
+    log(DEBUG, "createFactory: %s: %s", display->name.c_str(), launch.c_str());
+
+    gst_rtsp_media_factory_set_launch(factory, launch.c_str());
+
+    // One pipeline per display, however many clients are watching
+    gst_rtsp_media_factory_set_shared(factory, TRUE);
+
+    if (m_lowLatency.enabled)
+    {
+        gst_rtsp_media_factory_set_latency(factory, m_lowLatency.latency);
+        gst_rtsp_media_factory_set_do_retransmission(factory, FALSE);
+
+        // TCP interleaved suffers head-of-line blocking, so prefer UDP
+        int protocols = GST_RTSP_LOWER_TRANS_UDP | GST_RTSP_LOWER_TRANS_UDP_MCAST;
+        if (m_lowLatency.allowTcp)
+        {
+            protocols |= GST_RTSP_LOWER_TRANS_TCP;
+        }
+        gst_rtsp_media_factory_set_protocols(factory, (GstRTSPLowerTrans)protocols);
+    }
+
+    auto displayContext = new DisplayContext{display, this};
+
+    g_signal_connect_data(factory, "media-configure", (GCallback)mediaConfigureCallback, displayContext, (GClosureNotify)freeDisplayContext, (GConnectFlags)0);
+
+    if (recording)
+    {
+        // Send EOS on shutdown so the muxer can finish the file
+        gst_rtsp_media_factory_set_eos_shutdown(factory, TRUE);
+    }
+    return factory;
+}
+
+void VideoStream::displaysChanged(const vector<shared_ptr<Display>> &added, const vector<shared_ptr<Display>> &removed)
+{
+    if (!m_streaming)
+    {
+        // They'll all be mounted when it starts
+        return;
+    }
+
+    // The mount points and held media all belong to the main loop
+    auto source = g_idle_source_new();
+    g_source_set_callback(source, displaysChangedCallback, new DisplayChange{this, added, removed}, freeDisplayChange);
+    g_source_attach(source, m_context);
+    g_source_unref(source);
+}
+
+gboolean VideoStream::displaysChangedCallback(gpointer data)
+{
+    auto change = static_cast<DisplayChange*>(data);
+    change->videoStream->changeDisplays(change->added, change->removed);
+    return G_SOURCE_REMOVE;
+}
+
+void VideoStream::freeDisplayChange(gpointer data)
+{
+    delete static_cast<DisplayChange*>(data);
+}
+
+void VideoStream::changeDisplays(const vector<shared_ptr<Display>> &added, const vector<shared_ptr<Display>> &removed)
+{
+    if (!m_streaming)
+    {
+        return;
+    }
+
+    // Every other display's mount, pipeline and clients are left alone
+    auto mounts = gst_rtsp_server_get_mount_points(m_server);
+    for (const auto& display : removed)
+    {
+        string path = "/" + display->name;
+        log(INFO, "changeDisplays: Removing %s", path.c_str());
+        gst_rtsp_mount_points_remove_factory(mounts, path.c_str());
+        releaseHeldMedia(display);
+
+        // Anybody still watching is disconnected, if it was resized they can reconnect to the new one
+        WatchingClient watching = {path, false};
+        gst_rtsp_server_client_filter(m_server, closeWatchingClientFilter, &watching);
+    }
+
+    for (const auto& display : added)
+    {
+        log(INFO, "changeDisplays: Adding /%s", display->name.c_str());
+        bool recording = m_recorder != nullptr && m_recorder->isRecording(display);
+        auto factory = createFactory(display, recording);
+        gst_rtsp_mount_points_add_factory(mounts, ("/" + display->name).c_str(), factory);
+        if (recording || m_preroll)
+        {
+            holdMedia(factory, display, recording);
+        }
+    }
+    g_object_unref(mounts);
+}
+
+string VideoStream::buildLaunch(const shared_ptr<Display> &display, bool recording) const
+{
+    string launch = "(";
+
+    // Our "appsrc" where we provide the data
+    if (m_lowLatency.enabled)
+    {
+        // Buffers are stamped with their capture time in needData
+        launch += "appsrc name=mysrc block=true is-live=1 do-timestamp=0 min-latency=0 ! ";
+
+        // Only ever hold the newest frame
+        launch += " queue max-size-buffers=1 max-size-bytes=0 max-size-time=0 leaky=downstream ! ";
+    }
+    else
+    {
+        launch += "appsrc name=mysrc block=true is-live=1 do-timestamp=1 min-latency=0 ! ";
+
+        if (!m_turboJpeg)
+        {
+            // Add a queue, this will discard old frames!
+            launch += " queue max-size-time=500000000 ! ";
+        }
+    }
+
+    if (!m_turboJpeg && display->yuvConverter == nullptr)
+    {
+        // Convert it in to YUV, unless it was captured that way
+        launch += "videoconvert ! video/x-raw,format=I420 ! ";
+    }
+
+    // Encode it
+    string payloader;
+    switch (m_codec)
+    {
+        case CODEC_H264:
+            // May be slow to encode, lower bandwidth
+#ifdef __APPLE__
+            // Use Apple Media, using hardware acceleration where available
+            launch += "vtenc_h264 quality=0.25 realtime=true ";
+            if (m_lowLatency.enabled || m_webRtcServer != nullptr)
+            {
+                launch += "allow-frame-reordering=false ";
+            }
+            launch += "! ";
+#else
+            // Standard H264 encoder
+            launch += "x264enc ";
+            if (m_lowLatency.enabled)
+            {
+                launch += "tune=zerolatency speed-preset=ultrafast bframes=0 ";
+            }
+            if (m_encoderThreads > 0)
+            {
+                launch += "threads=" + to_string(m_encoderThreads) + " ";
+            }
+            if (m_pipelinedCapture)
+            {
+                // Each frame is split in to slices across the threads, rather than the threads each taking a frame
+                launch += "sliced-threads=true ";
+            }
+            launch += "! ";
+            if (m_webRtcServer != nullptr)
+            {
+                // Browsers can all decode constrained baseline
+                launch += "video/x-h264,profile=constrained-baseline ! ";
+            }
+#endif
+
+            // Make it streamable
+            // Send SPS/PPS in-band with every key frame, so clients joining a running pipeline can decode it
+            payloader = "rtph264pay name=pay0 pt=96 config-interval=-1 ";
+            if (m_lowLatency.enabled)
+            {
+                // Don't hold back NALs to aggregate them
+                payloader += "aggregate-mode=zero-latency ";
+            }
+            break;
+
+        case CODEC_MJPEG:
+            // Faster encoding, higher bandwidth
+            if (!m_turboJpeg)
+            {
+                launch += "jpegenc ! ";
+            }
+            payloader = "rtpjpegpay name=pay0";
+            break;
+    }
+
+    if (recording || m_webRtcServer != nullptr)
+    {
+        // Split the encoded stream between the payloader, the recorder and WebRTC
+        launch += "tee name=enctee ! queue ! " + payloader;
+        if (recording)
+        {
+            launch += m_recorder->getLaunch(m_codec);
+        }
+        if (m_webRtcServer != nullptr)
+        {
+            launch += WebRtcServer::getLaunch();
+        }
+    }
+    else
+    {
+        launch += payloader;
+    }
+    launch += " )";
+    return launch;
+}
+
 void VideoStream::streamMain()
 {
+    m_threadPolicy = make_shared<ThreadPolicy>(m_host->getConfig()->getScheduling());
+    m_threadPolicy->apply("VideoStream");
+
     log(DEBUG, "streamMain: calling gst_init");
 
     GError* error = nullptr;
@@ -135,69 +972,103 @@ void VideoStream::streamMain()
     }
 
     log(DEBUG, "streamMain: Creating main loop...");
-    m_loop = g_main_loop_new(nullptr, FALSE);
+    m_context = g_main_context_new();
+    g_main_context_push_thread_default(m_context);
+    m_loop = g_main_loop_new(m_context, FALSE);
 
     log(DEBUG, "streamMain: Creating server...");
     m_server = gst_rtsp_server_new ();
 
-    log(DEBUG, "streamMain: Creating mount points...");
-    auto mounts = gst_rtsp_server_get_mount_points(m_server);
-
-    for (const auto& display : m_xscreenPlugin->getDisplayManager()->getDisplays())
-    {
-        log(DEBUG, "streamMain: Creating factory for: /%s", display->name.c_str());
-        auto factory = gst_rtsp_media_factory_new();
-
-        string launch = "(";
+    // Each client gets a thread of its own, up to a limit, so one slow handshake doesn't hold up the
+    // rest. Every pipeline already has its own media thread, and appsrc feeds it from its own streaming
+    // thread. They're all started from here, so they take on our scheduling policy
+    int clientThreads = m_host->getConfig()->getRtsp().clientThreads;
+    auto threadPool = gst_rtsp_server_get_thread_pool(m_server);
+    gst_rtsp_thread_pool_set_max_threads(threadPool, clientThreads);
+    g_object_unref(threadPool);
+    log(DEBUG, "streamMain: clientThreads=%d", clientThreads);
 
-        // Our "appsrc" where we provide the data
-        launch += "appsrc name=mysrc block=true is-live=1 do-timestamp=1 min-latency=0 ! ";
+    auto config = m_host->getConfig();
+    m_codec = config->getCodec() == "h264" ? CODEC_H264 : CODEC_MJPEG;
+    m_turboJpeg = m_codec == CODEC_MJPEG && config->getMjpeg().encoder == "turbo";
+    m_lowLatency = config->getLowLatency();
+    m_pipelinedCapture = config->getPipelinedCapture().enabled;
+    m_preroll = config->getPreroll();
 
-        // Add a queue, this will discard old frames!
-        launch += " queue max-size-time=500000000 ! ";
+    // Every display encodes at once, so they share RTSP's part of the budget between them
+    int encoderBudget = config->getEncoderBudget(ENCODER_RTSP);
+    int displayCount = max(1, (int)m_host->getDisplays().size());
+    m_encoderThreads = encoderBudget > 0 ? max(1, encoderBudget / displayCount) : 0;
+    log(DEBUG, "streamMain: codec=%s, turboJpeg=%d", config->getCodec().c_str(), m_turboJpeg);
 
-        // Convert it in to YUV
-        launch += "videoconvert ! video/x-raw,format=I420 ! ";
+    m_recorder = make_shared<Recorder>(config->getRecording());
+    if (!m_recorder->start())
+    {
+        m_recorder = nullptr;
+    }
 
-        // Encode it
-        switch (m_codec)
+    if (config->getWebRtc().enabled)
+    {
+        if (m_codec != CODEC_H264)
         {
-            case CODEC_H264:
-                // May be slow to encode, lower bandwidth
-#ifdef __APPLE__
-                // Use Apple Media, using hardware acceleration where available
-                launch += "vtenc_h264 quality=0.25 realtime=true ! ";
-#else
-                // Standard H264 encoder
-                launch += "x264enc ! ";
-#endif
-
-                // Make it streamable
-                launch += "rtph264pay name=pay0 pt=96 ";
-                break;
-
-            case CODEC_MJPEG:
-                // Faster encoding, higher bandwidth
-                launch += "jpegenc !";
-                launch += " rtpjpegpay name=pay0";
-                break;
+            log(WARN, "streamMain: WebRTC needs the h264 codec, not serving it");
+        }
+        else if (!config->getHttp().enabled)
+        {
+            log(WARN, "streamMain: WebRTC is set up over HTTP, which isn't enabled");
         }
-        launch += " )";
+        else
+        {
+            m_webRtcServer = make_shared<WebRtcServer>(m_host, m_threadPolicy);
+            if (!m_webRtcServer->start())
+            {
+                m_webRtcServer = nullptr;
+            }
+        }
+    }
 
-        gst_rtsp_media_factory_set_launch(factory, launch.c_str());
+    if (config->getHttp().enabled)
+    {
+        m_httpServer = make_shared<HttpServer>(m_host, m_threadPolicy, m_webRtcServer);
+        if (!m_httpServer->start())
+        {
+            m_httpServer = nullptr;
+        }
+    }
 
-        auto displayContext = g_new0(DisplayContext, 1);
-        displayContext->display = display;
-        displayContext->videoStream = this;
+    log(DEBUG, "streamMain: Creating mount points...");
+    auto mounts = gst_rtsp_server_get_mount_points(m_server);
+    vector<tuple<GstRTSPMediaFactory*, shared_ptr<Display>, bool>> heldFactories;
 
-        g_signal_connect(factory, "media-configure", (GCallback)mediaConfigureCallback, displayContext);
+    for (const auto& display : m_host->getDisplays())
+    {
+        bool recording = m_recorder != nullptr && m_recorder->isRecording(display);
+        auto factory = createFactory(display, recording);
+        if (recording || m_preroll)
+        {
+            heldFactories.emplace_back(factory, display, recording);
+        }
 
         gst_rtsp_mount_points_add_factory (mounts, ("/" + display->name).c_str(), factory);
     }
 
     g_object_unref (mounts);
     log(DEBUG, "streamMain: Attaching server...");
-    gst_rtsp_server_attach(m_server, nullptr);
+    g_signal_connect(m_server, "client-connected", (GCallback)clientConnectedCallback, this);
+    m_serverSource = gst_rtsp_server_attach(m_server, m_context);
+    m_host->getLifecycleManager()->attach(m_context, [this](const shared_ptr<Display> &display)
+    {
+        wantMedia(display);
+    }, [this](const shared_ptr<Display> &display)
+    {
+        releaseHeldMedia(display);
+    });
+
+    // Recorded displays run for the whole session, with or without clients. Pre-rolled ones until they've been idle
+    for (const auto& [factory, display, recording] : heldFactories)
+    {
+        holdMedia(factory, display, recording);
+    }
 
     m_streaming = true;
 
@@ -205,5 +1076,71 @@ void VideoStream::streamMain()
     g_main_loop_run(m_loop);
     log(DEBUG, "streamMain: Done!");
 
+    if (m_httpServer != nullptr)
+    {
+        m_httpServer->stop();
+        m_httpServer = nullptr;
+    }
+
+    releaseHeldMedia();
+    m_recorder = nullptr;
+    m_jpegPool = nullptr;
+    m_host->getLifecycleManager()->detach();
+
+    // Stop listening and drop any clients, so the server can be started again
+    auto serverSource = g_main_context_find_source_by_id(m_context, m_serverSource);
+    if (serverSource != nullptr)
+    {
+        g_source_destroy(serverSource);
+    }
+    m_serverSource = 0;
+    gst_rtsp_server_client_filter(m_server, closeClientFilter, nullptr);
+    g_object_unref(m_server);
+    m_server = nullptr;
+
+    if (m_webRtcServer != nullptr)
+    {
+        m_webRtcServer->stop();
+        m_webRtcServer = nullptr;
+    }
+
+    g_main_loop_unref(m_loop);
     m_loop = nullptr;
+    g_main_context_pop_thread_default(m_context);
+    g_main_context_unref(m_context);
+    m_context = nullptr;
+}
+
+GstRTSPFilterResult VideoStream::closeClientFilter(
+    [[maybe_unused]] GstRTSPServer* server,
+    [[maybe_unused]] GstRTSPClient* client,
+    [[maybe_unused]] gpointer data)
+{
+    return GST_RTSP_FILTER_REMOVE;
+}
+
+GstRTSPFilterResult VideoStream::closeWatchingClientFilter([[maybe_unused]] GstRTSPServer* server, GstRTSPClient* client, gpointer data)
+{
+    auto watching = static_cast<WatchingClient*>(data);
+    watching->watching = false;
+    gst_rtsp_client_session_filter(client, findWatchingSessionFilter, data);
+    return watching->watching ? GST_RTSP_FILTER_REMOVE : GST_RTSP_FILTER_KEEP;
+}
+
+GstRTSPFilterResult VideoStream::findWatchingSessionFilter([[maybe_unused]] GstRTSPClient* client, GstRTSPSession* session, gpointer data)
+{
+    gst_rtsp_session_filter(session, findWatchingMediaFilter, data);
+    return GST_RTSP_FILTER_KEEP;
+}
+
+GstRTSPFilterResult VideoStream::findWatchingMediaFilter([[maybe_unused]] GstRTSPSession* session, GstRTSPSessionMedia* sessionMedia, gpointer data)
+{
+    // Only matches the start of the path, so make sure it's not just a display with a longer name
+    auto watching = static_cast<WatchingClient*>(data);
+    gint matched = 0;
+    if (gst_rtsp_session_media_matches(sessionMedia, watching->path.c_str(), &matched) && matched == (gint)watching->path.size())
+    {
+        watching->watching = true;
+    }
+    return GST_RTSP_FILTER_KEEP;
 }
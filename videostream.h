@@ -5,16 +5,29 @@
 #ifndef VIDEOSTREAM_H
 #define VIDEOSTREAM_H
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 #include <gst/gst.h>
 #include <gst/rtsp-server/rtsp-server.h>
 
+#include "config.h"
 #include "logger.h"
 
 struct Display;
-class XStreamPlugin;
+class StreamHost;
 class VideoStream;
+class Recorder;
+class JpegEncoder;
+class WorkerPool;
+class ThreadPolicy;
+class HttpServer;
+class WebRtcServer;
 
 enum Codec
 {
@@ -26,38 +39,151 @@ struct DisplayContext
 {
     std::shared_ptr<Display> display;
     VideoStream* videoStream;
+
+    // Only used when encoding JPEGs ourselves
+    std::shared_ptr<JpegEncoder> jpegEncoder;
+    std::vector<uint8_t> frame;
+    std::vector<uint8_t> encoded;
+
+    // The frame being pushed, and the last one we pushed
+    uint64_t frameSeq = 0;
+    std::chrono::steady_clock::time_point frameTime;
+    uint64_t lastFrameSeq = 0;
+    GstClockTime lastPts = GST_CLOCK_TIME_NONE;
+};
+
+// A pipeline we keep prepared ourselves, even when no clients are connected
+struct HeldMedia
+{
+    GstRTSPMedia* media;
+    GstRTSPMediaFactory* factory;
+    std::shared_ptr<Display> display;
+
+    // Recordings count as somebody watching, pipelines that are just pre-rolled don't
+    bool subscribed;
+};
+
+// Displays added and removed when the aircraft definition is reloaded, on their way to the main loop
+struct DisplayChange
+{
+    VideoStream* videoStream;
+    std::vector<std::shared_ptr<Display>> added;
+    std::vector<std::shared_ptr<Display>> removed;
 };
 
 class VideoStream : private Logger
 {
  private:
-    XStreamPlugin* m_xscreenPlugin;
+    StreamHost* m_host;
 
     std::shared_ptr<std::thread> m_streamMainThread;
+
+    // Our own context rather than the default one, which the sim or other plugins may be using
+    GMainContext* m_context = nullptr;
     GMainLoop* m_loop = nullptr;
     GstRTSPServer* m_server = nullptr;
-    bool m_streaming = false;
+    guint m_serverSource = 0;
+
+    // Read from media and client threads, and by the plugin
+    std::atomic<bool> m_streaming = false;
 
     Codec m_codec = CODEC_MJPEG;
 
-    static void needDataCallback(GstElement* appsrc, guint unused, const DisplayContext* displayData);
-    void needData(const std::shared_ptr<Display> &display);
+    // Encode MJPEG in-process with libjpeg-turbo rather than with jpegenc
+    bool m_turboJpeg = false;
+    std::shared_ptr<WorkerPool> m_jpegPool;
+
+    // Clients are handled on the server's thread pool, so media can be configured on several threads at once
+    std::mutex m_mutex;
+
+    LowLatencyConfig m_lowLatency;
+
+    // Frames arrive a band at a time, so x264 encodes them in slices
+    bool m_pipelinedCapture = false;
+
+    // Threads for each display's x264enc, 0 to let it decide
+    int m_encoderThreads = 0;
+
+    // Has to outlive the pipelines, which keep calling back in to it
+    std::shared_ptr<ThreadPolicy> m_threadPolicy;
+
+    std::shared_ptr<Recorder> m_recorder;
+    std::shared_ptr<HttpServer> m_httpServer;
+
+    // Fed from each display's encoder, so it's only there when encoding H264
+    std::shared_ptr<WebRtcServer> m_webRtcServer;
+
+    // Keep displays' pipelines built and running until they're idle, so clients join straight away
+    bool m_preroll = false;
+    std::vector<HeldMedia> m_heldMedia;
+
+    static void needDataCallback(GstElement* appsrc, guint unused, DisplayContext* displayData);
+    void needData(DisplayContext* displayContext);
+    GstBuffer* allocateFrame(const std::shared_ptr<Display> &display, size_t size);
+    static void freeFrame(gpointer data);
+    GstBuffer* encodeJpeg(DisplayContext* displayContext);
+    static void waitForFrame(DisplayContext* displayContext);
+
+    // Copies the display's frame with copyRows(firstRow, lastRow) under its lock. If it's part way through
+    // being captured that's a few bands at a time as they come in, each followed by bandsCopied(firstBand,
+    // lastBand) without the lock. Otherwise it's the last whole frame in one go. A frame that's abandoned or
+    // overtaken while being followed is dropped, and the copy starts again from the top of the next
+    static void copyFrame(DisplayContext* displayContext, const std::function<void(int, int)> &copyRows, const std::function<void(int, int)> &bandsCopied);
+
+    // Follows the frame part way through being captured, false if it's abandoned or overtaken before it's all in
+    static bool copyBands(DisplayContext* displayContext, std::unique_lock<std::mutex> &lock, const std::function<void(int, int)> &copyRows, const std::function<void(int, int)> &bandsCopied);
+    static GstClockTime captureTimestamp(DisplayContext* displayContext);
     static void enoughDataCallback(GstElement* appsrc, guint unused, DisplayContext* displayData);
     void enoughData(const std::shared_ptr<Display> &display);
 
     static void mediaConfigureCallback(GstRTSPMediaFactory* factory, GstRTSPMedia* media, DisplayContext* displayData);
     void mediaConfigure(GstRTSPMedia* media, const std::shared_ptr<Display> &display);
+    static void mediaUnpreparedCallback(GstRTSPMedia* media, DisplayContext* displayData);
+    static gboolean reholdMediaCallback(gpointer data);
+    static void freeReholdArgs(gpointer data);
+    void reholdMedia(GstRTSPMedia* media);
+    void wantMedia(const std::shared_ptr<Display> &display);
+    static gboolean holdWantedCallback(gpointer data);
+    static void freeHoldWantedArgs(gpointer data);
+    void holdWanted(const std::shared_ptr<Display> &display);
+    static void freeDisplayContext(gpointer data);
+
+    static void clientConnectedCallback(GstRTSPServer* server, GstRTSPClient* client, VideoStream* videoStream);
+    static void playRequestCallback(GstRTSPClient* client, GstRTSPContext* ctx, VideoStream* videoStream);
+    static void stopRequestCallback(GstRTSPClient* client, GstRTSPContext* ctx, VideoStream* videoStream);
+    static void clientClosedCallback(GstRTSPClient* client, VideoStream* videoStream);
+    [[nodiscard]] std::shared_ptr<Display> findDisplay(const GstRTSPContext* ctx) const;
+    void forceKeyUnit(GstRTSPMedia* media, const std::shared_ptr<Display> &display);
+
+    [[nodiscard]] std::string buildLaunch(const std::shared_ptr<Display> &display, bool recording) const;
+    GstRTSPMediaFactory* createFactory(const std::shared_ptr<Display> &display, bool recording);
+    void holdMedia(GstRTSPMediaFactory* factory, const std::shared_ptr<Display> &display, bool subscribed);
+
+    // Just the given display's, or all of them
+    void releaseHeldMedia(const std::shared_ptr<Display> &display = nullptr);
+
+    static gboolean displaysChangedCallback(gpointer data);
+    static void freeDisplayChange(gpointer data);
+    void changeDisplays(const std::vector<std::shared_ptr<Display>> &added, const std::vector<std::shared_ptr<Display>> &removed);
+
+    static GstRTSPFilterResult closeClientFilter(GstRTSPServer* server, GstRTSPClient* client, gpointer data);
+    static GstRTSPFilterResult closeWatchingClientFilter(GstRTSPServer* server, GstRTSPClient* client, gpointer data);
+    static GstRTSPFilterResult findWatchingSessionFilter(GstRTSPClient* client, GstRTSPSession* session, gpointer data);
+    static GstRTSPFilterResult findWatchingMediaFilter(GstRTSPSession* session, GstRTSPSessionMedia* sessionMedia, gpointer data);
 
     void streamMain();
 
  public:
-    explicit VideoStream(XStreamPlugin* plugin) : Logger("VideoStream"), m_xscreenPlugin(plugin) {}
+    explicit VideoStream(StreamHost* host) : Logger("VideoStream"), m_host(host) {}
     ~VideoStream() override = default;
 
     bool start();
     bool stop();
 
     [[nodiscard]] bool isStreaming() const  { return m_streaming; }
+
+    // Mounts new displays and drops removed ones without restarting the server, from any thread
+    void displaysChanged(const std::vector<std::shared_ptr<Display>> &added, const std::vector<std::shared_ptr<Display>> &removed);
 };
 
 
@@ -0,0 +1,603 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "webrtcserver.h"
+#include "displaymanager.h"
+#include "keyframedropper.h"
+#include "lifecyclemanager.h"
+#include "streamhost.h"
+#include "threadpolicy.h"
+
+// webrtcbin's library still warns that its API may change
+#define GST_USE_UNSTABLE_API
+#include <gst/webrtc/webrtc.h>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+// How much a peer that's falling behind can have queued before it drops frames
+static const guint64 PEER_QUEUE_TIME = 500 * GST_MSECOND;
+static const guint PEER_QUEUE_BYTES = 4 * 1024 * 1024;
+
+// The same for the branch off the RTSP pipeline's tee
+static const guint64 BRANCH_QUEUE_TIME = GST_SECOND;
+static const guint BRANCH_QUEUE_BYTES = 8 * 1024 * 1024;
+
+// How long to wait for ICE gathering before answering with whatever we have
+static const chrono::seconds GATHER_TIMEOUT(5);
+
+// Peers all ask for key frames when they join and lose packets, one does for all of them
+static const chrono::milliseconds KEY_FRAME_INTERVAL(500);
+
+WebRtcServer::WebRtcServer(StreamHost* host, const shared_ptr<ThreadPolicy> &threadPolicy) :
+    Logger("WebRtcServer"),
+    m_host(host),
+    m_threadPolicy(threadPolicy)
+{
+}
+
+WebRtcServer::~WebRtcServer()
+{
+    stop();
+}
+
+bool WebRtcServer::start()
+{
+    if (m_running)
+    {
+        log(DEBUG, "start: Already running!");
+        return true;
+    }
+
+    m_config = m_host->getConfig()->getWebRtc();
+
+    for (const char* name : {"webrtcbin", "h264parse", "rtph264pay"})
+    {
+        auto factory = gst_element_factory_find(name);
+        if (factory == nullptr)
+        {
+            log(ERROR, "start: GStreamer element %s isn't available", name);
+            return false;
+        }
+        gst_object_unref(factory);
+    }
+
+    for (const auto& display : m_host->getDisplays())
+    {
+        auto webRtcDisplay = make_shared<WebRtcDisplay>();
+        webRtcDisplay->server = this;
+        webRtcDisplay->display = display;
+        webRtcDisplay->pipeline = gst_pipeline_new(("webrtc-" + display->name).c_str());
+        webRtcDisplay->appSrc = gst_element_factory_make("appsrc", nullptr);
+        auto parser = gst_element_factory_make("h264parse", nullptr);
+        webRtcDisplay->tee = gst_element_factory_make("tee", nullptr);
+
+        // Frames are already as late as they're going to be, so they're stamped as they arrive
+        g_object_set(G_OBJECT(webRtcDisplay->appSrc), "is-live", TRUE, "do-timestamp", TRUE, nullptr);
+        gst_util_set_object_arg(G_OBJECT(webRtcDisplay->appSrc), "format", "time");
+
+        // SPS/PPS go in front of every key frame, so peers can start from any of them
+        g_object_set(G_OBJECT(parser), "config-interval", -1, nullptr);
+
+        // Frames go nowhere until somebody's watching
+        g_object_set(G_OBJECT(webRtcDisplay->tee), "allow-not-linked", TRUE, nullptr);
+
+        gst_bin_add_many(GST_BIN(webRtcDisplay->pipeline), webRtcDisplay->appSrc, parser, webRtcDisplay->tee, nullptr);
+        gst_element_link_many(webRtcDisplay->appSrc, parser, webRtcDisplay->tee, nullptr);
+
+        // Key frame requests from the peers come back up as far as appsrc, and are passed on from there
+        auto srcPad = gst_element_get_static_pad(webRtcDisplay->appSrc, "src");
+        gst_pad_add_probe(srcPad, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM, upstreamEventProbe, webRtcDisplay.get(), nullptr);
+        gst_object_unref(srcPad);
+
+        if (m_threadPolicy != nullptr)
+        {
+            m_threadPolicy->attach(webRtcDisplay->pipeline);
+        }
+        gst_element_set_state(webRtcDisplay->pipeline, GST_STATE_PLAYING);
+        m_displays.push_back(webRtcDisplay);
+        log(INFO, "start: Serving /webrtc/%s and /whep/%s", display->name.c_str(), display->name.c_str());
+    }
+
+    m_running = true;
+    return true;
+}
+
+bool WebRtcServer::stop()
+{
+    if (!m_running)
+    {
+        return true;
+    }
+
+    log(DEBUG, "stop: Stopping...");
+    m_running = false;
+    for (const auto& webRtcDisplay : m_displays)
+    {
+        map<string, shared_ptr<WebRtcPeer>> peers;
+        {
+            scoped_lock lock(webRtcDisplay->mutex);
+            peers = std::move(webRtcDisplay->peers);
+            webRtcDisplay->peers.clear();
+            disconnectSink(webRtcDisplay.get());
+            webRtcDisplay->appSrc = nullptr;
+        }
+
+        for (const auto& [id, peer] : peers)
+        {
+            destroyPeer(webRtcDisplay, peer);
+        }
+        gst_element_set_state(webRtcDisplay->pipeline, GST_STATE_NULL);
+        gst_object_unref(webRtcDisplay->pipeline);
+        webRtcDisplay->pipeline = nullptr;
+    }
+    m_displays.clear();
+    log(DEBUG, "stop: Done");
+    return true;
+}
+
+string WebRtcServer::getLaunch()
+{
+    // However far behind WebRTC gets it never holds up the RTSP stream, see configure
+    return " enctee. ! queue name=webrtcqueue ! "
+        "appsink name=webrtcsink emit-signals=true sync=false async=false";
+}
+
+void WebRtcServer::configure(GstElement* element, const shared_ptr<Display> &display)
+{
+    auto queue = gst_bin_get_by_name_recurse_up(GST_BIN(element), "webrtcqueue");
+    if (queue != nullptr)
+    {
+        KeyFrameDropper::attach(queue, display->name + " WebRTC", BRANCH_QUEUE_TIME, BRANCH_QUEUE_BYTES);
+        gst_object_unref(queue);
+    }
+
+    auto sink = gst_bin_get_by_name_recurse_up(GST_BIN(element), "webrtcsink");
+    if (sink == nullptr)
+    {
+        return;
+    }
+
+    auto it = find_if(m_displays.begin(), m_displays.end(), [&display](const shared_ptr<WebRtcDisplay> &webRtcDisplay)
+    {
+        return webRtcDisplay->display == display;
+    });
+    if (it == m_displays.end())
+    {
+        // Added since we started
+        gst_object_unref(sink);
+        return;
+    }
+
+    const auto& webRtcDisplay = *it;
+    auto handler = g_signal_connect_data(
+        sink,
+        "new-sample",
+        (GCallback)newSampleCallback,
+        new shared_ptr<WebRtcDisplay>(webRtcDisplay),
+        freeDisplayRef,
+        (GConnectFlags)0);
+
+    // The pipeline it replaces has been unprepared, and has stopped sending
+    scoped_lock lock(webRtcDisplay->mutex);
+    disconnectSink(webRtcDisplay.get());
+    webRtcDisplay->encodedSink = sink;
+    webRtcDisplay->sampleHandler = handler;
+    log(DEBUG, "configure: %s: Taking frames from %p", display->name.c_str(), sink);
+}
+
+void WebRtcServer::disconnectSink(WebRtcDisplay* webRtcDisplay)
+{
+    // With the display's mutex held. A sample that's already been emitted keeps its reference until it's done
+    if (webRtcDisplay->encodedSink != nullptr)
+    {
+        g_signal_handler_disconnect(webRtcDisplay->encodedSink, webRtcDisplay->sampleHandler);
+        gst_object_unref(webRtcDisplay->encodedSink);
+        webRtcDisplay->encodedSink = nullptr;
+        webRtcDisplay->sampleHandler = 0;
+    }
+}
+
+void WebRtcServer::freeDisplayRef(gpointer data, [[maybe_unused]] GClosure* closure)
+{
+    delete static_cast<shared_ptr<WebRtcDisplay>*>(data);
+}
+
+GstFlowReturn WebRtcServer::newSampleCallback(GstElement* appSink, shared_ptr<WebRtcDisplay>* data)
+{
+    const auto& webRtcDisplay = *data;
+    GstSample* sample = nullptr;
+    g_signal_emit_by_name(appSink, "pull-sample", &sample);
+    if (sample == nullptr)
+    {
+        return GST_FLOW_OK;
+    }
+
+    // Always pushed, even without any peers, so h264parse has the SPS/PPS ready for the first one.
+    // Whatever happens to it, the RTSP pipeline carries on
+    scoped_lock lock(webRtcDisplay->mutex);
+    if (webRtcDisplay->appSrc != nullptr)
+    {
+        // Only the caps' first appearance or a change is passed on
+        g_object_set(G_OBJECT(webRtcDisplay->appSrc), "caps", gst_sample_get_caps(sample), nullptr);
+
+        // The timestamps are the RTSP pipeline's, appsrc stamps it again with our own. Constrained
+        // baseline has no B frames, so there's no reordering to lose. The frame itself isn't copied
+        auto buffer = gst_buffer_copy(gst_sample_get_buffer(sample));
+        GST_BUFFER_PTS(buffer) = GST_CLOCK_TIME_NONE;
+        GST_BUFFER_DTS(buffer) = GST_CLOCK_TIME_NONE;
+
+        GstFlowReturn ret;
+        g_signal_emit_by_name(webRtcDisplay->appSrc, "push-buffer", buffer, &ret);
+        gst_buffer_unref(buffer);
+    }
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
+
+GstPadProbeReturn WebRtcServer::upstreamEventProbe([[maybe_unused]] GstPad* pad, GstPadProbeInfo* info, gpointer data)
+{
+    auto event = GST_PAD_PROBE_INFO_EVENT(info);
+    auto structure = gst_event_get_structure(event);
+    if (GST_EVENT_TYPE(event) != GST_EVENT_CUSTOM_UPSTREAM || structure == nullptr || !gst_structure_has_name(structure, "GstForceKeyUnit"))
+    {
+        return GST_PAD_PROBE_OK;
+    }
+
+    // A peer has joined or lost packets, and webrtcbin has turned its PLI in to a key frame request
+    auto webRtcDisplay = static_cast<WebRtcDisplay*>(data);
+    webRtcDisplay->server->requestKeyFrame(webRtcDisplay, false);
+    return GST_PAD_PROBE_DROP;
+}
+
+void WebRtcServer::requestKeyFrame(WebRtcDisplay* webRtcDisplay, bool force)
+{
+    GstElement* sink;
+    {
+        scoped_lock lock(webRtcDisplay->mutex);
+        auto now = chrono::steady_clock::now();
+        if (webRtcDisplay->encodedSink == nullptr || (!force && now - webRtcDisplay->lastKeyFrameRequest < KEY_FRAME_INTERVAL))
+        {
+            return;
+        }
+        webRtcDisplay->lastKeyFrameRequest = now;
+        sink = GST_ELEMENT(gst_object_ref(webRtcDisplay->encodedSink));
+    }
+
+    // Goes up through the tee to the RTSP pipeline's encoder
+    auto event = gst_event_new_custom(GST_EVENT_CUSTOM_UPSTREAM, gst_structure_new("GstForceKeyUnit",
+        "running-time", G_TYPE_UINT64, GST_CLOCK_TIME_NONE,
+        "all-headers", G_TYPE_BOOLEAN, TRUE,
+        "count", G_TYPE_UINT, 0,
+        NULL));
+    if (!gst_element_send_event(sink, event))
+    {
+        log(WARN, "requestKeyFrame: %s: Key unit request wasn't handled", webRtcDisplay->display->name.c_str());
+    }
+    gst_object_unref(sink);
+}
+
+shared_ptr<WebRtcDisplay> WebRtcServer::findDisplay(const string &name) const
+{
+    for (const auto& webRtcDisplay : m_displays)
+    {
+        if (webRtcDisplay->display->name == name)
+        {
+            return webRtcDisplay;
+        }
+    }
+    return nullptr;
+}
+
+bool WebRtcServer::canAddPeer(const shared_ptr<WebRtcDisplay> &webRtcDisplay)
+{
+    scoped_lock lock(webRtcDisplay->mutex);
+    return m_running && (m_config.maxPeers == 0 || (int)webRtcDisplay->peers.size() < m_config.maxPeers);
+}
+
+string WebRtcServer::addPeer(const shared_ptr<WebRtcDisplay> &webRtcDisplay, const string &offer, string &answer)
+{
+    const auto& display = webRtcDisplay->display;
+
+    GstSDPMessage* sdp = nullptr;
+    if (gst_sdp_message_new_from_text(offer.c_str(), &sdp) != GST_SDP_OK)
+    {
+        log(WARN, "addPeer: %s: Unable to parse the offer", display->name.c_str());
+        if (sdp != nullptr)
+        {
+            gst_sdp_message_free(sdp);
+        }
+        return "";
+    }
+
+    auto caps = findCaps(sdp);
+    if (caps == nullptr)
+    {
+        log(WARN, "addPeer: %s: The offer has no H264 we can send", display->name.c_str());
+        gst_sdp_message_free(sdp);
+        return "";
+    }
+
+    // Peers are fed from the RTSP pipeline, so have it built while the peer's being negotiated
+    m_host->getLifecycleManager()->displayRequested(display, true);
+
+    auto peer = make_shared<WebRtcPeer>();
+    gchar* uuid = g_uuid_string_random();
+    peer->id = uuid;
+    g_free(uuid);
+
+    bool created = createPeer(webRtcDisplay, peer, caps);
+    gst_caps_unref(caps);
+    if (!created || !negotiate(peer, sdp, answer))
+    {
+        destroyPeer(webRtcDisplay, peer);
+        return "";
+    }
+
+    // Only fed once it's ready to go
+    peer->teePad = gst_element_request_pad_simple(webRtcDisplay->tee, "src_%u");
+    auto sinkPad = gst_element_get_static_pad(peer->queue, "sink");
+    gst_pad_link(peer->teePad, sinkPad);
+    gst_object_unref(sinkPad);
+    display->subscribers++;
+
+    {
+        scoped_lock lock(webRtcDisplay->mutex);
+        webRtcDisplay->peers[peer->id] = peer;
+    }
+    requestKeyFrame(webRtcDisplay.get(), true);
+
+    log(INFO, "addPeer: %s: Added peer %s", display->name.c_str(), peer->id.c_str());
+    return peer->id;
+}
+
+GstCaps* WebRtcServer::findCaps(const GstSDPMessage* offer)
+{
+    // We send constrained baseline, which anything that offers H264 can decode. Prefer
+    // the payload types offered for it, but the profile is only a hint to most browsers
+    GstCaps* fallback = nullptr;
+    for (guint i = 0; i < gst_sdp_message_medias_len(offer); i++)
+    {
+        auto media = gst_sdp_message_get_media(offer, i);
+        if (strcmp(gst_sdp_media_get_media(media), "video") != 0)
+        {
+            continue;
+        }
+
+        for (guint j = 0; j < gst_sdp_media_formats_len(media); j++)
+        {
+            int payloadType = atoi(gst_sdp_media_get_format(media, j));
+            auto caps = gst_sdp_media_get_caps_from_media(media, payloadType);
+            if (caps == nullptr)
+            {
+                continue;
+            }
+
+            auto structure = gst_caps_get_structure(caps, 0);
+            const gchar* encoding = gst_structure_get_string(structure, "encoding-name");
+            const gchar* mode = gst_structure_get_string(structure, "packetization-mode");
+            if (encoding == nullptr || g_ascii_strcasecmp(encoding, "H264") != 0 || mode == nullptr || strcmp(mode, "1") != 0)
+            {
+                gst_caps_unref(caps);
+                continue;
+            }
+            gst_structure_set_name(structure, "application/x-rtp");
+
+            const gchar* profile = gst_structure_get_string(structure, "profile-level-id");
+            if (profile != nullptr && g_str_has_prefix(profile, "42"))
+            {
+                if (fallback != nullptr)
+                {
+                    gst_caps_unref(fallback);
+                }
+                return caps;
+            }
+            if (fallback == nullptr)
+            {
+                fallback = caps;
+            }
+            else
+            {
+                gst_caps_unref(caps);
+            }
+        }
+    }
+    return fallback;
+}
+
+bool WebRtcServer::createPeer(const shared_ptr<WebRtcDisplay> &webRtcDisplay, const shared_ptr<WebRtcPeer> &peer, GstCaps* caps)
+{
+    peer->queue = gst_element_factory_make("queue", nullptr);
+    peer->payloader = gst_element_factory_make("rtph264pay", nullptr);
+    peer->filter = gst_element_factory_make("capsfilter", nullptr);
+    peer->webrtc = gst_element_factory_make("webrtcbin", nullptr);
+    gst_bin_add_many(GST_BIN(webRtcDisplay->pipeline), peer->queue, peer->payloader, peer->filter, peer->webrtc, nullptr);
+
+    // A peer that can't keep up only drops its own frames, and its key frame request is rate limited with the rest
+    KeyFrameDropper::attach(peer->queue, peer->id, PEER_QUEUE_TIME, PEER_QUEUE_BYTES);
+
+    // Payloaded with the payload type the peer offered
+    int payloadType = 96;
+    gst_structure_get_int(gst_caps_get_structure(caps, 0), "payload", &payloadType);
+    g_object_set(G_OBJECT(peer->payloader), "pt", (guint)payloadType, "config-interval", -1, nullptr);
+    gst_util_set_object_arg(G_OBJECT(peer->payloader), "aggregate-mode", "zero-latency");
+    g_object_set(G_OBJECT(peer->filter), "caps", caps, nullptr);
+
+    // No STUN or TURN servers, so only host candidates are gathered
+    gst_util_set_object_arg(G_OBJECT(peer->webrtc), "bundle-policy", "max-bundle");
+    g_signal_connect(peer->webrtc, "notify::ice-gathering-state", (GCallback)iceGatheringStateCallback, peer.get());
+    g_signal_connect(peer->webrtc, "notify::connection-state", (GCallback)connectionStateCallback, peer.get());
+
+    if (!gst_element_link_many(peer->queue, peer->payloader, peer->filter, peer->webrtc, nullptr))
+    {
+        log(ERROR, "createPeer: %s: Unable to link the peer's elements", webRtcDisplay->display->name.c_str());
+        return false;
+    }
+
+    // Linking added a transceiver for the video, which we only ever send on
+    GstWebRTCRTPTransceiver* transceiver = nullptr;
+    g_signal_emit_by_name(peer->webrtc, "get-transceiver", 0, &transceiver);
+    if (transceiver != nullptr)
+    {
+        g_object_set(G_OBJECT(transceiver), "direction", GST_WEBRTC_RTP_TRANSCEIVER_DIRECTION_SENDONLY, nullptr);
+        gst_object_unref(transceiver);
+    }
+
+    for (auto element : {peer->queue, peer->payloader, peer->filter, peer->webrtc})
+    {
+        gst_element_sync_state_with_parent(element);
+    }
+    return true;
+}
+
+bool WebRtcServer::negotiate(const shared_ptr<WebRtcPeer> &peer, GstSDPMessage* offer, string &answer)
+{
+    // Takes the offer's SDP with it
+    auto remote = gst_webrtc_session_description_new(GST_WEBRTC_SDP_TYPE_OFFER, offer);
+    auto promise = gst_promise_new();
+    g_signal_emit_by_name(peer->webrtc, "set-remote-description", remote, promise);
+    gst_promise_wait(promise);
+    gst_promise_unref(promise);
+    gst_webrtc_session_description_free(remote);
+
+    GstWebRTCSessionDescription* local = nullptr;
+    promise = gst_promise_new();
+    g_signal_emit_by_name(peer->webrtc, "create-answer", nullptr, promise);
+    if (gst_promise_wait(promise) == GST_PROMISE_RESULT_REPLIED)
+    {
+        gst_structure_get(gst_promise_get_reply(promise), "answer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &local, nullptr);
+    }
+    gst_promise_unref(promise);
+    if (local == nullptr)
+    {
+        log(WARN, "negotiate: %s: Unable to answer the offer", peer->id.c_str());
+        return false;
+    }
+
+    promise = gst_promise_new();
+    g_signal_emit_by_name(peer->webrtc, "set-local-description", local, promise);
+    gst_promise_wait(promise);
+    gst_promise_unref(promise);
+    gst_webrtc_session_description_free(local);
+
+    // WHEP has no way to trickle candidates to the peer afterwards, so the answer has to have them all
+    {
+        unique_lock lock(peer->mutex);
+        if (!peer->cond.wait_for(lock, GATHER_TIMEOUT, [&peer]() { return peer->gathered; }))
+        {
+            log(WARN, "negotiate: %s: ICE gathering didn't finish, answering with the candidates so far", peer->id.c_str());
+        }
+    }
+
+    GstWebRTCSessionDescription* description = nullptr;
+    g_object_get(G_OBJECT(peer->webrtc), "local-description", &description, nullptr);
+    if (description == nullptr)
+    {
+        return false;
+    }
+    gchar* text = gst_sdp_message_as_text(description->sdp);
+    answer = text;
+    g_free(text);
+    gst_webrtc_session_description_free(description);
+    return true;
+}
+
+void WebRtcServer::iceGatheringStateCallback(GstElement* webrtc, [[maybe_unused]] GParamSpec* pspec, WebRtcPeer* peer)
+{
+    GstWebRTCICEGatheringState state;
+    g_object_get(G_OBJECT(webrtc), "ice-gathering-state", &state, nullptr);
+    if (state == GST_WEBRTC_ICE_GATHERING_STATE_COMPLETE)
+    {
+        scoped_lock lock(peer->mutex);
+        peer->gathered = true;
+        peer->cond.notify_all();
+    }
+}
+
+void WebRtcServer::connectionStateCallback(GstElement* webrtc, [[maybe_unused]] GParamSpec* pspec, WebRtcPeer* peer)
+{
+    // Peers that go without a WHEP DELETE end up here once ICE gives up on them
+    GstWebRTCPeerConnectionState state;
+    g_object_get(G_OBJECT(webrtc), "connection-state", &state, nullptr);
+    if (state == GST_WEBRTC_PEER_CONNECTION_STATE_FAILED || state == GST_WEBRTC_PEER_CONNECTION_STATE_CLOSED)
+    {
+        peer->closed = true;
+    }
+}
+
+bool WebRtcServer::removePeer(const shared_ptr<WebRtcDisplay> &webRtcDisplay, const string &id)
+{
+    shared_ptr<WebRtcPeer> peer;
+    {
+        scoped_lock lock(webRtcDisplay->mutex);
+        auto it = webRtcDisplay->peers.find(id);
+        if (it == webRtcDisplay->peers.end())
+        {
+            return false;
+        }
+        peer = it->second;
+        webRtcDisplay->peers.erase(it);
+    }
+
+    destroyPeer(webRtcDisplay, peer);
+    log(INFO, "removePeer: %s: Removed peer %s", webRtcDisplay->display->name.c_str(), id.c_str());
+    return true;
+}
+
+void WebRtcServer::reapPeers()
+{
+    for (const auto& webRtcDisplay : m_displays)
+    {
+        vector<shared_ptr<WebRtcPeer>> closed;
+        {
+            scoped_lock lock(webRtcDisplay->mutex);
+            for (auto it = webRtcDisplay->peers.begin(); it != webRtcDisplay->peers.end(); )
+            {
+                if (it->second->closed)
+                {
+                    closed.push_back(it->second);
+                    it = webRtcDisplay->peers.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+
+        for (const auto& peer : closed)
+        {
+            log(INFO, "reapPeers: %s: Peer %s has gone", webRtcDisplay->display->name.c_str(), peer->id.c_str());
+            destroyPeer(webRtcDisplay, peer);
+        }
+    }
+}
+
+void WebRtcServer::destroyPeer(const shared_ptr<WebRtcDisplay> &webRtcDisplay, const shared_ptr<WebRtcPeer> &peer)
+{
+    // Cut it off from the tee first, so nothing's pushed in to it while it's going away
+    if (peer->teePad != nullptr)
+    {
+        auto sinkPad = gst_element_get_static_pad(peer->queue, "sink");
+        gst_pad_unlink(peer->teePad, sinkPad);
+        gst_object_unref(sinkPad);
+        gst_element_release_request_pad(webRtcDisplay->tee, peer->teePad);
+        gst_object_unref(peer->teePad);
+        peer->teePad = nullptr;
+        webRtcDisplay->display->subscribers--;
+    }
+
+    g_signal_handlers_disconnect_by_data(peer->webrtc, peer.get());
+    for (auto element : {peer->webrtc, peer->filter, peer->payloader, peer->queue})
+    {
+        gst_element_set_state(element, GST_STATE_NULL);
+        gst_bin_remove(GST_BIN(webRtcDisplay->pipeline), element);
+    }
+    peer->queue = nullptr;
+    peer->payloader = nullptr;
+    peer->filter = nullptr;
+    peer->webrtc = nullptr;
+}
@@ -0,0 +1,123 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef WEBRTCSERVER_H
+#define WEBRTCSERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <gst/gst.h>
+#include <gst/sdp/sdp.h>
+
+#include "config.h"
+#include "logger.h"
+
+struct Display;
+class StreamHost;
+class ThreadPolicy;
+
+struct WebRtcPeer
+{
+    std::string id;
+    GstElement* queue = nullptr;
+    GstElement* payloader = nullptr;
+    GstElement* filter = nullptr;
+    GstElement* webrtc = nullptr;
+    GstPad* teePad = nullptr;
+
+    // Set from webrtcbin's threads
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool gathered = false;
+    std::atomic<bool> closed = false;
+};
+
+class WebRtcServer;
+
+struct WebRtcDisplay
+{
+    WebRtcServer* server = nullptr;
+    std::shared_ptr<Display> display;
+
+    // appsrc ! h264parse ! tee, with a branch per peer
+    GstElement* pipeline = nullptr;
+    GstElement* appSrc = nullptr;
+    GstElement* tee = nullptr;
+
+    // The RTSP pipeline's branch the encoded frames come from, which key frame requests are sent up
+    std::mutex mutex;
+    GstElement* encodedSink = nullptr;
+    gulong sampleHandler = 0;
+    std::chrono::steady_clock::time_point lastKeyFrameRequest;
+    std::map<std::string, std::shared_ptr<WebRtcPeer>> peers;
+};
+
+/*
+ * Serves the displays to browsers with webrtcbin. Rather than encoding again,
+ * each display's RTSP pipeline has a branch off its encoder's tee that hands
+ * the H264 to a pipeline of our own, which every peer is fed from. Each peer
+ * only has its own payloader, as browsers each pick their own payload type,
+ * and key frame requests from any of them go back up to the shared encoder.
+ *
+ * Peers are set up with WHEP through the HTTP server. The answer is only sent
+ * once ICE gathering has finished, so it has every candidate in it. Only host
+ * candidates are gathered, which is all a local network needs.
+ */
+class WebRtcServer : private Logger
+{
+ private:
+    StreamHost* m_host;
+    WebRtcConfig m_config;
+    std::shared_ptr<ThreadPolicy> m_threadPolicy;
+
+    std::vector<std::shared_ptr<WebRtcDisplay>> m_displays;
+    std::atomic<bool> m_running = false;
+
+    // Each connection holds a reference, so a sample already on its way in can't outlive the display
+    static GstFlowReturn newSampleCallback(GstElement* appSink, std::shared_ptr<WebRtcDisplay>* webRtcDisplay);
+    static void freeDisplayRef(gpointer data, GClosure* closure);
+    static void disconnectSink(WebRtcDisplay* webRtcDisplay);
+    static GstPadProbeReturn upstreamEventProbe(GstPad* pad, GstPadProbeInfo* info, gpointer data);
+    void requestKeyFrame(WebRtcDisplay* webRtcDisplay, bool force);
+
+    static void iceGatheringStateCallback(GstElement* webrtc, GParamSpec* pspec, WebRtcPeer* peer);
+    static void connectionStateCallback(GstElement* webrtc, GParamSpec* pspec, WebRtcPeer* peer);
+
+    static GstCaps* findCaps(const GstSDPMessage* offer);
+    bool createPeer(const std::shared_ptr<WebRtcDisplay> &webRtcDisplay, const std::shared_ptr<WebRtcPeer> &peer, GstCaps* caps);
+    bool negotiate(const std::shared_ptr<WebRtcPeer> &peer, GstSDPMessage* offer, std::string &answer);
+    void destroyPeer(const std::shared_ptr<WebRtcDisplay> &webRtcDisplay, const std::shared_ptr<WebRtcPeer> &peer);
+
+ public:
+    WebRtcServer(StreamHost* host, const std::shared_ptr<ThreadPolicy> &threadPolicy);
+    ~WebRtcServer() override;
+
+    bool start();
+    bool stop();
+
+    // Launch string for the branch hanging off the tee named "enctee"
+    [[nodiscard]] static std::string getLaunch();
+
+    // Picks up the encoded frames from a newly configured RTSP pipeline
+    void configure(GstElement* element, const std::shared_ptr<Display> &display);
+
+    [[nodiscard]] std::shared_ptr<WebRtcDisplay> findDisplay(const std::string &name) const;
+    [[nodiscard]] bool canAddPeer(const std::shared_ptr<WebRtcDisplay> &webRtcDisplay);
+
+    // Answers a WHEP offer, returns the new peer's id or an empty string if it couldn't be set up
+    std::string addPeer(const std::shared_ptr<WebRtcDisplay> &webRtcDisplay, const std::string &offer, std::string &answer);
+    bool removePeer(const std::shared_ptr<WebRtcDisplay> &webRtcDisplay, const std::string &id);
+
+    // Drops peers whose connection has failed or been closed without a WHEP DELETE
+    void reapPeers();
+};
+
+#endif //WEBRTCSERVER_H
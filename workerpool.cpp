@@ -0,0 +1,104 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "workerpool.h"
+#include "threadpolicy.h"
+
+using namespace std;
+
+WorkerPool::WorkerPool(int threads, const shared_ptr<ThreadPolicy> &policy) : m_policy(policy)
+{
+    for (int i = 0; i < threads; i++)
+    {
+        m_threads.emplace_back(&WorkerPool::workerMain, this);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        scoped_lock lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cond.notify_all();
+
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+void WorkerPool::workerMain()
+{
+    if (m_policy != nullptr)
+    {
+        m_policy->apply("WorkerPool");
+    }
+
+    while (true)
+    {
+        function<void()> task;
+        {
+            unique_lock lock(m_mutex);
+            m_cond.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+            if (m_tasks.empty())
+            {
+                return;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void WorkerPool::parallelFor(int count, const function<void(int)> &func)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    mutex doneMutex;
+    condition_variable doneCond;
+    int remaining = count - 1;
+
+    {
+        scoped_lock lock(m_mutex);
+        for (int i = 1; i < count; i++)
+        {
+            m_tasks.emplace_back([i, &func, &doneMutex, &doneCond, &remaining]()
+            {
+                func(i);
+
+                scoped_lock doneLock(doneMutex);
+                if (--remaining == 0)
+                {
+                    doneCond.notify_one();
+                }
+            });
+        }
+    }
+    m_cond.notify_all();
+
+    // Do our share rather than just waiting, and help out with anything still queued
+    func(0);
+    while (true)
+    {
+        function<void()> task;
+        {
+            scoped_lock lock(m_mutex);
+            if (m_tasks.empty())
+            {
+                break;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+
+    unique_lock doneLock(doneMutex);
+    doneCond.wait(doneLock, [&remaining] { return remaining == 0; });
+}
@@ -0,0 +1,46 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPolicy;
+
+/*
+ * A small fixed pool of threads for splitting a piece of work in to parts.
+ * parallelFor can be called from several threads at once, the calling thread
+ * always runs one of the parts itself.
+ */
+class WorkerPool
+{
+ private:
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::function<void()>> m_tasks;
+    bool m_stopping = false;
+    std::shared_ptr<ThreadPolicy> m_policy;
+
+    void workerMain();
+
+ public:
+    explicit WorkerPool(int threads, const std::shared_ptr<ThreadPolicy> &policy = nullptr);
+    ~WorkerPool();
+
+    // Calls func(0) to func(count - 1) and waits for them all to finish
+    void parallelFor(int count, const std::function<void(int)> &func);
+
+    // Including the calling thread
+    [[nodiscard]] int getConcurrency() const { return (int)m_threads.size() + 1; }
+};
+
+#endif //WORKERPOOL_H
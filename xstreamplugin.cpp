@@ -5,8 +5,15 @@
 #include <XPLMProcessing.h>
 #include <XPLMMenus.h>
 
+#include "config.h"
 #include "videostream.h"
 #include "displaymanager.h"
+#include "framepublisher.h"
+#include "lifecyclemanager.h"
+#include "profiler.h"
+#include "rfbserver.h"
+
+#include <ctime>
 
 using namespace std;
 
@@ -28,16 +35,40 @@ int XStreamPlugin::start(char* outName, char* outSig, char* outDesc)
 
     XPLMCheckMenuItem(m_menuId, m_streamMenuIndex, xplm_Menu_Unchecked);
 
+    m_config = make_shared<Config>();
+    m_config->load("Resources/plugins/xstream/config.yaml");
+
     m_videoStream = make_shared<VideoStream>(this);
-    m_displayManager = make_shared<DisplayManager>();
+    m_rfbServer = make_shared<RfbServer>(this);
+    m_framePublisher = make_shared<FramePublisher>(this);
+    m_displayManager = make_shared<DisplayManager>(m_config);
+    m_lifecycleManager = make_shared<LifecycleManager>(this);
+
+    // Only the RTSP server picks up added and removed displays without being restarted
+    m_displayManager->setDisplaysChangedCallback([this](const vector<shared_ptr<Display>> &added, const vector<shared_ptr<Display>> &removed)
+    {
+        m_videoStream->displaysChanged(added, removed);
+    });
+
+    if (m_config->getProfile())
+    {
+        createProfileMenu();
+    }
 
     return 1;
 }
 
 void XStreamPlugin::stop()
 {
-    m_videoStream->stop();
-    m_displayManager->stop();
+    // The profiler outlives any one stream, so it only goes when the plugin does
+    if (m_writeProfileCommand != nullptr)
+    {
+        XPLMUnregisterFlightLoopCallback(profileMenuCallback, this);
+        XPLMUnregisterCommandHandler(m_writeProfileCommand, writeProfileCallback, 1, this);
+        m_writeProfileCommand = nullptr;
+    }
+
+    stopStream();
 }
 
 
@@ -48,13 +79,12 @@ int XStreamPlugin::enable()
 
 void XStreamPlugin::disable()
 {
-    m_videoStream->stop();
-    m_displayManager->stop();
+    stopStream();
 }
 
 void XStreamPlugin::startStream()
 {
-    if (m_videoStream->isStreaming())
+    if (isStreaming())
     {
         // We're already streaming!
         return;
@@ -74,13 +104,58 @@ void XStreamPlugin::startStream()
         return;
     }
 
-    res = m_videoStream->start();
-    if (!res)
+    if (m_config->getEncoderDaemon().enabled)
     {
+        // xstream-encoderd does the rest
+        m_framePublisher->start();
         return;
     }
 
+    if (m_config->isRtspEnabled())
+    {
+        res = m_videoStream->start();
+        if (!res)
+        {
+            return;
+        }
+    }
+
+    if (m_config->isRfbEnabled())
+    {
+        res = m_rfbServer->start();
+        if (!res)
+        {
+            return;
+        }
+    }
+}
+
+void XStreamPlugin::stopStream()
+{
+    m_videoStream->stop();
+    m_rfbServer->stop();
+    m_framePublisher->stop();
+    m_displayManager->stop();
+}
 
+bool XStreamPlugin::isStreaming() const
+{
+    return m_videoStream->isStreaming() || m_rfbServer->isRunning() || m_framePublisher->isRunning();
+}
+
+vector<shared_ptr<Display>> XStreamPlugin::getDisplays()
+{
+    return m_displayManager->getDisplays();
+}
+
+void XStreamPlugin::armDisplay(const shared_ptr<Display> &display)
+{
+    m_displayManager->armDisplay(display);
+}
+
+void XStreamPlugin::releaseDisplay(const shared_ptr<Display> &display)
+{
+    m_displayManager->releaseDisplay(display);
 }
 
 void XStreamPlugin::receiveMessage(XPLMPluginID inFrom, int inMsg, void* inParam)
@@ -116,9 +191,18 @@ void XStreamPlugin::menu(void* itemRef)
     {
         m_displayManager->dumpTextures();
     }
+    else if (item == 4)
+    {
+        writeProfile();
+    }
+    else if (item == 5)
+    {
+        m_displayManager->getProfiler()->reset();
+        updateProfileMenu();
+    }
     else if (item == 3)
     {
-        if (!m_videoStream->isStreaming())
+        if (!isStreaming())
         {
             startStream();
             XPLMSetMenuItemName(m_menuId, m_streamMenuIndex, "Stop Streaming", 0);
@@ -126,11 +210,68 @@ void XStreamPlugin::menu(void* itemRef)
         else
         {
             XPLMSetMenuItemName(m_menuId, m_streamMenuIndex, "Start Streaming", 0);
-            stop();
+            stopStream();
         }
     }
 }
 
+void XStreamPlugin::createProfileMenu()
+{
+    int profileContainer = XPLMAppendMenuItem(m_menuId, "Profiler", nullptr, 0);
+    m_profileMenuId = XPLMCreateMenu("Profiler", m_menuId, profileContainer, menuCallback, this);
+
+    // The stats are just for show, they're updated once a second
+    m_profileCpuIndex = XPLMAppendMenuItem(m_profileMenuId, "CPU -", nullptr, 0);
+    m_profileGpuIndex = XPLMAppendMenuItem(m_profileMenuId, "GPU -", nullptr, 0);
+    XPLMEnableMenuItem(m_profileMenuId, m_profileCpuIndex, 0);
+    XPLMEnableMenuItem(m_profileMenuId, m_profileGpuIndex, 0);
+    XPLMAppendMenuSeparator(m_profileMenuId);
+    XPLMAppendMenuItem(m_profileMenuId, "Write Profile CSV", (void*)4, 1);
+    XPLMAppendMenuItem(m_profileMenuId, "Reset Profile", (void*)5, 1);
+
+    XPLMRegisterFlightLoopCallback(profileMenuCallback, 1.0f, this);
+
+    m_writeProfileCommand = XPLMCreateCommand("xstream/profiler/write_csv", "Write the XStream frame time profile to CSV");
+    XPLMRegisterCommandHandler(m_writeProfileCommand, writeProfileCallback, 1, this);
+}
+
+float XStreamPlugin::profileMenuCallback(
+    [[maybe_unused]] float elapsedSinceLastCall,
+    [[maybe_unused]] float elapsedTimeSinceLastFlightLoop,
+    [[maybe_unused]] int counter,
+    void* refcon)
+{
+    static_cast<XStreamPlugin*>(refcon)->updateProfileMenu();
+    return 1.0f;
+}
+
+void XStreamPlugin::updateProfileMenu()
+{
+    auto profiler = m_displayManager->getProfiler();
+    XPLMSetMenuItemName(m_profileMenuId, m_profileCpuIndex, profiler->getCpuSummary().c_str(), 0);
+    XPLMSetMenuItemName(m_profileMenuId, m_profileGpuIndex, profiler->getGpuSummary().c_str(), 0);
+}
+
+int XStreamPlugin::writeProfileCallback([[maybe_unused]] XPLMCommandRef command, XPLMCommandPhase phase, void* refcon)
+{
+    if (phase == xplm_CommandBegin)
+    {
+        static_cast<XStreamPlugin*>(refcon)->writeProfile();
+    }
+    return 1;
+}
+
+void XStreamPlugin::writeProfile()
+{
+    char timeStr[64];
+    time_t t = time(nullptr);
+    tm tm;
+    localtime_r(&t, &tm);
+    strftime(timeStr, sizeof(timeStr), "%Y%m%d_%H%M%S", &tm);
+
+    m_displayManager->getProfiler()->writeCsv(string("Output/xstream/profile_") + timeStr + ".csv");
+}
+
 PLUGIN_API int XPluginStart(char* outName, char* outSig, char* outDesc)
 {
     return g_ufcPlugin.start(outName, outSig, outDesc);
@@ -15,11 +15,16 @@
 #include <gst/gst.h>
 
 #include "logger.h"
+#include "streamhost.h"
 
 #include <thread>
 
+class Config;
 class VideoStream;
+class RfbServer;
+class FramePublisher;
 class DisplayManager;
+class LifecycleManager;
 
 class XPPluginDataSource;
 
@@ -42,7 +47,7 @@ class XPLogPrinter : public LogPrinter
 };
 
 
-class XStreamPlugin : private Logger
+class XStreamPlugin : private Logger, public StreamHost
 {
  private:
     XPLogPrinter m_logPrinter;
@@ -51,13 +56,28 @@ class XStreamPlugin : private Logger
     XPLMMenuID m_menuId = nullptr;
     int m_streamMenuIndex = -1;
 
+    XPLMMenuID m_profileMenuId = nullptr;
+    int m_profileCpuIndex = -1;
+    int m_profileGpuIndex = -1;
+    XPLMCommandRef m_writeProfileCommand = nullptr;
+
+    std::shared_ptr<Config> m_config;
     std::shared_ptr<VideoStream> m_videoStream;
+    std::shared_ptr<RfbServer> m_rfbServer;
+    std::shared_ptr<FramePublisher> m_framePublisher;
     std::shared_ptr<DisplayManager> m_displayManager;
+    std::shared_ptr<LifecycleManager> m_lifecycleManager;
 
     static void menuCallback(void* menuRef, void* itemRef);
 
     void menu(void* itemRef);
 
+    void createProfileMenu();
+    static float profileMenuCallback(float elapsedSinceLastCall, float elapsedTimeSinceLastFlightLoop, int counter, void* refcon);
+    void updateProfileMenu();
+    static int writeProfileCallback(XPLMCommandRef command, XPLMCommandPhase phase, void* refcon);
+    void writeProfile();
+
 public:
     XStreamPlugin() : Logger("XScreenPlugin") {}
 
@@ -67,11 +87,19 @@ public:
     void disable();
 
     void startStream();
+    void stopStream();
+    [[nodiscard]] bool isStreaming() const;
 
     void receiveMessage(XPLMPluginID inFrom, int inMsg, void * inParam);
 
+    std::shared_ptr<Config> getConfig() override { return m_config; }
     std::shared_ptr<VideoStream> getVideoStream() { return m_videoStream; }
     std::shared_ptr<DisplayManager> getDisplayManager() { return m_displayManager; }
+    std::shared_ptr<LifecycleManager> getLifecycleManager() override { return m_lifecycleManager; }
+
+    std::vector<std::shared_ptr<Display>> getDisplays() override;
+    void armDisplay(const std::shared_ptr<Display> &display) override;
+    void releaseDisplay(const std::shared_ptr<Display> &display) override;
 };
 
 #endif //UFCPLUGIN_H
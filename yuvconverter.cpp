@@ -0,0 +1,478 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#include "yuvconverter.h"
+#include "workerpool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define YUV_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define YUV_NEON 1
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+// Studio range BT.709, what H.264 decoders assume for HD
+static const YuvCoefficients BT709_COEFFICIENTS = {
+    47, 157, 16, (16 << 8) + 128,
+    -26, -86, 112,
+    112, -102, -10,
+    (128 << 8) + 127
+};
+
+// Full range BT.601, as JFIF expects
+static const YuvCoefficients JPEG_COEFFICIENTS = {
+    77, 150, 29, 128,
+    -43, -85, 128,
+    128, -107, -21,
+    (128 << 8) + 127
+};
+
+static inline uint8_t clampByte(int value)
+{
+    return (uint8_t)clamp(value, 0, 255);
+}
+
+static inline uint8_t average(uint8_t a, uint8_t b)
+{
+    // Rounds the same way as the SIMD averaging instructions
+    return (uint8_t)((a + b + 1) >> 1);
+}
+
+static void rowY(const uint8_t* src, uint8_t* dst, int x, int width, const YuvCoefficients &c)
+{
+    for (; x < width; x++)
+    {
+        const uint8_t* p = src + x * 4;
+        dst[x] = clampByte((c.yr * p[0] + c.yg * p[1] + c.yb * p[2] + c.yBias) >> 8);
+    }
+}
+
+static void rowUV(const uint8_t* top, const uint8_t* bottom, int cx, int width, uint8_t* u, uint8_t* v, bool interleaved, const YuvCoefficients &c)
+{
+    int chromaWidth = (width + 1) / 2;
+    int step = interleaved ? 2 : 1;
+    for (; cx < chromaWidth; cx++)
+    {
+        // An odd last column is paired with itself
+        const uint8_t* t0 = top + cx * 8;
+        const uint8_t* b0 = bottom + cx * 8;
+        int next = cx * 2 + 1 < width ? 4 : 0;
+
+        int rgb[3];
+        for (int i = 0; i < 3; i++)
+        {
+            rgb[i] = average(average(t0[i], b0[i]), average(t0[next + i], b0[next + i]));
+        }
+        u[cx * step] = clampByte((c.ur * rgb[0] + c.ug * rgb[1] + c.ub * rgb[2] + c.cBias) >> 8);
+        v[cx * step] = clampByte((c.vr * rgb[0] + c.vg * rgb[1] + c.vb * rgb[2] + c.cBias) >> 8);
+    }
+}
+
+#ifdef YUV_X86
+__attribute__((target("sse4.1")))
+static int rowYSse41(const uint8_t* src, uint8_t* dst, int width, const YuvCoefficients &c)
+{
+    const __m128i coef = _mm_setr_epi16((short)c.yr, (short)c.yg, (short)c.yb, 0, (short)c.yr, (short)c.yg, (short)c.yb, 0);
+    const __m128i bias = _mm_set1_epi32(c.yBias);
+    const __m128i zero = _mm_setzero_si128();
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i sums[4];
+        for (int i = 0; i < 4; i++)
+        {
+            // Four pixels, each pair of RGBA's madd gives R+G and B
+            __m128i pixels = _mm_loadu_si128((const __m128i*)(src + (x + i * 4) * 4));
+            __m128i lo = _mm_madd_epi16(_mm_cvtepu8_epi16(pixels), coef);
+            __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), coef);
+            sums[i] = _mm_srai_epi32(_mm_add_epi32(_mm_hadd_epi32(lo, hi), bias), 8);
+        }
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(sums[0], sums[1]), _mm_packs_epi32(sums[2], sums[3]));
+        _mm_storeu_si128((__m128i*)(dst + x), packed);
+    }
+    return x;
+}
+
+__attribute__((target("sse4.1")))
+static int rowUVSse41(const uint8_t* top, const uint8_t* bottom, int width, uint8_t* u, uint8_t* v, bool interleaved, const YuvCoefficients &c)
+{
+    const __m128i coefU = _mm_setr_epi16((short)c.ur, (short)c.ug, (short)c.ub, 0, (short)c.ur, (short)c.ug, (short)c.ub, 0);
+    const __m128i coefV = _mm_setr_epi16((short)c.vr, (short)c.vg, (short)c.vb, 0, (short)c.vr, (short)c.vg, (short)c.vb, 0);
+    const __m128i bias = _mm_set1_epi32(c.cBias);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i interleave = _mm_setr_epi8(0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15);
+
+    int cx = 0;
+    for (; (cx + 8) * 2 <= width; cx += 8)
+    {
+        __m128i us[2];
+        __m128i vs[2];
+        for (int i = 0; i < 2; i++)
+        {
+            // Average the two rows, then each pair of pixels
+            const uint8_t* t = top + (cx + i * 4) * 8;
+            const uint8_t* b = bottom + (cx + i * 4) * 8;
+            __m128i a0 = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)t), _mm_loadu_si128((const __m128i*)b));
+            __m128i a1 = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(t + 16)), _mm_loadu_si128((const __m128i*)(b + 16)));
+            __m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a0), _mm_castsi128_ps(a1), _MM_SHUFFLE(2, 0, 2, 0)));
+            __m128i odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a0), _mm_castsi128_ps(a1), _MM_SHUFFLE(3, 1, 3, 1)));
+            __m128i chroma = _mm_avg_epu8(even, odd);
+
+            __m128i lo = _mm_cvtepu8_epi16(chroma);
+            __m128i hi = _mm_unpackhi_epi8(chroma, zero);
+            us[i] = _mm_srai_epi32(_mm_add_epi32(_mm_hadd_epi32(_mm_madd_epi16(lo, coefU), _mm_madd_epi16(hi, coefU)), bias), 8);
+            vs[i] = _mm_srai_epi32(_mm_add_epi32(_mm_hadd_epi32(_mm_madd_epi16(lo, coefV), _mm_madd_epi16(hi, coefV)), bias), 8);
+        }
+
+        // Eight U then eight V
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(us[0], us[1]), _mm_packs_epi32(vs[0], vs[1]));
+        if (interleaved)
+        {
+            _mm_storeu_si128((__m128i*)(u + cx * 2), _mm_shuffle_epi8(packed, interleave));
+        }
+        else
+        {
+            _mm_storel_epi64((__m128i*)(u + cx), packed);
+            _mm_storel_epi64((__m128i*)(v + cx), _mm_srli_si128(packed, 8));
+        }
+    }
+    return cx;
+}
+
+__attribute__((target("avx2")))
+static int rowYAvx2(const uint8_t* src, uint8_t* dst, int width, const YuvCoefficients &c)
+{
+    const __m256i coef = _mm256_setr_epi16(
+        (short)c.yr, (short)c.yg, (short)c.yb, 0, (short)c.yr, (short)c.yg, (short)c.yb, 0,
+        (short)c.yr, (short)c.yg, (short)c.yb, 0, (short)c.yr, (short)c.yg, (short)c.yb, 0);
+    const __m256i bias = _mm256_set1_epi32(c.yBias);
+    const __m256i zero = _mm256_setzero_si256();
+
+    // Packing works within each 128 bit lane, this puts the dwords back in order
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i sums[4];
+        for (int i = 0; i < 4; i++)
+        {
+            __m256i pixels = _mm256_loadu_si256((const __m256i*)(src + (x + i * 8) * 4));
+            __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(pixels, zero), coef);
+            __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(pixels, zero), coef);
+            sums[i] = _mm256_srai_epi32(_mm256_add_epi32(_mm256_hadd_epi32(lo, hi), bias), 8);
+        }
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(sums[0], sums[1]), _mm256_packs_epi32(sums[2], sums[3]));
+        _mm256_storeu_si256((__m256i*)(dst + x), _mm256_permutevar8x32_epi32(packed, order));
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int rowUVAvx2(const uint8_t* top, const uint8_t* bottom, int width, uint8_t* u, uint8_t* v, bool interleaved, const YuvCoefficients &c)
+{
+    const __m256i coefU = _mm256_setr_epi16(
+        (short)c.ur, (short)c.ug, (short)c.ub, 0, (short)c.ur, (short)c.ug, (short)c.ub, 0,
+        (short)c.ur, (short)c.ug, (short)c.ub, 0, (short)c.ur, (short)c.ug, (short)c.ub, 0);
+    const __m256i coefV = _mm256_setr_epi16(
+        (short)c.vr, (short)c.vg, (short)c.vb, 0, (short)c.vr, (short)c.vg, (short)c.vb, 0,
+        (short)c.vr, (short)c.vg, (short)c.vb, 0, (short)c.vr, (short)c.vg, (short)c.vb, 0);
+    const __m256i bias = _mm256_set1_epi32(c.cBias);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i interleave = _mm256_setr_epi8(
+        0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15,
+        0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15);
+
+    int cx = 0;
+    for (; (cx + 16) * 2 <= width; cx += 16)
+    {
+        __m256i us[2];
+        __m256i vs[2];
+        for (int i = 0; i < 2; i++)
+        {
+            const uint8_t* t = top + (cx + i * 8) * 8;
+            const uint8_t* b = bottom + (cx + i * 8) * 8;
+            __m256i a0 = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i*)t), _mm256_loadu_si256((const __m256i*)b));
+            __m256i a1 = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i*)(t + 32)), _mm256_loadu_si256((const __m256i*)(b + 32)));
+            __m256i even = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(a0), _mm256_castsi256_ps(a1), _MM_SHUFFLE(2, 0, 2, 0)));
+            __m256i odd = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(a0), _mm256_castsi256_ps(a1), _MM_SHUFFLE(3, 1, 3, 1)));
+
+            // The shuffles stay within each lane, leaving pairs of chroma pixels out of order
+            __m256i chroma = _mm256_permute4x64_epi64(_mm256_avg_epu8(even, odd), _MM_SHUFFLE(3, 1, 2, 0));
+
+            __m256i lo = _mm256_unpacklo_epi8(chroma, zero);
+            __m256i hi = _mm256_unpackhi_epi8(chroma, zero);
+            us[i] = _mm256_srai_epi32(_mm256_add_epi32(_mm256_hadd_epi32(_mm256_madd_epi16(lo, coefU), _mm256_madd_epi16(hi, coefU)), bias), 8);
+            vs[i] = _mm256_srai_epi32(_mm256_add_epi32(_mm256_hadd_epi32(_mm256_madd_epi16(lo, coefV), _mm256_madd_epi16(hi, coefV)), bias), 8);
+        }
+
+        __m256i u16 = _mm256_permute4x64_epi64(_mm256_packs_epi32(us[0], us[1]), _MM_SHUFFLE(3, 1, 2, 0));
+        __m256i v16 = _mm256_permute4x64_epi64(_mm256_packs_epi32(vs[0], vs[1]), _MM_SHUFFLE(3, 1, 2, 0));
+
+        // Eight U then eight V in each lane
+        __m256i packed = _mm256_packus_epi16(u16, v16);
+        if (interleaved)
+        {
+            _mm256_storeu_si256((__m256i*)(u + cx * 2), _mm256_shuffle_epi8(packed, interleave));
+        }
+        else
+        {
+            packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128((__m128i*)(u + cx), _mm256_castsi256_si128(packed));
+            _mm_storeu_si128((__m128i*)(v + cx), _mm256_extracti128_si256(packed, 1));
+        }
+    }
+    return cx;
+}
+#endif
+
+#ifdef YUV_NEON
+static int rowYNeon(const uint8_t* src, uint8_t* dst, int width, const YuvCoefficients &c)
+{
+    // Every coefficient is positive and the sums fit in 16 bits
+    const uint8x8_t yr = vdup_n_u8((uint8_t)c.yr);
+    const uint8x8_t yg = vdup_n_u8((uint8_t)c.yg);
+    const uint8x8_t yb = vdup_n_u8((uint8_t)c.yb);
+    const uint16x8_t bias = vdupq_n_u16((uint16_t)c.yBias);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16x4_t pixels = vld4q_u8(src + x * 4);
+        uint16x8_t lo = vmull_u8(vget_low_u8(pixels.val[0]), yr);
+        lo = vmlal_u8(lo, vget_low_u8(pixels.val[1]), yg);
+        lo = vmlal_u8(lo, vget_low_u8(pixels.val[2]), yb);
+        uint16x8_t hi = vmull_u8(vget_high_u8(pixels.val[0]), yr);
+        hi = vmlal_u8(hi, vget_high_u8(pixels.val[1]), yg);
+        hi = vmlal_u8(hi, vget_high_u8(pixels.val[2]), yb);
+        vst1q_u8(dst + x, vcombine_u8(vshrn_n_u16(vaddq_u16(lo, bias), 8), vshrn_n_u16(vaddq_u16(hi, bias), 8)));
+    }
+    return x;
+}
+
+static int rowUVNeon(const uint8_t* top, const uint8_t* bottom, int width, uint8_t* u, uint8_t* v, bool interleaved, const YuvCoefficients &c)
+{
+    // U is -R -G +B and V is +R -G -B for every matrix. The intermediate sums
+    // wrap around, but the final ones always fit in 16 bits
+    const uint8x8_t ur = vdup_n_u8((uint8_t)-c.ur);
+    const uint8x8_t ug = vdup_n_u8((uint8_t)-c.ug);
+    const uint8x8_t ub = vdup_n_u8((uint8_t)c.ub);
+    const uint8x8_t vr = vdup_n_u8((uint8_t)c.vr);
+    const uint8x8_t vg = vdup_n_u8((uint8_t)-c.vg);
+    const uint8x8_t vb = vdup_n_u8((uint8_t)-c.vb);
+    const uint16x8_t bias = vdupq_n_u16((uint16_t)c.cBias);
+
+    int cx = 0;
+    for (; (cx + 8) * 2 <= width; cx += 8)
+    {
+        uint8x16x4_t t = vld4q_u8(top + cx * 8);
+        uint8x16x4_t b = vld4q_u8(bottom + cx * 8);
+
+        // Average the two rows, then add up each pair of pixels and round it back down
+        uint8x8_t r = vrshrn_n_u16(vpaddlq_u8(vrhaddq_u8(t.val[0], b.val[0])), 1);
+        uint8x8_t g = vrshrn_n_u16(vpaddlq_u8(vrhaddq_u8(t.val[1], b.val[1])), 1);
+        uint8x8_t bl = vrshrn_n_u16(vpaddlq_u8(vrhaddq_u8(t.val[2], b.val[2])), 1);
+
+        uint16x8_t uSum = vmull_u8(bl, ub);
+        uSum = vmlsl_u8(uSum, r, ur);
+        uSum = vmlsl_u8(uSum, g, ug);
+        uint16x8_t vSum = vmull_u8(r, vr);
+        vSum = vmlsl_u8(vSum, g, vg);
+        vSum = vmlsl_u8(vSum, bl, vb);
+
+        uint8x8x2_t uv;
+        uv.val[0] = vshrn_n_u16(vaddq_u16(uSum, bias), 8);
+        uv.val[1] = vshrn_n_u16(vaddq_u16(vSum, bias), 8);
+        if (interleaved)
+        {
+            vst2_u8(u + cx * 2, uv);
+        }
+        else
+        {
+            vst1_u8(u + cx, uv.val[0]);
+            vst1_u8(v + cx, uv.val[1]);
+        }
+    }
+    return cx;
+}
+#endif
+
+YuvConverter::YuvConverter(YuvFormat format, YuvMatrix matrix, int width, int height, const shared_ptr<WorkerPool> &pool) :
+    Logger("YuvConverter"),
+    m_format(format),
+    m_matrix(matrix),
+    m_width(width),
+    m_height(height),
+    m_layout(layout(format, width, height)),
+    m_coefficients(matrix == YUV_JPEG ? JPEG_COEFFICIENTS : BT709_COEFFICIENTS),
+    m_pool(pool)
+{
+    const char* kernels = "C++";
+#if defined(YUV_X86)
+    if (__builtin_cpu_supports("avx2"))
+    {
+        m_rowY = rowYAvx2;
+        m_rowUV = rowUVAvx2;
+        kernels = "AVX2";
+    }
+    else if (__builtin_cpu_supports("sse4.1"))
+    {
+        m_rowY = rowYSse41;
+        m_rowUV = rowUVSse41;
+        kernels = "SSE4.1";
+    }
+#elif defined(YUV_NEON)
+    m_rowY = rowYNeon;
+    m_rowUV = rowUVNeon;
+    kernels = "NEON";
+#endif
+    log(DEBUG, "YuvConverter: %dx%d %s, kernels=%s", width, height, getFormatName(), kernels);
+}
+
+YuvLayout YuvConverter::layout(YuvFormat format, int width, int height)
+{
+    // Matches gst_video_info_set_format, so frames can be pushed without a GstVideoMeta
+    YuvLayout result;
+    int height2 = (height + 1) & ~1;
+    int chromaHeight = height2 / 2;
+    result.strides[0] = (width + 3) & ~3;
+    result.offsets[1] = (size_t)result.strides[0] * height2;
+    if (format == YUV_NV12)
+    {
+        result.strides[1] = result.strides[0];
+        result.size = result.offsets[1] + (size_t)result.strides[1] * chromaHeight;
+    }
+    else
+    {
+        result.strides[1] = ((((width + 1) & ~1) / 2) + 3) & ~3;
+        result.strides[2] = result.strides[1];
+        result.offsets[2] = result.offsets[1] + (size_t)result.strides[1] * chromaHeight;
+        result.size = result.offsets[2] + (size_t)result.strides[2] * chromaHeight;
+    }
+    return result;
+}
+
+const char* YuvConverter::getFormatName() const
+{
+    return m_format == YUV_NV12 ? "NV12" : "I420";
+}
+
+const char* YuvConverter::getColorimetry() const
+{
+    // range:matrix:transfer:primaries, full range BT.601 like jpegdec produces
+    return m_matrix == YUV_JPEG ? "1:4:0:0" : "bt709";
+}
+
+void YuvConverter::clear(uint8_t* yuv) const
+{
+    memset(yuv, m_matrix == YUV_JPEG ? 0 : 16, m_layout.offsets[1]);
+    memset(yuv + m_layout.offsets[1], 128, m_layout.size - m_layout.offsets[1]);
+}
+
+void YuvConverter::convert(const uint8_t* src, int scale, bool bottomUp, uint8_t* yuv, uint8_t* rgba) const
+{
+    convert(src, 0, scale, bottomUp, yuv, rgba, 0, m_height);
+}
+
+void YuvConverter::convert(const uint8_t* src, int srcFirstRow, int scale, bool bottomUp, uint8_t* yuv, uint8_t* rgba, int firstRow, int lastRow) const
+{
+    int firstPair = firstRow / 2;
+    int pairs = (lastRow + 1) / 2 - firstPair;
+    int bands = m_pool != nullptr ? min(m_pool->getConcurrency(), pairs) : 1;
+    if (bands <= 1)
+    {
+        convertRows(src, srcFirstRow, scale, bottomUp, yuv, rgba, firstPair, firstPair + pairs);
+        return;
+    }
+
+    m_pool->parallelFor(bands, [this, src, srcFirstRow, scale, bottomUp, yuv, rgba, firstPair, pairs, bands](int band)
+    {
+        convertRows(src, srcFirstRow, scale, bottomUp, yuv, rgba, firstPair + pairs * band / bands, firstPair + pairs * (band + 1) / bands);
+    });
+}
+
+void YuvConverter::copyRows(const uint8_t* from, uint8_t* to, int firstRow, int lastRow) const
+{
+    // Rows are padded out to a whole pair, the same as the frame
+    int firstPair = firstRow / 2;
+    int lastPair = (lastRow + 1) / 2;
+    size_t offset = m_layout.offsets[0] + (size_t)firstPair * 2 * m_layout.strides[0];
+    memcpy(to + offset, from + offset, (size_t)(lastPair - firstPair) * 2 * m_layout.strides[0]);
+
+    int planes = m_format == YUV_NV12 ? 2 : 3;
+    for (int plane = 1; plane < planes; plane++)
+    {
+        offset = m_layout.offsets[plane] + (size_t)firstPair * m_layout.strides[plane];
+        memcpy(to + offset, from + offset, (size_t)(lastPair - firstPair) * m_layout.strides[plane]);
+    }
+}
+
+void YuvConverter::convertRows(const uint8_t* src, int srcFirstRow, int scale, bool bottomUp, uint8_t* yuv, uint8_t* rgba, int firstPair, int lastPair) const
+{
+    scale = max(scale, 1);
+    int srcWidth = m_width / scale;
+    int srcHeight = m_height / scale;
+    size_t rowBytes = (size_t)m_width * 4;
+
+    // Reduced resolution rows are blown back up in to here, unless they're going in to rgba anyway.
+    // Each worker keeps its own, so it only grows when the width does
+    static thread_local vector<uint8_t> g_scratch;
+    if (scale > 1 && rgba == nullptr && g_scratch.size() < rowBytes * 2)
+    {
+        g_scratch.resize(rowBytes * 2);
+    }
+
+    bool interleaved = m_format == YUV_NV12;
+    const YuvCoefficients &c = m_coefficients;
+    for (int pair = firstPair; pair < lastPair; pair++)
+    {
+        const uint8_t* rows[2];
+        for (int i = 0; i < 2; i++)
+        {
+            // An odd last row is paired with itself
+            int y = min(pair * 2 + i, m_height - 1);
+            int srcY = min((bottomUp ? m_height - 1 - y : y) / scale, srcHeight - 1);
+            const uint8_t* srcRow = src + (size_t)(srcY - srcFirstRow) * srcWidth * 4;
+
+            if (scale > 1)
+            {
+                auto dstRow = reinterpret_cast<uint32_t*>(rgba != nullptr ? rgba + y * rowBytes : g_scratch.data() + i * rowBytes);
+                auto srcPixels = reinterpret_cast<const uint32_t*>(srcRow);
+                for (int x = 0; x < m_width; x++)
+                {
+                    dstRow[x] = srcPixels[min(x / scale, srcWidth - 1)];
+                }
+                rows[i] = reinterpret_cast<const uint8_t*>(dstRow);
+            }
+            else
+            {
+                if (rgba != nullptr)
+                {
+                    memcpy(rgba + y * rowBytes, srcRow, rowBytes);
+                }
+                rows[i] = srcRow;
+            }
+
+            if (pair * 2 + i < m_height)
+            {
+                uint8_t* dst = yuv + m_layout.offsets[0] + (size_t)y * m_layout.strides[0];
+                int x = m_rowY != nullptr ? m_rowY(rows[i], dst, m_width, c) : 0;
+                rowY(rows[i], dst, x, m_width, c);
+            }
+        }
+
+        uint8_t* u = yuv + m_layout.offsets[1] + (size_t)pair * m_layout.strides[1];
+        uint8_t* v = interleaved ? u + 1 : yuv + m_layout.offsets[2] + (size_t)pair * m_layout.strides[2];
+        int cx = m_rowUV != nullptr ? m_rowUV(rows[0], rows[1], m_width, u, v, interleaved, c) : 0;
+        rowUV(rows[0], rows[1], cx, m_width, u, v, interleaved, c);
+    }
+}
@@ -0,0 +1,92 @@
+//
+// Created by Ian Parker on 19/10/2026.
+//
+
+#ifndef YUVCONVERTER_H
+#define YUVCONVERTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "config.h"
+#include "logger.h"
+
+class WorkerPool;
+
+// Where each plane lives in a frame, laid out the way GStreamer expects by default
+struct YuvLayout
+{
+    int strides[3] = {};
+    size_t offsets[3] = {};
+    size_t size = 0;
+};
+
+// 8.8 fixed point, chroma is pre-scaled for the matrix and range
+struct YuvCoefficients
+{
+    int yr, yg, yb, yBias;
+    int ur, ug, ub;
+    int vr, vg, vb;
+    int cBias;
+};
+
+/*
+ * Converts RGBA frames to I420 or NV12 in a single pass, optionally
+ * flipping them, blowing them back up from a reduced resolution capture and
+ * copying out the RGBA on the way past for anything else that wants it.
+ *
+ * The frame is split in to bands of row pairs that are converted in
+ * parallel. The rows are converted with AVX2 or SSE4.1 where the CPU has
+ * them and NEON on ARM, all of which give exactly the same results as the
+ * plain C++ that handles the odd pixels at the edges.
+ *
+ * Thread safe as long as each caller converts in to its own buffers.
+ */
+class YuvConverter : private Logger
+{
+ private:
+    YuvFormat m_format;
+    YuvMatrix m_matrix;
+    int m_width;
+    int m_height;
+    YuvLayout m_layout;
+    YuvCoefficients m_coefficients;
+    std::shared_ptr<WorkerPool> m_pool;
+
+    // Each returns how far along the row it got, the rest is left to the plain C++
+    typedef int (*RowYFunc)(const uint8_t* src, uint8_t* dst, int width, const YuvCoefficients &c);
+    typedef int (*RowUVFunc)(const uint8_t* top, const uint8_t* bottom, int width, uint8_t* u, uint8_t* v, bool interleaved, const YuvCoefficients &c);
+    RowYFunc m_rowY = nullptr;
+    RowUVFunc m_rowUV = nullptr;
+
+    void convertRows(const uint8_t* src, int srcFirstRow, int scale, bool bottomUp, uint8_t* yuv, uint8_t* rgba, int firstPair, int lastPair) const;
+
+ public:
+    YuvConverter(YuvFormat format, YuvMatrix matrix, int width, int height, const std::shared_ptr<WorkerPool> &pool);
+    ~YuvConverter() override = default;
+
+    // src is width / scale by height / scale, rgba may be null
+    void convert(const uint8_t* src, int scale, bool bottomUp, uint8_t* yuv, uint8_t* rgba) const;
+
+    // Just rows firstRow to lastRow of the frame, firstRow being even. src only has to
+    // hold the source rows they're made from, starting with row srcFirstRow
+    void convert(const uint8_t* src, int srcFirstRow, int scale, bool bottomUp, uint8_t* yuv, uint8_t* rgba, int firstRow, int lastRow) const;
+
+    // Copies rows firstRow to lastRow, and the chroma that goes with them, from one frame to another
+    void copyRows(const uint8_t* from, uint8_t* to, int firstRow, int lastRow) const;
+
+    // Fills a frame with black
+    void clear(uint8_t* yuv) const;
+
+    [[nodiscard]] YuvFormat getFormat() const { return m_format; }
+    [[nodiscard]] const YuvLayout& getLayout() const { return m_layout; }
+
+    // For the caps of a stream carrying the converted frames
+    [[nodiscard]] const char* getFormatName() const;
+    [[nodiscard]] const char* getColorimetry() const;
+
+    static YuvLayout layout(YuvFormat format, int width, int height);
+};
+
+#endif //YUVCONVERTER_H